@@ -1,12 +1,15 @@
 
 // Marcel Timm, RhinoDevel, 2024aug21
 
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <cassert>
 #include <vector>
 #include <cstdio>
 #include <cstring>
+#include <string>
+#include <utility>
 
 #include "log.h"
 #include "common.h"
@@ -19,103 +22,126 @@
 #include "mt_llm_s.h"
 #include "mt_llm_log.h"
 #include "mt_llm_state.h"
+#include "mt_llm_stats.h"
+#include "mt_llm_mem.h"
+#include "mt_llm_snapshot.h"
+#include "mt_llm_snapshot_file.h"
+#include "mt_llm_state_codec.h"
+#include "mt_llm_state_io.h"
+#include "mt_llm_rev.h"
+#include "mt_llm_prob.h"
+#include "mt_llm_record.h"
+#include "mt_llm_prefix_cache.h"
+#include "mt_llm_side.h"
 
 #include "mt_llm_tok_type.h"
 
 static struct mt_llm_s * s = nullptr;
 
-/** Calculate the probability of each token's logit in the given vector via
- *  softmax.
- *
- * - The index equals the token ID.
- * - Original source: llama.cpp/tools/server/utils.hpp/get_token_probabilities()
+// Incremented each time the tokens in the context get changed other than by
+// appending (see mt_llm_get_history()). Not part of the singleton, to also
+// change with each re-initialization:
+//
+static uint64_t s_epoch = 0;
+
+// Encoded states get decoded into this buffer before restoring them (kept for
+// reuse, see get_raw_data()):
+//
+static uint8_t * s_decoded = nullptr;
+static size_t s_decoded_capacity = 0;
+
+// See mt_llm_set_evict_thinking(). Not part of the singleton, to be settable
+// before initialization:
+//
+static bool s_evict_thinking = false;
+
+// The tokens in the context, if known (they are not known after restoring a
+// state, which does not hold the tokens, or after evicting tokens, see
+// evict_spans(), until the next reset):
+//
+static std::vector<int> s_toks;
+static bool s_toks_known = true;
+
+/** A token of the visible text of an answer (see mt_llm_barge_in()).
  */
-static std::vector<float> get_probabilities(
-    std::vector<float> const & logits, float const max)
+struct answer_tok
 {
-    assert(!logits.empty());
-    assert(*std::max_element(logits.begin(), logits.end()) == max);
-
-    int const len = static_cast<int>(logits.size());
-    std::vector<float> ret_val;
-    float sum = 0.0f;
-
-    ret_val.resize(len);
-
-    for(int i = 0; i < len; ++i)
-    {
-        ret_val[i] = expf(logits[i] - max);
-
-        sum += ret_val[i];
-    }
-
-    for(int i = 0; i < len; ++i)
-    {
-        ret_val[i] /= sum;
-    }
-
-    return ret_val;
-}
-
-/** Get a copy of the last logits and fill given reference with maximum logit
- *  value found.
- * 
- * - The index equals the token ID.
- * - Returns an empty vector, if no last logits available.
- * - Original source: llama.cpp/tools/server/utils.hpp/get_token_probabilities()
+    int pos;
+    size_t text_beg; // Count of bytes of the answer's text before the token.
+};
+
+// The visible tokens of the last answer, valid as long as the epoch and token
+// count do not change:
+//
+static std::vector<struct answer_tok> s_answer;
+static int s_answer_beg = -1; // Position of the first token sampled.
+static int s_answer_end = -1; // Token count after the answer.
+static uint64_t s_answer_epoch = 0;
+
+// The prompt added while being spoken (see mt_llm_prompt_begin()), valid as
+// long as the epoch does not change and the context holds exactly the tokens
+// decoded of it, at its end:
+//
+static bool s_prompt_is_active = false;
+static bool s_prompt_is_initial = false; // (see decode_prompt_beg())
+static int s_prompt_beg = -1; // Position of the prompt's first token.
+static std::string s_prompt_text;
+static std::vector<int> s_prompt_toks; // Decoded.
+static uint64_t s_prompt_epoch = 0;
+
+/** Where a turn started (see mt_llm_rollback()).
  */
-static std::vector<float> get_last_logits(float& max)
+struct turn
 {
-    assert(s != nullptr);
-    assert(s->model != nullptr);
-
-    std::vector<float> ret_val;
-
-    float const * const logits = llama_get_logits_ith(s->ctx, -1);
-
-    if(logits == nullptr)
-    {
-        assert(ret_val.empty());
-        return ret_val;
-    }
-
-    int32_t const n_vocab = llama_vocab_n_tokens(
-        llama_model_get_vocab(s->model));
+    int tok_cnt; // Tokens before the turn (<=> position of its first token).
+    int last_tok_type; // Of the token before the turn.
+};
 
-    assert(0 < n_vocab);
-
-    ret_val.resize(static_cast<size_t>(n_vocab));
-
-    ret_val[0] = logits[0];
-    max = ret_val[0];
-    for(int i = 1; i < n_vocab; ++i) // i == Token ID.
-    {
-        ret_val[i] = logits[i];
-
-        if(max < ret_val[i])
-        {
-            max = ret_val[i];
-        }
-    }
-    return ret_val;
-}
+// The turns since the last reset or restoring of a state:
+//
+static std::vector<struct turn> s_turns;
 
-static std::vector<float> get_token_group_probabilities(
-    std::vector<std::vector<int>> const & token_groups,
-    std::vector<float> const & token_probabilities)
+/** A conversation held by a fork sequence (see mt_llm_fork()).
+ */
+struct conv_fork
 {
-    size_t const n_groups = token_groups.size(); // Count of token groups.
-    std::vector<float> ret_val(n_groups);
-
-    for(int i = 0; i < static_cast<int>(n_groups); ++i)
-    {
-        for(int j = 0; j < static_cast<int>(token_groups[i].size()); ++j)
-        {
-            ret_val[i] += token_probabilities[token_groups[i][j]];
-        }
-    }
-    return ret_val;
-}
+    bool is_used;
+    int last_tok_type;
+    int tok_cnt;
+    llama_sampler * sampler; // Owned.
+    std::vector<int> toks; // (see s_toks)
+    bool toks_known;
+    std::vector<struct turn> turns; // (see s_turns)
+};
+
+// Indices are the ones of the fork sequences:
+//
+static struct conv_fork s_forks[MT_LLM_FORK_MAX];
+
+// See mt_llm_set_precompute(). Not part of the singleton, to be settable
+// before initialization:
+//
+static bool s_precompute = false;
+
+// See mt_llm_set_standby(). Not part of the singleton, to be settable before
+// initialization:
+//
+static bool s_standby = false;
+
+// The prompt's text speculated on (see mt_llm_prompt_speculate()):
+//
+static std::string s_spec_text;
+
+/** Tokens of an answer speculated, to be used by inference() instead of
+ *  sampling (see mt_llm_prompt_speculate()).
+ */
+struct pre_gen
+{
+    std::vector<int> toks;
+    int decoded; // Count of the first tokens decoded, already.
+    int dig_idx; // Index of the token with digit probabilities (-1 = none).
+    std::vector<float> dig_probs;
+};
 
 /**
  * - Returns true for an empty string given. 
@@ -150,104 +176,243 @@ static bool callback_handler(
         return false; // <=> No interruption.
     }
 
-    return s->mt_p->callback(
-        static_cast<int>(tok),
-        piece.c_str(),
-        s->last_tok_type,
-        dig_probs.empty() ? nullptr : dig_probs.data());
+    int64_t const t_start = ggml_time_us();
+
+    bool const ret_val = s->mt_p->callback(
+            static_cast<int>(tok),
+            piece.c_str(),
+            s->last_tok_type,
+            dig_probs.empty() ? nullptr : dig_probs.data());
+
+    mt_llm_stats_record_latency(
+        MT_LLM_STATS_LAT_CALLBACK,
+        static_cast<uint64_t>(ggml_time_us() - t_start));
+    return ret_val;
 }
 
-/** Add token representation of given string to context. Let the callback know
- *  that the tokens of this string are of given type. Increase overall token
- *  count.
- * 
- * - "Decode" as in using the decoder of the LLM architecture to add to its
- *   context.
+/** Add given tokens to context (see decode()). Increase overall token count.
  */
-static bool decode(char const * const str, int const tok_type)
+static bool decode_tokens(std::vector<int> tokens)
 {
-    s->last_tok_type = tok_type;
+    // Load the tokens from the prefix cache, as far as possible (the last one
+    // always gets decoded, to get its logits):
+    //
+    if(s_toks_known && 1 < tokens.size() && mt_llm_prefix_cache_is_enabled())
+    {
+        assert(static_cast<int>(s_toks.size()) == s->tok_cnt);
+
+        int const cached = mt_llm_prefix_cache_load(
+            s_toks, tokens, static_cast<int>(tokens.size()) - 1);
+
+        for(int i = 0; i < cached; ++i)
+        {
+            llama_sampler_accept(s->sampler, tokens[i]);
+            callback_handler( // (return value ignored, like when decoding)
+                tokens[i],
+                mt_llm_ctx_get_piece_from(*s->ctx, tokens[i]),
+                std::vector<float>());
+        }
+        s_toks.insert(s_toks.end(), tokens.begin(), tokens.begin() + cached);
+        s->tok_cnt += cached;
+        tokens.erase(tokens.begin(), tokens.begin() + cached);
+    }
 
-    int const str_tok_cnt = mt_llm_ctx_decode(
+    if(!mt_llm_ctx_decode(
             *s->ctx,
             *s->sampler,
             s->tok_cnt,
-            str,
-            callback_handler);
-
-    if(str_tok_cnt < 0)
+            tokens,
+            callback_handler))
     {
         MT_LOG_ERR("Decoding!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_DECODE, 1);
+        s_toks_known = false; // (some of the tokens may got decoded)
         return false;
     }
-    s->tok_cnt += str_tok_cnt;
+    if(s_toks_known)
+    {
+        s_toks.insert(s_toks.end(), tokens.begin(), tokens.end());
+    }
+    s->tok_cnt += static_cast<int>(tokens.size());
     return true;
 }
 
-/**
- * - Just assumes that the context length is always long enough to hold the
- *   prompt to be decoded, here (no check..).
+/** Add token representation of given string to context. Let the callback know
+ *  that the tokens of this string are of given type. Increase overall token
+ *  count.
+ * 
+ * - "Decode" as in using the decoder of the LLM architecture to add to its
+ *   context.
  */
-static bool decode_initial_query(char const * const prompt)
+static bool decode(char const * const str, int const tok_type)
 {
-    assert(s->mt_p->sys_prompt[0] != '\0');
-    assert(prompt != nullptr && prompt[0] != '\0');
+    s->last_tok_type = tok_type;
 
-    if(!decode(s->mt_p->sys_prompt_beg_delim, MT_TOK_TYPE_DELIM))
+    return decode_tokens(mt_llm_ctx_tokenize_for(*s->ctx, s->tok_cnt, str));
+}
+
+/** Get the tokens to be added, if the callback requests an interrupt.
+ *
+ * At least, if SPM vocabulary is used and to-be-tokenized string is not
+ * empty, the tokenizer may adds a space character as prefix before the
+ * created tokens.
+ * Since the interrupt can happen at each position of the LLM's response,
+ * that should not be a problem, here.
+ */
+static std::vector<int> get_irq_tokens()
+{
+    assert(s != nullptr);
+
+    std::vector<int> ret_val;
+
+    if(s->mt_p->rev_prompt[0] == '\0')
     {
-        MT_LOG_ERR("Decoding system prompt begin delimiter!");
-        return false;
+        // Use magic (or empty) str. & EOT (or EOS), only.
+
+        llama_vocab const * const vocab = llama_model_get_vocab(s->model);
+
+        ret_val = mt_llm_ctx_tokenize(
+            *s->ctx,
+            "", // E.g. "..." can cause an LLM to also use "..." just "for fun"!
+            false); // No adding of BOS and/or EOS [is both model-dependent].
+
+        // TODO: On Android, for the following models, this should be the other
+        //       way around, as it seems (try EOS first, then EOT):
+        //       - EXAONE 3.0 7.8B Instruct
+        //
+        // See: https://github.com/ggerganov/llama.cpp/pull/8296
+        //
+        llama_token const tok_eot = llama_vocab_eot(vocab);
+        //
+        assert(tok_eot != -1 || llama_vocab_eos(vocab) != -1);
+        ret_val.push_back(tok_eot == -1 ? llama_vocab_eos(vocab) : tok_eot);
     }
-    if(!decode(s->mt_p->sys_prompt, MT_TOK_TYPE_SYS_PROMPT))
+    else // Use reverse prompt given.
     {
-        MT_LOG_ERR("Decoding system prompt!");
-        return false;
+        ret_val = mt_llm_ctx_tokenize(
+            *s->ctx,
+            s->mt_p->rev_prompt,
+            false); // No adding of BOS and/or EOS [is both model-dependent].
     }
-    if(!decode(s->mt_p->sys_prompt_mid_delim, MT_TOK_TYPE_DELIM))
+    return ret_val;
+}
+
+/** Returns true, if another sequence (e.g. a pinned one of an async. snapshot
+ *  or the one of a fork) may share entries of the main sequence at given
+ *  position or later.
+ *
+ * - Conservative, as entries of other sequences at the same positions are not
+ *   necessarily shared (e.g. the ones added to a fork after switching).
+ */
+static bool is_main_shared_from(int const pos)
+{
+    llama_memory_t const mem = llama_get_memory(s->ctx);
+
+    for(int seq = 0; seq < MT_LLM_CTX_SEQ_COUNT; ++seq)
     {
-        MT_LOG_ERR("Decoding system prompt middle delimiter!");
-        return false;
+        if(seq != MT_LLM_CTX_SEQ_MAIN
+            && pos <= llama_memory_seq_pos_max(mem, seq)) // (-1, if empty)
+        {
+            return true;
+        }
     }
-    if(!decode(prompt, MT_TOK_TYPE_PROMPT))
+    return false;
+}
+
+/** Remove the KV cache entries of the tokens at given spans of positions
+ *  (each from the first position up to, but not including the second one and
+ *  in ascending order, not overlapping) from the main sequence, moving the
+ *  entries of following tokens to close the gaps.
+ *
+ * - The entries to be moved must not be shared with other sequences (see
+ *   is_main_shared_from()), as their positions would be modified, too.
+ * - Updates the token count. The tokens are not known afterwards, until the
+ *   next reset, as the entries of the following tokens got computed with the
+ *   evicted ones present (so they must not get stored in or loaded from the
+ *   prefix cache, keyed by the tokens).
+ */
+static bool evict_spans(std::vector<std::pair<int, int>> const & spans)
+{
+    assert(s != nullptr);
+    assert(s->ctx != nullptr);
+
+    llama_memory_t const mem = llama_get_memory(s->ctx);
+    int evicted = 0;
+
+    s_toks.clear();
+    s_toks_known = false;
+
+    // From the last span to the first, so the positions of the spans not
+    // processed, yet, stay valid:
+    //
+    for(auto i = spans.rbegin(); i != spans.rend(); ++i)
     {
-        MT_LOG_ERR("Decoding prompt!");
-        return false;
+        int const beg = i->first, end = i->second;
+
+        assert(0 <= beg && beg < end && end <= s->tok_cnt);
+
+        if(!llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_MAIN, beg, end))
+        {
+            MT_LOG_ERR("Failed to remove span %d to %d!\n", beg, end);
+            mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+            s_toks_known = false;
+            return false;
+        }
+        llama_memory_seq_add(mem, MT_LLM_CTX_SEQ_MAIN, end, -1, beg - end);
+
+        s->tok_cnt -= end - beg;
+        evicted += end - beg;
     }
-    if(!decode(s->mt_p->sys_prompt_end_delim, MT_TOK_TYPE_DELIM))
+
+    // Shift the keys now, as the entries may get serialized before the next
+    // decoding (e.g. by a snapshot update):
+    //
+    if(!mt_llm_ctx_apply_memory_update(*s->ctx))
     {
-        MT_LOG_ERR("Decoding system prompt end delimiter!");
-        return false;
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        s_toks_known = false;
+        return false; // (logged)
     }
+
+    mt_llm_stats_add(
+        MT_LLM_STATS_CNT_EVICTED_TOKENS, static_cast<uint64_t>(evicted));
+    MT_LOG("Evicted %d thinking tokens.\n", evicted);
     return true;
 }
 
-/**
- * - Just assumes that the context length is always long enough to hold the
- *   prompt to be decoded, here (no check..).
+/** Remove the entries of the tokens speculated, that are decoded, but not
+ *  used (e.g. because of an interrupt), from the main sequence, from given
+ *  position on (see inference()).
+ *
+ * - Rewinds the sampler, if the tokens are known (like truncate() does).
  */
-static bool decode_follow_up_query(char const * const prompt)
+static bool drop_pre_gen(int const pos)
 {
-    assert(prompt != nullptr && prompt[0] != '\0');
-
-    if(!decode(s->mt_p->prompt_beg_delim, MT_TOK_TYPE_DELIM))
-    {
-        MT_LOG_ERR("Decoding prompt begin delimiter!");
-        return false;
-    }
-    if(!decode(prompt, MT_TOK_TYPE_PROMPT))
+    if(!llama_memory_seq_rm(
+            llama_get_memory(s->ctx), MT_LLM_CTX_SEQ_MAIN, pos, -1))
     {
-        MT_LOG_ERR("Decoding prompt!");
+        MT_LOG_ERR("Failed to remove tokens from position %d!\n", pos);
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
         return false;
     }
-    if(!decode(s->mt_p->prompt_end_delim, MT_TOK_TYPE_DELIM))
+    if(s_toks_known)
     {
-        MT_LOG_ERR("Decoding prompt end delimiter!");
-        return false;
+        assert(static_cast<int>(s_toks.size()) == pos);
+
+        llama_sampler_reset(s->sampler);
+        for(int const tok : s_toks)
+        {
+            llama_sampler_accept(s->sampler, tok);
+        }
     }
     return true;
 }
 
-static bool inference()
+/**
+ * - Uses the tokens speculated given instead of sampling (see struct pre_gen),
+ *   if not nullptr.
+ */
+static bool inference(struct pre_gen const * const pre)
 {
     // TODO: Improve to avoid sending reverse prompt twice by always waiting for
     //       the count of tokens the reverse prompt has before calling the
@@ -256,77 +421,49 @@ static bool inference()
     assert(s != nullptr);
 
     llama_batch batch;
-    int n_cur = 0,
-        
-        // If reverse prompt is given, this will hold the index in the
-        // last_chars "ring buffer" where the last character was added.
-        last_chars_index = -1;
+    int n_cur = 0;
 
     bool irq = false,
-        is_thinking = false,
-
-        // Set to true, if reverse prompt is given and the count of characters
-        // of the reverse prompt was added to the last_chars "ring buffer".
-        last_chars_filled = false;
+        is_thinking = false;
 
     // To hold the token sequence to be used, if callback requests an interrupt
     // (e.g., if the user wants to interrupt the "chatbot"). Will hold the
     // reverse prompt tokens, if a reverse prompt is given.
     std::vector<int> irq_tokens;
 
-    // Used, if reverse prompt is given. Will be able to hold the count of
-    // characters necessary for the reverse prompt (w/o \0), then.
-    char* last_chars = nullptr;
+    // Used, if reverse prompt is given.
+    struct mt_llm_rev rev;
 
-    int const rev_prompt_len = static_cast<int>(strlen(s->mt_p->rev_prompt));
     llama_vocab const * const vocab = llama_model_get_vocab(s->model);
 
     std::vector<float> dig_probs;
 
-    // Prepare irq_tokens. Also prepare "ring buffer" that holds the last
-    // characters received, if reverse prompt is given / to be used:
+    // Positions of the thinking spans sampled, if to be evicted (see
+    // evict_spans()):
     //
-    // At least, if SPM vocabulary is used and to-be-tokenized string is not
-    // empty, the tokenizer may adds a space character as prefix before the
-    // created tokens.
-    // Since the interrupt can happen at each position of the LLM's response,
-    // that should not be a problem, here.
+    std::vector<std::pair<int, int>> think_spans;
+
+    // The visible tokens sampled (see mt_llm_barge_in()):
     //
-    if(rev_prompt_len == 0) // Use magic (or empty) str. & EOT (or EOS), only.
-    {
-        irq_tokens = mt_llm_ctx_tokenize(
-            *s->ctx,
-            "", // E.g. "..." can cause an LLM to also use "..." just "for fun"!
-            false); // No adding of BOS and/or EOS [is both model-dependent].
+    std::vector<struct answer_tok> answer;
+    size_t answer_len = 0;
 
-        // TODO: On Android, for the following models, this should be the other
-        //       way around, as it seems (try EOS first, then EOT):
-        //       - EXAONE 3.0 7.8B Instruct
-        //
-        // See: https://github.com/ggerganov/llama.cpp/pull/8296
-        //
-        llama_token const tok_eot = llama_vocab_eot(vocab);
-        //
-        assert(tok_eot != -1 || llama_vocab_eos(vocab) != -1);
-        irq_tokens.push_back(tok_eot == -1 ? llama_vocab_eos(vocab) : tok_eot);
-    }
-    else // Use reverse prompt given.
+    // Prepare irq_tokens. Also prepare "ring buffer" that holds the last
+    // characters received, if reverse prompt is given / to be used:
+    //
+    if(!mt_llm_rev_init(rev, s->mt_p->rev_prompt))
     {
-        assert(last_chars_index == -1);
-        assert(!last_chars_filled);
-
-        irq_tokens = mt_llm_ctx_tokenize(
-            *s->ctx,
-            s->mt_p->rev_prompt,
-            false); // No adding of BOS and/or EOS [is both model-dependent].
-
-        last_chars = static_cast<char*>(
-            malloc(rev_prompt_len * sizeof *last_chars));
-        assert(last_chars != nullptr);
+        MT_LOG_ERR("Failed to allocate reverse prompt ring buffer!\n");
+        mt_llm_rev_free(rev);
+        return false;
     }
+    irq_tokens = get_irq_tokens();
 
     int64_t const t_main_start = ggml_time_us();
 
+    // Time of the last sampled token given to the callback (-1 = none, yet):
+    int64_t t_last_tok = -1;
+
     batch = llama_batch_init(1, 0, 1); // Needs to be freed!
 
     // E.g.:
@@ -336,62 +473,51 @@ static bool inference()
     int const first_new_tok_index = s->tok_cnt;
     int const n_ctx = static_cast<int>(llama_n_ctx(s->ctx));
 
+    // Positions up to here hold the entries of tokens speculated:
+    //
+    int pre_end = first_new_tok_index + (pre == nullptr ? 0 : pre->decoded);
+
     bool const is_thinker = s->mt_p->think_beg_delim[0] != '\0';
 
     for(n_cur = first_new_tok_index; n_cur < n_ctx; ++n_cur)
     {
         // Break, if (optional) reverse prompt was sampled last:
-        if(last_chars_filled)
+        if(mt_llm_rev_is_found(rev))
         {
-            assert(0 <= last_chars_index && last_chars_index < rev_prompt_len);
+            s->last_tok_type = MT_TOK_TYPE_REV_PROMPT;
+
+            // "Hack":
+            //
+            // The reverse prompt got already sampled and send to the client
+            // code as non-reverse-prompt token type and now gets send the
+            // second time AS reverse-prompt token type.
+            //
+            // The client code must be aware of this and take action!
+            //
+            s->mt_p->callback(
+                0,
+                s->mt_p->rev_prompt, // TODO: What about a possible leading space (would be "missing" here)? Problem??
+                s->last_tok_type,
+                nullptr);
+            break;
+        }
 
-            //  0123456
-            // "Master:"
-            // <=> rev_prompt_len = 7
+        if(irq)
+        {
+            s->last_tok_type = MT_TOK_TYPE_IRQ;
 
-            bool rev_prompt_found = true; // TRUE by default.
-            
-            for(int i = rev_prompt_len - 1; 0 <= i; --i)
+            if(n_cur < pre_end)
             {
-                int const cur_last_chars_index =
-                        (i + last_chars_index + 1) % rev_prompt_len;
-
-                assert(
-                    0 <= cur_last_chars_index
-                        && cur_last_chars_index < rev_prompt_len);
-
-                if(s->mt_p->rev_prompt[i] != last_chars[cur_last_chars_index])
+                if(!drop_pre_gen(n_cur))
                 {
-                    rev_prompt_found = false;
-                    break;
+                    llama_batch_free(batch);
+                    mt_llm_rev_free(rev);
+                    s_toks_known = false;
+                    return false; // (logged)
                 }
+                pre_end = n_cur;
             }
 
-            if(rev_prompt_found)
-            {
-                s->last_tok_type = MT_TOK_TYPE_REV_PROMPT;
-
-                // "Hack":
-                //
-                // The reverse prompt got already sampled and send to the
-                // client code as non-reverse-prompt token type and now gets
-                // send the second time AS reverse-prompt token type.
-                //
-                // The client code must be aware of this and take action!
-                //
-                s->mt_p->callback(
-                    0,
-                    s->mt_p->rev_prompt, // TODO: What about a possible leading space (would be "missing" here)? Problem??
-                    s->last_tok_type,
-                    nullptr);
-                break;
-            }
-        }
-
-        if(irq)
-        {
-            s->last_tok_type = MT_TOK_TYPE_IRQ;
-
             if(!mt_llm_ctx_decode(
                     *s->ctx,
                     *s->sampler,
@@ -400,17 +526,28 @@ static bool inference()
                     callback_handler))
             {
                 MT_LOG_ERR("Decoding IRQ tokens!\n");
+                mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_DECODE, 1);
                 llama_batch_free(batch);
-                free(last_chars);
-                last_chars = nullptr;
+                mt_llm_rev_free(rev);
+                s_toks_known = false;
                 return false;
             }
+            if(s_toks_known)
+            {
+                s_toks.insert(
+                    s_toks.end(), irq_tokens.begin(), irq_tokens.end());
+            }
             n_cur += static_cast<int>(irq_tokens.size()); // TODO: NOT caring about maximum count..!
             break;
         }
 
-        llama_token const new_tok_id = llama_sampler_sample(
-            s->sampler, s->ctx, -1);
+        int const pre_i = n_cur - first_new_tok_index;
+        bool const is_pre =
+            pre != nullptr && pre_i < static_cast<int>(pre->toks.size());
+
+        llama_token const new_tok_id = is_pre
+            ? pre->toks[pre_i]
+            : llama_sampler_sample(s->sampler, s->ctx, -1);
 
         bool const new_tok_is_eog = llama_vocab_is_eog(vocab, new_tok_id);
 
@@ -425,6 +562,7 @@ static bool inference()
                 MT_LLM_P_LEN_THINK_BEG_DELIM) == 0)
             {
                 is_thinking = true; // BEFORE calling callback.
+                think_spans.push_back({ n_cur, -1 }); // (end still unknown)
             }
         }
         //
@@ -455,28 +593,30 @@ static bool inference()
                 {
                     s->last_tok_type = MT_TOK_TYPE_SAMPLED_NON_EOG_NON_CONTROL;
 
+                    answer.push_back({ n_cur, answer_len });
+                    answer_len += piece.size();
+
                     // Calculate probabilities of all digits for first sampled
                     // non-EOG, non-control, non-whitespace, non-thinking,
                     // non-empty-piece token (assumes that the sampling of all
                     // former whitespaces was "correct", which is kind of wrong,
                     // but OK in practice):
                     //
-                    if(dig_probs.empty() // <=> No non-whitespace sampled, yet.
+                    if(is_pre)
+                    {
+                        // (calculated, when the token got sampled)
+                        //
+                        if(pre_i == pre->dig_idx)
+                        {
+                            dig_probs = pre->dig_probs;
+                        }
+                    }
+                    else if(dig_probs.empty() // <=> No non-whitespace, yet.
                         && !piece.empty()
                         && !is_whitespace_only(piece.c_str()))
                     {
-                        float max = 0.0f;
-
-                        // TODO: Do just once during initialization:
-                        //
-                        std::vector<std::vector<int>> const dig_toks =
-                            mt_llm_model_get_digit_tokens(*s->model);
-
-                        std::vector<float> const logits = get_last_logits(max);
-                        std::vector<float> const probs = get_probabilities(logits, max);
-                        
-                        dig_probs = get_token_group_probabilities(
-                            dig_toks, probs);
+                        dig_probs = mt_llm_prob_get_digit_probabilities(
+                            *s->model, *s->ctx);
 
                         //{
                         //    float prob_sum = 0.0f;
@@ -494,7 +634,23 @@ static bool inference()
             }
         }
 
+        {
+            int64_t const t_tok = ggml_time_us();
+
+            if(0 <= t_last_tok)
+            {
+                mt_llm_stats_record_latency(
+                    MT_LLM_STATS_LAT_INTER_TOKEN,
+                    static_cast<uint64_t>(t_tok - t_last_tok));
+            }
+            t_last_tok = t_tok;
+        }
+
     	irq = callback_handler(new_tok_id, piece, dig_probs);
+        if(!piece.empty()) // (otherwise, callback was not called)
+        {
+            mt_llm_record_on_sampled(irq);
+        }
 
         if(is_thinker && is_thinking)
         {
@@ -504,30 +660,41 @@ static bool inference()
                 MT_LLM_P_LEN_THINK_END_DELIM) == 0)
             {
                 is_thinking = false; // AFTER calling callback.
+                think_spans.back().second = n_cur + 1;
             }
         }
         //
         // Otherwise: The model is not a thinker.
 
-        // Current/single token per "batch":
+        if(pre_end <= n_cur) // (otherwise: decoded and accepted, already)
+        {
+            // Current/single token per "batch":
+
+            common_batch_clear(batch);
+            common_batch_add(
+                batch, new_tok_id, n_cur, { MT_LLM_CTX_SEQ_MAIN }, true);
 
-        common_batch_clear(batch);
-        common_batch_add(batch, new_tok_id, n_cur, { 0 }, true);
+            int32_t const llama_decode_res = llama_decode(s->ctx, batch);
 
-        int32_t const llama_decode_res = llama_decode(s->ctx, batch);
+            if (llama_decode_res != 0)
+            {
+                MT_LOG_ERR(
+                    "Decoding current \"batch\" (error code %d)!\n",
+                    static_cast<int>(llama_decode_res));
+                mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_DECODE, 1);
+                llama_batch_free(batch);
+                mt_llm_rev_free(rev);
+                return false;
+            }
 
-        if (llama_decode_res != 0)
+            llama_sampler_accept(s->sampler, new_tok_id);
+        }
+        if(s_toks_known)
         {
-            MT_LOG_ERR(
-                "Decoding current \"batch\" (error code %d)!\n",
-                static_cast<int>(llama_decode_res));
-            llama_batch_free(batch);
-            free(last_chars);
-            last_chars = nullptr;
-            return false;
+            s_toks.push_back(new_tok_id);
         }
 
-        llama_sampler_accept(s->sampler, new_tok_id);
+        mt_llm_ctx_yield(); // (e.g. to let async. snapshots make progress)
 
         // Break, if some kind of EOG token was generated:
         //
@@ -537,40 +704,21 @@ static bool inference()
             break;
         }
 
-        if(last_chars != nullptr) // => Reverse prompt is used and ring buffer.
-        {
-            char const * piece_chars = piece.c_str();
-
-            while(*piece_chars != '\0') // Add current piece to ringbuffer.
-            {
-                ++last_chars_index;
-
-                if(last_chars_index == rev_prompt_len)
-                {
-                    last_chars_index = 0;
-                }
-
-                last_chars[last_chars_index] = *piece_chars;
-
-                if(last_chars_index == rev_prompt_len - 1)
-                {
-                    // Ring buffer is filled <=> Holds enough characters to
-                    // compare with the reverse prompt. Signalize this:
-
-                    last_chars_filled = true; // (setting once would be enough)
-                }
-
-                ++piece_chars;
-            }
-        }
+        mt_llm_rev_add(rev, piece.c_str()); // (if reverse prompt is used)
     }
     llama_batch_free(batch);
-    free(last_chars);
-    last_chars = nullptr;
+    mt_llm_rev_free(rev);
+
+    if(n_cur < pre_end && !drop_pre_gen(n_cur)) // E.g. reverse prompt found.
+    {
+        s_toks_known = false;
+        return false; // (logged)
+    }
 
     if(n_ctx <= n_cur)
     {
         MT_LOG_ERR("Last token was no EOG (ctx. length reached?)\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_CTX_FULL, 1);
         return false;
     }
 
@@ -583,234 +731,2267 @@ static bool inference()
         static_cast<float>(n_decode)
             / (static_cast<float>(t_main_end - t_main_start) / 1000000.0f));
 
+    mt_llm_stats_add(
+        MT_LLM_STATS_CNT_GENERATED_TOKENS, static_cast<uint64_t>(n_decode));
+    if(t_main_start < t_main_end)
+    {
+        mt_llm_stats_set_tokens_per_second(
+            static_cast<double>(n_decode) * 1000000.0
+                / static_cast<double>(t_main_end - t_main_start));
+    }
+
     s->tok_cnt = n_cur;
+
+    if(s_evict_thinking && !think_spans.empty())
+    {
+        if(think_spans.back().second < 0) // Not ended => Keep.
+        {
+            think_spans.pop_back();
+        }
+        // The entries to be moved got added by this inference, but may be
+        // shared (e.g. by a fork created from the callback):
+        //
+        if(!think_spans.empty()
+            && is_main_shared_from(think_spans.front().second))
+        {
+            MT_LOG(
+                "Not evicting thinking tokens, as entries are shared with"
+                    " another sequence.\n");
+        }
+        else if(!think_spans.empty()
+            && llama_memory_can_shift(llama_get_memory(s->ctx)))
+        {
+            if(!evict_spans(think_spans))
+            {
+                return false; // (logged)
+            }
+
+            // The visible tokens are never part of a span:
+            //
+            for(struct answer_tok & a : answer)
+            {
+                int shift = 0;
+
+                for(auto const & span : think_spans)
+                {
+                    if(span.second <= a.pos)
+                    {
+                        shift += span.second - span.first;
+                    }
+                }
+                a.pos -= shift;
+            }
+        }
+    }
+
+    s_answer.swap(answer);
+    s_answer_beg = first_new_tok_index;
+    s_answer_end = s->tok_cnt;
+    s_answer_epoch = s_epoch;
+    return true;
+}
+
+/** Update the gauges of the statistics that describe the KV cache usage.
+ */
+static void update_kv_gauges()
+{
+    if(s == nullptr || s->ctx == nullptr)
+    {
+        mt_llm_stats_set(MT_LLM_STATS_GAUGE_KV_USED_TOKENS, 0);
+        mt_llm_stats_set(MT_LLM_STATS_GAUGE_KV_SIZE_TOKENS, 0);
+        return;
+    }
+    mt_llm_stats_set(
+        MT_LLM_STATS_GAUGE_KV_USED_TOKENS, static_cast<uint64_t>(s->tok_cnt));
+    mt_llm_stats_set(
+        MT_LLM_STATS_GAUGE_KV_SIZE_TOKENS,
+        static_cast<uint64_t>(llama_n_ctx(s->ctx)));
+}
+
+/**
+ * - To be called by mt_llm_init().
+ * - Caller takes ownership.
+ */
+static llama_sampler* create_sampler(llama_vocab const * const vocab)
+{
+    assert(s != nullptr && s->mt_p != nullptr);
+
+    static size_t const min_keep = 0; // TODO: Is this the best option?
+    static char const * const grammar_root = "root"; // TODO: Is this correct?
+
+    llama_sampler_chain_params p = llama_sampler_chain_default_params();
+
+    assert(p.no_perf);
+
+    llama_sampler * const ret_val = llama_sampler_chain_init(p);
+
+    if(s->mt_p->grammar[0] != '\0') // <- Does not seem to be necessary.
+    {
+        // TODO: Test, if this actually works this way!
+
+        llama_sampler_chain_add(
+            ret_val,
+            llama_sampler_init_grammar(
+                vocab, s->mt_p->grammar, grammar_root));
+    }
+
+    // Not used here: llama_sampler_init_logit_bias()
+
+    // Not used here: llama_sampler_init_penalties()
+
+    // Not used here: llama_sampler_init_dry()
+
+    llama_sampler_chain_add(
+        ret_val, llama_sampler_init_top_k(s->mt_p->top_k));
+
+    // Not used here: llama_sampler_init_typical()
+
+    llama_sampler_chain_add(
+        ret_val, llama_sampler_init_top_p(s->mt_p->top_p, min_keep));
+
+    llama_sampler_chain_add(
+        ret_val, llama_sampler_init_min_p(s->mt_p->min_p, min_keep));
+
+    // Not used here: llama_sampler_init_xtc()
+
+    llama_sampler_chain_add( // TODO: Better use llama_sampler_init_temp_ext()?
+        ret_val, llama_sampler_init_temp(s->mt_p->temp));
+
+    assert(LLAMA_DEFAULT_SEED == static_cast<uint32_t>(-1));
+    llama_sampler_chain_add(ret_val, llama_sampler_init_dist(s->mt_p->seed));
+
+    return ret_val;
+}
+
+MT_EXPORT_LLM_API int mt_llm_get_token_count(
+    char const * const text, bool const add_special)
+{
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return -1;
+    }
+    if(text == nullptr)
+    {
+        MT_LOG_ERR("NULL given!\n");
+        return -2;
+    }
+
+    std::vector<int> const tokens = mt_llm_ctx_tokenize(
+        *s->ctx, text, add_special);
+
+    return static_cast<int>(tokens.size());
+}
+
+/** Copy the KV cache entries of given sequence into given state object's
+ *  buffer (see mt_llm_state_fill()).
+ */
+static bool fill_seq(
+    struct mt_llm_state & state, size_t & capacity, llama_seq_id const seq)
+{
+    assert(s != nullptr);
+    assert(s->ctx != nullptr);
+    assert(state.state != nullptr || capacity == 0);
+
+    // Just the sequence's KV cache entries are stored (and not e.g. the output
+    // buffers of the whole context), so the size is proportional to the count
+    // of tokens held and not to the context length:
+    //
+    size_t const state_size = llama_state_seq_get_size(s->ctx, seq);
+
+    MT_LOG("Serialized state size would be: %zu bytes\n", state_size);
+
+    if(capacity < state_size)
+    {
+        uint8_t * const buf = static_cast<uint8_t*>(
+            realloc(state.state, state_size));
+
+        if(buf == nullptr)
+        {
+            MT_LOG_ERR("Failed to allocate %zu bytes!\n", state_size);
+            mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+            return false;
+        }
+        state.state = buf;
+        capacity = state_size;
+    }
+
+    size_t const written = llama_state_seq_get_data(
+        s->ctx, state.state, state_size, seq);
+
+    if(written != state_size)
+    {
+        MT_LOG_ERR("Failed to write all %zu bytes!\n", state_size);
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        return false;
+    }
+
+    MT_LOG("Successfully copied %zu state bytes to memory.\n", state_size);
+    state.size = state_size;
+    state.last_tok_type = s->last_tok_type;
+    state.tok_cnt = s->tok_cnt;
+    return true;
+}
+
+bool mt_llm_state_fill(struct mt_llm_state & state, size_t & capacity)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+    return fill_seq(state, capacity, MT_LLM_CTX_SEQ_MAIN);
+}
+
+bool mt_llm_state_fill_delta(
+    struct mt_llm_state & state, size_t & capacity, int const pos_beg)
+{
+    return mt_llm_state_fill_range(state, capacity, pos_beg, -1);
+}
+
+bool mt_llm_state_fill_range(
+    struct mt_llm_state & state,
+    size_t & capacity,
+    int const pos_beg,
+    int const pos_end)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+
+    assert(s->ctx != nullptr);
+    assert(0 <= pos_beg && pos_beg <= s->tok_cnt);
+    assert(pos_end < 0 || (pos_beg < pos_end && pos_end <= s->tok_cnt));
+
+    llama_memory_t const mem = llama_get_memory(s->ctx);
+
+    // Let the scratch sequence share the main sequence's KV cache entries of
+    // the positions wanted (no data gets copied) and serialize it:
+
+    llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+    llama_memory_seq_cp(
+        mem, MT_LLM_CTX_SEQ_MAIN, MT_LLM_CTX_SEQ_SCRATCH, pos_beg, pos_end);
+
+    bool const ret_val = fill_seq(state, capacity, MT_LLM_CTX_SEQ_SCRATCH);
+
+    llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+    return ret_val;
+}
+
+/** Get the raw state data of given state, decoding it first, if it is encoded
+ *  (see mt_llm_state_codec.h).
+ */
+static bool get_raw_data(
+    struct mt_llm_state const & state, uint8_t const * & data, size_t & size)
+{
+    if(mt_llm_state_codec_get(state.state, state.size)
+        == MT_LLM_STATE_CODEC_RAW)
+    {
+        data = state.state;
+        size = state.size;
+        return true;
+    }
+
+    struct mt_llm_state decoded = { 0, -1, s_decoded, 0 };
+    bool const ret_val = mt_llm_state_codec_decode(
+        state.state, state.size, decoded, s_decoded_capacity);
+
+    s_decoded = decoded.state; // (may have been reallocated)
+    if(!ret_val)
+    {
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        return false; // (logged)
+    }
+    data = decoded.state;
+    size = decoded.size;
+    return true;
+}
+
+bool mt_llm_state_restore_delta(struct mt_llm_state const & state)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    assert(state.state != nullptr);
+    assert(0 < state.size);
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+
+    assert(s->ctx != nullptr);
+
+    llama_memory_t const mem = llama_get_memory(s->ctx);
+    uint8_t const * data = nullptr;
+    size_t size = 0;
+
+    if(!get_raw_data(state, data, size))
+    {
+        return false;
+    }
+
+    // Restoring into the main sequence would replace its entries, so restore
+    // into the scratch sequence and let the main sequence share the entries:
+
+    llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+
+    size_t const read = llama_state_seq_set_data(
+        s->ctx, data, size, MT_LLM_CTX_SEQ_SCRATCH);
+
+    if(read != size)
+    {
+        MT_LOG_ERR("Filed to read exactly %zu bytes!\n", size);
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+        return false;
+    }
+    llama_memory_seq_cp(
+        mem, MT_LLM_CTX_SEQ_SCRATCH, MT_LLM_CTX_SEQ_MAIN, -1, -1);
+    llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+
+    s->last_tok_type = state.last_tok_type;
+    s->tok_cnt = state.tok_cnt;
+    s_toks.clear();
+    s_toks_known = false; // (states do not hold the tokens)
+    s_turns.clear();
+    update_kv_gauges();
+    return true;
+}
+
+bool mt_llm_state_restore_range(
+    struct mt_llm_state const & state, int const pos_beg, int const pos_end)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    assert(state.state != nullptr);
+    assert(0 < state.size);
+    assert(0 <= pos_beg && pos_beg < pos_end);
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+
+    assert(s->ctx != nullptr);
+
+    llama_memory_t const mem = llama_get_memory(s->ctx);
+    uint8_t const * data = nullptr;
+    size_t size = 0;
+
+    if(!get_raw_data(state, data, size))
+    {
+        return false;
+    }
+
+    // Like mt_llm_state_restore_delta(), but just let the main sequence share
+    // the entries of the positions wanted:
+
+    llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+
+    size_t const read = llama_state_seq_set_data(
+        s->ctx, data, size, MT_LLM_CTX_SEQ_SCRATCH);
+
+    if(read != size)
+    {
+        MT_LOG_ERR("Filed to read exactly %zu bytes!\n", size);
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+        return false;
+    }
+    llama_memory_seq_cp(
+        mem, MT_LLM_CTX_SEQ_SCRATCH, MT_LLM_CTX_SEQ_MAIN, pos_beg, pos_end);
+    llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+    return true;
+}
+
+bool mt_llm_state_pin(
+    int const pin, int const pos_beg, struct mt_llm_state & out)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    assert(0 <= pin && pin < MT_LLM_CTX_SEQ_PIN_COUNT);
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+
+    assert(s->ctx != nullptr);
+    assert(pos_beg <= s->tok_cnt);
+
+    llama_memory_t const mem = llama_get_memory(s->ctx);
+    llama_seq_id const seq = MT_LLM_CTX_SEQ_PIN_FIRST + pin;
+
+    llama_memory_seq_rm(mem, seq, -1, -1);
+    llama_memory_seq_cp(mem, MT_LLM_CTX_SEQ_MAIN, seq, pos_beg, -1);
+
+    out.last_tok_type = s->last_tok_type;
+    out.tok_cnt = s->tok_cnt;
+    return true;
+}
+
+/** A buffer to be filled by write_to_buf().
+ */
+struct buf_dest
+{
+    uint8_t * buf;
+    size_t capacity;
+    size_t size; // Bytes written.
+};
+
+/** Write function for mt_llm_state_io_write(), which copies into the buffer
+ *  of the buf_dest object given as user data.
+ */
+static bool write_to_buf(
+    void * const user, uint8_t const * const data, size_t const size)
+{
+    struct buf_dest * const dest = static_cast<struct buf_dest *>(user);
+
+    if(dest->capacity - dest->size < size)
+    {
+        return false;
+    }
+    memcpy(dest->buf + dest->size, data, size);
+    dest->size += size;
     return true;
 }
 
-/**
- * - To be called by mt_llm_init().
- * - Caller takes ownership.
+bool mt_llm_state_fill_pinned(
+    struct mt_llm_state & state, size_t & capacity, int const pin)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    assert(0 <= pin && pin < MT_LLM_CTX_SEQ_PIN_COUNT);
+    assert(state.state != nullptr || capacity == 0);
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+
+    assert(s->ctx != nullptr);
+
+    llama_memory_t const mem = llama_get_memory(s->ctx);
+    llama_seq_id const seq = MT_LLM_CTX_SEQ_PIN_FIRST + pin;
+    size_t const state_size = llama_state_seq_get_size(s->ctx, seq);
+    bool ret_val = false;
+
+    if(capacity < state_size)
+    {
+        uint8_t * const buf = static_cast<uint8_t*>(
+            realloc(state.state, state_size));
+
+        if(buf == nullptr)
+        {
+            MT_LOG_ERR("Failed to allocate %zu bytes!\n", state_size);
+            mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+            llama_memory_seq_rm(mem, seq, -1, -1);
+            return false;
+        }
+        state.state = buf;
+        capacity = state_size;
+    }
+
+    // The pinned entries cannot be changed by the thread using the LLM, while
+    // it gets the context between the parts copied (it just uses the main, the
+    // scratch and the fork sequences):
+    {
+        struct buf_dest dest = { state.state, state_size, 0 };
+        size_t written = 0;
+
+        ret_val = mt_llm_state_io_write(
+                s->ctx, seq, write_to_buf, &dest, true, written)
+            && written == state_size;
+    }
+    llama_memory_seq_rm(mem, seq, -1, -1);
+
+    if(!ret_val)
+    {
+        MT_LOG_ERR("Failed to write all %zu bytes!\n", state_size);
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        return false;
+    }
+    state.size = state_size;
+    return true;
+}
+
+bool mt_llm_get_history(uint64_t & epoch, int & tok_cnt)
+{
+    if(s == nullptr)
+    {
+        return false;
+    }
+    epoch = s_epoch;
+    tok_cnt = s->tok_cnt;
+    return true;
+}
+
+bool mt_llm_get_model_fingerprint(uint64_t & out)
+{
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+
+    assert(s->model != nullptr);
+
+    out = mt_llm_model_get_fingerprint(*s->model);
+    return true;
+}
+
+static struct mt_llm_state * state_create()
+{
+    struct mt_llm_state * state = nullptr;
+    size_t capacity = 0;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return nullptr;
+    }
+
+    state = static_cast<mt_llm_state*>(malloc(sizeof *state));
+    if(state == nullptr)
+    {
+        MT_LOG_ERR("Failed to allocate state object!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        return nullptr;
+    }
+    state->state = nullptr;
+    state->size = 0;
+
+    if(!mt_llm_state_fill(*state, capacity)) // (logs on error)
+    {
+        free(state->state);
+        state->state = nullptr;
+        free(state);
+        state = nullptr;
+        return nullptr;
+    }
+    return state; // Caller takes ownership!
+}
+
+MT_EXPORT_LLM_API struct mt_llm_state * __stdcall mt_llm_state_create()
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    struct mt_llm_state * const ret_val = state_create();
+    char id[32];
+
+    snprintf(id, sizeof id, "%p", static_cast<void*>(ret_val));
+    mt_llm_record_end(t_rec, "state_create", ret_val != nullptr, id);
+    return ret_val;
+}
+
+static bool state_restore(struct mt_llm_state const * const state)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    assert(state != nullptr);
+    assert(state->state != nullptr);
+    assert(0 < state->size);
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+
+    assert(s->ctx != nullptr);
+
+    uint8_t const * data = nullptr;
+    size_t size = 0;
+
+    if(!get_raw_data(*state, data, size))
+    {
+        return false;
+    }
+    
+    // Replaces the main sequence's KV cache entries:
+    //
+    size_t const read = llama_state_seq_set_data(
+        s->ctx, data, size, MT_LLM_CTX_SEQ_MAIN);
+
+    s_toks.clear();
+    s_toks_known = false; // (states do not hold the tokens)
+    s_turns.clear();
+    if(read != size)
+    {
+        MT_LOG_ERR("Filed to read exactly %zu bytes!\n", size);
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        return false;
+    }
+    s->last_tok_type = state->last_tok_type;
+    s->tok_cnt = state->tok_cnt;
+    ++s_epoch;
+    update_kv_gauges();
+    return true;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_state_restore(
+    struct mt_llm_state const * const state)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = state_restore(state);
+    char id[32];
+
+    snprintf(id, sizeof id, "%p", static_cast<void const *>(state));
+    mt_llm_record_end(t_rec, "state_restore", ret_val, id);
+    return ret_val;
+}
+
+MT_EXPORT_LLM_API size_t __stdcall mt_llm_state_get_size()
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        return 0;
+    }
+
+    assert(s->ctx != nullptr);
+
+    return MT_LLM_STATE_SERIALIZED_HEADER_SIZE
+        + llama_state_seq_get_size(s->ctx, MT_LLM_CTX_SEQ_MAIN);
+}
+
+/** Write the header of a serialized state (see
+ *  MT_LLM_STATE_SERIALIZED_HEADER_SIZE) for the current state.
+ */
+static void write_header(uint8_t * const header)
+{
+    assert(s != nullptr);
+
+    int32_t const tok_cnt = static_cast<int32_t>(s->tok_cnt);
+    int32_t const last_tok_type = static_cast<int32_t>(s->last_tok_type);
+
+    memcpy(header, &tok_cnt, sizeof tok_cnt);
+    memcpy(header + sizeof tok_cnt, &last_tok_type, sizeof last_tok_type);
+}
+
+/** Set token count and type of given state from the header of a serialized
+ *  state (see MT_LLM_STATE_SERIALIZED_HEADER_SIZE).
+ */
+static void read_header(
+    uint8_t const * const header, struct mt_llm_state & state)
+{
+    int32_t tok_cnt = 0, last_tok_type = 0;
+
+    memcpy(&tok_cnt, header, sizeof tok_cnt);
+    memcpy(&last_tok_type, header + sizeof tok_cnt, sizeof last_tok_type);
+    state.tok_cnt = static_cast<int>(tok_cnt);
+    state.last_tok_type = static_cast<int>(last_tok_type);
+}
+
+static size_t state_write_to(uint8_t * const buf, size_t const capacity)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return 0;
+    }
+
+    assert(s->ctx != nullptr);
+
+    size_t const size = mt_llm_state_get_size();
+
+    if(buf == nullptr || capacity < size)
+    {
+        MT_LOG_ERR(
+            "Buffer of %zu bytes is too small for %zu bytes!\n",
+            buf == nullptr ? 0 : capacity,
+            size);
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        return 0;
+    }
+
+    write_header(buf);
+
+    size_t const written = llama_state_seq_get_data(
+        s->ctx,
+        buf + MT_LLM_STATE_SERIALIZED_HEADER_SIZE,
+        capacity - MT_LLM_STATE_SERIALIZED_HEADER_SIZE,
+        MT_LLM_CTX_SEQ_MAIN);
+
+    if(written != size - MT_LLM_STATE_SERIALIZED_HEADER_SIZE)
+    {
+        MT_LOG_ERR("Failed to write all %zu bytes!\n", size);
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        return 0;
+    }
+    return size;
+}
+
+MT_EXPORT_LLM_API size_t __stdcall mt_llm_state_write_to(
+    uint8_t * const buf, size_t const capacity)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    size_t const ret_val = state_write_to(buf, capacity);
+    char id[32];
+
+    snprintf(id, sizeof id, "%p", static_cast<void *>(buf));
+    mt_llm_record_end(t_rec, "state_write_to", ret_val != 0, id);
+    return ret_val;
+}
+
+static size_t state_write_stream(
+    bool(*write)(void *, uint8_t const *, size_t), void * const user)
+{
+    struct mt_llm_ctx_guard const guard;
+    uint8_t header[MT_LLM_STATE_SERIALIZED_HEADER_SIZE];
+    size_t written = 0;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return 0;
+    }
+    if(write == nullptr)
+    {
+        MT_LOG_ERR("NULL given!\n");
+        return 0;
+    }
+
+    assert(s->ctx != nullptr);
+
+    write_header(header);
+    if(!write(user, header, sizeof header)
+        || !mt_llm_state_io_write(
+            s->ctx, MT_LLM_CTX_SEQ_MAIN, write, user, false, written))
+    {
+        MT_LOG_ERR("Failed to write state to stream!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        return 0;
+    }
+    MT_LOG("Successfully wrote %zu state bytes to stream.\n", written);
+    return sizeof header + written;
+}
+
+MT_EXPORT_LLM_API size_t __stdcall mt_llm_state_write_stream(
+    bool(*write)(void *, uint8_t const *, size_t), void * const user)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    size_t const ret_val = state_write_stream(write, user);
+    char id[32];
+
+    snprintf(id, sizeof id, "%p", user);
+    mt_llm_record_end(t_rec, "state_write_stream", ret_val != 0, id);
+    return ret_val;
+}
+
+static bool state_read_from(uint8_t const * const buf, size_t const size)
+{
+    struct mt_llm_state state;
+
+    if(buf == nullptr || size <= MT_LLM_STATE_SERIALIZED_HEADER_SIZE)
+    {
+        MT_LOG_ERR("Invalid state data given!\n");
+        return false;
+    }
+
+    read_header(buf, state);
+    state.state = const_cast<uint8_t *>(
+        buf + MT_LLM_STATE_SERIALIZED_HEADER_SIZE); // (read, only)
+    state.size = size - MT_LLM_STATE_SERIALIZED_HEADER_SIZE;
+    return state_restore(&state);
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_state_read_from(
+    uint8_t const * const buf, size_t const size)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = state_read_from(buf, size);
+    char id[32];
+
+    snprintf(id, sizeof id, "%p", static_cast<void const *>(buf));
+    mt_llm_record_end(t_rec, "state_read_from", ret_val, id);
+    return ret_val;
+}
+
+static bool state_read_stream(
+    bool(*read)(void *, uint8_t *, size_t), void * const user)
+{
+    struct mt_llm_ctx_guard const guard;
+    uint8_t header[MT_LLM_STATE_SERIALIZED_HEADER_SIZE];
+    struct mt_llm_state state;
+    size_t read_size = 0;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+    if(read == nullptr)
+    {
+        MT_LOG_ERR("NULL given!\n");
+        return false;
+    }
+
+    assert(s->ctx != nullptr);
+
+    ++s_epoch;
+    s_toks.clear();
+    s_toks_known = false; // (states do not hold the tokens)
+    s_turns.clear();
+    if(!read(user, header, sizeof header)
+        || !mt_llm_state_io_read(
+            s->ctx, MT_LLM_CTX_SEQ_MAIN, read, user, read_size))
+    {
+        MT_LOG_ERR("Failed to read state from stream!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+
+        // Stay consistent with the (now empty) main sequence:
+        //
+        llama_memory_seq_rm(
+            llama_get_memory(s->ctx), MT_LLM_CTX_SEQ_MAIN, -1, -1);
+        s->last_tok_type = 0;
+        s->tok_cnt = 0;
+        s_toks_known = true;
+        update_kv_gauges();
+        return false;
+    }
+    read_header(header, state);
+    s->last_tok_type = state.last_tok_type;
+    s->tok_cnt = state.tok_cnt;
+    update_kv_gauges();
+    MT_LOG("Successfully read %zu state bytes from stream.\n", read_size);
+    return true;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_state_read_stream(
+    bool(*read)(void *, uint8_t *, size_t), void * const user)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = state_read_stream(read, user);
+    char id[32];
+
+    snprintf(id, sizeof id, "%p", user);
+    mt_llm_record_end(t_rec, "state_read_stream", ret_val, id);
+    return ret_val;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_get_memory_info(
+    struct mt_llm_memory_info * const out)
+{
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+    if(out == nullptr)
+    {
+        MT_LOG_ERR("NULL given!\n");
+        return false;
+    }
+
+    assert(s->model != nullptr);
+    assert(s->ctx != nullptr);
+
+    uint64_t const kv_per_tok = mt_llm_model_get_kv_bytes_per_token(*s->model);
+
+    out->model_bytes = llama_model_size(s->model);
+    out->model_mapped_bytes = mt_llm_mem_get_file_mapped(
+        s->mt_p->model_file_path, &out->model_resident_bytes);
+
+    out->kv_used_bytes = kv_per_tok * static_cast<uint64_t>(s->tok_cnt);
+    out->kv_allocated_bytes =
+        kv_per_tok * static_cast<uint64_t>(llama_n_ctx(s->ctx));
+
+    out->snapshot_bytes = static_cast<uint64_t>(mt_llm_snapshot_get_bytes());
+
+    out->process_resident_bytes = mt_llm_mem_get_process_resident();
+    out->process_peak_bytes = mt_llm_mem_get_process_peak();
+
+    // Everything not accounted for, otherwise (the model's weights are
+    // resident, even if not memory-mapped):
+    //
+    {
+        uint64_t const known = (out->model_mapped_bytes == 0
+                    ? out->model_bytes : out->model_resident_bytes)
+                + out->kv_allocated_bytes
+                + out->snapshot_bytes;
+
+        out->compute_bytes = known < out->process_resident_bytes
+            ? out->process_resident_bytes - known : 0;
+    }
+    return true;
+}
+
+/** Returns true, if a prompt got begun (see mt_llm_prompt_begin()) and the
+ *  context was not modified otherwise, since.
+ */
+static bool is_prompt_pending()
+{
+    return s_prompt_is_active
+        && s_prompt_epoch == s_epoch
+        && s->tok_cnt
+            == s_prompt_beg + static_cast<int>(s_prompt_toks.size());
+}
+
+/** Stop decoding in the background and move the entries of the side tokens
+ *  decoded (but not more than given count) into the main sequence, as if the
+ *  tokens got decoded there (the callback gets called for them).
+ *
+ * - Keeps the side tokens (which are not valid, anymore, if tokens got
+ *   moved).
+ * - Returns the count of tokens moved (0, if the side tokens are not valid).
+ */
+static int side_adopt(int const max_count)
+{
+    mt_llm_side_hold();
+
+    if(!mt_llm_side_is_valid())
+    {
+        return 0;
+    }
+
+    struct mt_llm_side const & side = mt_llm_side_get();
+    int const count = std::min(max_count, side.decoded);
+
+    if(count <= 0)
+    {
+        return 0;
+    }
+
+    mt_llm_side_share(0, count);
+
+    for(int i = 0; i < count; ++i)
+    {
+        s->last_tok_type = side.types[i];
+        llama_sampler_accept(s->sampler, side.toks[i]);
+        callback_handler( // (return value ignored, like when decoding)
+            side.toks[i],
+            mt_llm_ctx_get_piece_from(*s->ctx, side.toks[i]),
+            std::vector<float>());
+    }
+    if(s_toks_known)
+    {
+        s_toks.insert(
+            s_toks.end(), side.toks.begin(), side.toks.begin() + count);
+    }
+    s->tok_cnt += count;
+    update_kv_gauges();
+    return count;
+}
+
+/** Decode the side tokens at given indices (from the first up to, but not
+ *  including the second index) into the main sequence (e.g. the ones not
+ *  decoded in the background, yet), letting the callback know their types.
+ */
+static bool decode_side_toks(int const beg, int const end)
+{
+    struct mt_llm_side const & side = mt_llm_side_get();
+
+    assert(0 <= beg && end <= static_cast<int>(side.toks.size()));
+
+    for(int i = beg; i < end;) // Per token type.
+    {
+        int type_end = i + 1;
+
+        while(type_end < end && side.types[type_end] == side.types[i])
+        {
+            ++type_end;
+        }
+
+        s->last_tok_type = side.types[i];
+        if(!decode_tokens(
+                std::vector<int>(
+                    side.toks.begin() + i, side.toks.begin() + type_end)))
+        {
+            MT_LOG_ERR("Decoding tokens of type %d!\n", s->last_tok_type);
+            return false;
+        }
+        i = type_end;
+    }
+    return true;
+}
+
+/** Add the tokens of given string to be decoded after given count of tokens
+ *  followed by the ones given, as well as their types.
+ */
+static void add_toks_for(
+    int const tok_cnt,
+    char const * const str,
+    int const type,
+    std::vector<int> & toks,
+    std::vector<int> & types)
+{
+    std::vector<int> const added = mt_llm_ctx_tokenize_for(
+        *s->ctx, tok_cnt + static_cast<int>(toks.size()), str);
+
+    toks.insert(toks.end(), added.begin(), added.end());
+    types.resize(toks.size(), type);
+}
+
+/** Get the tokens of the delimiters (and the system prompt) to precede a
+ *  prompt following given count of tokens (see decode_prompt_beg()), as well
+ *  as their types.
+ */
+static void get_prompt_beg_toks(
+    int const tok_cnt, std::vector<int> & toks, std::vector<int> & types)
+{
+    toks.clear();
+    types.clear();
+    if(tok_cnt == 0 && s->mt_p->sys_prompt[0] != '\0') // (see query())
+    {
+        add_toks_for(
+            0, s->mt_p->sys_prompt_beg_delim, MT_TOK_TYPE_DELIM, toks, types);
+        add_toks_for(
+            0, s->mt_p->sys_prompt, MT_TOK_TYPE_SYS_PROMPT, toks, types);
+        add_toks_for(
+            0, s->mt_p->sys_prompt_mid_delim, MT_TOK_TYPE_DELIM, toks, types);
+        return;
+    }
+    add_toks_for(
+        tok_cnt, s->mt_p->prompt_beg_delim, MT_TOK_TYPE_DELIM, toks, types);
+}
+
+/** Let the worker thread decode the tokens to precede the first prompt after
+ *  a reset into the standby sequence, if wanted (see mt_llm_set_standby()).
+ *
+ * - Returns false, if not wanted.
+ */
+static bool standby_begin()
+{
+    assert(s != nullptr);
+
+    std::vector<int> toks, types;
+
+    if(s_standby)
+    {
+        get_prompt_beg_toks(0, toks, types);
+    }
+    mt_llm_side_standby_begin(toks, types); // (just clears, if empty)
+    return s_standby;
+}
+
+/** Let the worker thread decode the tokens to precede the next prompt (see
+ *  decode_prompt_beg()) into the side sequence, if wanted (see
+ *  mt_llm_set_precompute()).
+ *
+ * - To be called, when the LLM gets idle (e.g. after an answer or a reset).
+ */
+static void precompute_begin()
+{
+    assert(s != nullptr);
+
+    mt_llm_side_standby_hold(false); // (held while a prompt was pending)
+    if(s->tok_cnt == 0 && mt_llm_side_standby_use())
+    {
+        return; // (the standby's tokens get decoded separately)
+    }
+    if(!s_precompute)
+    {
+        return;
+    }
+
+    std::vector<int> toks, types;
+
+    get_prompt_beg_toks(s->tok_cnt, toks, types);
+    if(toks.empty())
+    {
+        return;
+    }
+    mt_llm_side_begin(toks, types, true);
+}
+
+/** Decode the delimiters (and the system prompt) to precede a prompt.
+ *
+ * - Initial <=> First query (after a reset) and a system prompt is set.
+ */
+static bool decode_prompt_beg(bool const is_initial)
+{
+    struct mt_llm_side const & side = mt_llm_side_get();
+
+    if(s->tok_cnt == 0
+        && (!(side.is_prompt_beg && mt_llm_side_is_valid())
+            || side.decoded < mt_llm_side_standby_get_decoded()))
+    {
+        // Sharing the standby tokens decoded until now (does nothing, if there
+        // is no standby):
+        //
+        mt_llm_side_standby_use();
+    }
+    if(side.is_prompt_beg && mt_llm_side_is_valid())
+    {
+        // Precomputed (at least partially) in the background, for the same
+        // token count (<=> same value of is_initial):
+
+        int const count = static_cast<int>(side.toks.size());
+        int const moved = side_adopt(count);
+        bool const ret_val = decode_side_toks(moved, count);
+
+        MT_LOG("Used %d of %d tokens precomputed.\n", moved, count);
+        mt_llm_side_cancel();
+        return ret_val;
+    }
+    mt_llm_side_cancel();
+
+    if(!is_initial)
+    {
+        if(!decode(s->mt_p->prompt_beg_delim, MT_TOK_TYPE_DELIM))
+        {
+            MT_LOG_ERR("Decoding prompt begin delimiter!");
+            return false;
+        }
+        return true;
+    }
+
+    assert(s->mt_p->sys_prompt[0] != '\0');
+
+    if(!decode(s->mt_p->sys_prompt_beg_delim, MT_TOK_TYPE_DELIM))
+    {
+        MT_LOG_ERR("Decoding system prompt begin delimiter!");
+        return false;
+    }
+    if(!decode(s->mt_p->sys_prompt, MT_TOK_TYPE_SYS_PROMPT))
+    {
+        MT_LOG_ERR("Decoding system prompt!");
+        return false;
+    }
+    if(!decode(s->mt_p->sys_prompt_mid_delim, MT_TOK_TYPE_DELIM))
+    {
+        MT_LOG_ERR("Decoding system prompt middle delimiter!");
+        return false;
+    }
+    return true;
+}
+
+/** Decode the delimiter to follow a prompt (see decode_prompt_beg()).
+ */
+static bool decode_prompt_end(bool const is_initial)
+{
+    if(is_initial)
+    {
+        if(!decode(s->mt_p->sys_prompt_end_delim, MT_TOK_TYPE_DELIM))
+        {
+            MT_LOG_ERR("Decoding system prompt end delimiter!");
+            return false;
+        }
+        return true;
+    }
+    if(!decode(s->mt_p->prompt_end_delim, MT_TOK_TYPE_DELIM))
+    {
+        MT_LOG_ERR("Decoding prompt end delimiter!");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * - Just assumes that the context length is always long enough to hold the
+ *   prompt to be decoded, here (no check..).
+ */
+static bool decode_query(char const * const prompt, bool const is_initial)
+{
+    assert(prompt != nullptr && prompt[0] != '\0');
+
+    if(!decode_prompt_beg(is_initial))
+    {
+        return false; // (logged)
+    }
+    if(!decode(prompt, MT_TOK_TYPE_PROMPT))
+    {
+        MT_LOG_ERR("Decoding prompt!");
+        return false;
+    }
+    return decode_prompt_end(is_initial);
+}
+
+/** End the prefill phase of a query, which started at given time and decoded
+ *  given count of tokens (see mt_llm_stats.h).
+ */
+static void end_prefill(int64_t const t_prefill_start, int const n_prefill)
+{
+    mt_llm_stats_end_phase(MT_LLM_STATS_PHASE_PREFILL, n_prefill);
+
+    mt_llm_stats_add(
+        MT_LLM_STATS_CNT_PREFILL_TOKENS, static_cast<uint64_t>(n_prefill));
+    if(0 < n_prefill)
+    {
+        mt_llm_stats_record_latency(
+            MT_LLM_STATS_LAT_PREFILL_PER_100,
+            static_cast<uint64_t>(
+                (ggml_time_us() - t_prefill_start) * 100 / n_prefill));
+    }
+}
+
+/** Generate the answer to the prompt decoded (see inference()), as the
+ *  generation phase of a query.
+ *
+ * - The worker thread must be paused since before the prefill, as any decode
+ *   in the background (e.g. while mt_llm_ctx_decode() yields the context)
+ *   discards the logits of the prompt's last token. Resumes it.
+ */
+static bool generate(struct pre_gen const * const pre)
+{
+    int const gen_tok_cnt_start = s->tok_cnt;
+
+    mt_llm_stats_begin_phase(MT_LLM_STATS_PHASE_GENERATION);
+
+    bool const is_generated = inference(pre);
+
+    mt_llm_side_set_paused(false);
+
+    if(!is_generated)
+    {
+        mt_llm_stats_end_phase(MT_LLM_STATS_PHASE_GENERATION, 0);
+        update_kv_gauges();
+        s_toks_known = false;
+        return false; // (called function logs on error)
+    }
+    mt_llm_stats_end_phase(
+        MT_LLM_STATS_PHASE_GENERATION, s->tok_cnt - gen_tok_cnt_start);
+    update_kv_gauges();
+
+    if(s_toks_known && mt_llm_prefix_cache_is_enabled())
+    {
+        assert(static_cast<int>(s_toks.size()) == s->tok_cnt);
+
+        mt_llm_prefix_cache_store(s_toks);
+    }
+    precompute_begin();
+
+    MT_LOG("Token count: %d.\n", s->tok_cnt);
+    return true;
+}
+
+static bool query(char const * const prompt)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+
+    assert(s->mt_p != nullptr);
+    assert(s->model != nullptr);
+    assert(s->ctx != nullptr);
+    assert(s->sampler != nullptr);
+
+    if(is_prompt_pending())
+    {
+        MT_LOG_ERR("Prompt begun, but not committed!\n");
+        return false;
+    }
+    s_prompt_is_active = false;
+    mt_llm_side_standby_hold(false); // (e.g. after an earlier prompt's error)
+
+    mt_llm_stats_add(MT_LLM_STATS_CNT_QUERIES, 1);
+
+    // Also kept on error, to be able to roll back a partially added turn:
+    //
+    s_turns.push_back({ s->tok_cnt, s->last_tok_type });
+
+    int64_t const t_prefill_start = ggml_time_us();
+    int const prefill_tok_cnt_start = s->tok_cnt;
+
+    mt_llm_stats_begin_phase(MT_LLM_STATS_PHASE_PREFILL);
+    mt_llm_side_set_paused(true); // (see generate())
+    if(!decode_query(
+            prompt, s->tok_cnt == 0 && s->mt_p->sys_prompt[0] != '\0'))
+    {
+        mt_llm_side_set_paused(false);
+        mt_llm_stats_end_phase(MT_LLM_STATS_PHASE_PREFILL, 0);
+        return false; // (called function logs on error)
+    }
+    end_prefill(t_prefill_start, s->tok_cnt - prefill_tok_cnt_start);
+
+    return generate(nullptr);
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_query(char const * const prompt)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = query(prompt);
+
+    mt_llm_record_end_query(t_rec, ret_val, prompt);
+    return ret_val;
+}
+
+static void reset()
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        return; // Cannot do anything.
+    }
+
+    assert(s->mt_p != nullptr);
+    assert(s->model != nullptr);
+    assert(s->ctx != nullptr);
+    assert(s->sampler != nullptr);
+
+    mt_llm_side_cancel();
+
+    {
+        llama_memory_t kv = llama_get_memory(s->ctx);
+
+        if(kv != nullptr)
+        {
+            // Not clearing the whole memory, as the pinned sequences of
+            // pending async. snapshots must keep their entries:
+            //
+            llama_memory_seq_rm(kv, MT_LLM_CTX_SEQ_MAIN, -1, -1);
+            llama_memory_seq_rm(kv, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+            kv = nullptr;
+        }
+    }
+
+    llama_sampler_reset(s->sampler);
+
+    s->last_tok_type = 0;
+    s->tok_cnt = 0;
+    s_toks.clear();
+    s_toks_known = true;
+    s_turns.clear();
+    ++s_epoch;
+    update_kv_gauges();
+    precompute_begin(); // (shares the standby, if any)
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_reset()
+{
+    int64_t const t_rec = mt_llm_record_begin();
+
+    reset();
+    mt_llm_record_end(t_rec, "reset", true, nullptr);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_set_evict_thinking(bool const evict)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+
+    {
+        struct mt_llm_ctx_guard const guard;
+
+        s_evict_thinking = evict;
+    }
+    mt_llm_record_end(t_rec, "set_evict_thinking", true, evict ? "1" : "0");
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_set_precompute(bool const precompute)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+
+    {
+        struct mt_llm_ctx_guard const guard;
+
+        s_precompute = precompute;
+        if(s != nullptr
+            && mt_llm_side_get().base < 0
+            && !is_prompt_pending())
+        {
+            precompute_begin(); // (does nothing, if not wanted)
+        }
+        else if(!precompute && mt_llm_side_get().is_prompt_beg)
+        {
+            mt_llm_side_cancel();
+        }
+    }
+    mt_llm_record_end(t_rec, "set_precompute", true, precompute ? "1" : "0");
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_set_standby(bool const standby)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+
+    {
+        struct mt_llm_ctx_guard const guard;
+
+        s_standby = standby;
+        if(s != nullptr && (!standby || !mt_llm_side_standby_is_set()))
+        {
+            standby_begin(); // (just clears, if not wanted)
+        }
+    }
+    mt_llm_record_end(t_rec, "set_standby", true, standby ? "1" : "0");
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_set_background_threads(
+    int const threads)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    char arg[16];
+
+    {
+        struct mt_llm_ctx_guard const guard;
+
+        mt_llm_side_set_threads(threads);
+    }
+    snprintf(arg, sizeof arg, "%d", threads);
+    mt_llm_record_end(t_rec, "set_background_threads", true, arg);
+}
+
+/** Remove the KV cache entries of the tokens at given and following positions
+ *  from the main sequence and rewind the sampler (e.g. the state of a
+ *  grammar), if the tokens are known.
+ *
+ * - Updates token count and the tokens known, but not the type of the last
+ *   token.
+ */
+static bool truncate(int const tok_cnt)
+{
+    assert(s != nullptr);
+    assert(s->ctx != nullptr);
+    assert(s->sampler != nullptr);
+    assert(0 <= tok_cnt && tok_cnt <= s->tok_cnt);
+
+    mt_llm_side_cancel();
+
+    if(!llama_memory_seq_rm(
+            llama_get_memory(s->ctx), MT_LLM_CTX_SEQ_MAIN, tok_cnt, -1))
+    {
+        // E.g. for recurrent models, which cannot remove partially:
+        //
+        MT_LOG_ERR("Failed to remove tokens from position %d!\n", tok_cnt);
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_STATE, 1);
+        return false;
+    }
+    s->tok_cnt = tok_cnt;
+
+    if(s_toks_known)
+    {
+        s_toks.resize(tok_cnt);
+        llama_sampler_reset(s->sampler);
+        for(int const tok : s_toks)
+        {
+            llama_sampler_accept(s->sampler, tok);
+        }
+    }
+
+    ++s_epoch;
+    update_kv_gauges();
+    return true;
+}
+
+static bool rollback(int const n_turns)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+    if(n_turns < 1 || static_cast<int>(s_turns.size()) < n_turns)
+    {
+        MT_LOG_ERR(
+            "Cannot roll back %d of %d turns!\n",
+            n_turns,
+            static_cast<int>(s_turns.size()));
+        return false;
+    }
+
+    struct turn const t = s_turns[s_turns.size() - n_turns];
+
+    if(!truncate(t.tok_cnt))
+    {
+        return false; // (logged)
+    }
+    s_turns.resize(s_turns.size() - n_turns);
+    s->last_tok_type = t.last_tok_type;
+    precompute_begin();
+    return true;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_rollback(int const n_turns)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = rollback(n_turns);
+    char arg[16];
+
+    snprintf(arg, sizeof arg, "%d", n_turns);
+    mt_llm_record_end(t_rec, "rollback", ret_val, arg);
+    return ret_val;
+}
+
+MT_EXPORT_LLM_API int __stdcall mt_llm_get_turn_count()
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return -1;
+    }
+    return static_cast<int>(s_turns.size());
+}
+
+static bool barge_in(size_t const heard_len)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+    if(s_answer_epoch != s_epoch || s_answer_end != s->tok_cnt)
+    {
+        MT_LOG_ERR("Context was modified after the last answer!\n");
+        return false;
+    }
+
+    // Keep the tokens up to the last one (partially) heard:
+
+    int tok_cnt = s_answer_beg;
+
+    for(struct answer_tok const & a : s_answer)
+    {
+        if(heard_len <= a.text_beg)
+        {
+            break;
+        }
+        tok_cnt = a.pos + 1;
+    }
+
+    int const evicted = s->tok_cnt - tok_cnt;
+
+    if(!truncate(tok_cnt))
+    {
+        return false; // (logged)
+    }
+    mt_llm_stats_add(
+        MT_LLM_STATS_CNT_EVICTED_TOKENS, static_cast<uint64_t>(evicted));
+    s_answer.clear(); // (also invalid because of the epoch, already)
+
+    // Append the interrupt marker, like inference() does:
+
+    std::vector<int> const irq_tokens = get_irq_tokens();
+
+    s->last_tok_type = MT_TOK_TYPE_IRQ;
+    if(!mt_llm_ctx_decode(
+            *s->ctx,
+            *s->sampler,
+            s->tok_cnt,
+            irq_tokens,
+            callback_handler))
+    {
+        MT_LOG_ERR("Decoding IRQ tokens!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_DECODE, 1);
+        s_toks_known = false;
+        return false;
+    }
+    if(s_toks_known)
+    {
+        s_toks.insert(s_toks.end(), irq_tokens.begin(), irq_tokens.end());
+    }
+    s->tok_cnt += static_cast<int>(irq_tokens.size());
+    update_kv_gauges();
+    MT_LOG(
+        "Kept %d answer tokens, removed %d tokens.\n",
+        tok_cnt - s_answer_beg,
+        evicted);
+    precompute_begin();
+    return true;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_barge_in(size_t const heard_len)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = barge_in(heard_len);
+    char arg[32];
+
+    snprintf(arg, sizeof arg, "%zu", heard_len);
+    mt_llm_record_end(t_rec, "barge_in", ret_val, arg);
+    return ret_val;
+}
+
+/** Tokenize the prompt's text (see sync_prompt()).
+ *
+ * - If not final, the tokens of the last word (which may change with text
+ *   appended) are held back.
+ */
+static std::vector<int> get_prompt_toks(bool const is_final)
+{
+    size_t len = s_prompt_text.size();
+
+    if(!is_final)
+    {
+        // The last word starts with the whitespace before it (tokenizers
+        // usually add it to the word's first token):
+        //
+        size_t const ws = s_prompt_text.find_last_of(" \t\r\n");
+
+        len = ws == std::string::npos ? 0 : ws;
+    }
+
+    // Tokenizing is fast in comparison to decoding, so the whole text is
+    // tokenized each time (tokenizing just parts may give other tokens):
+    //
+    return len == 0
+        ? std::vector<int>()
+        : mt_llm_ctx_tokenize_for(
+            *s->ctx, s_prompt_beg, s_prompt_text.substr(0, len).c_str());
+}
+
+/** Remove the prompt's tokens decoded, that differ from given ones (e.g.
+ *  because of a revision), and the ones following them.
+ *
+ * - Returns the count of tokens kept or -1 on error (then the prompt is not
+ *   active, anymore).
+ */
+static int keep_prompt_toks(std::vector<int> const & toks)
+{
+    size_t common = 0;
+
+    while(common < toks.size()
+        && common < s_prompt_toks.size()
+        && toks[common] == s_prompt_toks[common])
+    {
+        ++common;
+    }
+
+    if(common < s_prompt_toks.size())
+    {
+        MT_LOG(
+            "Removing %d revised prompt tokens.\n",
+            static_cast<int>(s_prompt_toks.size() - common));
+        if(!truncate(s_prompt_beg + static_cast<int>(common)))
+        {
+            s_prompt_is_active = false;
+            mt_llm_side_standby_hold(false);
+            return -1; // (logged)
+        }
+        s_prompt_toks.resize(common);
+        s_prompt_epoch = s_epoch;
+    }
+    return static_cast<int>(common);
+}
+
+/** Decode the tokens of the prompt's text, which are not decoded, yet, after
+ *  removing the decoded ones, that differ (e.g. because of a revision).
+ *
+ * - If not final, the tokens of the last word are held back (see
+ *   get_prompt_toks()).
+ * - Returns the count of tokens decoded or -1 on error (then the prompt is
+ *   not active, anymore).
+ */
+static int sync_prompt(bool const is_final)
+{
+    assert(s_prompt_is_active);
+
+    std::vector<int> const toks = get_prompt_toks(is_final);
+    int const common = keep_prompt_toks(toks);
+
+    if(common < 0)
+    {
+        return -1; // (logged)
+    }
+    if(common == static_cast<int>(toks.size()))
+    {
+        return 0;
+    }
+
+    std::vector<int> const added(toks.begin() + common, toks.end());
+
+    s->last_tok_type = MT_TOK_TYPE_PROMPT;
+    if(!decode_tokens(added))
+    {
+        MT_LOG_ERR("Decoding prompt!\n");
+        s_prompt_is_active = false;
+        mt_llm_side_standby_hold(false);
+        update_kv_gauges();
+        return -1;
+    }
+    s_prompt_toks.insert(s_prompt_toks.end(), added.begin(), added.end());
+    update_kv_gauges();
+    return static_cast<int>(added.size());
+}
+
+static bool prompt_begin()
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+    if(is_prompt_pending())
+    {
+        MT_LOG_ERR("Prompt begun, already!\n");
+        return false;
+    }
+
+    assert(s->mt_p != nullptr);
+    assert(s->ctx != nullptr);
+
+    mt_llm_stats_add(MT_LLM_STATS_CNT_QUERIES, 1);
+    s_turns.push_back({ s->tok_cnt, s->last_tok_type }); // (see query())
+
+    int const tok_cnt_start = s->tok_cnt;
+
+    s_prompt_is_active = false;
+    s_prompt_is_initial =
+        s->tok_cnt == 0 && s->mt_p->sys_prompt[0] != '\0';
+    if(!decode_prompt_beg(s_prompt_is_initial))
+    {
+        update_kv_gauges();
+        return false; // (logged)
+    }
+    mt_llm_stats_add(
+        MT_LLM_STATS_CNT_PREFILL_TOKENS,
+        static_cast<uint64_t>(s->tok_cnt - tok_cnt_start));
+    update_kv_gauges();
+
+    s_prompt_is_active = true;
+    s_prompt_beg = s->tok_cnt;
+    s_prompt_text.clear();
+    s_prompt_toks.clear();
+    s_prompt_epoch = s_epoch;
+
+    // Committing may not decode anything more (e.g. without an end delimiter)
+    // and sample from the logits of the prompt's last token, which decoding
+    // the standby tokens would discard (see precompute_begin()):
+    //
+    mt_llm_side_standby_hold(true);
+    return true;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_prompt_begin()
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = prompt_begin();
+
+    mt_llm_record_end(t_rec, "prompt_begin", ret_val, nullptr);
+    return ret_val;
+}
+
+/** Append given text to the prompt's text or replace the latter with given
+ *  text (see mt_llm_prompt_append() and mt_llm_prompt_replace()).
+ */
+static bool prompt_update(char const * const text, bool const is_append)
+{
+    struct mt_llm_ctx_guard const guard;
+
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+    if(text == nullptr)
+    {
+        MT_LOG_ERR("NULL given!\n");
+        return false;
+    }
+    if(!is_prompt_pending())
+    {
+        MT_LOG_ERR("No prompt begun!\n");
+        return false;
+    }
+
+    if(is_append ? text[0] == '\0' : s_prompt_text == text)
+    {
+        return true; // Nothing changed (keeps an answer speculated valid).
+    }
+    if(!is_append)
+    {
+        s_prompt_text.clear();
+    }
+    s_prompt_text += text;
+
+    if(mt_llm_side_get().is_spec && s_spec_text != s_prompt_text)
+    {
+        MT_LOG("Prompt changed, discarding the answer speculated.\n");
+        mt_llm_side_cancel();
+    }
+
+    int const decoded = sync_prompt(false);
+
+    if(decoded < 0)
+    {
+        return false; // (logged)
+    }
+    mt_llm_stats_add(
+        MT_LLM_STATS_CNT_PREFILL_TOKENS, static_cast<uint64_t>(decoded));
+    return true;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_prompt_append(
+    char const * const text)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = prompt_update(text, true);
+
+    mt_llm_record_end(t_rec, "prompt_append", ret_val, text);
+    return ret_val;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_prompt_replace(
+    char const * const text)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = prompt_update(text, false);
+
+    mt_llm_record_end(t_rec, "prompt_replace", ret_val, text);
+    return ret_val;
+}
+
+/** Returns true, if an answer is speculated for the prompt's current text and
+ *  the context was not modified otherwise, since.
  */
-static llama_sampler* create_sampler(llama_vocab const * const vocab)
+static bool is_spec_valid()
 {
-    assert(s != nullptr && s->mt_p != nullptr);
+    return mt_llm_side_get().is_spec
+        && mt_llm_side_is_valid()
+        && s_spec_text == s_prompt_text;
+}
 
-    static size_t const min_keep = 0; // TODO: Is this the best option?
-    static char const * const grammar_root = "root"; // TODO: Is this correct?
+static bool prompt_speculate(int const max_tokens)
+{
+    struct mt_llm_ctx_guard const guard;
 
-    llama_sampler_chain_params p = llama_sampler_chain_default_params();
+    if(s == nullptr)
+    {
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
+    }
+    if(max_tokens < 1)
+    {
+        MT_LOG_ERR("Invalid token count %d given!\n", max_tokens);
+        return false;
+    }
+    if(!is_prompt_pending())
+    {
+        MT_LOG_ERR("No prompt begun!\n");
+        return false;
+    }
+    if(is_whitespace_only(s_prompt_text.c_str()))
+    {
+        MT_LOG_ERR("Prompt is empty!\n");
+        return false;
+    }
 
-    assert(p.no_perf);
+    if(is_spec_valid()) // Speculating on this text, already.
+    {
+        // (e.g. if the former count was reached):
+        //
+        mt_llm_side_set_max_tokens(max_tokens);
+        return true;
+    }
 
-    llama_sampler * const ret_val = llama_sampler_chain_init(p);
+    // The whole text gets used, like when committed (this may remove revised
+    // tokens from the main sequence):
 
-    if(s->mt_p->grammar[0] != '\0') // <- Does not seem to be necessary.
+    std::vector<int> const toks = get_prompt_toks(true);
+    int const common = keep_prompt_toks(toks);
+
+    if(common < 0)
     {
-        // TODO: Test, if this actually works this way!
+        return false; // (logged)
+    }
 
-        llama_sampler_chain_add(
-            ret_val,
-            llama_sampler_init_grammar(
-                vocab, s->mt_p->grammar, grammar_root));
+    std::vector<int> side_toks(toks.begin() + common, toks.end());
+    std::vector<int> side_types(side_toks.size(), MT_TOK_TYPE_PROMPT);
+
+    {
+        std::vector<int> const delim = mt_llm_ctx_tokenize_for(
+            *s->ctx,
+            s->tok_cnt + static_cast<int>(side_toks.size()),
+            s_prompt_is_initial
+                ? s->mt_p->sys_prompt_end_delim : s->mt_p->prompt_end_delim);
+
+        side_toks.insert(side_toks.end(), delim.begin(), delim.end());
+        side_types.resize(side_toks.size(), MT_TOK_TYPE_DELIM);
+    }
+    if(side_toks.empty())
+    {
+        MT_LOG_ERR("No tokens left to be decoded for the prompt!\n");
+        return false; // (no logits to sample from in the side sequence)
     }
 
-    // Not used here: llama_sampler_init_logit_bias()
+    llama_sampler * const sampler = llama_sampler_clone(s->sampler);
 
-    // Not used here: llama_sampler_init_penalties()
+    if(sampler == nullptr)
+    {
+        MT_LOG_ERR("Failed to clone sampler!\n");
+        return false;
+    }
 
-    // Not used here: llama_sampler_init_dry()
+    mt_llm_side_speculate(side_toks, side_types, sampler, max_tokens);
+    s_spec_text = s_prompt_text;
+    MT_LOG(
+        "Speculating on the prompt (%d tokens left to be decoded).\n",
+        static_cast<int>(side_toks.size()));
+    return true;
+}
 
-    llama_sampler_chain_add(
-        ret_val, llama_sampler_init_top_k(s->mt_p->top_k));
+MT_EXPORT_LLM_API bool __stdcall mt_llm_prompt_speculate(int const max_tokens)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = prompt_speculate(max_tokens);
+    char arg[16];
 
-    // Not used here: llama_sampler_init_typical()
+    snprintf(arg, sizeof arg, "%d", max_tokens);
+    mt_llm_record_end(t_rec, "prompt_speculate", ret_val, arg);
+    return ret_val;
+}
 
-    llama_sampler_chain_add(
-        ret_val, llama_sampler_init_top_p(s->mt_p->top_p, min_keep));
+/** Use the side tokens of the answer speculated (see is_spec_valid()): Move
+ *  the entries of the prompt's tokens decoded into the main sequence, decode
+ *  the ones left and hand the answer's tokens over to given object (to be
+ *  used by inference()).
+ */
+static bool spec_take(struct pre_gen & pre)
+{
+    assert(is_spec_valid());
 
-    llama_sampler_chain_add(
-        ret_val, llama_sampler_init_min_p(s->mt_p->min_p, min_keep));
+    struct mt_llm_side const & side = mt_llm_side_get();
+    int const prefill = side.spec_prefill;
+    int const moved = side_adopt(prefill);
 
-    // Not used here: llama_sampler_init_xtc()
+    MT_LOG(
+        "Using the answer speculated (%d of %d prompt tokens, %d answer"
+            " tokens decoded).\n",
+        moved,
+        prefill,
+        std::max(0, side.decoded - prefill));
 
-    llama_sampler_chain_add( // TODO: Better use llama_sampler_init_temp_ext()?
-        ret_val, llama_sampler_init_temp(s->mt_p->temp));
+    if(!decode_side_toks(moved, prefill)) // Prompt's tokens left.
+    {
+        mt_llm_side_cancel();
+        return false; // (logged)
+    }
 
-    assert(LLAMA_DEFAULT_SEED == static_cast<uint32_t>(-1));
-    llama_sampler_chain_add(ret_val, llama_sampler_init_dist(s->mt_p->seed));
+    if(moved == prefill && prefill < static_cast<int>(side.toks.size()))
+    {
+        // The answer's tokens got sampled with the logits of the side
+        // sequence, so its entries and the sampler, that accepted the tokens,
+        // get used:
 
-    return ret_val;
+        if(prefill < side.decoded)
+        {
+            mt_llm_side_share(prefill, side.decoded);
+        }
+        llama_sampler_free(s->sampler);
+        s->sampler = mt_llm_side_take_sampler();
+
+        // (the last one sampled is never decoded, here)
+        assert(side.decoded < static_cast<int>(side.toks.size()));
+
+        pre.toks.assign(side.toks.begin() + prefill, side.toks.end());
+        pre.decoded = side.decoded - prefill;
+        pre.dig_idx = side.spec_dig_idx < 0 ? -1 : side.spec_dig_idx - prefill;
+        pre.dig_probs = side.spec_dig_probs;
+    }
+    mt_llm_side_cancel();
+    return true;
 }
 
-MT_EXPORT_LLM_API int mt_llm_get_token_count(
-    char const * const text, bool const add_special)
+static bool prompt_commit()
 {
+    struct mt_llm_ctx_guard const guard;
+
     if(s == nullptr)
     {
         MT_LOG_ERR("Not intialized!\n");
-        return -1;
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
     }
-    if(text == nullptr)
+    if(!is_prompt_pending())
     {
-        MT_LOG_ERR("NULL given!\n");
-        return -2;
+        MT_LOG_ERR("No prompt begun!\n");
+        return false;
+    }
+    if(is_whitespace_only(s_prompt_text.c_str()))
+    {
+        MT_LOG_ERR("Prompt is empty!\n");
+        return false; // (prompt stays active)
     }
 
-    std::vector<int> const tokens = mt_llm_ctx_tokenize(
-        *s->ctx, text, add_special);
+    int64_t const t_prefill_start = ggml_time_us();
+    struct pre_gen pre = { std::vector<int>(), 0, -1, std::vector<float>() };
+    int n_prefill = 0;
+    bool is_decoded = false;
 
-    return static_cast<int>(tokens.size());
+    mt_llm_stats_begin_phase(MT_LLM_STATS_PHASE_PREFILL);
+    mt_llm_side_set_paused(true); // (see generate())
+
+    if(is_spec_valid())
+    {
+        int const tok_cnt_start = s->tok_cnt;
+
+        is_decoded = spec_take(pre);
+        n_prefill = s->tok_cnt - tok_cnt_start; // (also the ones moved)
+    }
+    else
+    {
+        mt_llm_side_cancel();
+
+        // Just the tokens held back (or revised) and the end delimiter are
+        // left to be decoded:
+
+        int const decoded = sync_prompt(true);
+        int const tok_cnt_synced = s->tok_cnt;
+
+        is_decoded = 0 <= decoded && decode_prompt_end(s_prompt_is_initial);
+        n_prefill = decoded + s->tok_cnt - tok_cnt_synced;
+    }
+    s_prompt_is_active = false;
+    if(!is_decoded)
+    {
+        mt_llm_side_standby_hold(false);
+        mt_llm_side_set_paused(false);
+        mt_llm_stats_end_phase(MT_LLM_STATS_PHASE_PREFILL, 0);
+        update_kv_gauges();
+        return false; // (logged)
+    }
+
+    end_prefill(t_prefill_start, n_prefill);
+
+    return generate(pre.toks.empty() ? nullptr : &pre);
 }
 
-MT_EXPORT_LLM_API struct mt_llm_state * __stdcall mt_llm_state_create()
+MT_EXPORT_LLM_API bool __stdcall mt_llm_prompt_commit()
 {
-    struct mt_llm_state * state = nullptr;
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = prompt_commit();
+
+    mt_llm_record_end_commit(t_rec, ret_val);
+    return ret_val;
+}
+
+static int fork_create()
+{
+    struct mt_llm_ctx_guard const guard;
+
+    assert(MT_LLM_FORK_MAX == MT_LLM_CTX_SEQ_FORK_COUNT);
 
     if(s == nullptr)
     {
         MT_LOG_ERR("Not intialized!\n");
-        return nullptr;
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return -1;
     }
 
     assert(s->ctx != nullptr);
+    assert(s->sampler != nullptr);
 
-    size_t const state_size = llama_state_get_size(s->ctx);
-
-    MT_LOG("Serialized state size would be: %zu bytes\n", state_size);
+    int fork = 0;
 
-    state = static_cast<mt_llm_state*>(malloc(sizeof *state));
-    if(state == nullptr)
+    while(fork < MT_LLM_FORK_MAX && s_forks[fork].is_used)
     {
-        MT_LOG_ERR("Failed to allocate state object!\n");
-        return nullptr;
+        ++fork;
+    }
+    if(fork == MT_LLM_FORK_MAX)
+    {
+        MT_LOG_ERR("All %d forks are in use!\n", MT_LLM_FORK_MAX);
+        return -2;
     }
 
-    state->state = static_cast<uint8_t*>(malloc(state_size));
-    if(state->state == nullptr)
+    struct conv_fork & f = s_forks[fork];
+    llama_memory_t const mem = llama_get_memory(s->ctx);
+    llama_seq_id const seq = MT_LLM_CTX_SEQ_FORK_FIRST + fork;
+
+    f.sampler = llama_sampler_clone(s->sampler);
+    if(f.sampler == nullptr)
     {
-        MT_LOG_ERR("Failed to allocate %zu bytes!\n", state_size);
-        free(state);
-        state = nullptr;
-        return nullptr;
+        MT_LOG_ERR("Failed to clone sampler!\n");
+        return -1;
     }
 
-    size_t const written = llama_state_get_data(
-        s->ctx, state->state, state_size);
+    // Let the fork's sequence share the main sequence's entries:
+    //
+    llama_memory_seq_rm(mem, seq, -1, -1);
+    llama_memory_seq_cp(mem, MT_LLM_CTX_SEQ_MAIN, seq, -1, -1);
+
+    f.is_used = true;
+    f.last_tok_type = s->last_tok_type;
+    f.tok_cnt = s->tok_cnt;
+    f.toks = s_toks;
+    f.toks_known = s_toks_known;
+    f.turns = s_turns;
+    return fork;
+}
+
+MT_EXPORT_LLM_API int __stdcall mt_llm_fork()
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    int const ret_val = fork_create();
+    char fork[16];
 
-    if(written != state_size)
+    snprintf(fork, sizeof fork, "%d", ret_val);
+    mt_llm_record_end(t_rec, "fork", 0 <= ret_val, fork);
+    return ret_val;
+}
+
+/**
+ * - Returns nullptr, if there is no fork with given index.
+ */
+static struct conv_fork * get_fork(int const fork)
+{
+    if(fork < 0 || MT_LLM_FORK_MAX <= fork || !s_forks[fork].is_used)
     {
-        MT_LOG_ERR("Failed to write all %zu bytes!\n", state_size);
-        free(state->state);
-        state->state = nullptr;
-        free(state);
-        state = nullptr;
+        MT_LOG_ERR("There is no fork with index %d!\n", fork);
         return nullptr;
     }
-
-    MT_LOG("Successfully copied %zu state bytes to memory.\n", state_size);
-    state->size = state_size;
-    state->last_tok_type = s->last_tok_type;
-    state->tok_cnt = s->tok_cnt;
-    return state; // Caller takes ownership!
+    return s_forks + fork;
 }
 
-MT_EXPORT_LLM_API bool __stdcall mt_llm_state_restore(
-    struct mt_llm_state const * const state)
+static bool fork_switch(int const fork)
 {
-    assert(state != nullptr);
-    assert(state->state != nullptr);
-    assert(0 < state->size);
+    struct mt_llm_ctx_guard const guard;
 
     if(s == nullptr)
     {
         MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
         return false;
     }
 
-    assert(s->ctx != nullptr);
-    
-    size_t const read = llama_state_set_data(s->ctx, state->state, state->size);
+    struct conv_fork * const f = get_fork(fork);
 
-    if(read != state->size)
+    if(f == nullptr)
     {
-        MT_LOG_ERR("Filed to read exactly %zu bytes!\n", state->size);
         return false;
     }
-    s->last_tok_type = state->last_tok_type;
-    s->tok_cnt = state->tok_cnt;
+
+    assert(s->ctx != nullptr);
+
+    llama_memory_t const mem = llama_get_memory(s->ctx);
+    llama_seq_id const seq = MT_LLM_CTX_SEQ_FORK_FIRST + fork;
+
+    mt_llm_side_cancel();
+
+    // Exchange the entries of the main and the fork's sequence via the scratch
+    // sequence (no data gets copied):
+
+    llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+    llama_memory_seq_cp(
+        mem, MT_LLM_CTX_SEQ_MAIN, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+
+    llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_MAIN, -1, -1);
+    llama_memory_seq_cp(mem, seq, MT_LLM_CTX_SEQ_MAIN, -1, -1);
+
+    llama_memory_seq_rm(mem, seq, -1, -1);
+    llama_memory_seq_cp(mem, MT_LLM_CTX_SEQ_SCRATCH, seq, -1, -1);
+
+    llama_memory_seq_rm(mem, MT_LLM_CTX_SEQ_SCRATCH, -1, -1);
+
+    std::swap(s->last_tok_type, f->last_tok_type);
+    std::swap(s->tok_cnt, f->tok_cnt);
+    std::swap(s->sampler, f->sampler);
+    s_toks.swap(f->toks);
+    std::swap(s_toks_known, f->toks_known);
+    s_turns.swap(f->turns);
+    ++s_epoch;
+    update_kv_gauges();
+    precompute_begin();
     return true;
 }
 
-MT_EXPORT_LLM_API bool __stdcall mt_llm_query(char const * const prompt)
+MT_EXPORT_LLM_API bool __stdcall mt_llm_fork_switch(int const fork)
 {
-    if(s == nullptr)
-    {
-        MT_LOG_ERR("Not intialized!\n");
-        return false;
-    }
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = fork_switch(fork);
+    char arg[16];
 
-    assert(s->mt_p != nullptr);
-    assert(s->model != nullptr);
-    assert(s->ctx != nullptr);
-    assert(s->sampler != nullptr);
-    
-    if(s->tok_cnt == 0 && s->mt_p->sys_prompt[0] != '\0')
-    {
-        if(!decode_initial_query(prompt))
-        {
-            return false; // (called function logs on error)
-        }
-    }
-    else
-    {
-        if(!decode_follow_up_query(prompt))
-        {
-            return false; // (called function logs on error)
-        }
-    }
+    snprintf(arg, sizeof arg, "%d", fork);
+    mt_llm_record_end(t_rec, "fork_switch", ret_val, arg);
+    return ret_val;
+}
 
-    if(!inference())
+/** Free the sampler and tokens of given fork and mark it as unused.
+ *
+ * - Does not modify the KV cache.
+ */
+static void free_fork(struct conv_fork & f)
+{
+    if(f.sampler != nullptr)
     {
-        return false; // (called function logs on error)
+        llama_sampler_free(f.sampler);
+        f.sampler = nullptr;
     }
-
-    MT_LOG("Token count: %d.\n", s->tok_cnt);
-    return true;
+    std::vector<int>().swap(f.toks);
+    std::vector<struct turn>().swap(f.turns);
+    f.is_used = false;
 }
 
-MT_EXPORT_LLM_API void __stdcall mt_llm_reset()
+static bool fork_discard(int const fork)
 {
+    struct mt_llm_ctx_guard const guard;
+
     if(s == nullptr)
     {
-        return; // Cannot do anything.
+        MT_LOG_ERR("Not intialized!\n");
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED, 1);
+        return false;
     }
 
-    assert(s->mt_p != nullptr);
-    assert(s->model != nullptr);
-    assert(s->ctx != nullptr);
-    assert(s->sampler != nullptr);
+    struct conv_fork * const f = get_fork(fork);
 
+    if(f == nullptr)
     {
-        llama_memory_t kv = llama_get_memory(s->ctx);
-
-        if(kv != nullptr)
-        {
-            llama_memory_clear(kv, true);
-            kv = nullptr;
-        }
+        return false;
     }
 
-    llama_sampler_reset(s->sampler);
+    assert(s->ctx != nullptr);
 
-    s->last_tok_type = 0;
-    s->tok_cnt = 0;
+    llama_memory_seq_rm(
+        llama_get_memory(s->ctx), MT_LLM_CTX_SEQ_FORK_FIRST + fork, -1, -1);
+    free_fork(*f);
+    return true;
 }
 
-MT_EXPORT_LLM_API void __stdcall mt_llm_deinit()
+MT_EXPORT_LLM_API bool __stdcall mt_llm_fork_discard(int const fork)
 {
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = fork_discard(fork);
+    char arg[16];
+
+    snprintf(arg, sizeof arg, "%d", fork);
+    mt_llm_record_end(t_rec, "fork_discard", ret_val, arg);
+    return ret_val;
+}
+
+static void deinit()
+{
+    mt_llm_side_deinit(); // (needs the context)
+    mt_llm_snapshot_async_stop(); // (needs the context)
+    mt_llm_snapshot_file_stop(); // (files hold copies of states, only)
+
     if(s == nullptr)
     {
-        return; // Just do nothing.
+        mt_llm_log_stop(); // (e.g. started by a failed initialization)
+        return; // Just do nothing else.
     }
 
     if(s->mt_p != nullptr)
@@ -828,6 +3009,10 @@ MT_EXPORT_LLM_API void __stdcall mt_llm_deinit()
         llama_sampler_free(s->sampler);
         s->sampler = nullptr;
     }
+    for(int i = 0; i < MT_LLM_FORK_MAX; ++i) // (before freeing the model)
+    {
+        free_fork(s_forks[i]);
+    }
     if(s->model != nullptr)
     {
         llama_model_free(s->model);
@@ -837,17 +3022,37 @@ MT_EXPORT_LLM_API void __stdcall mt_llm_deinit()
 
     free(s);
     s = nullptr;
+    update_kv_gauges();
+
+    free(s_decoded);
+    s_decoded = nullptr;
+    s_decoded_capacity = 0;
+    mt_llm_state_io_free();
+
+    std::vector<int>().swap(s_toks);
+    s_toks_known = true;
+    std::vector<struct turn>().swap(s_turns);
+    std::vector<struct answer_tok>().swap(s_answer);
+    s_prompt_is_active = false;
+    std::string().swap(s_prompt_text);
+    std::vector<int>().swap(s_prompt_toks);
+    std::string().swap(s_spec_text);
+    mt_llm_prefix_cache_free(); // (KV cache entries depend on the model)
+
+    mt_llm_log_stop(); // Flushes the log messages.
 }
 
-MT_EXPORT_LLM_API bool __stdcall mt_llm_reinit(
-    struct mt_llm_p const * const mt_p)
+MT_EXPORT_LLM_API void __stdcall mt_llm_deinit()
 {
-    //common_init(); // Not calling this, seems to work anyway..
+    int64_t const t_rec = mt_llm_record_begin();
 
-    common_log_pause(common_log_main());
-    //
-    //static void llama_log_callback_null(ggml_log_level level, const char * text, void * user_data) { (void) level; (void) text; (void) user_data; }
-    //llama_log_set(llama_log_callback_null, NULL);
+    deinit();
+    mt_llm_record_end(t_rec, "deinit", true, nullptr);
+}
+
+static bool reinit(struct mt_llm_p const * const mt_p)
+{
+    //common_init(); // Not calling this, seems to work anyway..
 
     if(s != nullptr)
     {
@@ -870,6 +3075,11 @@ MT_EXPORT_LLM_API bool __stdcall mt_llm_reinit(
         return false;
     }
 
+    // Log asynchronously from here on (also routes llama.cpp's messages),
+    // stopped by mt_llm_deinit(), also on error:
+    //
+    mt_llm_log_start();
+
     s->mt_p = mt_llm_p_create_copy(*mt_p);
     if(s->mt_p == nullptr)
     {
@@ -952,6 +3162,7 @@ MT_EXPORT_LLM_API bool __stdcall mt_llm_reinit(
         mt_llm_deinit();
         return false;
     }
+    mt_llm_side_init(*s);
 
     {
         int32_t const n_ctx_train = llama_model_n_ctx_train(s->model),
@@ -977,6 +3188,29 @@ MT_EXPORT_LLM_API bool __stdcall mt_llm_reinit(
 
     s->last_tok_type = 0;
     s->tok_cnt = 0;
+    ++s_epoch;
+    update_kv_gauges();
+
+    mt_llm_stats_reset_latency(); // Statistics are per session.
+    mt_llm_stats_reset_hw();
 
+    {
+        struct mt_llm_ctx_guard const guard;
+
+        if(!standby_begin())
+        {
+            precompute_begin(); // (e.g. the system prompt block)
+        }
+    }
     return true;
 }
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_reinit(
+    struct mt_llm_p const * const mt_p)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = reinit(mt_p);
+
+    mt_llm_record_end_reinit(t_rec, ret_val, *mt_p);
+    return ret_val;
+}
@@ -10,13 +10,29 @@
 
 #ifdef __cplusplus
     #include <cstdbool>
+    #include <cstddef>
     #include <cstdint>
 #else //__cplusplus
     #include <stdbool.h>
+    #include <stddef.h>
     #include <stdint.h>
 #endif //__cplusplus
 
 #include "mt_llm_p.h"
+#include "mt_llm_mem_info.h"
+
+// Serialized state, as written by mt_llm_state_write_to() and
+// mt_llm_state_write_stream() (all values in host byte order):
+//
+// - 4 bytes: Token count (see mt_llm_state).
+// - 4 bytes: Type of the last token (see mt_llm_state).
+// - State data (as given by llama.cpp for the sequence used).
+//
+#define MT_LLM_STATE_SERIALIZED_HEADER_SIZE 8
+
+// Maximum count of forks existing at the same time (see mt_llm_fork()):
+//
+#define MT_LLM_FORK_MAX 4
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,17 +55,285 @@ MT_EXPORT_LLM_API struct mt_llm_state * __stdcall mt_llm_state_create();
 /**
  * - Returns false and does nothing, if not initialized.
  * - Assumes non-nullptr given and object to hold valid values.
+ * - Also accepts encoded states (see mt_llm_state_codec.h), which get decoded
+ *   into a buffer kept for reuse until de-initialization.
  * - If false is returned because of failed read attempt, the state of the
  *   context is unknown..
  */
 MT_EXPORT_LLM_API bool __stdcall mt_llm_state_restore(
     struct mt_llm_state const * const state);
 
+/** Returns the size of the current state, serialized (see
+ *  mt_llm_state_write_to()).
+ *
+ * - Returns 0, if not initialized.
+ */
+MT_EXPORT_LLM_API size_t __stdcall mt_llm_state_get_size();
+
+/** Write the current state (serialized, see
+ *  MT_LLM_STATE_SERIALIZED_HEADER_SIZE) into given buffer owned by the caller,
+ *  which has given capacity (in bytes).
+ *
+ * - llama.cpp copies the KV cache entries directly into given buffer.
+ * - Returns the count of bytes written.
+ * - Returns 0 and does nothing, if not initialized, if given capacity is too
+ *   small (see mt_llm_state_get_size()) or on error.
+ */
+MT_EXPORT_LLM_API size_t __stdcall mt_llm_state_write_to(
+    uint8_t * const buf, size_t const capacity);
+
+/** Write the current state (serialized, see
+ *  MT_LLM_STATE_SERIALIZED_HEADER_SIZE) to given function, in parts.
+ *
+ * - The function gets called with given user pointer, the data and its size
+ *   and must return false on error.
+ * - The KV cache entries are copied in parts of at most 1 MiB via a buffer
+ *   kept just during the call, so the whole state is never held in RAM.
+ * - Returns the count of bytes written.
+ * - Returns 0, if not initialized, if the function returned false or on error.
+ */
+MT_EXPORT_LLM_API size_t __stdcall mt_llm_state_write_stream(
+    bool(*write)(void *, uint8_t const *, size_t), void * const user);
+
+/** Restore the state from given buffer (as written by mt_llm_state_write_to()
+ *  or mt_llm_state_write_stream()) of given size.
+ *
+ * - llama.cpp reads the KV cache entries directly from given buffer (without
+ *   copying it, first), which may also be read-only (e.g. memory-mapped).
+ * - Returns false, if not initialized, if given data is invalid or on error
+ *   (like mt_llm_state_restore()).
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_state_read_from(
+    uint8_t const * const buf, size_t const size);
+
+/** Restore the state from given function (reading data written by
+ *  mt_llm_state_write_to() or mt_llm_state_write_stream()).
+ *
+ * - The function gets called with given user pointer, a buffer and its size
+ *   and must fill the buffer completely or return false.
+ * - Reads exactly the bytes of the state (so the stream may hold more data).
+ * - Just the data of a single tensor (e.g. the K values of one layer) gets
+ *   buffered, in a buffer kept for reuse until de-initialization.
+ * - Returns false, if not initialized, if the function returned false or on
+ *   error (then the context is empty).
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_state_read_stream(
+    bool(*read)(void *, uint8_t *, size_t), void * const user);
+
+/** Retrieve the current memory usage of model, KV cache, compute buffers and
+ *  snapshots, as well as of the whole process.
+ *
+ * - Returns false and does nothing, if not initialized or nullptr given.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_get_memory_info(
+    struct mt_llm_memory_info * const out);
+
 /**
  * - Returns false and does nothing, if not initialized.
  */
 MT_EXPORT_LLM_API bool __stdcall mt_llm_query(char const * const prompt);
 
+/** Begin a query, whose prompt gets added while it is still being spoken (e.g.
+ *  from the partial transcripts of speech-to-text), so just its last tokens
+ *  are left to be decoded, when it is complete (see mt_llm_prompt_commit()).
+ *
+ * - Decodes the delimiters (and the system prompt) preceding the prompt.
+ * - Use mt_llm_rollback() with 1 to cancel the query.
+ * - mt_llm_query() fails, until the query gets committed or cancelled.
+ * - Modifying the context otherwise (e.g. by a reset) cancels the query
+ *   implicitly.
+ * - Returns false, if not initialized, if a query is begun, already, or on
+ *   error.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_prompt_begin();
+
+/** Append given text to the prompt of the query begun (see
+ *  mt_llm_prompt_begin()) and decode the new tokens.
+ *
+ * - The tokens of the last word (which may change with text appended) are
+ *   held back.
+ * - The callback gets called for the tokens decoded (like by mt_llm_query()).
+ * - Returns false, if not initialized, if no query is begun or on error.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_prompt_append(char const * const text);
+
+/** Like mt_llm_prompt_append(), but replace the whole text of the prompt with
+ *  given text (e.g. if speech-to-text revised former words).
+ *
+ * - Removes the tokens decoded, that differ from the new ones (and all tokens
+ *   following them), and decodes the new ones.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_prompt_replace(char const * const text);
+
+/** Start generating the answer to the prompt of the query begun (see
+ *  mt_llm_prompt_begin()) in the background, as if the prompt got committed
+ *  now (e.g. if the partial transcript did not change for a while).
+ *
+ * - The tokens of the whole text (none held back), the delimiter following
+ *   the prompt and the answer get decoded into a side sequence of the
+ *   context by a background thread, one token at a time.
+ * - If mt_llm_prompt_commit() gets called without the prompt's text being
+ *   changed, the side sequence's entries get used: The callback gets called
+ *   for the tokens generated, at once, and the generation continues after
+ *   them.
+ * - Changing the prompt's text (or modifying the context otherwise) discards
+ *   the side sequence's entries.
+ * - CPU budget: At most given count of tokens get generated, with the count
+ *   of threads set via mt_llm_set_background_threads(). The context is held
+ *   just for decoding a single token, so other calls wait for one token, at
+ *   most.
+ * - Returns false, if not initialized, if no query is begun, if the prompt is
+ *   empty, if given count is not positive or on error.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_prompt_speculate(int const max_tokens);
+
+/** Complete the prompt of the query begun (see mt_llm_prompt_begin()) and run
+ *  inference, like mt_llm_query() does.
+ *
+ * - Just the tokens held back and the delimiter following the prompt are left
+ *   to be decoded (if not decoded speculatively, already, see
+ *   mt_llm_prompt_speculate()).
+ * - Returns false, if not initialized, if no query is begun, if the prompt is
+ *   empty (then the query stays begun) or on error.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_prompt_commit();
+
+/** Set, if the tokens known ahead of time are to be decoded in the background
+ *  while the LLM is idle, so the next query starts from a warm context: The
+ *  delimiter preceding the next prompt (e.g. after an answer) or the whole
+ *  system prompt block (after a reset or initialization).
+ *
+ * - The tokens get decoded into a side sequence of the context by a
+ *   background thread, one token at a time (see
+ *   mt_llm_set_background_threads()).
+ * - The next query (see mt_llm_query() and mt_llm_prompt_begin()) waits for
+ *   one token, at most, then uses the tokens decoded, so far (the callback
+ *   gets called for them) and decodes the ones left.
+ * - Disabled by default.
+ * - Can also be called, if not initialized.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_set_precompute(bool const precompute);
+
+/** Set, if the tokens to precede the first prompt after a reset (the system
+ *  prompt block) are to be kept decoded in a standby sequence of the context,
+ *  so a reset followed by a query does not need to decode them again (e.g.
+ *  for a new visitor of a kiosk).
+ *
+ * - The standby sequence gets filled in the background after initialization
+ *   (or after calling this), one token at a time (see
+ *   mt_llm_set_background_threads()), but not while an answer gets generated.
+ * - The first query after a reset (see mt_llm_query() and
+ *   mt_llm_prompt_begin()) lets the main sequence share the standby's entries
+ *   (the callback gets called for their tokens, without copying data) and
+ *   decodes the tokens not in the standby, yet, if any.
+ * - The standby keeps its entries, so it does not need to be filled again.
+ *   It occupies cells of the context for the block, while not shared with
+ *   the main sequence.
+ * - Disabled by default.
+ * - Can also be called, if not initialized.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_set_standby(bool const standby);
+
+/** Set the count of threads to be used by llama.cpp, while decoding in the
+ *  background (see mt_llm_prompt_speculate(), mt_llm_set_precompute() and
+ *  mt_llm_set_standby()), e.g. to keep cores free for speech-to-text.
+ *
+ * - 0 means the count of threads of the parameters (see mt_llm_p).
+ * - 1 by default.
+ * - Can also be called, if not initialized.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_set_background_threads(
+    int const threads);
+
+/** Set, if the KV cache entries of the thinking spans sampled by reasoning
+ *  models (see think_beg_delim and think_end_delim of mt_llm_p) are to be
+ *  removed from the context at the end of each turn, keeping just the answer
+ *  (like the chat templates of such models usually do for former turns).
+ *
+ * - The entries of the tokens following a span get moved to close the gap.
+ * - A span not ended (e.g. because of an interrupt) is kept.
+ * - Not done for models, whose KV cache does not support moving entries.
+ * - Disabled by default.
+ * - Can also be called, if not initialized.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_set_evict_thinking(bool const evict);
+
+/** Remove the given count of last turns (each started by mt_llm_query()) from
+ *  the context, e.g. to undo or regenerate the last answer.
+ *
+ * - Just removes the KV cache entries of the turns' tokens (no state gets
+ *   restored, so this is fast).
+ * - The sampler gets reset and given the tokens kept again, if they are known
+ *   (not after restoring a state or snapshot until the next reset). Its random
+ *   number generator is not rewound, so a regenerated answer may differ.
+ * - Just the turns since the last reset or restoring of a state or snapshot
+ *   are known (see mt_llm_get_turn_count()).
+ * - Returns false and does nothing, if not initialized or if fewer turns are
+ *   known.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_rollback(int const n_turns);
+
+/** Get the count of turns known (see mt_llm_rollback()).
+ *
+ * - Returns -1, if not initialized.
+ */
+MT_EXPORT_LLM_API int __stdcall mt_llm_get_turn_count();
+
+/** Make the context consistent with what the user actually heard of the last
+ *  answer (e.g. if text-to-speech got interrupted): Remove the tokens of the
+ *  answer following the last one heard (also the interrupt marker, if the
+ *  answer was interrupted) and append the interrupt marker (like an interrupt
+ *  requested by the callback does).
+ *
+ * - Given length is the count of bytes heard of the answer's text (the pieces
+ *   given to the callback with token type
+ *   MT_TOK_TYPE_SAMPLED_NON_EOG_NON_CONTROL). The token including the last
+ *   byte heard is kept. If zero, the whole answer gets removed.
+ * - No tokens of the answer get decoded again, the callback gets called for
+ *   the interrupt marker's tokens, only.
+ * - The sampler gets rewound like by mt_llm_rollback().
+ * - Must be called before modifying the context otherwise (e.g. by another
+ *   query, a reset, a rollback or by switching forks).
+ * - Returns false, if not initialized, if the context was modified or on
+ *   error.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_barge_in(size_t const heard_len);
+
+/** Clone the current conversation into a new fork, which can be switched to
+ *  later (e.g. to explore alternatives from the same point).
+ *
+ * - The fork shares the KV cache entries of the current conversation (no data
+ *   gets copied, so this is fast), just the sampler's state gets cloned.
+ * - The entries of tokens added later to either of the conversations are not
+ *   shared and take space in the context (whose length is shared by the
+ *   current conversation and all forks).
+ * - Forks are kept by mt_llm_reset() and by restoring states or snapshots
+ *   (which just replace the current conversation).
+ * - Returns the index of the fork (less than MT_LLM_FORK_MAX).
+ * - Returns -1, if not initialized or on error.
+ * - Returns -2, if MT_LLM_FORK_MAX forks exist, already.
+ */
+MT_EXPORT_LLM_API int __stdcall mt_llm_fork();
+
+/** Exchange the current conversation with the one of the fork with given
+ *  index (see mt_llm_fork()).
+ *
+ * - The former current conversation is held by the fork afterwards, so
+ *   switching again with the same index switches back.
+ * - No data gets copied.
+ * - Returns false and does nothing, if not initialized or if there is no fork
+ *   with given index.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_fork_switch(int const fork);
+
+/** Discard the fork with given index (see mt_llm_fork()), freeing the KV
+ *  cache entries not shared with other conversations.
+ *
+ * - Returns false and does nothing, if not initialized or if there is no fork
+ *   with given index.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_fork_discard(int const fork);
+
 /** Reset state, as if the model just got loaded.
  *
  * - Does nothing, if singleton is not initialized.
@@ -71,4 +355,103 @@ MT_EXPORT_LLM_API bool __stdcall mt_llm_reinit(
 }
 #endif //__cplusplus
 
+// The following functions are used internally and are not pure-C:
+//
+#ifdef __cplusplus/*MT_EXPORT_LLM*/
+
+#include "mt_llm_state.h"
+
+/** Copy the current state into the buffer of given state object, which has
+ *  given capacity (in bytes).
+ *
+ * - Reallocates the buffer (and updates the capacity), only if it is too small.
+ * - Keeps the buffer (and its capacity), on error.
+ * - Returns false and does nothing, if not initialized.
+ */
+bool mt_llm_state_fill(struct mt_llm_state & state, size_t & capacity);
+
+/** Like mt_llm_state_fill(), but just for the KV cache entries of the tokens
+ *  at given and following positions (a "delta" to a state holding the tokens
+ *  before given position).
+ */
+bool mt_llm_state_fill_delta(
+    struct mt_llm_state & state, size_t & capacity, int const pos_beg);
+
+/** Like mt_llm_state_fill_delta(), but just for the tokens before given end
+ *  position (like mt_llm_state_fill_delta(), if negative).
+ */
+bool mt_llm_state_fill_range(
+    struct mt_llm_state & state,
+    size_t & capacity,
+    int const pos_beg,
+    int const pos_end);
+
+/** Add the KV cache entries of given delta state (see
+ *  mt_llm_state_fill_delta()) to the context.
+ *
+ * - Also accepts encoded states (like mt_llm_state_restore()).
+ * - The context must hold exactly the tokens before the delta's first
+ *   position, as stored when the delta was created (e.g. after restoring the
+ *   state the delta was based on).
+ * - Returns false and does nothing, if not initialized.
+ */
+bool mt_llm_state_restore_delta(struct mt_llm_state const & state);
+
+/** Add the KV cache entries of the tokens at given and following positions
+ *  before given end position of given state (see mt_llm_state_fill_range())
+ *  to the context.
+ *
+ * - Also accepts encoded states (like mt_llm_state_restore()).
+ * - The context must hold exactly the tokens before given position (with the
+ *   same KV cache entries as the tokens the state was based on).
+ * - Just modifies the KV cache (not the token count and type or the sampler,
+ *   which is left to the caller).
+ * - Returns false and does nothing, if not initialized.
+ */
+bool mt_llm_state_restore_range(
+    struct mt_llm_state const & state, int const pos_beg, int const pos_end);
+
+/** Let the pinned sequence with given index (less than
+ *  MT_LLM_CTX_SEQ_PIN_COUNT) share the current KV cache entries of the tokens
+ *  at given and following positions (of all tokens, if negative).
+ *
+ * - No data gets copied, so this is fast (the entries stay in the context,
+ *   until mt_llm_state_fill_pinned() gets called).
+ * - Sets the token count and type of given state object to the current ones.
+ * - Returns false and does nothing, if not initialized.
+ */
+bool mt_llm_state_pin(
+    int const pin, int const pos_beg, struct mt_llm_state & out);
+
+/** Like mt_llm_state_fill() for the entries of the pinned sequence with given
+ *  index (see mt_llm_state_pin()), which gets emptied afterwards (also on
+ *  error).
+ *
+ * - Can be called from any thread, while the LLM gets used: The lock of the
+ *   context is given to the thread using the LLM between the parts of data
+ *   copied (see mt_llm_ctx_yield()).
+ * - Does not modify the token count and type of given state object.
+ */
+bool mt_llm_state_fill_pinned(
+    struct mt_llm_state & state, size_t & capacity, int const pin);
+
+/** Get the current epoch and count of tokens in the context.
+ *
+ * - The epoch changes each time the tokens in the context get changed other
+ *   than by appending (e.g. by a reset or by restoring a state). So if it did
+ *   not change, the tokens held at an earlier point in time are still the
+ *   first tokens in the context.
+ * - Returns false, if not initialized.
+ */
+bool mt_llm_get_history(uint64_t & epoch, int & tok_cnt);
+
+/** Get the fingerprint of the model in use (see
+ *  mt_llm_model_get_fingerprint()).
+ *
+ * - Returns false and does nothing, if not initialized.
+ */
+bool mt_llm_get_model_fingerprint(uint64_t & out);
+
+#endif //__cplusplus/*MT_EXPORT_LLM*/
+
 #endif //MT_LLM
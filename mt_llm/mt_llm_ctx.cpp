@@ -2,15 +2,30 @@
 // Marcel Timm, RhinoDevel, 2024aug21
 
 #include <cstdio>
+#include <cstdint>
 #include <cassert>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include "llama.h"
 #include "common.h"
+#include "llama-memory.h"
 
 #include "mt_llm_p.h"
 #include "mt_llm_ctx.h"
 #include "mt_llm_log.h"
 
+// Guards the following (a ticket lock, see mt_llm_ctx_lock()):
+//
+static std::mutex s_lock_mutex;
+static std::condition_variable s_lock_cond; // Signals changes of the following.
+//
+static uint64_t s_ticket_next = 0; // To be given to the next thread asking.
+static uint64_t s_ticket_serving = 0; // Of the thread holding or to hold lock.
+static std::thread::id s_owner; // Thread holding the lock (if any).
+static int s_depth = 0; // Count of nested locks by the owner (0 = Unlocked).
+
 static llama_context_params get_ctx_params(mt_llm_p const & mt_p)
 {
     llama_context_params ret_val = llama_context_default_params();
@@ -25,7 +40,13 @@ static llama_context_params get_ctx_params(mt_llm_p const & mt_p)
     //
     ret_val.n_batch = 1; // Logical max. batch size.
     ret_val.n_ubatch = 1; // Physical max. batch size.
-    ret_val.n_seq_max = 1; // Max. number of sequences.
+    ret_val.n_seq_max = MT_LLM_CTX_SEQ_COUNT; // Max. number of sequences.
+
+    // All sequences share the same KV cache (otherwise each sequence would get
+    // its own part of the context length and copying between sequences would
+    // copy the data):
+    //
+    ret_val.kv_unified = true;
 
     return ret_val;
 }
@@ -44,7 +65,8 @@ static bool decode_single_token(
 {
     llama_batch b = llama_batch_init(1, 0, 1);
 
-    common_batch_add(b, tok, existing_token_count, { 0 }, output_logits);
+    common_batch_add(
+        b, tok, existing_token_count, { MT_LLM_CTX_SEQ_MAIN }, output_logits);
 
     if (llama_decode(ctx, b) != 0)
     {
@@ -136,6 +158,8 @@ bool mt_llm_ctx_decode(
             return false; // (called function logged)
         }
 
+        mt_llm_ctx_yield(); // (e.g. to let async. snapshots make progress)
+
         if(callback != nullptr)
         {
             callback( // (return value ignored)
@@ -167,12 +191,10 @@ std::vector<int> mt_llm_ctx_tokenize(
                //    special tokens.
 }
 
-int mt_llm_ctx_decode(
-        llama_context& ctx,
-        llama_sampler& sampler,
-        int const existing_token_count,
-        char const * const str,
-        bool(*callback)(llama_token, std::string const &, std::vector<float> const &))
+std::vector<int> mt_llm_ctx_tokenize_for(
+    llama_context const & ctx,
+    int const existing_token_count,
+    char const * const str)
 {
     assert( // TODO: Can be removed, if "BUG" below is fixed!
         !llama_vocab_get_add_eos(
@@ -182,7 +204,7 @@ int mt_llm_ctx_decode(
     // Tokenize the given string (while automatically adding a BOS token at the
     // beginning, if required by the model and the context is empty):
     //
-    std::vector<int> const tokens = mt_llm_ctx_tokenize(
+    return mt_llm_ctx_tokenize(
         ctx,
         str,
 
@@ -195,6 +217,17 @@ int mt_llm_ctx_decode(
             && llama_vocab_get_add_bos( // <- Unnecessary (llama.cpp does this).
                 llama_model_get_vocab(
                     llama_get_model(&ctx))));
+}
+
+int mt_llm_ctx_decode(
+        llama_context& ctx,
+        llama_sampler& sampler,
+        int const existing_token_count,
+        char const * const str,
+        bool(*callback)(llama_token, std::string const &, std::vector<float> const &))
+{
+    std::vector<int> const tokens = mt_llm_ctx_tokenize_for(
+        ctx, existing_token_count, str);
 
     if(!mt_llm_ctx_decode(
             ctx,
@@ -208,6 +241,106 @@ int mt_llm_ctx_decode(
     return static_cast<int>(tokens.size());
 }
 
+/**
+ * - Mutex must be locked via given lock.
+ */
+static void wait_for_turn(std::unique_lock<std::mutex> & lock)
+{
+    uint64_t const ticket = s_ticket_next++;
+
+    s_lock_cond.wait(lock, [ticket]() { return s_ticket_serving == ticket; });
+    s_owner = std::this_thread::get_id();
+}
+
+/**
+ * - Mutex must be locked.
+ */
+static void end_turn()
+{
+    s_owner = std::thread::id();
+    s_depth = 0;
+    ++s_ticket_serving;
+    s_lock_cond.notify_all();
+}
+
+void mt_llm_ctx_lock()
+{
+    std::unique_lock<std::mutex> lock(s_lock_mutex);
+
+    if(0 < s_depth && s_owner == std::this_thread::get_id())
+    {
+        ++s_depth;
+        return;
+    }
+    wait_for_turn(lock);
+    s_depth = 1;
+}
+
+void mt_llm_ctx_unlock()
+{
+    std::lock_guard<std::mutex> const lock(s_lock_mutex);
+
+    assert(0 < s_depth && s_owner == std::this_thread::get_id());
+
+    --s_depth;
+    if(s_depth == 0)
+    {
+        end_turn();
+    }
+}
+
+bool mt_llm_ctx_yield()
+{
+    std::unique_lock<std::mutex> lock(s_lock_mutex);
+
+    if(s_depth == 0
+        || s_owner != std::this_thread::get_id()
+        || s_ticket_next == s_ticket_serving + 1) // (nobody is waiting)
+    {
+        return false;
+    }
+
+    int const depth = s_depth;
+
+    end_turn();
+    wait_for_turn(lock);
+    s_depth = depth;
+    return true;
+}
+
+bool mt_llm_ctx_apply_memory_update(llama_context & ctx)
+{
+    llama_memory_t const mem = llama_get_memory(&ctx);
+
+    if(mem == nullptr)
+    {
+        return true; // Nothing to do.
+    }
+
+    // Like llama.cpp does before decoding:
+
+    llama_memory_context_ptr const mctx = mem->init_update(&ctx, false);
+
+    switch(mctx->get_status())
+    {
+        case LLAMA_MEMORY_STATUS_SUCCESS:
+            break;
+
+        case LLAMA_MEMORY_STATUS_NO_UPDATE:
+            return true; // Nothing to do.
+
+        default:
+            MT_LOG_ERR("Failed to prepare memory update!\n");
+            return false;
+    }
+    if(!mctx->apply())
+    {
+        MT_LOG_ERR("Failed to apply memory update!\n");
+        return false;
+    }
+    return true;
+}
+
 llama_context* mt_llm_ctx_create(
     mt_llm_p const & mt_p, llama_model& model)
 {
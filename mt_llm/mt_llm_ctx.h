@@ -9,9 +9,34 @@
 
 #include "mt_llm_p.h"
 
+// Sequences of the context (could be an enum):
+//
+#define MT_LLM_CTX_SEQ_MAIN 0 // Holds the conversation.
+#define MT_LLM_CTX_SEQ_SCRATCH 1 // Used temporarily (e.g. for delta states).
+#define MT_LLM_CTX_SEQ_PIN_FIRST 2 // Pin the entries of async. snapshots.
+#define MT_LLM_CTX_SEQ_FORK_FIRST 4 // Hold the conversations of forks.
+#define MT_LLM_CTX_SEQ_SIDE 8 // Decoded to in the background.
+#define MT_LLM_CTX_SEQ_STANDBY 9 // Holds the system prompt block for resets.
+//
+#define MT_LLM_CTX_SEQ_PIN_COUNT 2
+#define MT_LLM_CTX_SEQ_FORK_COUNT 4 // (see MT_LLM_FORK_MAX)
+//
+#define MT_LLM_CTX_SEQ_COUNT (MT_LLM_CTX_SEQ_STANDBY + 1)
+
 std::vector<int> mt_llm_ctx_tokenize(
     llama_context const & ctx, char const * const str, bool const add_special);
 
+/** Tokenize given string to be decoded after given count of existing tokens
+ *  (see mt_llm_ctx_decode()).
+ *
+ * - Prepends BOS token, if existing token count is zero and model meta data
+ *   says so.
+ */
+std::vector<int> mt_llm_ctx_tokenize_for(
+    llama_context const & ctx,
+    int const existing_token_count,
+    char const * const str);
+
 std::string mt_llm_ctx_get_piece_from(
     llama_context& ctx, llama_token const tok);
 
@@ -43,6 +68,49 @@ int mt_llm_ctx_decode(
         char const * const str,
         bool(*callback)(llama_token, std::string const &, std::vector<float> const &));
 
+/** Apply the pending updates of the context's KV cache (e.g. shifting the keys
+ *  of entries moved via llama_memory_seq_add()), which llama.cpp would apply
+ *  with the next decoding, otherwise.
+ *
+ * - To be used before entries moved get serialized, which would store them
+ *   with their new positions, but with keys not shifted, yet.
+ */
+bool mt_llm_ctx_apply_memory_update(llama_context & ctx);
+
+/** Lock the context for the calling thread.
+ *
+ * - The context is used by the thread that uses the LLM and by the background
+ *   thread of the snapshot store, which copies the KV cache entries of pinned
+ *   sequences (see mt_llm_snapshot_slot_update_async()).
+ * - Re-entrant: Nested calls by the thread holding the lock just count.
+ * - Waiting threads get the lock in the order they asked for it.
+ */
+void mt_llm_ctx_lock();
+
+/** Undo one call of mt_llm_ctx_lock().
+ */
+void mt_llm_ctx_unlock();
+
+/** Let the threads waiting for the context (if any) have it for their turn,
+ *  before continuing.
+ *
+ * - Does nothing, if the calling thread does not hold the lock.
+ * - Returns true, if the lock was given away (the context may have been used
+ *   meanwhile).
+ */
+bool mt_llm_ctx_yield();
+
+/** Holds the lock of the context during its lifetime.
+ */
+struct mt_llm_ctx_guard
+{
+    mt_llm_ctx_guard() { mt_llm_ctx_lock(); }
+    ~mt_llm_ctx_guard() { mt_llm_ctx_unlock(); }
+
+    mt_llm_ctx_guard(mt_llm_ctx_guard const &) = delete;
+    mt_llm_ctx_guard & operator=(mt_llm_ctx_guard const &) = delete;
+};
+
 /** Initialize the model.
  * 
  *  - Caller takes ownership of created object.
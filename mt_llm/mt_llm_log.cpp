@@ -0,0 +1,338 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdarg>
+#include <cstring>
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#include "log.h"
+#include "llama.h"
+
+#include "mt_llm_log.h"
+
+// Must be a power of two:
+#define MT_LLM_LOG_SLOT_COUNT 256
+
+// Longer messages get truncated:
+#define MT_LLM_LOG_MSG_LEN (511 + 1)
+
+// How long the background thread sleeps at most, when there is nothing to do:
+#define MT_LLM_LOG_IDLE_MS 20
+
+struct slot
+{
+    std::atomic<size_t> seq;
+    int level;
+    char msg[MT_LLM_LOG_MSG_LEN];
+};
+
+/** Bounded multi-producer ring buffer (after Dmitry Vyukov), drained by a
+ *  single consumer (the background thread).
+ */
+struct ring
+{
+    slot slots[MT_LLM_LOG_SLOT_COUNT];
+
+    std::atomic<size_t> enq_pos;
+    size_t deq_pos; // Used by the consumer, only.
+
+    ring() : enq_pos(0), deq_pos(0)
+    {
+        for(size_t i = 0; i < MT_LLM_LOG_SLOT_COUNT; ++i)
+        {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+};
+
+static std::atomic<int> s_level(MT_LOG_LEVEL_INFO);
+static std::atomic<void(*)(int, char const *)> s_sink(nullptr);
+
+static std::atomic<uint64_t> s_dropped(0);
+static std::atomic<uint64_t> s_enqueued(0);
+static std::atomic<uint64_t> s_done(0);
+
+static std::atomic<bool> s_is_async(false);
+static std::atomic<bool> s_stop(false);
+// Pointer, as a still running std::thread object must not get destroyed (e.g.
+// at process exit without mt_llm_deinit() called):
+static std::thread * s_thread = nullptr;
+static std::mutex s_wake_mtx;
+static std::condition_variable s_wake;
+
+// For llama.cpp's continuation messages (GGML_LOG_LEVEL_CONT):
+static thread_local int s_llama_last_level = MT_LOG_LEVEL_INFO;
+
+static ring & get_ring()
+{
+    static ring r; // (initialization is thread-safe)
+
+    return r;
+}
+
+static void default_sink(int const level, char const * const msg)
+{
+    FILE * const f = level <= MT_LOG_LEVEL_WARN ? stderr : stdout;
+
+    fputs(msg, f);
+    fflush(f);
+}
+
+static void give_to_sink(int const level, char const * const msg)
+{
+    void(* const sink)(int, char const *) = s_sink.load(
+        std::memory_order_acquire);
+
+    if(sink == nullptr)
+    {
+        default_sink(level, msg);
+        return;
+    }
+    sink(level, msg);
+}
+
+/**
+ * - Returns false, if the ring buffer is full.
+ */
+static bool try_enqueue(int const level, char const * const msg)
+{
+    ring & r = get_ring();
+    size_t pos = r.enq_pos.load(std::memory_order_relaxed);
+    slot * cur = nullptr;
+
+    while(true)
+    {
+        cur = &r.slots[pos & (MT_LLM_LOG_SLOT_COUNT - 1)];
+
+        size_t const seq = cur->seq.load(std::memory_order_acquire);
+        intptr_t const dif =
+            static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+        if(dif == 0)
+        {
+            if(r.enq_pos.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed))
+            {
+                break; // Got the slot.
+            }
+            continue; // (pos got updated by compare_exchange_weak())
+        }
+        if(dif < 0)
+        {
+            return false; // Full.
+        }
+        pos = r.enq_pos.load(std::memory_order_relaxed);
+    }
+
+    cur->level = level;
+    strncpy(cur->msg, msg, MT_LLM_LOG_MSG_LEN - 1);
+    cur->msg[MT_LLM_LOG_MSG_LEN - 1] = '\0';
+    cur->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * - To be called by the consumer, only.
+ * - Returns false, if the ring buffer is empty.
+ */
+static bool try_dequeue_to_sink()
+{
+    ring & r = get_ring();
+    slot & cur = r.slots[r.deq_pos & (MT_LLM_LOG_SLOT_COUNT - 1)];
+
+    if(cur.seq.load(std::memory_order_acquire) != r.deq_pos + 1)
+    {
+        return false; // Empty (or the next message is not written, yet).
+    }
+
+    give_to_sink(cur.level, cur.msg);
+
+    cur.seq.store(r.deq_pos + MT_LLM_LOG_SLOT_COUNT, std::memory_order_release);
+    ++r.deq_pos;
+    s_done.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+static void thread_func()
+{
+    while(true)
+    {
+        while(try_dequeue_to_sink())
+        {
+            // (nothing else to do)
+        }
+
+        if(s_stop.load(std::memory_order_acquire))
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(s_wake_mtx);
+
+        s_wake.wait_for(lock, std::chrono::milliseconds(MT_LLM_LOG_IDLE_MS));
+    }
+}
+
+static void on_llama_log(
+    ggml_log_level const level, char const * const text, void * const user)
+{
+    (void)user;
+
+    int mt_level = MT_LOG_LEVEL_INFO;
+
+    switch(level)
+    {
+        case GGML_LOG_LEVEL_ERROR:
+            mt_level = MT_LOG_LEVEL_ERR;
+            break;
+        case GGML_LOG_LEVEL_WARN:
+            mt_level = MT_LOG_LEVEL_WARN;
+            break;
+        case GGML_LOG_LEVEL_DEBUG:
+            mt_level = MT_LOG_LEVEL_DEBUG;
+            break;
+        case GGML_LOG_LEVEL_CONT:
+            mt_level = s_llama_last_level;
+            break;
+
+        default: // (GGML_LOG_LEVEL_NONE or GGML_LOG_LEVEL_INFO)
+            break;
+    }
+    s_llama_last_level = mt_level;
+
+    mt_llm_log_write(mt_level, "llama.cpp", "%s", text);
+}
+
+void mt_llm_log_write(
+    int const level, char const * const func, char const * const fmt, ...)
+{
+    if(s_level.load(std::memory_order_relaxed) < level)
+    {
+        return;
+    }
+
+    char msg[MT_LLM_LOG_MSG_LEN];
+    char const * prefix = "";
+    int len = 0;
+
+    switch(level)
+    {
+        case MT_LOG_LEVEL_ERR:
+            prefix = "ERROR: ";
+            break;
+        case MT_LOG_LEVEL_WARN:
+            prefix = "WARNING: ";
+            break;
+        case MT_LOG_LEVEL_DEBUG:
+            prefix = "DEBUG: ";
+            break;
+
+        default:
+            break;
+    }
+
+    len = snprintf(msg, MT_LLM_LOG_MSG_LEN, "%s : %s", func, prefix);
+    if(0 <= len && len < MT_LLM_LOG_MSG_LEN)
+    {
+        va_list args;
+
+        va_start(args, fmt);
+        vsnprintf(msg + len, MT_LLM_LOG_MSG_LEN - len, fmt, args);
+        va_end(args);
+    }
+
+    if(!s_is_async.load(std::memory_order_acquire))
+    {
+        give_to_sink(level, msg);
+        return;
+    }
+
+    if(!try_enqueue(level, msg))
+    {
+        s_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    s_enqueued.fetch_add(1, std::memory_order_release);
+    s_wake.notify_one();
+}
+
+void mt_llm_log_start()
+{
+    if(s_thread != nullptr)
+    {
+        return; // Already started.
+    }
+
+    get_ring(); // Initializes the ring buffer, if not done, yet.
+
+    s_stop.store(false, std::memory_order_release);
+    s_thread = new std::thread(thread_func);
+    s_is_async.store(true, std::memory_order_release);
+
+    // Route llama.cpp's (and GGML's) messages into the same sink:
+    //
+    llama_log_set(on_llama_log, nullptr);
+    //
+    // The "common" library has its own (asynchronous) logger that does not
+    // support a sink, pause it (its messages get dropped, then):
+    //
+    common_log_pause(common_log_main());
+}
+
+void mt_llm_log_stop()
+{
+    if(s_thread == nullptr)
+    {
+        return; // Not started.
+    }
+
+    s_is_async.store(false, std::memory_order_release);
+
+    s_stop.store(true, std::memory_order_release);
+    s_wake.notify_one();
+    s_thread->join();
+    delete s_thread;
+    s_thread = nullptr;
+
+    // Messages that were enqueued after the thread stopped:
+    //
+    while(try_dequeue_to_sink())
+    {
+        // (nothing else to do)
+    }
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_log_set_level(int const level)
+{
+    s_level.store(level, std::memory_order_relaxed);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_log_set_sink(
+    void(*sink)(int, char const *))
+{
+    s_sink.store(sink, std::memory_order_release);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_log_flush()
+{
+    uint64_t const enqueued = s_enqueued.load(std::memory_order_acquire);
+
+    while(s_is_async.load(std::memory_order_acquire)
+        && s_done.load(std::memory_order_acquire) < enqueued)
+    {
+        s_wake.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+MT_EXPORT_LLM_API uint64_t __stdcall mt_llm_log_get_dropped()
+{
+    return s_dropped.load(std::memory_order_relaxed);
+}
@@ -1,13 +1,130 @@
 
 // Marcel Timm, RhinoDevel, 2024aug28
 
+// The configuration functions are meant to be a pure-C interface.
+
 #ifndef MT_LLM_LOG
 #define MT_LLM_LOG
 
-#define MT_LOG_ERR(fmt, ...) \
-    fprintf(stderr, "%s : ERROR: " fmt, __func__, ##__VA_ARGS__)
+#include "mt_llm_lib.h"
+
+#ifdef __cplusplus
+    #include <cstdint>
+#else //__cplusplus
+    #include <stdint.h>
+#endif //__cplusplus
+
+// Could be an enum:
+
+// To be used with mt_llm_log_set_level(), only (disables logging).
+#define MT_LOG_LEVEL_NONE 0
+
+#define MT_LOG_LEVEL_ERR 1
+#define MT_LOG_LEVEL_WARN 2
+#define MT_LOG_LEVEL_INFO 3
+#define MT_LOG_LEVEL_DEBUG 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+/** Set the maximum level of messages to be logged (this includes the messages
+ *  of llama.cpp, while initialized).
+ *
+ * - Default is MT_LOG_LEVEL_INFO.
+ * - Can be called at any time (e.g. before mt_llm_reinit()).
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_log_set_level(int const level);
+
+/** Set the function that receives each (complete) message to be logged, or
+ *  nullptr to use the default, which writes to stdout (and to stderr for
+ *  errors and warnings).
+ *
+ * - While initialized, the sink gets called by a background thread that drains
+ *   a ring buffer, so a slow sink never stalls inference. Otherwise, it gets
+ *   called synchronously.
+ * - Messages are dropped, if the ring buffer is full
+ *   (see mt_llm_log_get_dropped()).
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_log_set_sink(
+    void(*sink)(int, char const *));
+
+/** Wait until all messages logged so far were given to the sink.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_log_flush();
+
+/** Returns the count of messages dropped, because the ring buffer was full.
+ */
+MT_EXPORT_LLM_API uint64_t __stdcall mt_llm_log_get_dropped();
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+// The following is used internally and is not pure-C:
+//
+#ifdef __cplusplus/*MT_EXPORT_LLM*/
+
+// Removes all logging calls with a higher level than the one given at
+// compile-time (e.g. 2 = Only errors and warnings):
+//
+#ifndef MT_LLM_LOG_COMPILE_LEVEL
+    #define MT_LLM_LOG_COMPILE_LEVEL MT_LOG_LEVEL_DEBUG
+#endif //MT_LLM_LOG_COMPILE_LEVEL
+
+/** Log a message with given level, prefixed by given function name.
+ *
+ * - Use the macros below instead of calling this directly.
+ */
+void mt_llm_log_write(
+    int const level, char const * const func, char const * const fmt, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 3, 4)))
+#endif //__GNUC__
+    ;
+
+/** Start the background thread that gives the messages to the sink.
+ *
+ * - Also routes llama.cpp's log messages into the same sink.
+ * - Does nothing, if already started.
+ */
+void mt_llm_log_start();
+
+/** Stop the background thread after all queued messages were given to the
+ *  sink. Log synchronously from then on.
+ *
+ * - Does nothing, if not started.
+ */
+void mt_llm_log_stop();
+
+#if MT_LOG_LEVEL_ERR <= MT_LLM_LOG_COMPILE_LEVEL
+    #define MT_LOG_ERR(fmt, ...) \
+        mt_llm_log_write(MT_LOG_LEVEL_ERR, __func__, fmt, ##__VA_ARGS__)
+#else
+    #define MT_LOG_ERR(fmt, ...) ((void)0)
+#endif
+
+#if MT_LOG_LEVEL_WARN <= MT_LLM_LOG_COMPILE_LEVEL
+    #define MT_LOG_WARN(fmt, ...) \
+        mt_llm_log_write(MT_LOG_LEVEL_WARN, __func__, fmt, ##__VA_ARGS__)
+#else
+    #define MT_LOG_WARN(fmt, ...) ((void)0)
+#endif
+
+#if MT_LOG_LEVEL_INFO <= MT_LLM_LOG_COMPILE_LEVEL
+    #define MT_LOG(fmt, ...) \
+        mt_llm_log_write(MT_LOG_LEVEL_INFO, __func__, fmt, ##__VA_ARGS__)
+#else
+    #define MT_LOG(fmt, ...) ((void)0)
+#endif
+
+#if MT_LOG_LEVEL_DEBUG <= MT_LLM_LOG_COMPILE_LEVEL
+    #define MT_LOG_DBG(fmt, ...) \
+        mt_llm_log_write(MT_LOG_LEVEL_DEBUG, __func__, fmt, ##__VA_ARGS__)
+#else
+    #define MT_LOG_DBG(fmt, ...) ((void)0)
+#endif
 
-#define MT_LOG(fmt, ...) \
-    printf("%s : " fmt, __func__, ##__VA_ARGS__)
+#endif //__cplusplus/*MT_EXPORT_LLM*/
 
 #endif //MT_LLM_LOG
@@ -0,0 +1,179 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <cctype>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
+#else //_WIN32
+    #include <climits>
+#endif //_WIN32
+
+#include "mt_llm_mem.h"
+
+#ifndef _WIN32
+
+/** Returns the value in bytes of the given "kB" entry (e.g. "VmRSS:") of
+ *  /proc/self/status.
+ *
+ * - Returns 0, if not found.
+ */
+static uint64_t get_proc_status_kb(char const * const key)
+{
+    assert(key != nullptr);
+
+    FILE * const f = fopen("/proc/self/status", "r");
+    size_t const key_len = strlen(key);
+    char line[256];
+    uint64_t ret_val = 0;
+
+    if(f == nullptr)
+    {
+        return 0;
+    }
+
+    while(fgets(line, sizeof line, f) != nullptr)
+    {
+        if(strncmp(line, key, key_len) == 0)
+        {
+            ret_val = 1024 * strtoull(line + key_len, nullptr, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return ret_val;
+}
+
+#endif //_WIN32
+
+uint64_t mt_llm_mem_get_process_resident()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc))
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(pmc.WorkingSetSize);
+#else //_WIN32
+    return get_proc_status_kb("VmRSS:");
+#endif //_WIN32
+}
+
+uint64_t mt_llm_mem_get_process_peak()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc))
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(pmc.PeakWorkingSetSize);
+#else //_WIN32
+    return get_proc_status_kb("VmHWM:");
+#endif //_WIN32
+}
+
+uint64_t mt_llm_mem_get_file_mapped(
+    char const * const path, uint64_t * const out_resident)
+{
+    assert(path != nullptr);
+
+    if(out_resident != nullptr)
+    {
+        *out_resident = 0; // (also on error)
+    }
+
+#ifdef _WIN32
+    // Assumes that llama.cpp memory-maps the whole file (its default):
+
+    struct _stat64 st;
+
+    if(_stat64(path, &st) != 0)
+    {
+        return 0;
+    }
+    if(out_resident != nullptr)
+    {
+        *out_resident = static_cast<uint64_t>(st.st_size);
+    }
+    return static_cast<uint64_t>(st.st_size);
+#else //_WIN32
+    // Sum up the sizes and the resident set sizes of all mappings of the file
+    // listed in /proc/self/smaps:
+
+    char real_path[PATH_MAX];
+    char line[PATH_MAX + 128];
+    bool is_in_mapping = false;
+    uint64_t mapped = 0,
+        resident = 0;
+
+    if(realpath(path, real_path) == nullptr)
+    {
+        return 0;
+    }
+
+    size_t const real_path_len = strlen(real_path);
+    FILE * const f = fopen("/proc/self/smaps", "r");
+
+    if(f == nullptr)
+    {
+        return 0;
+    }
+
+    while(fgets(line, sizeof line, f) != nullptr)
+    {
+        size_t const len = strlen(line);
+
+        // Mapping header lines start with the (lower-case hexadecimal) address
+        // range, all other lines with an upper-case field name:
+        //
+        // 7f2d4c000000-7f2d4e000000 r--p 00000000 08:01 1234  /path/to/file
+        // Size:              32768 kB
+        //
+        if(isdigit(static_cast<unsigned char>(line[0]))
+            || ('a' <= line[0] && line[0] <= 'f'))
+        {
+            is_in_mapping = real_path_len + 1 < len
+                && line[len - 1] == '\n'
+                && line[len - real_path_len - 2] == ' '
+                && strncmp(
+                    line + len - real_path_len - 1,
+                    real_path,
+                    real_path_len) == 0;
+            continue;
+        }
+        if(!is_in_mapping)
+        {
+            continue;
+        }
+        if(strncmp(line, "Size:", 5) == 0)
+        {
+            mapped += 1024 * strtoull(line + 5, nullptr, 10);
+            continue;
+        }
+        if(strncmp(line, "Rss:", 4) == 0)
+        {
+            resident += 1024 * strtoull(line + 4, nullptr, 10);
+            continue;
+        }
+    }
+    fclose(f);
+
+    if(out_resident != nullptr)
+    {
+        *out_resident = resident;
+    }
+    return mapped;
+#endif //_WIN32
+}
@@ -0,0 +1,33 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#ifndef MT_LLM_MEM
+#define MT_LLM_MEM
+
+#include <cstdint>
+
+/** Returns the current resident set size of the process in bytes.
+ *
+ * - Returns 0, if not retrievable.
+ */
+uint64_t mt_llm_mem_get_process_resident();
+
+/** Returns the resident set size high-water mark of the process in bytes.
+ *
+ * - Returns 0, if not retrievable.
+ */
+uint64_t mt_llm_mem_get_process_peak();
+
+/** Returns the bytes of the given file memory-mapped into the process' address
+ *  space.
+ *
+ * - Returns 0, if not mapped or not retrievable.
+ * - Retrieves the size of the resident part, if out_resident is not nullptr.
+ *   This is set to the mapped bytes, if the resident part cannot be determined
+ *   (non-Linux).
+ * - The resident part is 0, if 0 is returned.
+ */
+uint64_t mt_llm_mem_get_file_mapped(
+    char const * const path, uint64_t * const out_resident);
+
+#endif //MT_LLM_MEM
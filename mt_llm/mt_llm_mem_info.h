@@ -0,0 +1,39 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#ifndef MT_LLM_MEM_INFO
+#define MT_LLM_MEM_INFO
+
+#ifdef __cplusplus
+    #include <cstdint>
+#else //__cplusplus
+    #include <stdint.h>
+#endif //__cplusplus
+
+/** Memory usage in bytes, as seen from the CPU side.
+ *
+ * - Memory of model layers offloaded to a GPU is not included.
+ */
+struct mt_llm_memory_info
+{
+    uint64_t model_bytes; // Size of the model's weights.
+    uint64_t model_mapped_bytes; // Model file bytes memory-mapped (0 = no mmap).
+    uint64_t model_resident_bytes; // Mapped model bytes currently in RAM.
+                                   // Equals model_mapped_bytes, if unknown
+                                   // (non-Linux).
+
+    uint64_t kv_used_bytes; // KV cache bytes holding tokens of the context.
+    uint64_t kv_allocated_bytes; // KV cache bytes for the whole context size.
+
+    // Estimation: Resident process memory not accounted for by the model, the
+    // KV cache and the snapshots (llama.cpp does not offer a way to retrieve
+    // the compute buffer sizes):
+    uint64_t compute_bytes;
+
+    uint64_t snapshot_bytes; // Bytes of all stored snapshots.
+
+    uint64_t process_resident_bytes; // Current resident set size.
+    uint64_t process_peak_bytes; // Resident set size high-water mark.
+};
+
+#endif //MT_LLM_MEM_INFO
@@ -0,0 +1,440 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdarg>
+#include <cassert>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#ifndef _WIN32
+    #include <unistd.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif //_WIN32
+
+#include "mt_llm_metrics.h"
+#include "mt_llm_stats.h"
+#include "mt_llm_log.h"
+
+// How long to wait for a socket client to send its request:
+#define MT_LLM_METRICS_CLIENT_TIMEOUT_MS 100
+
+static std::thread * s_thread = nullptr; // (pointer, see mt_llm_log.cpp)
+static std::mutex s_mtx;
+static std::condition_variable s_stop_cv;
+static bool s_stop = false; // Guarded by s_mtx.
+
+static std::string s_path;
+static bool s_is_socket = false;
+static uint32_t s_interval_ms = 0;
+static int s_listen_fd = -1;
+
+static void append(std::string & out, char const * const fmt, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 2, 3)))
+#endif //__GNUC__
+    ;
+
+static void append(std::string & out, char const * const fmt, ...)
+{
+    char buf[256];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+
+    out += buf;
+}
+
+static void append_metric(
+    std::string & out,
+    char const * const name,
+    char const * const type,
+    char const * const help,
+    double const val)
+{
+    append(out, "# HELP mt_llm_%s %s\n", name, help);
+    append(out, "# TYPE mt_llm_%s %s\n", name, type);
+    append(out, "mt_llm_%s %.17g\n", name, val);
+}
+
+static void append_error(
+    std::string & out, char const * const type, uint64_t const val)
+{
+    append(
+        out,
+        "mt_llm_errors_total{type=\"%s\"} %llu\n",
+        type,
+        static_cast<unsigned long long>(val));
+}
+
+static void append_latency(
+    std::string & out,
+    char const * const name,
+    char const * const help,
+    struct mt_llm_latency const & lat)
+{
+    append(out, "# HELP mt_llm_%s_seconds %s\n", name, help);
+    append(out, "# TYPE mt_llm_%s_seconds summary\n", name);
+    append(
+        out,
+        "mt_llm_%s_seconds{quantile=\"0.5\"} %.6f\n",
+        name,
+        static_cast<double>(lat.p50) / 1000000.0);
+    append(
+        out,
+        "mt_llm_%s_seconds{quantile=\"0.95\"} %.6f\n",
+        name,
+        static_cast<double>(lat.p95) / 1000000.0);
+    append(
+        out,
+        "mt_llm_%s_seconds{quantile=\"0.99\"} %.6f\n",
+        name,
+        static_cast<double>(lat.p99) / 1000000.0);
+    append(
+        out,
+        "mt_llm_%s_seconds_count %llu\n",
+        name,
+        static_cast<unsigned long long>(lat.count));
+}
+
+static std::string create_text()
+{
+    struct mt_llm_counters c;
+    struct mt_llm_latency_stats l;
+    std::string ret_val;
+
+    mt_llm_stats_get_counters(&c);
+    mt_llm_stats_get_latency(&l);
+
+    append_metric(
+        ret_val,
+        "queries_total",
+        "counter",
+        "Count of queries.",
+        static_cast<double>(c.queries));
+    append_metric(
+        ret_val,
+        "prefill_tokens_total",
+        "counter",
+        "Count of prompt tokens decoded.",
+        static_cast<double>(c.prefill_tokens));
+    append_metric(
+        ret_val,
+        "generated_tokens_total",
+        "counter",
+        "Count of tokens sampled.",
+        static_cast<double>(c.generated_tokens));
+    append_metric(
+        ret_val,
+        "evicted_tokens_total",
+        "counter",
+        "Count of tokens removed from the context to reclaim space.",
+        static_cast<double>(c.evicted_tokens));
+
+    append(ret_val, "# HELP mt_llm_errors_total Count of errors by type.\n");
+    append(ret_val, "# TYPE mt_llm_errors_total counter\n");
+    append_error(ret_val, "not_initialized", c.errors_not_initialized);
+    append_error(ret_val, "decode", c.errors_decode);
+    append_error(ret_val, "ctx_full", c.errors_ctx_full);
+    append_error(ret_val, "state", c.errors_state);
+
+    append_metric(
+        ret_val,
+        "tokens_per_second",
+        "gauge",
+        "Generation speed of the last inference.",
+        c.tokens_per_second);
+    append_metric(
+        ret_val,
+        "kv_used_tokens",
+        "gauge",
+        "Tokens held by the context.",
+        static_cast<double>(c.kv_used_tokens));
+    append_metric(
+        ret_val,
+        "kv_size_tokens",
+        "gauge",
+        "Context size in tokens.",
+        static_cast<double>(c.kv_size_tokens));
+    append_metric(
+        ret_val,
+        "kv_utilization",
+        "gauge",
+        "Ratio of the context in use.",
+        c.kv_size_tokens == 0
+            ? 0.0
+            : static_cast<double>(c.kv_used_tokens)
+                / static_cast<double>(c.kv_size_tokens));
+    append_metric(
+        ret_val,
+        "snapshots",
+        "gauge",
+        "Count of stored snapshots.",
+        static_cast<double>(c.snapshot_count));
+    append_metric(
+        ret_val,
+        "snapshot_bytes",
+        "gauge",
+        "Bytes of stored snapshots.",
+        static_cast<double>(c.snapshot_bytes));
+
+    append_latency(
+        ret_val,
+        "inter_token_latency",
+        "Time between two sampled tokens.",
+        l.inter_token);
+    append_latency(
+        ret_val,
+        "prefill_latency_per_100_tokens",
+        "Prefill latency normalized to 100 tokens.",
+        l.prefill_per_100);
+    append_latency(
+        ret_val, "callback_duration", "Duration of callback calls.", l.callback);
+
+    return ret_val;
+}
+
+static bool write_file(std::string const & text)
+{
+    std::string const tmp_path = s_path + ".tmp";
+    FILE * const f = fopen(tmp_path.c_str(), "wb");
+
+    if(f == nullptr)
+    {
+        return false;
+    }
+
+    bool const ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+
+    if(fclose(f) != 0 || !ok)
+    {
+        remove(tmp_path.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    remove(s_path.c_str()); // (rename() does not replace on Windows)
+#endif //_WIN32
+
+    return rename(tmp_path.c_str(), s_path.c_str()) == 0;
+}
+
+#ifndef _WIN32
+
+static void write_all(int const fd, char const * const buf, size_t const len)
+{
+    size_t done = 0;
+
+    while(done < len)
+    {
+        ssize_t const n = send(fd, buf + done, len - done, MSG_NOSIGNAL);
+
+        if(n <= 0)
+        {
+            return; // (client is gone)
+        }
+        done += static_cast<size_t>(n);
+    }
+}
+
+static void serve_client(int const fd)
+{
+    struct pollfd p;
+    char req[512];
+    ssize_t req_len = 0;
+
+    p.fd = fd;
+    p.events = POLLIN;
+    p.revents = 0;
+
+    // Optionally receive a request (e.g. "GET /metrics HTTP/1.1"):
+    //
+    if(0 < poll(&p, 1, MT_LLM_METRICS_CLIENT_TIMEOUT_MS))
+    {
+        req_len = recv(fd, req, sizeof req - 1, 0);
+    }
+
+    std::string const text = create_text();
+
+    if(3 <= req_len && strncmp(req, "GET", 3) == 0)
+    {
+        char head[128];
+        int const head_len = snprintf(
+            head,
+            sizeof head,
+            "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: %zu\r\n"
+                "\r\n",
+            text.size());
+
+        write_all(fd, head, static_cast<size_t>(head_len));
+    }
+    write_all(fd, text.data(), text.size());
+}
+
+static bool open_socket()
+{
+    struct sockaddr_un addr;
+
+    if(sizeof addr.sun_path <= s_path.size())
+    {
+        MT_LOG_ERR("Socket path is too long!\n");
+        return false;
+    }
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, s_path.c_str());
+
+    unlink(s_path.c_str()); // (may be left over from a former process)
+
+    s_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(s_listen_fd < 0)
+    {
+        MT_LOG_ERR("Failed to create socket!\n");
+        return false;
+    }
+    if(bind(s_listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr)
+            != 0
+        || listen(s_listen_fd, 8) != 0)
+    {
+        MT_LOG_ERR("Failed to bind/listen to \"%s\"!\n", s_path.c_str());
+        close(s_listen_fd);
+        s_listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+#endif //_WIN32
+
+static bool is_stop_requested(uint32_t const wait_ms)
+{
+    std::unique_lock<std::mutex> lock(s_mtx);
+
+    return s_stop_cv.wait_for(
+        lock,
+        std::chrono::milliseconds(wait_ms),
+        []{ return s_stop; });
+}
+
+static void thread_func()
+{
+    if(!s_is_socket)
+    {
+        do
+        {
+            if(!write_file(create_text()))
+            {
+                MT_LOG_WARN("Failed to write \"%s\"!\n", s_path.c_str());
+            }
+        }while(!is_stop_requested(s_interval_ms));
+        return;
+    }
+
+#ifndef _WIN32
+    do
+    {
+        struct pollfd p;
+
+        p.fd = s_listen_fd;
+        p.events = POLLIN;
+        p.revents = 0;
+
+        // Wake up regularly to check for a stop request:
+        //
+        if(poll(&p, 1, MT_LLM_METRICS_CLIENT_TIMEOUT_MS) <= 0)
+        {
+            continue;
+        }
+
+        int const fd = accept(s_listen_fd, nullptr, nullptr);
+
+        if(fd < 0)
+        {
+            continue;
+        }
+        serve_client(fd);
+        close(fd);
+    }while(!is_stop_requested(0));
+#endif //_WIN32
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_metrics_start(
+    char const * const path, bool const is_socket, uint32_t const interval_ms)
+{
+    mt_llm_metrics_stop();
+
+    if(path == nullptr || path[0] == '\0')
+    {
+        MT_LOG_ERR("No path given!\n");
+        return false;
+    }
+    if(!is_socket && interval_ms == 0)
+    {
+        MT_LOG_ERR("Interval must not be zero!\n");
+        return false;
+    }
+
+    s_path = path;
+    s_is_socket = is_socket;
+    s_interval_ms = interval_ms;
+
+    if(s_is_socket)
+    {
+#ifdef _WIN32
+        MT_LOG_ERR("Unix domain socket is not supported on Windows!\n");
+        return false;
+#else //_WIN32
+        if(!open_socket())
+        {
+            return false; // (called function logged)
+        }
+#endif //_WIN32
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_mtx);
+
+        s_stop = false;
+    }
+    s_thread = new std::thread(thread_func);
+    return true;
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_metrics_stop()
+{
+    if(s_thread == nullptr)
+    {
+        return; // Not started.
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_mtx);
+
+        s_stop = true;
+    }
+    s_stop_cv.notify_one();
+    s_thread->join();
+    delete s_thread;
+    s_thread = nullptr;
+
+#ifndef _WIN32
+    if(s_listen_fd != -1)
+    {
+        close(s_listen_fd);
+        s_listen_fd = -1;
+        unlink(s_path.c_str());
+    }
+#endif //_WIN32
+}
@@ -0,0 +1,49 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// This is meant to be a pure-C interface to export metrics for monitoring.
+
+#ifndef MT_LLM_METRICS
+#define MT_LLM_METRICS
+
+#include "mt_llm_lib.h"
+
+#ifdef __cplusplus
+    #include <cstdbool>
+    #include <cstdint>
+#else //__cplusplus
+    #include <stdbool.h>
+    #include <stdint.h>
+#endif //__cplusplus
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+/** Start a background thread that publishes the counters, gauges and latency
+ *  percentiles (see mt_llm_stats.h) in Prometheus text format.
+ *
+ * - If is_socket is false, the file at given path gets replaced (atomically,
+ *   via renaming a temporary file) each interval_ms milliseconds (e.g. for
+ *   node_exporter's textfile collector).
+ * - If is_socket is true, a Unix domain socket is created at given path. Each
+ *   client connecting gets the current metrics (as HTTP response, if the
+ *   client sends an HTTP request). Not supported on Windows.
+ * - Stops an already running exporter, first.
+ * - Does not need mt_llm to be initialized.
+ * - Returns false, if the exporter could not be started.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_metrics_start(
+    char const * const path, bool const is_socket, uint32_t const interval_ms);
+
+/**
+ * - Does no harm, if not started.
+ * - Removes the socket file, if is_socket was given as true.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_metrics_stop();
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //MT_LLM_METRICS
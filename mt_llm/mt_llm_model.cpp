@@ -5,7 +5,10 @@
 #include <cstdlib>
 #include <cstring>
 #include <cctype>
+#include <cstdint>
+#include <algorithm>
 #include <vector>
+#include <string>
 
 #include "llama.h"
 #include "llama-vocab.h"
@@ -14,6 +17,7 @@
 #include "mt_llm_log.h"
 
 #define MT_LLM_MODEL_NAME_KEY "general.name"
+#define MT_LLM_MODEL_ARCH_KEY "general.architecture"
 
 #define MT_LLM_MODEL_DEFAULT_META_VAL_STR_MAX_LEN (9 + 1) // Trailing '\0' incl. 
 
@@ -570,6 +574,22 @@ static struct prompt_template const * try_get_prompt_template(
     assert(false); // Must never get here.
 }
 
+static void set_prompts(
+    struct prompt_template const & pt, struct mt_llm_p & p)
+{
+    strcpy(p.sys_prompt_beg_delim, pt.sys_prompt_beg_delim);
+    strcpy(p.sys_prompt_mid_delim, pt.sys_prompt_mid_delim);
+    strcpy(p.sys_prompt_end_delim, pt.sys_prompt_end_delim);
+
+    strcpy(p.prompt_beg_delim, pt.prompt_beg_delim);
+    strcpy(p.prompt_end_delim, pt.prompt_end_delim);
+
+    strcpy(p.rev_prompt, pt.rev_prompt);
+
+    strcpy(p.think_beg_delim, pt.think_beg_delim);
+    strcpy(p.think_end_delim, pt.think_end_delim);
+}
+
 static llama_model_params get_model_params(mt_llm_p const & mt_p)
 {
     llama_model_params ret_val = llama_model_default_params();
@@ -647,20 +667,32 @@ bool mt_llm_model_try_set_prompts(
         "Setting default prompt strings for model with name \"%s\"..\n",
         model_name);
 
-    strcpy(p.sys_prompt_beg_delim, pt->sys_prompt_beg_delim);
-    strcpy(p.sys_prompt_mid_delim, pt->sys_prompt_mid_delim);
-    strcpy(p.sys_prompt_end_delim, pt->sys_prompt_end_delim);
+    set_prompts(*pt, p);
+
+    free(model_name);
+    return true;
+}
 
-    strcpy(p.prompt_beg_delim, pt->prompt_beg_delim);
-    strcpy(p.prompt_end_delim, pt->prompt_end_delim);
+char const * mt_llm_model_get_template(
+    int const index, struct mt_llm_p * const p)
+{
+    assert(0 <= index);
 
-    strcpy(p.rev_prompt, pt->rev_prompt);
+    for(int i = 0; i <= index; ++i)
+    {
+        if(s_prompt_templates[i] == NULL) // <=> Index is out of range.
+        {
+            return nullptr;
+        }
+    }
 
-    strcpy(p.think_beg_delim, pt->think_beg_delim);
-    strcpy(p.think_end_delim, pt->think_end_delim);
+    struct prompt_template const & pt = *s_prompt_templates[index];
 
-    free(model_name);
-    return true;
+    if(p != nullptr)
+    {
+        set_prompts(pt, *p);
+    }
+    return pt.model_names[0];
 }
 
 std::vector<std::vector<int>> mt_llm_model_get_digit_tokens(
@@ -694,6 +726,104 @@ std::vector<std::vector<int>> mt_llm_model_get_digit_tokens(
     return ret_val;
 }
 
+uint64_t mt_llm_model_get_kv_bytes_per_token(struct llama_model const & model)
+{
+    static uint64_t const bytes_per_val = 2; // F16.
+
+    uint64_t const n_layer = static_cast<uint64_t>(
+        llama_model_n_layer(&model));
+    uint64_t const n_head = static_cast<uint64_t>(llama_model_n_head(&model));
+    uint64_t const n_head_kv = static_cast<uint64_t>(
+        llama_model_n_head_kv(&model));
+
+    // Default head dimensions, if not given by the model's meta data:
+    //
+    uint64_t n_embd_head_k = 0 < n_head
+            ? static_cast<uint64_t>(llama_model_n_embd(&model)) / n_head : 0,
+        n_embd_head_v = n_embd_head_k;
+
+    char * const arch = get_meta_val_str(model, MT_LLM_MODEL_ARCH_KEY);
+
+    if(arch != nullptr)
+    {
+        std::string const prefix = std::string(arch) + ".attention.";
+        char * val = nullptr;
+
+        val = get_meta_val_str(model, (prefix + "key_length").c_str());
+        if(val != nullptr)
+        {
+            n_embd_head_k = strtoull(val, nullptr, 10);
+            free(val);
+            val = nullptr;
+        }
+
+        val = get_meta_val_str(model, (prefix + "value_length").c_str());
+        if(val != nullptr)
+        {
+            n_embd_head_v = strtoull(val, nullptr, 10);
+            free(val);
+            val = nullptr;
+        }
+
+        free(arch);
+    }
+
+    return n_layer
+        * n_head_kv * (n_embd_head_k + n_embd_head_v) * bytes_per_val;
+}
+
+/** Add given bytes to given FNV-1a hash value.
+ */
+static uint64_t add_to_hash(
+    uint64_t const hash, void const * const bytes, size_t const len)
+{
+    uint64_t ret_val = hash;
+    uint8_t const * const b = static_cast<uint8_t const *>(bytes);
+
+    for(size_t i = 0; i < len; ++i)
+    {
+        ret_val ^= static_cast<uint64_t>(b[i]);
+        ret_val *= 0x100000001b3ULL; // FNV prime.
+    }
+    return ret_val;
+}
+
+uint64_t mt_llm_model_get_fingerprint(struct llama_model const & model)
+{
+    uint64_t ret_val = 0xcbf29ce484222325ULL; // FNV offset basis.
+    char desc[256];
+    int32_t const desc_len = llama_model_desc(&model, desc, sizeof desc);
+    char * const name = get_meta_val_str(model, MT_LLM_MODEL_NAME_KEY);
+    uint64_t const vals[] = {
+        llama_model_n_params(&model),
+        llama_model_size(&model),
+        static_cast<uint64_t>(llama_model_n_embd(&model)),
+        static_cast<uint64_t>(llama_model_n_layer(&model)),
+        static_cast<uint64_t>(llama_model_n_head(&model)),
+        static_cast<uint64_t>(llama_model_n_head_kv(&model)),
+        static_cast<uint64_t>(
+            llama_vocab_n_tokens(llama_model_get_vocab(&model)))
+    };
+
+    if(name != nullptr)
+    {
+        ret_val = add_to_hash(ret_val, name, strlen(name));
+        free(name);
+    }
+    if(0 < desc_len)
+    {
+        ret_val = add_to_hash(
+            ret_val,
+            desc,
+            std::min(static_cast<size_t>(desc_len), sizeof desc - 1));
+    }
+    for(uint64_t const val : vals) // (in host byte order)
+    {
+        ret_val = add_to_hash(ret_val, &val, sizeof val);
+    }
+    return ret_val;
+}
+
 llama_model* mt_llm_model_create(mt_llm_p const & mt_p)
 {
     return llama_model_load_from_file(
@@ -23,6 +23,33 @@ std::vector<std::vector<int>> mt_llm_model_get_digit_tokens(
 bool mt_llm_model_try_set_prompts(
     struct llama_model const & model, struct mt_llm_p & p);
 
+/** Returns the (first) model name of the prompt template with given index or
+ *  nullptr, if there is no template with given index.
+ *
+ * - Also sets the prompt strings of given parameters to the template's ones,
+ *   if a template was found and given parameters object is not nullptr.
+ * - Meant to enumerate the supported models (e.g. to create test models).
+ */
+char const * mt_llm_model_get_template(
+    int const index, struct mt_llm_p * const p);
+
+/** Returns the count of KV cache bytes needed per token (for all layers).
+ *
+ * - Assumes F16 as the type of the K and V caches (llama.cpp's default).
+ * - Does not take sliding-window attention layers into account, that need
+ *   less memory (the value returned is the upper bound for such models).
+ */
+uint64_t mt_llm_model_get_kv_bytes_per_token(struct llama_model const & model);
+
+/** Returns a 64-bit FNV-1a hash of the model's name, description, parameter
+ *  count, size, dimensions and vocabulary size.
+ *
+ * - Differs for different quantizations of the same model (as their sizes
+ *   differ).
+ * - Meant to make sure that a stored state belongs to the model in use.
+ */
+uint64_t mt_llm_model_get_fingerprint(struct llama_model const & model);
+
 /** Initialize model.
  * 
  *  - Caller takes ownership of returned object.
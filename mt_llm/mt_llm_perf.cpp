@@ -0,0 +1,174 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <vector>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <dirent.h>
+    #include <sys/syscall.h>
+    #include <sys/ioctl.h>
+    #include <linux/perf_event.h>
+#endif //__linux__
+
+#include "mt_llm_perf.h"
+
+#ifdef __linux__
+
+// Read format used (PERF_FORMAT_TOTAL_TIME_ENABLED
+// | PERF_FORMAT_TOTAL_TIME_RUNNING):
+//
+struct read_val
+{
+    uint64_t val;
+    uint64_t time_enabled;
+    uint64_t time_running;
+};
+
+static uint64_t const s_configs[MT_LLM_PERF_EVT_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES, // MT_LLM_PERF_EVT_CYCLES
+    PERF_COUNT_HW_INSTRUCTIONS, // MT_LLM_PERF_EVT_INSTRUCTIONS
+    PERF_COUNT_HW_CACHE_MISSES, // MT_LLM_PERF_EVT_LLC_MISSES
+    PERF_COUNT_HW_STALLED_CYCLES_BACKEND // MT_LLM_PERF_EVT_STALLED_CYCLES
+};
+
+// File descriptors of the counters opened by mt_llm_perf_begin(), for each
+// event:
+//
+static std::vector<int> s_fds[MT_LLM_PERF_EVT_COUNT];
+
+static int open_counter(uint64_t const config, pid_t const tid)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit = 1; // Count threads created by this thread, too.
+    attr.exclude_kernel = 1; // (allowed with perf_event_paranoid <= 2)
+    attr.exclude_hv = 1;
+
+    return static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+}
+
+/** Returns the IDs of all threads of the process.
+ */
+static std::vector<pid_t> get_thread_ids()
+{
+    std::vector<pid_t> ret_val;
+    DIR * const dir = opendir("/proc/self/task");
+
+    if(dir == nullptr)
+    {
+        ret_val.push_back(static_cast<pid_t>(syscall(SYS_gettid)));
+        return ret_val;
+    }
+
+    struct dirent * entry = nullptr;
+
+    while((entry = readdir(dir)) != nullptr)
+    {
+        if(entry->d_name[0] < '0' || '9' < entry->d_name[0])
+        {
+            continue; // (e.g. "." and "..")
+        }
+        ret_val.push_back(static_cast<pid_t>(atoi(entry->d_name)));
+    }
+    closedir(dir);
+    return ret_val;
+}
+
+#endif //__linux__
+
+bool mt_llm_perf_is_available()
+{
+#ifdef __linux__
+    int const fd = open_counter(
+        s_configs[MT_LLM_PERF_EVT_CYCLES],
+        static_cast<pid_t>(syscall(SYS_gettid)));
+
+    if(fd < 0)
+    {
+        return false;
+    }
+    close(fd);
+    return true;
+#else //__linux__
+    return false;
+#endif //__linux__
+}
+
+bool mt_llm_perf_begin()
+{
+#ifdef __linux__
+    std::vector<pid_t> const tids = get_thread_ids();
+    bool ret_val = false;
+
+    for(int evt = 0; evt < MT_LLM_PERF_EVT_COUNT; ++evt)
+    {
+        assert(s_fds[evt].empty());
+
+        for(pid_t const tid : tids)
+        {
+            int const fd = open_counter(s_configs[evt], tid);
+
+            if(fd < 0)
+            {
+                // Event not supported or thread gone. Do not try the event
+                // for other threads, if not supported at all:
+                //
+                if(s_fds[evt].empty())
+                {
+                    break;
+                }
+                continue;
+            }
+            s_fds[evt].push_back(fd);
+            ret_val = true;
+        }
+    }
+    return ret_val;
+#else //__linux__
+    return false;
+#endif //__linux__
+}
+
+void mt_llm_perf_end(
+    uint64_t (&out_vals)[MT_LLM_PERF_EVT_COUNT],
+    bool (&out_is_valid)[MT_LLM_PERF_EVT_COUNT])
+{
+    for(int evt = 0; evt < MT_LLM_PERF_EVT_COUNT; ++evt)
+    {
+        out_vals[evt] = 0;
+        out_is_valid[evt] = false;
+
+#ifdef __linux__
+        for(int const fd : s_fds[evt])
+        {
+            struct read_val r;
+
+            if(read(fd, &r, sizeof r) == static_cast<ssize_t>(sizeof r)
+                && 0 < r.time_running)
+            {
+                // Scale, if the counter was multiplexed:
+                //
+                out_vals[evt] += static_cast<uint64_t>(
+                    static_cast<double>(r.val)
+                        * static_cast<double>(r.time_enabled)
+                        / static_cast<double>(r.time_running));
+                out_is_valid[evt] = true;
+            }
+            close(fd);
+        }
+        s_fds[evt].clear();
+#endif //__linux__
+    }
+}
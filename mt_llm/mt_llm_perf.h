@@ -0,0 +1,41 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#ifndef MT_LLM_PERF
+#define MT_LLM_PERF
+
+#include <cstdint>
+
+// Could be an enum:
+//
+#define MT_LLM_PERF_EVT_CYCLES 0
+#define MT_LLM_PERF_EVT_INSTRUCTIONS 1
+#define MT_LLM_PERF_EVT_LLC_MISSES 2 // Last-level cache misses.
+#define MT_LLM_PERF_EVT_STALLED_CYCLES 3 // Stalled in back-end (e.g. memory).
+//
+#define MT_LLM_PERF_EVT_COUNT 4
+
+/** Returns, if hardware performance counters can be used (always false on
+ *  other systems than Linux).
+ */
+bool mt_llm_perf_is_available();
+
+/** Start counting the hardware events for all threads of the process (threads
+ *  created by these threads later are counted, too).
+ *
+ * - Events not supported by the CPU or the kernel are just not counted.
+ * - Returns false, if no event can be counted.
+ * - Call mt_llm_perf_end() to stop counting, also if false was returned.
+ */
+bool mt_llm_perf_begin();
+
+/** Stop counting and retrieve the event counts (scaled, if the kernel had to
+ *  multiplex the hardware counters).
+ *
+ * - out_is_valid tells, which events could be counted.
+ */
+void mt_llm_perf_end(
+    uint64_t (&out_vals)[MT_LLM_PERF_EVT_COUNT],
+    bool (&out_is_valid)[MT_LLM_PERF_EVT_COUNT]);
+
+#endif //MT_LLM_PERF
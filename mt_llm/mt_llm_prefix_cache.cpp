@@ -0,0 +1,702 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cassert>
+
+#include "mt_llm_prefix_cache.h"
+#include "mt_llm_state.h"
+#include "mt_llm_state_codec.h"
+#include "mt_llm_snapshot.h"
+#include "mt_llm.h"
+#include "mt_llm_log.h"
+#include "mt_llm_record.h"
+
+/** Stored KV cache entries of the tokens at the positions from pos_beg to
+ *  before pos_end.
+ */
+struct segment
+{
+    mt_llm_state state; // Buffer is nullptr, if on disk (size stays set).
+    size_t capacity; // Of the buffer (0, if on disk).
+    int pos_beg;
+    int pos_end;
+    std::string path; // Of the file, if on disk (empty otherwise).
+    int refs; // Count of nodes referencing the segment.
+    uint64_t last_used; // See s_clock.
+};
+
+/** A node of the radix tree.
+ */
+struct node
+{
+    std::vector<int> toks; // Following the tokens of the parent.
+    int pos_beg; // Position of the first token.
+    struct segment * seg; // Holds the tokens' entries (nullptr for root).
+    struct node * parent; // nullptr for root.
+    std::map<int, struct node *> children; // By their first tokens.
+    uint64_t last_used; // See s_clock.
+};
+
+// Guards all of the following (but not the contents of the state buffers,
+// which are just accessed by the thread using the LLM):
+//
+static std::mutex s_mutex;
+//
+static struct node s_root = { {}, 0, nullptr, nullptr, {}, 0 };
+static int s_max_tokens = 0; // 0 = Disabled.
+static uint64_t s_budget = 0; // 0 = No limit.
+static uint64_t s_disk_budget = 0; // 0 = No limit.
+static std::string s_dir; // Empty = Do not move segments to disk.
+//
+static uint64_t s_clock = 0; // Incremented on each use of a node.
+static uint64_t s_file_id = 0; // Incremented for each file written.
+static uint64_t s_held = 0; // Capacities of the segments in RAM.
+static uint64_t s_disk_held = 0; // Sizes of the segments on disk.
+static uint64_t s_nodes = 0;
+static uint64_t s_segments = 0;
+static struct mt_llm_state s_raw = { 0, -1, nullptr, 0 }; // For encoding.
+static size_t s_raw_capacity = 0;
+static std::vector<uint8_t> s_file_buf; // For loading segments from disk.
+//
+static uint64_t s_lookups = 0;
+static uint64_t s_hits = 0;
+static uint64_t s_hit_tokens = 0;
+static uint64_t s_stored_tokens = 0;
+static uint64_t s_evictions = 0;
+static uint64_t s_spills = 0;
+
+/** Returns the token at given position of the known tokens followed by given
+ *  tokens.
+ */
+static int get_tok(
+    std::vector<int> const & known,
+    std::vector<int> const & toks,
+    int const pos)
+{
+    int const known_cnt = static_cast<int>(known.size());
+
+    return pos < known_cnt ? known[pos] : toks[pos - known_cnt];
+}
+
+/** Mark given node and the nodes above as used.
+ *
+ * - Mutex must be locked.
+ */
+static void touch(struct node * n)
+{
+    uint64_t const now = ++s_clock;
+
+    for(; n != nullptr && n != &s_root; n = n->parent)
+    {
+        n->last_used = now;
+        n->seg->last_used = now;
+    }
+}
+
+/** Remove a reference to given segment and free it, if it is not referenced
+ *  anymore.
+ *
+ * - Mutex must be locked.
+ */
+static void release_segment(struct segment * const seg)
+{
+    assert(0 < seg->refs);
+
+    --seg->refs;
+    if(0 < seg->refs)
+    {
+        return;
+    }
+    if(seg->path.empty())
+    {
+        s_held -= seg->capacity;
+        free(seg->state.state);
+    }
+    else
+    {
+        s_disk_held -= seg->state.size;
+        remove(seg->path.c_str());
+    }
+    --s_segments;
+    delete seg;
+}
+
+/** Remove given leaf.
+ *
+ * - Mutex must be locked.
+ */
+static void remove_leaf(struct node * const n)
+{
+    assert(n != &s_root && n->children.empty());
+
+    n->parent->children.erase(n->toks[0]);
+    release_segment(n->seg);
+    --s_nodes;
+    delete n;
+}
+
+/** Remove all nodes below given node.
+ *
+ * - Mutex must be locked.
+ */
+static void remove_children(struct node * const n)
+{
+    while(!n->children.empty())
+    {
+        struct node * const child = n->children.begin()->second;
+
+        remove_children(child);
+        remove_leaf(child);
+    }
+}
+
+/** Split given node after given count of its tokens into itself and a new
+ *  child, which get the remaining tokens and the children (both keep
+ *  referencing the segment).
+ *
+ * - Mutex must be locked.
+ */
+static void split(struct node * const n, size_t const tok_cnt)
+{
+    assert(0 < tok_cnt && tok_cnt < n->toks.size());
+
+    struct node * const child = new node;
+
+    child->toks.assign(n->toks.begin() + tok_cnt, n->toks.end());
+    child->pos_beg = n->pos_beg + static_cast<int>(tok_cnt);
+    child->seg = n->seg;
+    child->parent = n;
+    child->children.swap(n->children);
+    child->last_used = n->last_used;
+    for(auto & entry : child->children)
+    {
+        entry.second->parent = child;
+    }
+    ++child->seg->refs;
+    ++s_nodes;
+
+    n->toks.resize(tok_cnt);
+    n->children[child->toks[0]] = child;
+}
+
+/** Find the least recently used leaf below given node (with its segment on
+ *  disk, only, if so requested).
+ *
+ * - Mutex must be locked.
+ */
+static void find_lru_leaf(
+    struct node * const n, bool const on_disk, struct node * & lru)
+{
+    for(auto const & entry : n->children)
+    {
+        struct node * const child = entry.second;
+
+        if(!child->children.empty())
+        {
+            find_lru_leaf(child, on_disk, lru);
+            continue;
+        }
+        if(on_disk && child->seg->path.empty())
+        {
+            continue;
+        }
+        if(lru == nullptr || child->last_used < lru->last_used)
+        {
+            lru = child;
+        }
+    }
+}
+
+/** Find the least recently used segment in RAM below given node.
+ *
+ * - Mutex must be locked.
+ */
+static void find_lru_segment(struct node * const n, struct segment * & lru)
+{
+    for(auto const & entry : n->children)
+    {
+        struct segment * const seg = entry.second->seg;
+
+        if(seg->path.empty()
+            && (lru == nullptr || seg->last_used < lru->last_used))
+        {
+            lru = seg;
+        }
+        find_lru_segment(entry.second, lru);
+    }
+}
+
+/** Move given segment from RAM to a file in the directory set.
+ *
+ * - Mutex must be locked.
+ */
+static bool spill(struct segment & seg)
+{
+    static uint64_t const run_id = static_cast<uint64_t>(time(nullptr));
+
+    assert(seg.path.empty() && !s_dir.empty());
+
+    char name[64];
+
+    snprintf(
+        name,
+        sizeof name,
+        "/mt_llm_prefix_%llu_%llu.seg",
+        static_cast<unsigned long long>(run_id),
+        static_cast<unsigned long long>(++s_file_id));
+
+    std::string const path = s_dir + name;
+    FILE * const f = fopen(path.c_str(), "wb");
+
+    if(f == nullptr)
+    {
+        MT_LOG_ERR("Failed to create file \"%s\"!\n", path.c_str());
+        return false;
+    }
+
+    bool const is_ok =
+        fwrite(seg.state.state, 1, seg.state.size, f) == seg.state.size;
+
+    if(fclose(f) != 0 || !is_ok)
+    {
+        MT_LOG_ERR("Failed to write file \"%s\"!\n", path.c_str());
+        remove(path.c_str());
+        return false;
+    }
+
+    s_held -= seg.capacity;
+    s_disk_held += seg.state.size;
+    free(seg.state.state);
+    seg.state.state = nullptr;
+    seg.capacity = 0;
+    seg.path = path;
+    ++s_spills;
+    return true;
+}
+
+/** Move segments to disk and evict least recently used leaves until the held
+ *  bytes are within the budgets.
+ *
+ * - Mutex must be locked.
+ */
+static void enforce_budgets()
+{
+    while(s_budget != 0 && s_budget < s_held)
+    {
+        struct segment * seg = nullptr;
+        struct node * leaf = nullptr;
+
+        if(!s_dir.empty())
+        {
+            find_lru_segment(&s_root, seg);
+            if(seg != nullptr && spill(*seg))
+            {
+                continue;
+            }
+        }
+        find_lru_leaf(&s_root, false, leaf);
+        if(leaf == nullptr)
+        {
+            break;
+        }
+        remove_leaf(leaf);
+        ++s_evictions;
+    }
+    while(s_disk_budget != 0 && s_disk_budget < s_disk_held)
+    {
+        struct node * leaf = nullptr;
+
+        find_lru_leaf(&s_root, true, leaf);
+        if(leaf == nullptr)
+        {
+            break;
+        }
+        remove_leaf(leaf);
+        ++s_evictions;
+    }
+}
+
+/** Follow the known tokens followed by given tokens (given count of tokens in
+ *  total) down the tree.
+ *
+ * - Adds the nodes (partially) matched and the positions after their last
+ *   tokens matched to given path.
+ * - Returns the count of tokens matched.
+ * - Mutex must be locked.
+ */
+static int walk(
+    std::vector<int> const & known,
+    std::vector<int> const & toks,
+    int const count,
+    std::vector<std::pair<struct node *, int>> & path)
+{
+    struct node * n = &s_root;
+    int pos = 0;
+
+    while(pos < count)
+    {
+        auto const entry = n->children.find(get_tok(known, toks, pos));
+
+        if(entry == n->children.end())
+        {
+            break;
+        }
+
+        struct node * const child = entry->second;
+        int const child_cnt = static_cast<int>(child->toks.size());
+        int matched = 0;
+
+        while(matched < child_cnt
+            && pos + matched < count
+            && child->toks[matched] == get_tok(known, toks, pos + matched))
+        {
+            ++matched;
+        }
+        pos += matched;
+        path.push_back({ child, pos });
+        if(matched < child_cnt)
+        {
+            break;
+        }
+        n = child;
+    }
+    return pos;
+}
+
+/** Add the KV cache entries of the positions from given to before given end
+ *  position stored in given segment to the context.
+ *
+ * - Mutex must be locked.
+ */
+static bool restore(
+    struct segment const & seg, int const pos_beg, int const pos_end)
+{
+    assert(seg.pos_beg <= pos_beg && pos_end <= seg.pos_end);
+
+    if(seg.path.empty())
+    {
+        return mt_llm_state_restore_range(
+            seg.state, pos_beg, pos_end); // (logs on error)
+    }
+
+    FILE * const f = fopen(seg.path.c_str(), "rb");
+
+    if(f == nullptr)
+    {
+        MT_LOG_ERR("Failed to open file \"%s\"!\n", seg.path.c_str());
+        return false;
+    }
+    s_file_buf.resize(seg.state.size);
+
+    bool const is_read =
+        fread(s_file_buf.data(), 1, seg.state.size, f) == seg.state.size;
+
+    fclose(f);
+    if(!is_read)
+    {
+        MT_LOG_ERR("Failed to read file \"%s\"!\n", seg.path.c_str());
+        return false;
+    }
+
+    struct mt_llm_state state = seg.state;
+
+    state.state = s_file_buf.data();
+    return mt_llm_state_restore_range(
+        state, pos_beg, pos_end); // (logs on error)
+}
+
+bool mt_llm_prefix_cache_is_enabled()
+{
+    std::lock_guard<std::mutex> const lock(s_mutex);
+
+    return 0 < s_max_tokens;
+}
+
+int mt_llm_prefix_cache_load(
+    std::vector<int> const & known,
+    std::vector<int> const & toks,
+    int const count)
+{
+    assert(0 <= count && count <= static_cast<int>(toks.size()));
+
+    std::lock_guard<std::mutex> const lock(s_mutex);
+    std::vector<std::pair<struct node *, int>> path;
+    int const known_cnt = static_cast<int>(known.size());
+    int loaded = known_cnt; // Position after the last token loaded.
+
+    ++s_lookups;
+    if(walk(known, toks, known_cnt + count, path) <= known_cnt)
+    {
+        return 0;
+    }
+
+    // Restore the entries of the tokens not known, restoring the parts of the
+    // same segment (held by nodes split from the same node) at once:
+    //
+    for(size_t i = 0; i < path.size(); ++i)
+    {
+        struct segment const * const seg = path[i].first->seg;
+        int pos_end = path[i].second;
+
+        while(i + 1 < path.size() && path[i + 1].first->seg == seg)
+        {
+            ++i;
+            pos_end = path[i].second;
+        }
+        if(pos_end <= loaded)
+        {
+            continue; // Known, already.
+        }
+        if(!restore(*seg, loaded, pos_end))
+        {
+            break; // (logged)
+        }
+        loaded = pos_end;
+    }
+    if(loaded == known_cnt)
+    {
+        return 0;
+    }
+
+    // Mark the last node loaded from (and the ones above) as used:
+    //
+    for(auto const & entry : path)
+    {
+        if(entry.second == loaded)
+        {
+            touch(entry.first);
+            break;
+        }
+    }
+
+    ++s_hits;
+    s_hit_tokens += static_cast<uint64_t>(loaded - known_cnt);
+    MT_LOG("Loaded %d cached prefix tokens.\n", loaded - known_cnt);
+    return loaded - known_cnt;
+}
+
+/** Copy the KV cache entries of the positions from given to before given end
+ *  position into given segment, encoded with the codec set for snapshots.
+ *
+ * - Mutex must be locked.
+ */
+static bool fill(struct segment & seg, int const pos_beg, int const pos_end)
+{
+    int const codec = mt_llm_snapshot_get_codec();
+
+    if(codec == MT_LLM_STATE_CODEC_RAW)
+    {
+        return mt_llm_state_fill_range(
+            seg.state, seg.capacity, pos_beg, pos_end); // (logs on error)
+    }
+    return mt_llm_state_fill_range(s_raw, s_raw_capacity, pos_beg, pos_end)
+        && mt_llm_state_codec_encode(
+            s_raw.state,
+            s_raw.size,
+            codec,
+            seg.state,
+            seg.capacity); // (both log on error)
+}
+
+void mt_llm_prefix_cache_store(std::vector<int> const & toks)
+{
+    std::lock_guard<std::mutex> const lock(s_mutex);
+    std::vector<std::pair<struct node *, int>> path;
+    std::vector<int> const none;
+    int const count = static_cast<int>(toks.size()) < s_max_tokens
+        ? static_cast<int>(toks.size()) : s_max_tokens;
+    int const matched = walk(none, toks, count, path);
+
+    if(!path.empty())
+    {
+        touch(path.back().first);
+    }
+    if(count <= matched)
+    {
+        return; // Nothing to store.
+    }
+
+    struct segment * const seg = new segment;
+
+    seg->state = { 0, -1, nullptr, 0 };
+    seg->capacity = 0;
+    seg->pos_beg = matched;
+    seg->pos_end = count;
+    seg->refs = 1;
+    seg->last_used = ++s_clock;
+
+    if(!fill(*seg, matched, count))
+    {
+        free(seg->state.state);
+        delete seg;
+        return;
+    }
+
+    // Add the node for the tokens not cached, yet, below the node matched last
+    // (splitting it, if just partially matched):
+
+    struct node * parent = &s_root;
+
+    if(!path.empty())
+    {
+        parent = path.back().first;
+        if(matched < parent->pos_beg + static_cast<int>(parent->toks.size()))
+        {
+            split(parent, static_cast<size_t>(matched - parent->pos_beg));
+        }
+    }
+
+    struct node * const leaf = new node;
+
+    leaf->toks.assign(toks.begin() + matched, toks.begin() + count);
+    leaf->pos_beg = matched;
+    leaf->seg = seg;
+    leaf->parent = parent;
+    leaf->last_used = seg->last_used;
+    parent->children[leaf->toks[0]] = leaf;
+
+    ++s_nodes;
+    ++s_segments;
+    s_held += seg->capacity;
+    s_stored_tokens += static_cast<uint64_t>(count - matched);
+    MT_LOG(
+        "Stored %d prefix tokens (%zu bytes).\n",
+        count - matched,
+        seg->capacity);
+
+    enforce_budgets();
+}
+
+static void clear()
+{
+    std::lock_guard<std::mutex> const lock(s_mutex);
+
+    remove_children(&s_root);
+    assert(s_nodes == 0 && s_segments == 0);
+
+    free(s_raw.state);
+    s_raw = { 0, -1, nullptr, 0 };
+    s_raw_capacity = 0;
+    std::vector<uint8_t>().swap(s_file_buf);
+
+    s_held = 0;
+    s_disk_held = 0;
+}
+
+void mt_llm_prefix_cache_free()
+{
+    clear();
+}
+
+static void set_max_tokens(int const max_tokens)
+{
+    std::lock_guard<std::mutex> const lock(s_mutex);
+
+    s_max_tokens = max_tokens < 0 ? 0 : max_tokens;
+}
+
+static void set_budget(uint64_t const bytes)
+{
+    std::lock_guard<std::mutex> const lock(s_mutex);
+
+    s_budget = bytes;
+    enforce_budgets();
+}
+
+static void set_dir(char const * const path)
+{
+    std::lock_guard<std::mutex> const lock(s_mutex);
+
+    s_dir = path == nullptr ? "" : path;
+    enforce_budgets();
+}
+
+static void set_disk_budget(uint64_t const bytes)
+{
+    std::lock_guard<std::mutex> const lock(s_mutex);
+
+    s_disk_budget = bytes;
+    enforce_budgets();
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_set_max_tokens(
+    int const max_tokens)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    char arg[16];
+
+    set_max_tokens(max_tokens);
+    snprintf(arg, sizeof arg, "%d", max_tokens);
+    mt_llm_record_end(t_rec, "prefix_cache_set_max_tokens", true, arg);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_set_budget(
+    uint64_t const bytes)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    char arg[32];
+
+    set_budget(bytes);
+    snprintf(arg, sizeof arg, "%llu", static_cast<unsigned long long>(bytes));
+    mt_llm_record_end(t_rec, "prefix_cache_set_budget", true, arg);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_set_dir(
+    char const * const path)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+
+    set_dir(path);
+    mt_llm_record_end(t_rec, "prefix_cache_set_dir", true, path);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_set_disk_budget(
+    uint64_t const bytes)
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    char arg[32];
+
+    set_disk_budget(bytes);
+    snprintf(arg, sizeof arg, "%llu", static_cast<unsigned long long>(bytes));
+    mt_llm_record_end(t_rec, "prefix_cache_set_disk_budget", true, arg);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_clear()
+{
+    int64_t const t_rec = mt_llm_record_begin();
+
+    clear();
+    mt_llm_record_end(t_rec, "prefix_cache_clear", true, nullptr);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_get_stats(
+    struct mt_llm_prefix_cache_stats * const out)
+{
+    if(out == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> const lock(s_mutex);
+
+    out->nodes = s_nodes;
+    out->segments = s_segments;
+    out->bytes = s_held;
+    out->disk_bytes = s_disk_held;
+    out->budget_bytes = s_budget;
+    out->disk_budget_bytes = s_disk_budget;
+    out->lookups = s_lookups;
+    out->hits = s_hits;
+    out->hit_tokens = s_hit_tokens;
+    out->stored_tokens = s_stored_tokens;
+    out->evictions = s_evictions;
+    out->spills = s_spills;
+}
@@ -0,0 +1,152 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// This is meant to be a pure-C interface to configure the prefix cache, which
+// shares the KV cache entries of common token sequences (e.g. system prompt
+// and first turns) between conversations.
+
+#ifndef MT_LLM_PREFIX_CACHE
+#define MT_LLM_PREFIX_CACHE
+
+#include "mt_llm_lib.h"
+
+#ifdef __cplusplus
+    #include <cstdbool>
+    #include <cstdint>
+#else //__cplusplus
+    #include <stdbool.h>
+    #include <stdint.h>
+#endif //__cplusplus
+
+/** Statistics of the prefix cache.
+ */
+struct mt_llm_prefix_cache_stats
+{
+    uint64_t nodes; // Count of nodes of the tree (without the root).
+    uint64_t segments; // Count of stored KV cache segments (RAM and disk).
+    uint64_t bytes; // Held by segments in RAM.
+    uint64_t disk_bytes; // Held by segments on disk.
+    uint64_t budget_bytes; // See mt_llm_prefix_cache_set_budget().
+    uint64_t disk_budget_bytes; // See mt_llm_prefix_cache_set_disk_budget().
+
+    uint64_t lookups; // Token sequences looked up before decoding them.
+    uint64_t hits; // Lookups that loaded at least one token.
+    uint64_t hit_tokens; // Tokens loaded instead of decoded.
+    uint64_t stored_tokens; // Tokens whose KV cache entries got stored.
+    uint64_t evictions; // Nodes removed to stay within the budgets.
+    uint64_t spills; // Segments moved from RAM to disk.
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+// The prefix cache is a radix tree keyed by token sequences:
+//
+// - Each node holds the tokens following the ones of its parent and
+//   references the KV cache segment stored for them (nodes split from the
+//   same node share the segment, which is reference-counted).
+// - mt_llm_query() looks up the tokens to be decoded (appended to the tokens
+//   in the context) and loads the KV cache entries of the longest cached
+//   prefix instead of decoding these tokens (the callback gets called for
+//   them, as if they were decoded). The last token of each string decoded
+//   (e.g. of the prompt) is always decoded.
+// - At the end of each query, the tokens in the context (up to the maximum
+//   count set) are added to the tree, storing the KV cache entries of the
+//   tokens not cached, yet, as new segment.
+// - If a byte budget is set, the least recently used segments are moved to
+//   disk (if a directory is set) and the least recently used leaves get
+//   evicted, if necessary.
+// - Works just while the tokens in the context are known (not after restoring
+//   a state or snapshot until the next reset).
+// - Segments are encoded with the codec set via mt_llm_snapshot_set_codec().
+// - Gets cleared by mt_llm_deinit() (as the KV cache entries depend on the
+//   model).
+// - Must be used on the thread that uses the LLM (like all other calls of
+//   mt_llm), but mt_llm_prefix_cache_get_stats() can be called from any
+//   thread.
+
+/** Set the maximum count of tokens of a cached prefix.
+ *
+ * - 0 disables the prefix cache (which is the default).
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_set_max_tokens(
+    int const max_tokens);
+
+/** Set the maximum count of bytes to be held in RAM by the prefix cache.
+ *
+ * - 0 means no limit (which is the default).
+ * - Moves segments to disk or evicts leaves, if necessary.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_set_budget(
+    uint64_t const bytes);
+
+/** Set the directory to move segments to, if the RAM budget is exceeded.
+ *
+ * - nullptr or an empty string disables moving to disk (which is the
+ *   default).
+ * - Segments already on disk stay in the former directory.
+ * - If a segment cannot be written to the directory, leaves get evicted
+ *   instead.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_set_dir(
+    char const * const path);
+
+/** Set the maximum count of bytes to be held on disk by the prefix cache.
+ *
+ * - 0 means no limit (which is the default).
+ * - Evicts leaves, if necessary.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_set_disk_budget(
+    uint64_t const bytes);
+
+/** Remove all nodes and segments (also deleting the files on disk).
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_clear();
+
+/**
+ * - Can be called from any thread.
+ * - Does nothing, if nullptr given.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_prefix_cache_get_stats(
+    struct mt_llm_prefix_cache_stats * const out);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+// The following functions are used internally and are not pure-C:
+//
+#ifdef __cplusplus/*MT_EXPORT_LLM*/
+
+#include <vector>
+
+/** Returns true, if the maximum count of tokens is not zero.
+ */
+bool mt_llm_prefix_cache_is_enabled();
+
+/** Load the KV cache entries of the longest cached prefix of the tokens known
+ *  to be in the context followed by given count of given tokens into the
+ *  context (which must hold exactly the known tokens).
+ *
+ * - Returns the count of given tokens loaded (the caller must update token
+ *   count and sampler).
+ */
+int mt_llm_prefix_cache_load(
+    std::vector<int> const & known,
+    std::vector<int> const & toks,
+    int const count);
+
+/** Add given tokens (the context must hold exactly these tokens) to the tree,
+ *  storing the KV cache entries of the tokens not cached, yet (up to the
+ *  maximum count of tokens).
+ */
+void mt_llm_prefix_cache_store(std::vector<int> const & toks);
+
+/** Like mt_llm_prefix_cache_clear(), but without recording the call.
+ */
+void mt_llm_prefix_cache_free();
+
+#endif //__cplusplus/*MT_EXPORT_LLM*/
+
+#endif //MT_LLM_PREFIX_CACHE
@@ -0,0 +1,107 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+#include "llama.h"
+
+#include "mt_llm_prob.h"
+#include "mt_llm_model.h"
+
+std::vector<float> mt_llm_prob_get_probabilities(
+    std::vector<float> const & logits, float const max)
+{
+    assert(!logits.empty());
+    assert(*std::max_element(logits.begin(), logits.end()) == max);
+
+    int const len = static_cast<int>(logits.size());
+    std::vector<float> ret_val;
+    float sum = 0.0f;
+
+    ret_val.resize(len);
+
+    for(int i = 0; i < len; ++i)
+    {
+        ret_val[i] = expf(logits[i] - max);
+
+        sum += ret_val[i];
+    }
+
+    for(int i = 0; i < len; ++i)
+    {
+        ret_val[i] /= sum;
+    }
+
+    return ret_val;
+}
+
+std::vector<float> mt_llm_prob_get_last_logits(
+    llama_context & ctx, float & max)
+{
+    std::vector<float> ret_val;
+
+    float const * const logits = llama_get_logits_ith(&ctx, -1);
+
+    if(logits == nullptr)
+    {
+        assert(ret_val.empty());
+        return ret_val;
+    }
+
+    int32_t const n_vocab = llama_vocab_n_tokens(
+        llama_model_get_vocab(llama_get_model(&ctx)));
+
+    assert(0 < n_vocab);
+
+    ret_val.resize(static_cast<size_t>(n_vocab));
+
+    ret_val[0] = logits[0];
+    max = ret_val[0];
+    for(int i = 1; i < n_vocab; ++i) // i == Token ID.
+    {
+        ret_val[i] = logits[i];
+
+        if(max < ret_val[i])
+        {
+            max = ret_val[i];
+        }
+    }
+    return ret_val;
+}
+
+std::vector<float> mt_llm_prob_get_token_group_probabilities(
+    std::vector<std::vector<int>> const & token_groups,
+    std::vector<float> const & token_probabilities)
+{
+    size_t const n_groups = token_groups.size(); // Count of token groups.
+    std::vector<float> ret_val(n_groups);
+
+    for(int i = 0; i < static_cast<int>(n_groups); ++i)
+    {
+        for(int j = 0; j < static_cast<int>(token_groups[i].size()); ++j)
+        {
+            ret_val[i] += token_probabilities[token_groups[i][j]];
+        }
+    }
+    return ret_val;
+}
+
+std::vector<float> mt_llm_prob_get_digit_probabilities(
+    llama_model const & model, llama_context & ctx)
+{
+    float max = 0.0f;
+
+    // TODO: Do just once during initialization:
+    //
+    std::vector<std::vector<int>> const dig_toks =
+        mt_llm_model_get_digit_tokens(model);
+
+    std::vector<float> const logits = mt_llm_prob_get_last_logits(ctx, max);
+    std::vector<float> const probs =
+        mt_llm_prob_get_probabilities(logits, max);
+
+    return mt_llm_prob_get_token_group_probabilities(dig_toks, probs);
+}
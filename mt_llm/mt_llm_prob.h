@@ -0,0 +1,42 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#ifndef MT_LLM_PROB
+#define MT_LLM_PROB
+
+#include <vector>
+
+#include "llama.h"
+
+/** Calculate the probability of each token's logit in the given vector via
+ *  softmax.
+ *
+ * - The index equals the token ID.
+ * - Original source: llama.cpp/tools/server/utils.hpp/get_token_probabilities()
+ */
+std::vector<float> mt_llm_prob_get_probabilities(
+    std::vector<float> const & logits, float const max);
+
+/** Get a copy of the last logits of given context and fill given reference
+ *  with maximum logit value found.
+ * 
+ * - The index equals the token ID.
+ * - Returns an empty vector, if no last logits available.
+ * - Original source: llama.cpp/tools/server/utils.hpp/get_token_probabilities()
+ */
+std::vector<float> mt_llm_prob_get_last_logits(
+    llama_context & ctx, float & max);
+
+/** Returns the sum of the probabilities of each group of tokens given.
+ */
+std::vector<float> mt_llm_prob_get_token_group_probabilities(
+    std::vector<std::vector<int>> const & token_groups,
+    std::vector<float> const & token_probabilities);
+
+/** Calculate the probabilities of all digits (see
+ *  mt_llm_model_get_digit_tokens()) from the last logits of given context.
+ */
+std::vector<float> mt_llm_prob_get_digit_probabilities(
+    llama_model const & model, llama_context & ctx);
+
+#endif //MT_LLM_PROB
@@ -0,0 +1,241 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstdio>
+#include <cstdint>
+#include <cinttypes>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "mt_llm_record.h"
+#include "mt_llm_p.h"
+#include "mt_llm_log.h"
+
+static std::mutex s_mtx; // Guards s_file.
+static FILE * s_file = nullptr;
+static std::atomic<bool> s_is_active(false);
+static std::chrono::steady_clock::time_point s_t0;
+
+// Depth of nested calls of API functions to be recorded (only the outermost
+// call gets recorded):
+static thread_local int s_depth = 0;
+
+// Count of sampled tokens given to the callback during the current query and
+// the count, when the callback requested an interrupt (0 = none):
+static int s_sampled_cnt = 0;
+static int s_irq_at = 0;
+
+static int64_t get_time_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - s_t0).count();
+}
+
+static void append_escaped(std::string & out, char const * const str)
+{
+    for(char const * c = str; *c != '\0'; ++c)
+    {
+        switch(*c)
+        {
+            case ' ': out += "\\s"; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+
+            default:
+                out += *c;
+                break;
+        }
+    }
+}
+
+static void append_field(
+    std::string & out, char const * const key, char const * const val)
+{
+    out += ' ';
+    out += key;
+    out += '=';
+    append_escaped(out, val);
+}
+
+static void append_field(
+    std::string & out, char const * const key, double const val)
+{
+    char buf[32];
+
+    snprintf(buf, sizeof buf, "%.9g", val);
+    append_field(out, key, buf);
+}
+
+/**
+ * - Given string must already be escaped (may be empty).
+ */
+static void write_line(
+    int64_t const t_start,
+    char const * const call,
+    bool const ret_val,
+    std::string const & args)
+{
+    int64_t const t_end = get_time_us();
+    std::lock_guard<std::mutex> lock(s_mtx);
+
+    if(s_file == nullptr)
+    {
+        return; // (stopped in the meantime)
+    }
+    fprintf(
+        s_file,
+        "%" PRId64 " %" PRId64 " %d %s%s\n",
+        t_start,
+        t_end - t_start,
+        ret_val ? 1 : 0,
+        call,
+        args.c_str());
+}
+
+int64_t mt_llm_record_begin()
+{
+    ++s_depth;
+    if(s_depth != 1 || !s_is_active.load(std::memory_order_acquire))
+    {
+        return -1;
+    }
+    s_sampled_cnt = 0;
+    s_irq_at = 0;
+    return get_time_us();
+}
+
+void mt_llm_record_end(
+    int64_t const t_start,
+    char const * const call,
+    bool const ret_val,
+    char const * const arg)
+{
+    --s_depth;
+    if(t_start < 0)
+    {
+        return;
+    }
+
+    std::string args;
+
+    if(arg != nullptr)
+    {
+        args += ' ';
+        append_escaped(args, arg);
+    }
+    write_line(t_start, call, ret_val, args);
+}
+
+void mt_llm_record_end_query(
+    int64_t const t_start, bool const ret_val, char const * const prompt)
+{
+    --s_depth;
+    if(t_start < 0)
+    {
+        return;
+    }
+
+    std::string args = " " + std::to_string(s_irq_at) + " ";
+
+    append_escaped(args, prompt == nullptr ? "" : prompt);
+    write_line(t_start, "query", ret_val, args);
+}
+
+void mt_llm_record_end_commit(int64_t const t_start, bool const ret_val)
+{
+    --s_depth;
+    if(t_start < 0)
+    {
+        return;
+    }
+    write_line(
+        t_start,
+        "prompt_commit",
+        ret_val,
+        " " + std::to_string(s_irq_at));
+}
+
+void mt_llm_record_end_reinit(
+    int64_t const t_start, bool const ret_val, struct mt_llm_p const & mt_p)
+{
+    --s_depth;
+    if(t_start < 0)
+    {
+        return;
+    }
+
+    std::string args;
+
+    append_field(args, "n_gpu_layers", mt_p.n_gpu_layers);
+    append_field(args, "seed", mt_p.seed);
+    append_field(args, "n_ctx", mt_p.n_ctx);
+    append_field(args, "threads", mt_p.threads);
+    append_field(args, "top_k", mt_p.top_k);
+    append_field(args, "top_p", mt_p.top_p);
+    append_field(args, "min_p", mt_p.min_p);
+    append_field(args, "temp", mt_p.temp);
+    append_field(args, "grammar", mt_p.grammar);
+    append_field(args, "model_file_path", mt_p.model_file_path);
+    append_field(args, "sys_prompt", mt_p.sys_prompt);
+    append_field(args, "prompt_beg_delim", mt_p.prompt_beg_delim);
+    append_field(args, "prompt_end_delim", mt_p.prompt_end_delim);
+    append_field(args, "sys_prompt_beg_delim", mt_p.sys_prompt_beg_delim);
+    append_field(args, "sys_prompt_mid_delim", mt_p.sys_prompt_mid_delim);
+    append_field(args, "sys_prompt_end_delim", mt_p.sys_prompt_end_delim);
+    append_field(args, "rev_prompt", mt_p.rev_prompt);
+    append_field(args, "think_beg_delim", mt_p.think_beg_delim);
+    append_field(args, "think_end_delim", mt_p.think_end_delim);
+    append_field(args, "try_prompts_by_model", mt_p.try_prompts_by_model);
+
+    write_line(t_start, "reinit", ret_val, args);
+}
+
+void mt_llm_record_on_sampled(bool const irq)
+{
+    ++s_sampled_cnt;
+    if(irq && s_irq_at == 0)
+    {
+        s_irq_at = s_sampled_cnt;
+    }
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_record_start(char const * const path)
+{
+    mt_llm_record_stop();
+
+    if(path == nullptr || path[0] == '\0')
+    {
+        MT_LOG_ERR("No path given!\n");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mtx);
+
+    s_file = fopen(path, "w");
+    if(s_file == nullptr)
+    {
+        MT_LOG_ERR("Failed to create \"%s\"!\n", path);
+        return false;
+    }
+    fprintf(s_file, "mt_llm_record %d\n", MT_LLM_RECORD_VERSION);
+
+    s_t0 = std::chrono::steady_clock::now();
+    s_is_active.store(true, std::memory_order_release);
+    return true;
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_record_stop()
+{
+    std::lock_guard<std::mutex> lock(s_mtx);
+
+    s_is_active.store(false, std::memory_order_release);
+    if(s_file != nullptr)
+    {
+        fclose(s_file);
+        s_file = nullptr;
+    }
+}
@@ -0,0 +1,101 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// This is meant to be a pure-C interface to record the calls of the API (e.g.
+// to replay them later for benchmarking, see mt_llm_bench/mt_llm_replay.c).
+
+#ifndef MT_LLM_RECORD
+#define MT_LLM_RECORD
+
+#include "mt_llm_lib.h"
+
+#ifdef __cplusplus
+    #include <cstdbool>
+    #include <cstdint>
+#else //__cplusplus
+    #include <stdbool.h>
+    #include <stdint.h>
+#endif //__cplusplus
+
+// Version of the record file format (given in its first line):
+#define MT_LLM_RECORD_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+/** Start recording each call of mt_llm_reinit(), mt_llm_deinit(),
+ *  mt_llm_query(), mt_llm_reset(), mt_llm_state_create(),
+ *  mt_llm_state_restore() and of the snapshot functions to the text file at
+ *  given path (which gets replaced).
+ *
+ * - Each line holds the start time (in microseconds, relative to the start of
+ *   the recording), duration (in microseconds), success (0 or 1) and name of a
+ *   call, followed by its arguments (with spaces, backslashes and control
+ *   characters escaped as \s, \\, \n, \r and \t).
+ * - For mt_llm_query(), the count of sampled tokens given to the callback
+ *   until it requested to stop is recorded, too (0 = no interrupt).
+ * - For mt_llm_reinit(), all parameters are recorded (but the callback).
+ * - Stops an already running recording, first.
+ * - Returns false, if the file could not be created.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_record_start(char const * const path);
+
+/**
+ * - Does no harm, if not started.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_record_stop();
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+// The following functions are used internally and are not pure-C:
+//
+#ifdef __cplusplus/*MT_EXPORT_LLM*/
+
+#include "mt_llm_p.h"
+
+/** To be called at the beginning of each API function to be recorded.
+ *
+ * - Returns the start time or -1, if not recording or if called by another
+ *   API function to be recorded (e.g. mt_llm_state_create() called by
+ *   mt_llm_snapshot_update()).
+ * - mt_llm_record_end() [or one of its variants below] must be called with
+ *   the value returned, before the API function returns.
+ */
+int64_t mt_llm_record_begin();
+
+/**
+ * - Does nothing, if -1 given (see mt_llm_record_begin()).
+ * - Argument given is optional and gets escaped.
+ */
+void mt_llm_record_end(
+    int64_t const t_start,
+    char const * const call,
+    bool const ret_val,
+    char const * const arg);
+
+/** Like mt_llm_record_end(), but for mt_llm_query().
+ */
+void mt_llm_record_end_query(
+    int64_t const t_start, bool const ret_val, char const * const prompt);
+
+/** Like mt_llm_record_end_query(), but for mt_llm_prompt_commit() (without a
+ *  prompt).
+ */
+void mt_llm_record_end_commit(int64_t const t_start, bool const ret_val);
+
+/** Like mt_llm_record_end(), but for mt_llm_reinit().
+ */
+void mt_llm_record_end_reinit(
+    int64_t const t_start, bool const ret_val, struct mt_llm_p const & mt_p);
+
+/** To be called for each sampled token given to the callback, with the
+ *  callback's return value.
+ */
+void mt_llm_record_on_sampled(bool const irq);
+
+#endif //__cplusplus/*MT_EXPORT_LLM*/
+
+#endif //MT_LLM_RECORD
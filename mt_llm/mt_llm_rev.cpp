@@ -0,0 +1,97 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "mt_llm_rev.h"
+
+bool mt_llm_rev_init(struct mt_llm_rev & rev, char const * const rev_prompt)
+{
+    assert(rev_prompt != nullptr);
+
+    rev.rev_prompt = rev_prompt;
+    rev.rev_prompt_len = static_cast<int>(strlen(rev_prompt));
+    rev.last_chars = nullptr;
+    rev.last_chars_index = -1;
+    rev.last_chars_filled = false;
+
+    if(rev.rev_prompt_len == 0)
+    {
+        return true; // No reverse prompt used.
+    }
+
+    rev.last_chars = static_cast<char*>(
+        malloc(rev.rev_prompt_len * sizeof *rev.last_chars));
+    return rev.last_chars != nullptr;
+}
+
+void mt_llm_rev_add(struct mt_llm_rev & rev, char const * const piece)
+{
+    if(rev.last_chars == nullptr)
+    {
+        return; // Reverse prompt is not used.
+    }
+
+    char const * piece_chars = piece;
+
+    while(*piece_chars != '\0') // Add current piece to ringbuffer.
+    {
+        ++rev.last_chars_index;
+
+        if(rev.last_chars_index == rev.rev_prompt_len)
+        {
+            rev.last_chars_index = 0;
+        }
+
+        rev.last_chars[rev.last_chars_index] = *piece_chars;
+
+        if(rev.last_chars_index == rev.rev_prompt_len - 1)
+        {
+            // Ring buffer is filled <=> Holds enough characters to compare
+            // with the reverse prompt. Signalize this:
+
+            rev.last_chars_filled = true; // (setting once would be enough)
+        }
+
+        ++piece_chars;
+    }
+}
+
+bool mt_llm_rev_is_found(struct mt_llm_rev const & rev)
+{
+    if(!rev.last_chars_filled)
+    {
+        return false;
+    }
+
+    assert(
+        0 <= rev.last_chars_index && rev.last_chars_index < rev.rev_prompt_len);
+
+    //  0123456
+    // "Master:"
+    // <=> rev_prompt_len = 7
+
+    for(int i = rev.rev_prompt_len - 1; 0 <= i; --i)
+    {
+        int const cur_last_chars_index =
+                (i + rev.last_chars_index + 1) % rev.rev_prompt_len;
+
+        assert(
+            0 <= cur_last_chars_index
+                && cur_last_chars_index < rev.rev_prompt_len);
+
+        if(rev.rev_prompt[i] != rev.last_chars[cur_last_chars_index])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void mt_llm_rev_free(struct mt_llm_rev & rev)
+{
+    free(rev.last_chars);
+    rev.last_chars = nullptr;
+}
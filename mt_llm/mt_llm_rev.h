@@ -0,0 +1,49 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#ifndef MT_LLM_REV
+#define MT_LLM_REV
+
+/** "Ring buffer" that holds the last characters sampled, to detect the
+ *  (optional) reverse prompt.
+ */
+struct mt_llm_rev
+{
+    char const * rev_prompt; // Not owned.
+    int rev_prompt_len; // Count of characters (w/o \0).
+
+    // Can hold the count of characters necessary for the reverse prompt
+    // (w/o \0). Is nullptr, if no reverse prompt is given.
+    char* last_chars;
+
+    // Holds the index in the last_chars "ring buffer" where the last character
+    // was added.
+    int last_chars_index;
+
+    // Set to true, if the count of characters of the reverse prompt was added
+    // to the last_chars "ring buffer".
+    bool last_chars_filled;
+};
+
+/**
+ * - Given reverse prompt must stay valid until mt_llm_rev_free() is called.
+ * - Returns false, if memory allocation failed.
+ * - Call mt_llm_rev_free(), later (also if false was returned).
+ */
+bool mt_llm_rev_init(struct mt_llm_rev & rev, char const * const rev_prompt);
+
+/** Add the characters of given piece to the ring buffer.
+ *
+ * - Does nothing, if no reverse prompt is used.
+ */
+void mt_llm_rev_add(struct mt_llm_rev & rev, char const * const piece);
+
+/** Returns true, if the last characters added equal the reverse prompt.
+ *
+ * - Returns false, if no reverse prompt is used.
+ */
+bool mt_llm_rev_is_found(struct mt_llm_rev const & rev);
+
+void mt_llm_rev_free(struct mt_llm_rev & rev);
+
+#endif //MT_LLM_REV
@@ -0,0 +1,581 @@
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "common.h"
+#include "llama.h"
+
+#include "mt_llm_side.h"
+#include "mt_llm.h"
+#include "mt_llm_p.h"
+#include "mt_llm_s.h"
+#include "mt_llm_ctx.h"
+#include "mt_llm_log.h"
+#include "mt_llm_stats.h"
+#include "mt_llm_prob.h"
+
+static struct mt_llm_s const * s = nullptr; // See mt_llm_side_init().
+
+// The worker thread and its flags:
+//
+static std::thread s_worker;
+static std::mutex s_mutex; // (flags get modified with the context locked)
+static std::condition_variable s_cond; // Signals modified flags.
+static bool s_is_running = false; // Worker thread got started.
+static bool s_is_stopping = false; // Worker thread shall stop.
+static bool s_is_busy = false; // Worker thread has side tokens to decode.
+static bool s_standby_is_busy = false; // Same for standby tokens.
+static bool s_standby_is_held = false; // See mt_llm_side_standby_hold().
+static bool s_is_paused = false; // See mt_llm_side_set_paused().
+
+// See mt_llm_side_set_threads(). Not reset by mt_llm_side_deinit(), to be
+// settable before initialization:
+//
+static int s_threads = 1;
+
+static struct mt_llm_side s_side = {
+    std::vector<int>(),
+    std::vector<int>(),
+    0,
+    -1,
+    0,
+    false,
+    false,
+    0,
+    -1,
+    std::vector<float>() };
+
+// The answer speculated (see mt_llm_side_speculate()), whose tokens get
+// sampled and added to the side tokens following the prompt's ones:
+//
+static int s_spec_max_tokens = 0;
+static llama_sampler * s_spec_sampler = nullptr; // Owned.
+static bool s_spec_is_thinking = false;
+
+// The tokens to be decoded into the standby sequence from position zero on
+// (see mt_llm_side_standby_begin()):
+//
+static std::vector<int> s_standby_toks;
+static std::vector<int> s_standby_types; // Token type of each token.
+static int s_standby_decoded = 0; // Count of the first tokens decoded.
+
+/** Returns true, if given string is empty or holds whitespace, only.
+ */
+static bool is_whitespace_only(std::string const & str)
+{
+    return str.find_first_not_of(" \t\n\v\f\r") == std::string::npos;
+}
+
+/** Sample the next token of the answer speculated (see side_step()) and add
+ *  it to the side tokens.
+ *
+ * - Keeps track of thinking and calculates the digit probabilities for the
+ *   same token as inference() does.
+ */
+static void spec_sample()
+{
+    llama_vocab const * const vocab = llama_model_get_vocab(s->model);
+    bool const is_thinker = s->mt_p->think_beg_delim[0] != '\0';
+
+    llama_token const tok = llama_sampler_sample(s_spec_sampler, s->ctx, -1);
+    std::string const piece = mt_llm_ctx_get_piece_from(*s->ctx, tok);
+
+    if(is_thinker
+        && !s_spec_is_thinking
+        && strncmp(
+            piece.c_str(),
+            s->mt_p->think_beg_delim,
+            MT_LLM_P_LEN_THINK_BEG_DELIM) == 0)
+    {
+        s_spec_is_thinking = true;
+    }
+    if(s_side.spec_dig_idx < 0
+        && !s_spec_is_thinking
+        && !llama_vocab_is_eog(vocab, tok)
+        && !llama_vocab_is_control(vocab, tok)
+        && !is_whitespace_only(piece))
+    {
+        s_side.spec_dig_idx = static_cast<int>(s_side.toks.size());
+        s_side.spec_dig_probs =
+            mt_llm_prob_get_digit_probabilities(*s->model, *s->ctx);
+    }
+    if(is_thinker
+        && s_spec_is_thinking
+        && strncmp(
+            piece.c_str(),
+            s->mt_p->think_end_delim,
+            MT_LLM_P_LEN_THINK_END_DELIM) == 0)
+    {
+        s_spec_is_thinking = false;
+    }
+
+    s_side.toks.push_back(tok);
+    s_side.types.push_back(0); // (set by inference())
+}
+
+/** Remove the entries of the side sequence and forget about the side tokens
+ *  (and the answer speculated).
+ */
+static void side_clear()
+{
+    if(s != nullptr && s->ctx != nullptr)
+    {
+        llama_memory_seq_rm(
+            llama_get_memory(s->ctx), MT_LLM_CTX_SEQ_SIDE, -1, -1);
+    }
+    s_side.toks.clear();
+    s_side.types.clear();
+    s_side.decoded = 0;
+    s_side.base = -1;
+    s_side.is_prompt_beg = false;
+
+    s_side.is_spec = false;
+    s_side.spec_prefill = 0;
+    s_side.spec_dig_idx = -1;
+    s_side.spec_dig_probs.clear();
+    s_spec_max_tokens = 0;
+    if(s_spec_sampler != nullptr)
+    {
+        llama_sampler_free(s_spec_sampler);
+        s_spec_sampler = nullptr;
+    }
+    s_spec_is_thinking = false;
+}
+
+/** Remove the entries of the standby sequence and forget about the standby
+ *  tokens (the worker thread must not be busy with them).
+ */
+static void standby_clear()
+{
+    if(s != nullptr && s->ctx != nullptr)
+    {
+        llama_memory_seq_rm(
+            llama_get_memory(s->ctx), MT_LLM_CTX_SEQ_STANDBY, -1, -1);
+    }
+    s_standby_toks.clear();
+    s_standby_types.clear();
+    s_standby_decoded = 0;
+}
+
+/** Decode given token at given position into given sequence with the count of
+ *  threads set (see mt_llm_side_set_threads()), which gets reset before the
+ *  context is given to other threads.
+ */
+static bool decode_in_background(
+    llama_token const tok,
+    int const pos,
+    llama_seq_id const seq,
+    bool const is_logits)
+{
+    llama_batch batch = llama_batch_init(1, 0, 1); // Needs to be freed!
+
+    common_batch_add(batch, tok, pos, { seq }, is_logits);
+
+    int32_t const threads = 0 < s_threads
+        ? static_cast<int32_t>(s_threads)
+        : static_cast<int32_t>(s->mt_p->threads);
+    int32_t const default_threads = static_cast<int32_t>(s->mt_p->threads);
+
+    llama_set_n_threads(s->ctx, threads, threads);
+    int32_t const llama_decode_res = llama_decode(s->ctx, batch);
+    llama_set_n_threads(s->ctx, default_threads, default_threads);
+
+    llama_batch_free(batch);
+    if(llama_decode_res != 0)
+    {
+        MT_LOG_ERR(
+            "Decoding in the background (error code %d)!\n",
+            static_cast<int>(llama_decode_res));
+        mt_llm_stats_add(MT_LLM_STATS_CNT_ERR_DECODE, 1);
+        return false;
+    }
+    return true;
+}
+
+/** Decode the next side token into the side sequence. If speculating, sample
+ *  the next token of the answer, after the last token of the prompt is
+ *  decoded (see spec_sample()).
+ *
+ * - The context's lock must be held (by the worker thread).
+ * - Returns false, if there is nothing (more) to be done.
+ */
+static bool side_step()
+{
+    if(s == nullptr || s_side.base < 0)
+    {
+        return false;
+    }
+    if(!mt_llm_side_is_valid())
+    {
+        MT_LOG("Main sequence was modified, discarding side sequence.\n");
+        side_clear();
+        return false;
+    }
+    if(s_side.decoded == static_cast<int>(s_side.toks.size()))
+    {
+        return false;
+    }
+
+    llama_token const tok = s_side.toks[s_side.decoded];
+    bool const is_sampled =
+        s_side.is_spec && s_side.spec_prefill <= s_side.decoded;
+
+    // The last token sampled is kept, but not decoded, if the CPU budget is
+    // used (or if it is an EOG token), so inference() decodes it into the
+    // main sequence and gets logits to sample from:
+    //
+    if(is_sampled
+        && (s_spec_max_tokens
+                <= static_cast<int>(s_side.toks.size()) - s_side.spec_prefill
+            || llama_vocab_is_eog(llama_model_get_vocab(s->model), tok)))
+    {
+        return false;
+    }
+
+    int const pos = s_side.base + s_side.decoded;
+
+    if(static_cast<int>(llama_n_ctx(s->ctx)) <= pos)
+    {
+        return false;
+    }
+
+    // The next token is to be sampled from the logits, if speculating:
+    //
+    bool const is_last =
+        s_side.decoded + 1 == static_cast<int>(s_side.toks.size());
+    bool const is_logits = s_side.is_spec && is_last;
+
+    if(!decode_in_background(tok, pos, MT_LLM_CTX_SEQ_SIDE, is_logits))
+    {
+        return false; // (logged)
+    }
+    ++s_side.decoded;
+
+    if(!s_side.is_spec)
+    {
+        return !is_last;
+    }
+    llama_sampler_accept(s_spec_sampler, tok);
+
+    if(is_logits)
+    {
+        spec_sample();
+    }
+    return true;
+}
+
+/** Decode the next standby token into the standby sequence.
+ *
+ * - The context's lock must be held (by the worker thread).
+ * - Returns false, if there is nothing (more) to be done.
+ */
+static bool standby_step()
+{
+    if(s == nullptr
+        || s_standby_decoded == static_cast<int>(s_standby_toks.size())
+        || static_cast<int>(llama_n_ctx(s->ctx)) <= s_standby_decoded)
+    {
+        return false;
+    }
+    if(!decode_in_background(
+            s_standby_toks[s_standby_decoded],
+            s_standby_decoded,
+            MT_LLM_CTX_SEQ_STANDBY,
+            false))
+    {
+        return false; // (logged)
+    }
+    ++s_standby_decoded;
+    if(s_standby_decoded == static_cast<int>(s_standby_toks.size()))
+    {
+        MT_LOG("Standby holds %d tokens.\n", s_standby_decoded);
+        return false;
+    }
+    return true;
+}
+
+/** Decode the side tokens and then the standby tokens in the background,
+ *  while there are some to be decoded and the worker thread is not paused
+ *  (see set_flag()).
+ */
+static void worker()
+{
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(s_mutex);
+
+            s_cond.wait(
+                lock,
+                []()
+                {
+                    return s_is_stopping
+                        || (!s_is_paused
+                            && (s_is_busy
+                                || (s_standby_is_busy
+                                    && !s_standby_is_held)));
+                });
+            if(s_is_stopping)
+            {
+                return;
+            }
+        }
+
+        // One token per turn of holding the context (checking again, as the
+        // thread using the LLM may have changed the flags meanwhile):
+        //
+        struct mt_llm_ctx_guard const guard;
+
+        if(s_is_paused)
+        {
+            continue;
+        }
+        if(s_is_busy)
+        {
+            if(!side_step())
+            {
+                std::lock_guard<std::mutex> const lock(s_mutex);
+
+                s_is_busy = false;
+            }
+            continue;
+        }
+        if(s_standby_is_busy && !s_standby_is_held && !standby_step())
+        {
+            std::lock_guard<std::mutex> const lock(s_mutex);
+
+            s_standby_is_busy = false;
+        }
+    }
+}
+
+/** Set given flag of the worker thread (e.g. s_is_busy) to given value.
+ *  Start the worker thread, if there is something to be done and it is not
+ *  running, yet.
+ *
+ * - The context's lock must be held.
+ */
+static void set_flag(bool & flag, bool const value)
+{
+    std::lock_guard<std::mutex> const lock(s_mutex);
+
+    flag = value;
+    if(!s_is_running && (s_is_busy || s_standby_is_busy))
+    {
+        s_is_stopping = false;
+        s_worker = std::thread(worker);
+        s_is_running = true;
+    }
+    s_cond.notify_all();
+}
+
+/** Stop the worker thread (waiting for the token being decoded, if any).
+ *
+ * - The context's lock must NOT be held.
+ */
+static void stop()
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    if(!s_is_running)
+    {
+        return;
+    }
+    s_is_stopping = true;
+    s_cond.notify_all();
+    lock.unlock();
+
+    s_worker.join();
+
+    lock.lock();
+    s_is_running = false;
+    s_is_stopping = false;
+    s_is_busy = false;
+    s_standby_is_busy = false;
+}
+
+void mt_llm_side_init(struct mt_llm_s const & mt_llm_s)
+{
+    assert(s == nullptr);
+
+    s = &mt_llm_s;
+}
+
+void mt_llm_side_deinit()
+{
+    stop(); // (needs the context)
+
+    side_clear(); // (before freeing context and model)
+    standby_clear();
+    std::vector<int>().swap(s_side.toks);
+    std::vector<int>().swap(s_side.types);
+    std::vector<int>().swap(s_standby_toks);
+    std::vector<int>().swap(s_standby_types);
+    s_standby_is_held = false;
+    s_is_paused = false;
+    s = nullptr;
+}
+
+void mt_llm_side_set_threads(int const threads)
+{
+    s_threads = threads < 0 ? 0 : threads;
+}
+
+void mt_llm_side_set_paused(bool const is_paused)
+{
+    set_flag(s_is_paused, is_paused);
+}
+
+struct mt_llm_side const & mt_llm_side_get()
+{
+    return s_side;
+}
+
+bool mt_llm_side_is_valid()
+{
+    uint64_t epoch = 0;
+    int tok_cnt = -1;
+
+    return 0 <= s_side.base
+        && mt_llm_get_history(epoch, tok_cnt)
+        && s_side.base == tok_cnt
+        && s_side.epoch == epoch;
+}
+
+void mt_llm_side_begin(
+    std::vector<int> const & toks,
+    std::vector<int> const & types,
+    bool const is_prompt_beg)
+{
+    assert(s != nullptr);
+    assert(toks.size() == types.size());
+
+    mt_llm_side_cancel();
+
+    llama_memory_seq_cp(
+        llama_get_memory(s->ctx),
+        MT_LLM_CTX_SEQ_MAIN,
+        MT_LLM_CTX_SEQ_SIDE,
+        -1,
+        -1);
+
+    s_side.toks = toks;
+    s_side.types = types;
+    s_side.decoded = 0;
+    mt_llm_get_history(s_side.epoch, s_side.base);
+    s_side.is_prompt_beg = is_prompt_beg;
+    set_flag(s_is_busy, true);
+}
+
+void mt_llm_side_speculate(
+    std::vector<int> const & toks,
+    std::vector<int> const & types,
+    llama_sampler * const sampler,
+    int const max_tokens)
+{
+    assert(sampler != nullptr);
+
+    mt_llm_side_begin(toks, types, false); // (worker waits for the lock)
+
+    s_side.is_spec = true;
+    s_side.spec_prefill = static_cast<int>(toks.size());
+    s_spec_max_tokens = max_tokens;
+    s_spec_sampler = sampler;
+}
+
+void mt_llm_side_set_max_tokens(int const max_tokens)
+{
+    s_spec_max_tokens = max_tokens;
+    set_flag(s_is_busy, true);
+}
+
+void mt_llm_side_hold()
+{
+    set_flag(s_is_busy, false);
+}
+
+void mt_llm_side_share(int const beg, int const end)
+{
+    assert(0 <= beg && beg <= end && end <= s_side.decoded);
+
+    llama_memory_seq_cp(
+        llama_get_memory(s->ctx),
+        MT_LLM_CTX_SEQ_SIDE,
+        MT_LLM_CTX_SEQ_MAIN,
+        s_side.base + beg,
+        s_side.base + end);
+}
+
+llama_sampler * mt_llm_side_take_sampler()
+{
+    llama_sampler * const ret_val = s_spec_sampler;
+
+    s_spec_sampler = nullptr;
+    return ret_val;
+}
+
+void mt_llm_side_cancel()
+{
+    set_flag(s_is_busy, false);
+    side_clear();
+}
+
+void mt_llm_side_standby_begin(
+    std::vector<int> const & toks, std::vector<int> const & types)
+{
+    assert(toks.size() == types.size());
+
+    set_flag(s_standby_is_busy, false);
+    standby_clear();
+    s_standby_toks = toks;
+    s_standby_types = types;
+    set_flag(s_standby_is_busy, !s_standby_toks.empty());
+}
+
+bool mt_llm_side_standby_is_set()
+{
+    return !s_standby_toks.empty();
+}
+
+int mt_llm_side_standby_get_decoded()
+{
+    return s_standby_decoded;
+}
+
+void mt_llm_side_standby_hold(bool const is_held)
+{
+    set_flag(s_standby_is_held, is_held);
+}
+
+bool mt_llm_side_standby_use()
+{
+    assert(s != nullptr && s->tok_cnt == 0);
+
+    if(s_standby_toks.empty())
+    {
+        return false;
+    }
+
+    mt_llm_side_cancel();
+
+    llama_memory_seq_cp(
+        llama_get_memory(s->ctx),
+        MT_LLM_CTX_SEQ_STANDBY,
+        MT_LLM_CTX_SEQ_SIDE,
+        -1,
+        -1);
+
+    s_side.toks = s_standby_toks;
+    s_side.types = s_standby_types;
+    s_side.decoded = s_standby_decoded;
+    mt_llm_get_history(s_side.epoch, s_side.base);
+    s_side.is_prompt_beg = true;
+    return true;
+}
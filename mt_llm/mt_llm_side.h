@@ -0,0 +1,162 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// Decoding in the background by a worker thread, which decodes a single token
+// each time it holds the lock of the context:
+//
+// - Side tokens get decoded into the side sequence, following the tokens of
+//   the main sequence (whose entries the side sequence shares), e.g. the ones
+//   to precede the next prompt or the ones of a prompt to speculate on, whose
+//   answer's tokens get sampled, then.
+// - Standby tokens get decoded into the standby sequence from position zero
+//   on, after the side tokens (e.g. the ones to precede the first prompt after
+//   a reset).
+// - All functions, but mt_llm_side_init() and mt_llm_side_deinit(), must be
+//   called with the context's lock held.
+
+#ifndef MT_LLM_SIDE
+#define MT_LLM_SIDE
+
+#include <cstdint>
+#include <vector>
+
+#include "llama.h"
+
+#include "mt_llm_s.h"
+
+/** The side tokens, valid as long as the epoch and the token count of the
+ *  main sequence do not change (see mt_llm_side_is_valid()).
+ */
+struct mt_llm_side
+{
+    std::vector<int> toks;
+    std::vector<int> types; // Token type of each token (0, if sampled).
+    int decoded; // Count of the first tokens decoded.
+    int base; // Token count of the main sequence (-1 = no side tokens).
+    uint64_t epoch; // Of the main sequence (see mt_llm_get_history()).
+    bool is_prompt_beg; // Tokens to precede the next prompt.
+
+    // Answer speculated (see mt_llm_side_speculate()):
+    //
+    bool is_spec;
+    int spec_prefill; // Count of the first tokens, which are not sampled.
+    int spec_dig_idx; // Token with digit probabilities (-1 = none).
+    std::vector<float> spec_dig_probs;
+};
+
+/** Use the context, model and parameters of given object (which must stay
+ *  valid until mt_llm_side_deinit() gets called) for decoding in the
+ *  background.
+ */
+void mt_llm_side_init(struct mt_llm_s const & s);
+
+/** Stop the worker thread (waiting for the token being decoded, if any),
+ *  remove the entries of the side and standby sequences and forget about the
+ *  side and standby tokens.
+ *
+ * - The context's lock must NOT be held.
+ * - To be called before freeing the context and the model.
+ */
+void mt_llm_side_deinit();
+
+/** Set the count of threads to decode with in the background (0 = the count
+ *  of the parameters).
+ */
+void mt_llm_side_set_threads(int const threads);
+
+/** Let the worker thread wait (e.g. during a query, as any decode in the
+ *  background discards the logits of the last token decoded into the main
+ *  sequence) or let it go on.
+ */
+void mt_llm_side_set_paused(bool const is_paused);
+
+/** Returns the side tokens (to be read, only).
+ */
+struct mt_llm_side const & mt_llm_side_get();
+
+/** Returns true, if there are side tokens following the main sequence's tokens
+ *  (which were not modified since mt_llm_side_begin()).
+ */
+bool mt_llm_side_is_valid();
+
+/** Let the worker thread decode given tokens of given types into the side
+ *  sequence, following the tokens of the main sequence.
+ *
+ * - Cancels the former decoding in the background.
+ */
+void mt_llm_side_begin(
+    std::vector<int> const & toks,
+    std::vector<int> const & types,
+    bool const is_prompt_beg);
+
+/** Like mt_llm_side_begin(), but with the tokens of a prompt, after which the
+ *  tokens of the answer get sampled with given sampler (taking ownership),
+ *  up to given count (see mt_llm_side_set_max_tokens()).
+ *
+ * - The last token sampled never gets decoded, so the one decoding it into
+ *   the main sequence gets logits to sample the next token from.
+ */
+void mt_llm_side_speculate(
+    std::vector<int> const & toks,
+    std::vector<int> const & types,
+    llama_sampler * const sampler,
+    int const max_tokens);
+
+/** Set the maximum count of tokens of the answer speculated and let the worker
+ *  thread go on (e.g. if the former count was reached).
+ */
+void mt_llm_side_set_max_tokens(int const max_tokens);
+
+/** Stop decoding in the background, keeping the side tokens.
+ */
+void mt_llm_side_hold();
+
+/** Let the main sequence share the entries of the side tokens decoded at
+ *  given indices (from the first up to, but not including the second index).
+ *
+ * - Does not modify the side tokens (see mt_llm_side_hold()).
+ */
+void mt_llm_side_share(int const beg, int const end);
+
+/** Returns the sampler of the answer speculated, which accepted the tokens
+ *  sampled (caller takes ownership).
+ */
+llama_sampler * mt_llm_side_take_sampler();
+
+/** Stop decoding in the background, remove the entries of the side sequence
+ *  and forget about the side tokens (and the answer speculated).
+ */
+void mt_llm_side_cancel();
+
+/** Let the worker thread decode given tokens of given types into the standby
+ *  sequence, after removing the former ones.
+ *
+ * - Just removes the former ones, if empty vectors given.
+ */
+void mt_llm_side_standby_begin(
+    std::vector<int> const & toks, std::vector<int> const & types);
+
+/** Returns true, if there are standby tokens (decoded or not).
+ */
+bool mt_llm_side_standby_is_set();
+
+/** Returns the count of standby tokens decoded.
+ */
+int mt_llm_side_standby_get_decoded();
+
+/** Let the worker thread wait with decoding the standby tokens (e.g. while a
+ *  prompt is pending, as committing it may sample from the logits of its last
+ *  token decoded) or let it go on.
+ */
+void mt_llm_side_standby_hold(bool const is_held);
+
+/** Let the side sequence share the entries of the standby tokens decoded (as
+ *  side tokens to precede the next prompt, following an empty main
+ *  sequence).
+ *
+ * - The tokens not decoded, yet, are left to the standby's decoding.
+ * - Returns false, if there are no standby tokens.
+ */
+bool mt_llm_side_standby_use();
+
+#endif //MT_LLM_SIDE
@@ -2,55 +2,1107 @@
 // Marcel Timm, RhinoDevel, 2025feb23
 
 #include <cstdint>
+#include <cstdlib>
+#include <cstdio>
 #include <string>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <iterator>
 #include <cassert>
 
 #include "mt_llm_snapshot.h"
 #include "mt_llm_state.h"
+#include "mt_llm_state_codec.h"
 #include "mt_llm.h"
 #include "mt_llm_log.h"
+#include "mt_llm_stats.h"
+#include "mt_llm_record.h"
+#include "mt_llm_ctx.h"
 
-static mt_llm_state * s_snapshot = nullptr;
+/** A state and the capacity of its buffer.
+ */
+struct part
+{
+	mt_llm_state state;
+	size_t capacity;
+};
 
-MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_clear()
+/** A named snapshot, consisting of a (full) base state and delta states with
+ *  the KV cache entries of the tokens added after the base or former delta.
+ */
+struct slot
+{
+	std::string name;
+	struct part base;
+	std::vector<struct part> deltas;
+
+	// Epoch of the context (see mt_llm_get_history()), when the slot was last
+	// updated or restored:
+	//
+	uint64_t epoch;
+};
+
+/** An update of a slot, whose state got pinned (see mt_llm_state_pin()) and
+ *  which gets completed by the background thread.
+ */
+struct job
+{
+	uint64_t handle;
+	std::string name;
+	int pin; // Index of the pinned sequence holding the KV cache entries.
+	int pos_beg; // First position of a delta or -1 for a (full) base state.
+	uint64_t epoch; // Of the context, when pinned.
+	int tok_cnt; // Of the context, when pinned.
+	int last_tok_type; // Of the context, when pinned.
+	int depth; // Count of delta states of the slot after the update.
+};
+
+struct pooled
+{
+	uint8_t * buf;
+	size_t capacity;
+};
+
+// Guards all of the following (but not the contents of the state buffers,
+// which are just accessed by the thread using the LLM and by the background
+// thread, while it completes an update):
+//
+static std::mutex s_mutex;
+static std::condition_variable s_cond; // Signals completed async. updates.
+//
+static std::list<struct slot> s_slots; // Most recently used first.
+static std::unordered_map<std::string, std::list<struct slot>::iterator>
+	s_index;
+static std::vector<struct pooled> s_pool;
+//
+static uint64_t s_budget = 0; // 0 = No limit.
+static uint64_t s_held = 0; // Capacities of all (also pooled) buffers.
+static uint64_t s_pooled = 0; // Capacities of all pooled buffers.
+static int s_max_delta_depth = MT_LLM_SNAPSHOT_DEFAULT_MAX_DELTA_DEPTH;
+static int s_codec = MT_LLM_STATE_CODEC_RAW;
+static struct part s_raw = { { 0, -1, nullptr, 0 }, 0 }; // For encoding.
+static struct part s_async_raw = { { 0, -1, nullptr, 0 }, 0 }; // Same.
+//
+static std::deque<struct job> s_jobs; // Incl. the one being completed (first).
+static std::unordered_set<uint64_t> s_failed; // Handles of failed jobs.
+static uint64_t s_next_handle = 1; // 0 is invalid.
+static std::thread s_worker;
+static bool s_is_running = false; // Worker thread got started.
+static bool s_is_stopping = false; // Worker thread shall stop.
+static struct slot const * s_restoring = nullptr; // Must not be evicted.
+//
+static uint64_t s_hits = 0;
+static uint64_t s_misses = 0;
+static uint64_t s_evictions = 0;
+
+/**
+ * - Mutex must be locked.
+ */
+static void update_gauges()
+{
+	mt_llm_stats_set(
+		MT_LLM_STATS_GAUGE_SNAPSHOT_COUNT,
+		static_cast<uint64_t>(s_slots.size()));
+	mt_llm_stats_set(MT_LLM_STATS_GAUGE_SNAPSHOT_BYTES, s_held);
+}
+
+size_t mt_llm_snapshot_get_bytes()
+{
+	std::lock_guard<std::mutex> const lock(s_mutex);
+
+	return static_cast<size_t>(s_held);
+}
+
+static size_t get_slot_bytes(struct slot const & slot)
 {
-	if(s_snapshot != nullptr)
+	size_t ret_val = slot.base.capacity;
+
+	for(auto const & delta : slot.deltas)
 	{
-		free(s_snapshot->state);
-		s_snapshot->state = nullptr;
-		free(s_snapshot);
-		s_snapshot = nullptr;
+		ret_val += delta.capacity;
 	}
+	return ret_val;
 }
 
-MT_EXPORT_LLM_API bool mt_llm_snapshot_restore()
+/** Returns the count of tokens held by given slot.
+ */
+static int get_slot_tok_cnt(struct slot const & slot)
+{
+	return slot.deltas.empty()
+		? slot.base.state.tok_cnt : slot.deltas.back().state.tok_cnt;
+}
+
+/** Add the buffer of given part to the pool.
+ *
+ * - Mutex must be locked.
+ */
+static void pool_part(struct part const & part)
+{
+	if(part.state.state != nullptr)
+	{
+		s_pool.push_back({ part.state.state, part.capacity });
+		s_pooled += part.capacity;
+	}
+}
+
+/** Take the largest (to most likely avoid a reallocation for a full state) or
+ *  the smallest (for a delta state) buffer from the pool.
+ *
+ * - Sets up given part without a buffer, if the pool is empty.
+ * - Mutex must be locked.
+ */
+static void take_pooled(bool const largest, struct part & out)
+{
+	out.state.state = nullptr;
+	out.state.size = 0;
+	out.capacity = 0;
+
+	if(s_pool.empty())
+	{
+		return;
+	}
+
+	size_t best = 0;
+
+	for(size_t i = 1; i < s_pool.size(); ++i)
+	{
+		if((s_pool[best].capacity < s_pool[i].capacity) == largest)
+		{
+			best = i;
+		}
+	}
+	out.state.state = s_pool[best].buf;
+	out.capacity = s_pool[best].capacity;
+	s_pooled -= out.capacity;
+	s_pool[best] = s_pool.back();
+	s_pool.pop_back();
+}
+
+/** Remove given slot and add its buffers to the pool.
+ *
+ * - Mutex must be locked.
+ */
+static void pool_slot(std::list<struct slot>::iterator const it)
+{
+	pool_part(it->base);
+	for(auto const & delta : it->deltas)
+	{
+		pool_part(delta);
+	}
+	s_index.erase(it->name);
+	s_slots.erase(it);
+}
+
+/** Free the buffers of given slot and remove it.
+ *
+ * - Mutex must be locked.
+ */
+static void free_slot(std::list<struct slot>::iterator const it)
+{
+	s_held -= get_slot_bytes(*it);
+	free(it->base.state.state);
+	for(auto const & delta : it->deltas)
+	{
+		free(delta.state.state);
+	}
+	s_index.erase(it->name);
+	s_slots.erase(it);
+}
+
+/** Free pooled buffers and evict least recently used slots until the held
+ *  bytes are within the budget.
+ *
+ * - Never evicts the most recently used slot and the slot being restored.
+ * - Mutex must be locked.
+ */
+static void enforce_budget()
+{
+	while(s_budget != 0 && s_budget < s_held)
+	{
+		if(!s_pool.empty())
+		{
+			free(s_pool.back().buf);
+			s_held -= s_pool.back().capacity;
+			s_pooled -= s_pool.back().capacity;
+			s_pool.pop_back();
+			continue;
+		}
+		if(s_slots.size() < 2)
+		{
+			break;
+		}
+
+		auto victim = std::prev(s_slots.end());
+
+		if(&*victim == s_restoring) // (by the thread using the LLM)
+		{
+			if(s_slots.size() < 3)
+			{
+				break;
+			}
+			victim = std::prev(victim);
+		}
+		MT_LOG(
+			"Evicting snapshot \"%s\" (%zu bytes).\n",
+			victim->name.c_str(),
+			get_slot_bytes(*victim));
+		free_slot(victim);
+		++s_evictions;
+	}
+}
+
+/** Free given buffer used for the raw state data, when encoding.
+ *
+ * - Mutex must be locked.
+ */
+static void free_raw(struct part & raw)
+{
+	s_held -= raw.capacity;
+	free(raw.state.state);
+	raw.state.state = nullptr;
+	raw.state.size = 0;
+	raw.capacity = 0;
+}
+
+/** Copy the current state (or just a delta starting at given position, if it
+ *  is not negative) or the state pinned for given job (if not nullptr) into
+ *  given part, encoded with given codec.
+ *
+ * - Uses given other part for the raw state data, if encoding.
+ * - Mutex must not be locked.
+ */
+static bool fill(
+	struct part & out,
+	struct part & raw,
+	int const codec,
+	int const pos_beg,
+	struct job const * const pinned)
+{
+	struct part & dest = codec == MT_LLM_STATE_CODEC_RAW ? out : raw;
+	bool filled = false;
+
+	if(pinned != nullptr)
+	{
+		dest.state.last_tok_type = pinned->last_tok_type;
+		dest.state.tok_cnt = pinned->tok_cnt;
+		filled = mt_llm_state_fill_pinned(
+			dest.state, dest.capacity, pinned->pin);
+	}
+	else
+	{
+		filled = pos_beg < 0
+			? mt_llm_state_fill(dest.state, dest.capacity)
+			: mt_llm_state_fill_delta(dest.state, dest.capacity, pos_beg);
+	}
+
+	if(!filled || codec == MT_LLM_STATE_CODEC_RAW)
+	{
+		return filled; // (logged on error)
+	}
+	out.state.last_tok_type = raw.state.last_tok_type;
+	out.state.tok_cnt = raw.state.tok_cnt;
+	return mt_llm_state_codec_encode(
+		raw.state.state,
+		raw.state.size,
+		codec,
+		out.state,
+		out.capacity); // (logs on error)
+}
+
+/** Like fill(), but with the store's codec and buffer for the raw state data
+ *  (there is one for the thread using the LLM and one for the background
+ *  thread).
+ *
+ * - Mutex must be locked via given lock (gets unlocked while copying).
+ * - Updates the held bytes by the changes of the capacities.
+ */
+static bool fill_unlocked(
+	std::unique_lock<std::mutex> & lock,
+	struct part & out,
+	int const pos_beg,
+	struct job const * const pinned)
+{
+	struct part & raw_slot = pinned == nullptr ? s_raw : s_async_raw;
+	struct part raw = raw_slot;
+	int const codec = s_codec;
+	size_t const old_capacity = out.capacity;
+	size_t const old_raw_capacity = raw.capacity;
+
+	raw_slot = { { 0, -1, nullptr, 0 }, 0 };
+
+	lock.unlock();
+	bool const ret_val = fill(out, raw, codec, pos_beg, pinned);
+	lock.lock();
+
+	s_held += out.capacity - old_capacity;
+	s_held += raw.capacity - old_raw_capacity;
+	assert(raw_slot.state.state == nullptr);
+	raw_slot = raw;
+	if(s_codec == MT_LLM_STATE_CODEC_RAW)
+	{
+		free_raw(raw_slot); // (codec was changed meanwhile)
+	}
+	return ret_val;
+}
+
+/** Returns true, if there is a job for the slot with given name or for any
+ *  slot, if nullptr given.
+ *
+ * - Mutex must be locked.
+ */
+static bool has_jobs(std::string const * const name)
+{
+	if(name == nullptr)
+	{
+		return !s_jobs.empty();
+	}
+	for(auto const & j : s_jobs)
+	{
+		if(j.name == *name)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/** Wait for the jobs for the slot with given name (for all jobs, if nullptr
+ *  given) to be completed.
+ *
+ * - Mutex must be locked via given lock.
+ */
+static void wait_for_jobs(
+	std::unique_lock<std::mutex> & lock, std::string const * const name)
+{
+	s_cond.wait(lock, [name]() { return !has_jobs(name); });
+}
+
+static void clear()
+{
+	std::unique_lock<std::mutex> lock(s_mutex);
+
+	wait_for_jobs(lock, nullptr);
+	s_failed.clear();
+
+	while(!s_slots.empty())
+	{
+		free_slot(s_slots.begin());
+	}
+	for(auto & p : s_pool)
+	{
+		free(p.buf);
+	}
+	s_pool.clear();
+	free_raw(s_raw);
+	free_raw(s_async_raw);
+
+	s_held = 0;
+	s_pooled = 0;
+	update_gauges();
+}
+
+static bool restore(std::string const & name)
 {
-	if(s_snapshot == nullptr)
+	mt_llm_state base;
+	std::vector<mt_llm_state> deltas;
+
 	{
-		MT_LOG_ERR("No snapshot was taken!");
+		std::unique_lock<std::mutex> lock(s_mutex);
+
+		wait_for_jobs(lock, &name);
+
+		auto const entry = s_index.find(name);
+
+		if(entry == s_index.end())
+		{
+			++s_misses;
+			MT_LOG_ERR("No snapshot \"%s\" was taken!\n", name.c_str());
+			return false;
+		}
+		++s_hits;
+
+		// Mark as most recently used:
+		//
+		s_slots.splice(s_slots.begin(), s_slots, entry->second);
+
+		// Protect the buffers from being freed by the background thread (a
+		// new slot added by it may make this one not the most recently used):
+		//
+		s_restoring = &*entry->second;
+
+		// (buffers stay owned by the slot)
+		//
+		base = entry->second->base.state;
+		for(auto const & delta : entry->second->deltas)
+		{
+			deltas.push_back(delta.state);
+		}
+	}
+
+	assert(0 < base.size);
+
+	bool ret_val = mt_llm_state_restore(&base); // (logs on error)
+
+	for(size_t i = 0; ret_val && i < deltas.size(); ++i)
+	{
+		ret_val = mt_llm_state_restore_delta(deltas[i]); // (logs on error)
+	}
+	if(!ret_val)
+	{
+		std::lock_guard<std::mutex> const lock(s_mutex);
+
+		s_restoring = nullptr;
 		return false;
 	}
 
-	assert(0 < s_snapshot->size);
+	// The context now holds the slot's tokens, so the next update of the slot
+	// can be stored as delta:
+	{
+		uint64_t epoch = 0;
+		int tok_cnt = 0;
+
+		mt_llm_get_history(epoch, tok_cnt);
 
-	return mt_llm_state_restore(s_snapshot); // (logs on error)
+		std::lock_guard<std::mutex> const lock(s_mutex);
+		auto const entry = s_index.find(name);
+
+		s_restoring = nullptr;
+		if(entry != s_index.end())
+		{
+			entry->second->epoch = epoch;
+		}
+	}
+	return true;
 }
 
-MT_EXPORT_LLM_API bool mt_llm_snapshot_update()
+/** Add a delta state holding the tokens appended since the last update or
+ *  restore of given slot to it (taken from the state pinned for given job, if
+ *  not nullptr).
+ *
+ * - Mutex must be locked via given lock (gets unlocked while copying).
+ */
+static bool update_delta(
+	std::unique_lock<std::mutex> & lock,
+	std::string const & name,
+	int const pos_beg,
+	struct job const * const pinned)
+{
+	struct part delta;
+
+	take_pooled(false, delta);
+
+	bool const filled = fill_unlocked(lock, delta, pos_beg, pinned);
+	auto const entry = s_index.find(name);
+
+	if(!filled
+		|| entry == s_index.end()
+		|| get_slot_tok_cnt(*entry->second) != pos_beg) // (e.g. evicted)
+	{
+		pool_part(delta);
+		if(entry != s_index.end())
+		{
+			pool_slot(entry->second); // (its state is unknown)
+		}
+		return false;
+	}
+
+	assert(0 < delta.state.size);
+
+	entry->second->deltas.push_back(delta);
+	s_slots.splice(s_slots.begin(), s_slots, entry->second);
+	if(s_budget != 0 && s_budget < get_slot_bytes(*entry->second))
+	{
+		MT_LOG_ERR(
+			"Snapshot \"%s\" exceeds the budget of %llu bytes!\n",
+			name.c_str(),
+			static_cast<unsigned long long>(s_budget));
+		pool_slot(entry->second);
+		return false;
+	}
+	return true;
+}
+
+/** Replace the slot with given name (if existing) by one holding a (full) base
+ *  state, only (taken from the state pinned for given job, if not nullptr).
+ *
+ * - Mutex must be locked via given lock (gets unlocked while copying).
+ */
+static bool update_base(
+	std::unique_lock<std::mutex> & lock,
+	std::string const & name,
+	uint64_t const epoch,
+	struct job const * const pinned)
+{
+	struct part base;
+	auto const entry = s_index.find(name);
+
+	// Take over the buffer of the slot to be updated or one from the pool:
+	//
+	if(entry != s_index.end())
+	{
+		base = entry->second->base;
+		entry->second->base.state.state = nullptr;
+		pool_slot(entry->second); // (pools the delta buffers)
+	}
+	else
+	{
+		take_pooled(true, base);
+	}
+
+	bool const filled = fill_unlocked(lock, base, -1, pinned);
+
+	if(!filled || (s_budget != 0 && s_budget < base.capacity))
+	{
+		if(filled)
+		{
+			MT_LOG_ERR(
+				"Snapshot of %zu bytes exceeds the budget of %llu bytes!\n",
+				base.capacity,
+				static_cast<unsigned long long>(s_budget));
+		}
+		pool_part(base);
+		return false;
+	}
+
+	assert(0 < base.state.size);
+	assert(s_index.find(name) == s_index.end());
+
+	s_slots.push_front({ name, base, {}, epoch });
+	s_index[name] = s_slots.begin();
+	return true;
+}
+
+static bool update(std::string const & name)
+{
+	uint64_t epoch = 0;
+	int tok_cnt = 0;
+
+	if(!mt_llm_get_history(epoch, tok_cnt))
+	{
+		MT_LOG_ERR("Not intialized!\n");
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock(s_mutex);
+
+	wait_for_jobs(lock, &name);
+
+	auto const entry = s_index.find(name);
+	bool ret_val = false;
+
+	// Just add a delta, if the context still holds the slot's tokens and the
+	// maximum depth is not reached (otherwise compact to a new base):
+	//
+	if(entry != s_index.end()
+		&& entry->second->epoch == epoch
+		&& static_cast<int>(entry->second->deltas.size()) < s_max_delta_depth
+		&& get_slot_tok_cnt(*entry->second) <= tok_cnt)
+	{
+		if(get_slot_tok_cnt(*entry->second) == tok_cnt)
+		{
+			// Nothing was added.
+
+			s_slots.splice(s_slots.begin(), s_slots, entry->second);
+			return true;
+		}
+		ret_val = update_delta(
+			lock, name, get_slot_tok_cnt(*entry->second), nullptr);
+	}
+	else
+	{
+		ret_val = update_base(lock, name, epoch, nullptr);
+	}
+	enforce_budget();
+	update_gauges();
+	return ret_val;
+}
+
+/** Complete the given job's update of its slot.
+ *
+ * - Mutex must be locked via given lock (gets unlocked while copying).
+ */
+static bool complete(
+	std::unique_lock<std::mutex> & lock, struct job const & j)
+{
+	bool const ret_val = j.pos_beg < 0
+		? update_base(lock, j.name, j.epoch, &j)
+		: update_delta(lock, j.name, j.pos_beg, &j);
+
+	if(!ret_val)
+	{
+		MT_LOG_ERR(
+			"Async. update of snapshot \"%s\" failed!\n", j.name.c_str());
+	}
+	enforce_budget();
+	update_gauges();
+	return ret_val;
+}
+
+static void worker()
 {
-	mt_llm_snapshot_clear();
+	std::unique_lock<std::mutex> lock(s_mutex);
 
-	assert(s_snapshot == nullptr);
+	while(true)
+	{
+		s_cond.wait(lock, []() { return !s_jobs.empty() || s_is_stopping; });
+		if(s_jobs.empty())
+		{
+			return; // Stopping.
+		}
+
+		// The job stays queued until completed (so its slot gets waited for
+		// and its pin stays in use):
+		//
+		struct job const j = s_jobs.front();
+
+		if(!complete(lock, j))
+		{
+			s_failed.insert(j.handle);
+		}
+		assert(!s_jobs.empty() && s_jobs.front().handle == j.handle);
+		s_jobs.pop_front();
+		s_cond.notify_all();
+	}
+}
+
+/** Returns the index of a pinned sequence not in use by a job or -1, if all
+ *  are in use.
+ *
+ * - Mutex must be locked.
+ */
+static int get_free_pin()
+{
+	bool used[MT_LLM_CTX_SEQ_PIN_COUNT] = { false };
+
+	for(auto const & j : s_jobs)
+	{
+		used[j.pin] = true;
+	}
+	for(int i = 0; i < MT_LLM_CTX_SEQ_PIN_COUNT; ++i)
+	{
+		if(!used[i])
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/** Like update(), but just pins the state in the context and lets the
+ *  background thread complete the update.
+ *
+ * - Returns the handle of the update or 0 on error.
+ */
+static uint64_t update_async(std::string const & name)
+{
+	uint64_t epoch = 0;
+	int tok_cnt = 0;
 
-	mt_llm_state * const state = mt_llm_state_create(); // (logs on error)
+	if(!mt_llm_get_history(epoch, tok_cnt))
+	{
+		MT_LOG_ERR("Not intialized!\n");
+		return 0;
+	}
 
-	if(state == nullptr)
+	std::unique_lock<std::mutex> lock(s_mutex);
+
+	// Wait for the oldest update to complete, if all pins are in use:
+	//
+	s_cond.wait(lock, []() { return 0 <= get_free_pin(); });
+
+	struct job j;
+	uint64_t base_epoch = 0;
+	int base_tok_cnt = -1, // -1 = Neither slot, nor pending update existing.
+		base_depth = 0;
+
+	j.handle = s_next_handle++;
+	j.name = name;
+	j.pin = get_free_pin();
+	j.epoch = epoch;
+	j.pos_beg = -1;
+	j.depth = 0;
+
+	// Base the update on the last pending update of the slot or on the slot
+	// (like update() does):
+	//
+	for(auto const & pending : s_jobs)
+	{
+		if(pending.name == name)
+		{
+			base_epoch = pending.epoch;
+			base_tok_cnt = pending.tok_cnt;
+			base_depth = pending.depth;
+		}
+	}
+	if(base_tok_cnt < 0)
+	{
+		auto const entry = s_index.find(name);
+
+		if(entry != s_index.end())
+		{
+			base_epoch = entry->second->epoch;
+			base_tok_cnt = get_slot_tok_cnt(*entry->second);
+			base_depth = static_cast<int>(entry->second->deltas.size());
+		}
+	}
+	if(0 <= base_tok_cnt
+		&& base_epoch == epoch
+		&& base_depth < s_max_delta_depth
+		&& base_tok_cnt <= tok_cnt)
+	{
+		if(base_tok_cnt == tok_cnt)
+		{
+			// Nothing was added (the handle is completed, as it is not
+			// queued).
+
+			auto const entry = s_index.find(name);
+
+			if(entry != s_index.end())
+			{
+				s_slots.splice(s_slots.begin(), s_slots, entry->second);
+			}
+			return j.handle;
+		}
+		j.pos_beg = base_tok_cnt;
+		j.depth = base_depth + 1;
+	}
+
+	// Pinning is fast, as no data gets copied:
+	{
+		struct mt_llm_state pinned = { 0, -1, nullptr, 0 };
+
+		lock.unlock();
+		bool const is_pinned = mt_llm_state_pin(j.pin, j.pos_beg, pinned);
+		lock.lock();
+
+		if(!is_pinned)
+		{
+			return 0; // (logged)
+		}
+		j.tok_cnt = pinned.tok_cnt;
+		j.last_tok_type = pinned.last_tok_type;
+	}
+
+	if(!s_is_running)
+	{
+		s_is_stopping = false;
+		s_worker = std::thread(worker);
+		s_is_running = true;
+	}
+	s_jobs.push_back(j);
+	s_cond.notify_all();
+	return j.handle;
+}
+
+/**
+ * - Mutex must be locked.
+ */
+static int get_async_status(uint64_t const handle)
+{
+	if(handle == 0 || s_next_handle <= handle)
+	{
+		return MT_LLM_SNAPSHOT_ASYNC_FAILED; // Invalid handle.
+	}
+	for(auto const & j : s_jobs)
 	{
+		if(j.handle == handle)
+		{
+			return MT_LLM_SNAPSHOT_ASYNC_PENDING;
+		}
+	}
+	return s_failed.find(handle) == s_failed.end()
+		? MT_LLM_SNAPSHOT_ASYNC_DONE : MT_LLM_SNAPSHOT_ASYNC_FAILED;
+}
+
+static int poll_async(uint64_t const handle)
+{
+	std::lock_guard<std::mutex> const lock(s_mutex);
+
+	return get_async_status(handle);
+}
+
+static bool wait_async(uint64_t const handle)
+{
+	std::unique_lock<std::mutex> lock(s_mutex);
+
+	s_cond.wait(
+		lock,
+		[handle]()
+		{
+			return get_async_status(handle) != MT_LLM_SNAPSHOT_ASYNC_PENDING;
+		});
+	return get_async_status(handle) == MT_LLM_SNAPSHOT_ASYNC_DONE;
+}
+
+void mt_llm_snapshot_async_stop()
+{
+	std::unique_lock<std::mutex> lock(s_mutex);
+
+	if(!s_is_running)
+	{
+		return;
+	}
+	wait_for_jobs(lock, nullptr);
+	s_is_stopping = true;
+	s_cond.notify_all();
+	lock.unlock();
+
+	s_worker.join();
+
+	lock.lock();
+	s_is_running = false;
+	s_is_stopping = false;
+}
+
+static bool exists(std::string const & name)
+{
+	std::lock_guard<std::mutex> const lock(s_mutex);
+
+	return s_index.find(name) != s_index.end();
+}
+
+static void remove_slot(std::string const & name)
+{
+	std::unique_lock<std::mutex> lock(s_mutex);
+
+	wait_for_jobs(lock, &name);
+
+	auto const entry = s_index.find(name);
+
+	if(entry != s_index.end())
+	{
+		pool_slot(entry->second);
+		update_gauges();
+	}
+}
+
+static void set_budget(uint64_t const bytes)
+{
+	std::lock_guard<std::mutex> const lock(s_mutex);
+
+	s_budget = bytes;
+	enforce_budget();
+	update_gauges();
+}
+
+static bool set_codec(int const codec)
+{
+	if(codec != MT_LLM_STATE_CODEC_RAW
+		&& codec != MT_LLM_STATE_CODEC_LOSSLESS
+		&& codec != MT_LLM_STATE_CODEC_Q8_0)
+	{
+		MT_LOG_ERR("Invalid codec %d given!\n", codec);
 		return false;
 	}
 
-	assert(0 < state->size);
+	std::lock_guard<std::mutex> const lock(s_mutex);
 
-	s_snapshot = state;
+	s_codec = codec;
+	if(codec == MT_LLM_STATE_CODEC_RAW)
+	{
+		free_raw(s_raw);
+		free_raw(s_async_raw); // (does nothing, if in use by worker thread)
+		update_gauges();
+	}
 	return true;
 }
+
+int mt_llm_snapshot_get_codec()
+{
+	std::lock_guard<std::mutex> const lock(s_mutex);
+
+	return s_codec;
+}
+
+static void set_max_delta_depth(int const depth)
+{
+	std::lock_guard<std::mutex> const lock(s_mutex);
+
+	s_max_delta_depth = depth < 0 ? 0 : depth;
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_clear()
+{
+	int64_t const t_rec = mt_llm_record_begin();
+
+	clear();
+	mt_llm_record_end(t_rec, "snapshot_clear", true, nullptr);
+}
+
+MT_EXPORT_LLM_API bool mt_llm_snapshot_restore()
+{
+	int64_t const t_rec = mt_llm_record_begin();
+	bool const ret_val = restore("");
+
+	mt_llm_record_end(t_rec, "snapshot_restore", ret_val, nullptr);
+	return ret_val;
+}
+
+MT_EXPORT_LLM_API bool mt_llm_snapshot_update()
+{
+	int64_t const t_rec = mt_llm_record_begin();
+	bool const ret_val = update("");
+
+	mt_llm_record_end(t_rec, "snapshot_update", ret_val, nullptr);
+	return ret_val;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_slot_update(
+	char const * const name)
+{
+	if(name == nullptr)
+	{
+		MT_LOG_ERR("NULL given!\n");
+		return false;
+	}
+
+	int64_t const t_rec = mt_llm_record_begin();
+	bool const ret_val = update(name);
+
+	mt_llm_record_end(t_rec, "snapshot_slot_update", ret_val, name);
+	return ret_val;
+}
+
+MT_EXPORT_LLM_API uint64_t __stdcall mt_llm_snapshot_update_async()
+{
+	int64_t const t_rec = mt_llm_record_begin();
+	uint64_t const ret_val = update_async("");
+
+	mt_llm_record_end(t_rec, "snapshot_update_async", ret_val != 0, nullptr);
+	return ret_val;
+}
+
+MT_EXPORT_LLM_API uint64_t __stdcall mt_llm_snapshot_slot_update_async(
+	char const * const name)
+{
+	if(name == nullptr)
+	{
+		MT_LOG_ERR("NULL given!\n");
+		return 0;
+	}
+
+	int64_t const t_rec = mt_llm_record_begin();
+	uint64_t const ret_val = update_async(name);
+
+	mt_llm_record_end(t_rec, "snapshot_slot_update_async", ret_val != 0, name);
+	return ret_val;
+}
+
+MT_EXPORT_LLM_API int __stdcall mt_llm_snapshot_async_poll(
+	uint64_t const handle)
+{
+	return poll_async(handle);
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_async_wait(
+	uint64_t const handle)
+{
+	int64_t const t_rec = mt_llm_record_begin();
+	bool const ret_val = wait_async(handle);
+	char arg[32];
+
+	snprintf(arg, sizeof arg, "%llu", static_cast<unsigned long long>(handle));
+	mt_llm_record_end(t_rec, "snapshot_async_wait", ret_val, arg);
+	return ret_val;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_slot_restore(
+	char const * const name)
+{
+	if(name == nullptr)
+	{
+		MT_LOG_ERR("NULL given!\n");
+		return false;
+	}
+
+	int64_t const t_rec = mt_llm_record_begin();
+	bool const ret_val = restore(name);
+
+	mt_llm_record_end(t_rec, "snapshot_slot_restore", ret_val, name);
+	return ret_val;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_slot_exists(
+	char const * const name)
+{
+	return name != nullptr && exists(name);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_slot_remove(
+	char const * const name)
+{
+	if(name == nullptr)
+	{
+		return;
+	}
+
+	int64_t const t_rec = mt_llm_record_begin();
+
+	remove_slot(name);
+	mt_llm_record_end(t_rec, "snapshot_slot_remove", true, name);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_set_budget(
+	uint64_t const bytes)
+{
+	int64_t const t_rec = mt_llm_record_begin();
+	char arg[32];
+
+	set_budget(bytes);
+	snprintf(arg, sizeof arg, "%llu", static_cast<unsigned long long>(bytes));
+	mt_llm_record_end(t_rec, "snapshot_set_budget", true, arg);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_set_max_delta_depth(
+	int const depth)
+{
+	int64_t const t_rec = mt_llm_record_begin();
+	char arg[16];
+
+	set_max_delta_depth(depth);
+	snprintf(arg, sizeof arg, "%d", depth);
+	mt_llm_record_end(t_rec, "snapshot_set_max_delta_depth", true, arg);
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_set_codec(int const codec)
+{
+	int64_t const t_rec = mt_llm_record_begin();
+	bool const ret_val = set_codec(codec);
+	char arg[16];
+
+	snprintf(arg, sizeof arg, "%d", codec);
+	mt_llm_record_end(t_rec, "snapshot_set_codec", ret_val, arg);
+	return ret_val;
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_get_stats(
+	struct mt_llm_snapshot_stats * const out)
+{
+	if(out == nullptr)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> const lock(s_mutex);
+
+	out->slots = static_cast<uint64_t>(s_slots.size());
+	out->deltas = 0;
+	for(auto const & slot : s_slots)
+	{
+		out->deltas += static_cast<uint64_t>(slot.deltas.size());
+	}
+	out->bytes = s_held;
+	out->pooled_bytes = s_pooled;
+	out->budget_bytes = s_budget;
+	out->hits = s_hits;
+	out->misses = s_misses;
+	out->evictions = s_evictions;
+	out->codec = s_codec;
+	out->pending = static_cast<uint64_t>(s_jobs.size());
+}
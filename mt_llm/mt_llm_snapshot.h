@@ -10,20 +10,219 @@
 
 #ifdef __cplusplus
 	#include <cstdbool>
+	#include <cstddef>
+	#include <cstdint>
 #else //__cplusplus
 	#include <stdbool.h>
+	#include <stdint.h>
 #endif //__cplusplus
 
+/** Statistics of the snapshot store.
+ */
+struct mt_llm_snapshot_stats
+{
+	uint64_t slots; // Count of stored snapshots.
+	uint64_t deltas; // Count of delta states of all snapshots.
+	uint64_t bytes; // Held by the snapshots and by pooled buffers.
+	uint64_t pooled_bytes; // Held by buffers kept for reuse.
+	uint64_t budget_bytes; // See mt_llm_snapshot_set_budget().
+
+	uint64_t hits; // Restores of existing snapshots.
+	uint64_t misses; // Restores of non-existing snapshots.
+	uint64_t evictions; // Snapshots removed to stay within the budget.
+
+	int codec; // See mt_llm_snapshot_set_codec().
+
+	uint64_t pending; // Async. updates not completed, yet.
+};
+
+// See mt_llm_snapshot_set_max_delta_depth():
+//
+#define MT_LLM_SNAPSHOT_DEFAULT_MAX_DELTA_DEPTH 8
+
+// Status of an async. update (see mt_llm_snapshot_async_poll(), could be an
+// enum):
+//
+#define MT_LLM_SNAPSHOT_ASYNC_PENDING 0
+#define MT_LLM_SNAPSHOT_ASYNC_DONE 1
+#define MT_LLM_SNAPSHOT_ASYNC_FAILED 2
+
 #ifdef __cplusplus
 extern "C" {
 #endif //__cplusplus
 
+// The snapshot store holds named snapshots (slots) of the LLM state in RAM:
+//
+// - If just tokens were added to the conversation since the last update or
+//   restore of a slot, updating the slot again just stores the KV cache
+//   entries of these tokens as a "delta" (restoring applies the full base
+//   state and all deltas).
+// - If a slot's count of deltas reached the maximum depth or if the tokens in
+//   the context were changed otherwise (e.g. by a reset), updating it stores
+//   the full state again (as new base), reusing the base's buffer (a new one is
+//   only allocated, if the state got larger).
+// - Buffers of removed slots are pooled and reused by other slots.
+// - If a byte budget is set, the least recently used (updated or restored)
+//   slots are evicted, if necessary.
+// - Snapshots can be stored lossless compressed or with quantized K and V
+//   values (see mt_llm_snapshot_set_codec()).
+// - Async. updates just pin the KV cache entries in the context and let a
+//   background thread copy them, while the LLM keeps being used (see
+//   mt_llm_snapshot_slot_update_async()).
+// - Updating and restoring must happen on the thread that uses the LLM (like
+//   all other calls of mt_llm), but mt_llm_snapshot_slot_exists(),
+//   mt_llm_snapshot_async_poll(), mt_llm_snapshot_async_wait() and
+//   mt_llm_snapshot_get_stats() can be called from any thread.
+// - Calls for a slot with pending async. updates (and clearing the store) wait
+//   for these updates to complete, first.
+
+/** Remove all snapshots and free all (also pooled) buffers.
+ *
+ * - Waits for pending async. updates and forgets their results.
+ */
 MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_clear();
+
+/** Like mt_llm_snapshot_slot_update() for the slot with empty name.
+ */
 MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_update();
+
+/** Like mt_llm_snapshot_slot_restore() for the slot with empty name.
+ */
 MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_restore();
 
+/** Store the current LLM state in the slot with given name, creating the slot,
+ *  if not existing.
+ *
+ * - Evicts least recently used other slots, if necessary to stay within the
+ *   budget.
+ * - Returns false and removes the slot, if the state could not be stored or if
+ *   it alone does not fit into the budget.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_slot_update(
+	char const * const name);
+
+/** Like mt_llm_snapshot_slot_update_async() for the slot with empty name.
+ */
+MT_EXPORT_LLM_API uint64_t __stdcall mt_llm_snapshot_update_async();
+
+/** Like mt_llm_snapshot_slot_update(), but just pins the current KV cache
+ *  entries (or the ones appended since the last update) in the context
+ *  without copying them, which gets done by a background thread.
+ *
+ * - Meant to be called at the end of a turn: The next query can be made right
+ *   away, the background thread gets the context between the tokens being
+ *   decoded (for the time of copying one part of 1 MiB, at most) and while
+ *   the LLM is not used.
+ * - Waits for the oldest async. update to complete, if
+ *   MT_LLM_CTX_SEQ_PIN_COUNT (2) updates are pending.
+ * - Like all other calls for slots, must not be called from within the
+ *   callback given via mt_llm_p.
+ * - Returns a handle to be given to mt_llm_snapshot_async_poll() or to
+ *   mt_llm_snapshot_async_wait() or 0, if not initialized or on error.
+ */
+MT_EXPORT_LLM_API uint64_t __stdcall mt_llm_snapshot_slot_update_async(
+	char const * const name);
+
+/** Returns MT_LLM_SNAPSHOT_ASYNC_PENDING, MT_LLM_SNAPSHOT_ASYNC_DONE or
+ *  MT_LLM_SNAPSHOT_ASYNC_FAILED (also for an invalid handle) for the async.
+ *  update with given handle.
+ *
+ * - Can be called from any thread.
+ */
+MT_EXPORT_LLM_API int __stdcall mt_llm_snapshot_async_poll(
+	uint64_t const handle);
+
+/** Wait for the async. update with given handle to complete.
+ *
+ * - Returns false, if the update failed or for an invalid handle.
+ * - Can be called from any thread, but not from within the callback given
+ *   via mt_llm_p (as the background thread needs the context, too).
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_async_wait(
+	uint64_t const handle);
+
+/** Restore the LLM state from the slot with given name.
+ *
+ * - Counts as hit or miss (see mt_llm_snapshot_get_stats()).
+ * - Returns false, if there is no such slot or restoring failed.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_slot_restore(
+	char const * const name);
+
+/**
+ * - Can be called from any thread.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_slot_exists(
+	char const * const name);
+
+/** Remove the slot with given name and keep its buffer for reuse.
+ *
+ * - Does nothing, if there is no such slot.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_slot_remove(
+	char const * const name);
+
+/** Set the maximum count of delta states per slot, before the slot gets
+ *  compacted into a (full) base state, again, on its next update.
+ *
+ * - 0 disables delta states.
+ * - Default is MT_LLM_SNAPSHOT_DEFAULT_MAX_DELTA_DEPTH.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_set_max_delta_depth(
+	int const depth);
+
+/** Set the codec to encode snapshots with, when they get stored (see
+ *  mt_llm_state_codec.h).
+ *
+ * - Affects the following updates of slots and files written by
+ *   mt_llm_snapshot_file_save() and mt_llm_snapshot_file_save_async() (the
+ *   latter encode in the background thread).
+ * - Restoring decodes the snapshots, again.
+ * - While encoding, the store keeps a buffer for the raw state data (counted as
+ *   held bytes), which gets freed when MT_LLM_STATE_CODEC_RAW is set again.
+ * - Default is MT_LLM_STATE_CODEC_RAW.
+ * - Returns false and does nothing, if an invalid codec is given.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_set_codec(int const codec);
+
+/** Set the maximum count of bytes to be held by the snapshot store.
+ *
+ * - 0 means no limit (which is the default).
+ * - Frees pooled buffers and evicts least recently used slots, if necessary.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_set_budget(
+	uint64_t const bytes);
+
+/**
+ * - Can be called from any thread.
+ * - Does nothing, if nullptr given.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_snapshot_get_stats(
+	struct mt_llm_snapshot_stats * const out);
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
 
+// The following functions are used internally and are not pure-C:
+//
+#ifdef __cplusplus/*MT_EXPORT_LLM*/
+
+/** Returns the count of bytes used by the stored snapshot(-s) and by the
+ *  pooled buffers.
+ */
+size_t mt_llm_snapshot_get_bytes();
+
+/** Returns the codec set via mt_llm_snapshot_set_codec().
+ */
+int mt_llm_snapshot_get_codec();
+
+/** Wait for all async. updates to complete and stop the background thread.
+ *
+ * - Does no harm, if not started.
+ */
+void mt_llm_snapshot_async_stop();
+
+#endif //__cplusplus/*MT_EXPORT_LLM*/
+
 #endif //MT_LLM_SNAPSHOT
@@ -0,0 +1,590 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else //_WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif //_WIN32
+
+#include "mt_llm_snapshot_file.h"
+#include "mt_llm_state.h"
+#include "mt_llm_state_codec.h"
+#include "mt_llm_snapshot.h"
+#include "mt_llm.h"
+#include "mt_llm_log.h"
+#include "mt_llm_record.h"
+
+static char const s_magic[8] = { 'M', 'T', 'L', 'L', 'M', 'S', 'N', 'P' };
+
+// Offsets of the header fields (see mt_llm_snapshot_file.h):
+//
+#define MT_LLM_SNAPSHOT_FILE_OFFSET_MAGIC 0
+#define MT_LLM_SNAPSHOT_FILE_OFFSET_VERSION 8
+#define MT_LLM_SNAPSHOT_FILE_OFFSET_HEADER_SIZE 12
+#define MT_LLM_SNAPSHOT_FILE_OFFSET_FINGERPRINT 16
+#define MT_LLM_SNAPSHOT_FILE_OFFSET_TOK_CNT 24
+#define MT_LLM_SNAPSHOT_FILE_OFFSET_LAST_TOK_TYPE 28
+#define MT_LLM_SNAPSHOT_FILE_OFFSET_DATA_SIZE 32
+//
+#define MT_LLM_SNAPSHOT_FILE_MIN_HEADER_SIZE 40
+
+// Header size used for writing (keeps the state data aligned to cache lines):
+//
+#define MT_LLM_SNAPSHOT_FILE_HEADER_SIZE 64
+
+/** A file to be written by the background thread.
+ */
+struct job
+{
+    std::string path;
+    uint64_t fingerprint;
+    int codec;
+    mt_llm_state state; // Owns the buffer.
+};
+
+/** A read-only memory-mapped file.
+ */
+struct mapping
+{
+    uint8_t const * addr; // nullptr = Not mapped.
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE map;
+#endif //_WIN32
+};
+
+// Guards all of the following:
+//
+static std::mutex s_mutex;
+static std::condition_variable s_cond; // Signals changes of the following.
+//
+static std::deque<struct job> s_jobs;
+static std::thread s_worker;
+static bool s_is_running = false; // Worker thread got started.
+static bool s_is_stopping = false; // Worker thread shall stop.
+static int s_busy = 0; // Count of jobs currently being written.
+static bool s_has_failed = false; // Since last mt_llm_snapshot_file_wait().
+
+static void fill_header(
+    uint8_t * const header,
+    uint64_t const fingerprint,
+    mt_llm_state const & state)
+{
+    uint32_t const version = MT_LLM_SNAPSHOT_FILE_VERSION;
+    uint32_t const header_size = MT_LLM_SNAPSHOT_FILE_HEADER_SIZE;
+    int32_t const tok_cnt = state.tok_cnt;
+    int32_t const last_tok_type = state.last_tok_type;
+    uint64_t const data_size = static_cast<uint64_t>(state.size);
+
+    memset(header, 0, MT_LLM_SNAPSHOT_FILE_HEADER_SIZE);
+    memcpy(header + MT_LLM_SNAPSHOT_FILE_OFFSET_MAGIC, s_magic, sizeof s_magic);
+    memcpy(
+        header + MT_LLM_SNAPSHOT_FILE_OFFSET_VERSION, &version, sizeof version);
+    memcpy(
+        header + MT_LLM_SNAPSHOT_FILE_OFFSET_HEADER_SIZE,
+        &header_size,
+        sizeof header_size);
+    memcpy(
+        header + MT_LLM_SNAPSHOT_FILE_OFFSET_FINGERPRINT,
+        &fingerprint,
+        sizeof fingerprint);
+    memcpy(
+        header + MT_LLM_SNAPSHOT_FILE_OFFSET_TOK_CNT, &tok_cnt, sizeof tok_cnt);
+    memcpy(
+        header + MT_LLM_SNAPSHOT_FILE_OFFSET_LAST_TOK_TYPE,
+        &last_tok_type,
+        sizeof last_tok_type);
+    memcpy(
+        header + MT_LLM_SNAPSHOT_FILE_OFFSET_DATA_SIZE,
+        &data_size,
+        sizeof data_size);
+}
+
+/** Write given state to a temporary file and rename it to given path, when
+ *  complete.
+ *
+ * - Can be called from any thread.
+ */
+static bool write_file(
+    std::string const & path,
+    uint64_t const fingerprint,
+    mt_llm_state const & state)
+{
+    std::string const tmp_path = path + ".tmp";
+    uint8_t header[MT_LLM_SNAPSHOT_FILE_HEADER_SIZE];
+    FILE * const f = fopen(tmp_path.c_str(), "wb");
+
+    if(f == nullptr)
+    {
+        MT_LOG_ERR("Failed to create file \"%s\"!\n", tmp_path.c_str());
+        return false;
+    }
+
+    fill_header(header, fingerprint, state);
+
+    bool is_ok = fwrite(header, 1, sizeof header, f) == sizeof header
+        && fwrite(state.state, 1, state.size, f) == state.size;
+
+    is_ok = fclose(f) == 0 && is_ok;
+    if(!is_ok)
+    {
+        MT_LOG_ERR("Failed to write file \"%s\"!\n", tmp_path.c_str());
+        remove(tmp_path.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    if(!MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else //_WIN32
+    if(rename(tmp_path.c_str(), path.c_str()) != 0)
+#endif //_WIN32
+    {
+        MT_LOG_ERR("Failed to rename file to \"%s\"!\n", path.c_str());
+        remove(tmp_path.c_str());
+        return false;
+    }
+
+    MT_LOG(
+        "Wrote %zu state bytes to file \"%s\".\n", state.size, path.c_str());
+    return true;
+}
+
+/** Replace the raw data of given state by the data encoded with given codec.
+ *
+ * - Can be called from any thread.
+ */
+static bool encode(mt_llm_state & state, int const codec)
+{
+    if(codec == MT_LLM_STATE_CODEC_RAW)
+    {
+        return true;
+    }
+
+    mt_llm_state encoded = state;
+    size_t capacity = 0;
+
+    encoded.state = nullptr;
+    encoded.size = 0;
+    if(!mt_llm_state_codec_encode(
+        state.state, state.size, codec, encoded, capacity))
+    {
+        free(encoded.state);
+        return false; // (logged)
+    }
+    free(state.state);
+    state = encoded;
+    return true;
+}
+
+static void worker()
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    while(true)
+    {
+        s_cond.wait(lock, []() { return !s_jobs.empty() || s_is_stopping; });
+        if(s_jobs.empty())
+        {
+            return; // Stopping.
+        }
+
+        struct job j = std::move(s_jobs.front());
+
+        s_jobs.pop_front();
+        ++s_busy;
+
+        lock.unlock();
+        bool const is_ok = encode(j.state, j.codec)
+            && write_file(j.path, j.fingerprint, j.state);
+        free(j.state.state);
+        lock.lock();
+
+        --s_busy;
+        s_has_failed = s_has_failed || !is_ok;
+        s_cond.notify_all();
+    }
+}
+
+/**
+ * - Mutex must be locked via given lock.
+ */
+static void wait_for_jobs(std::unique_lock<std::mutex> & lock)
+{
+    s_cond.wait(lock, []() { return s_jobs.empty() && s_busy == 0; });
+}
+
+/**
+ * - Cleans up and returns false on error.
+ */
+static bool map_file(char const * const path, struct mapping & m)
+{
+    m.addr = nullptr;
+    m.size = 0;
+
+#ifdef _WIN32
+    LARGE_INTEGER size;
+
+    m.map = nullptr;
+    m.file = CreateFileA(
+        path,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+    if(m.file == INVALID_HANDLE_VALUE)
+    {
+        MT_LOG_ERR("Failed to open file \"%s\"!\n", path);
+        return false;
+    }
+    if(!GetFileSizeEx(m.file, &size) || size.QuadPart == 0)
+    {
+        MT_LOG_ERR("Failed to get size of file \"%s\"!\n", path);
+        CloseHandle(m.file);
+        return false;
+    }
+    m.map = CreateFileMappingA(m.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(m.map == nullptr)
+    {
+        MT_LOG_ERR("Failed to map file \"%s\"!\n", path);
+        CloseHandle(m.file);
+        return false;
+    }
+    m.addr = static_cast<uint8_t const *>(
+        MapViewOfFile(m.map, FILE_MAP_READ, 0, 0, 0));
+    if(m.addr == nullptr)
+    {
+        MT_LOG_ERR("Failed to map view of file \"%s\"!\n", path);
+        CloseHandle(m.map);
+        CloseHandle(m.file);
+        return false;
+    }
+    m.size = static_cast<size_t>(size.QuadPart);
+#else //_WIN32
+    struct stat st;
+    int const fd = open(path, O_RDONLY);
+
+    if(fd == -1)
+    {
+        MT_LOG_ERR("Failed to open file \"%s\"!\n", path);
+        return false;
+    }
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        MT_LOG_ERR("Failed to get size of file \"%s\"!\n", path);
+        close(fd);
+        return false;
+    }
+
+    void * const addr = mmap(
+        nullptr,
+        static_cast<size_t>(st.st_size),
+        PROT_READ,
+        MAP_PRIVATE,
+        fd,
+        0);
+
+    close(fd); // (the mapping stays valid)
+    if(addr == MAP_FAILED)
+    {
+        MT_LOG_ERR("Failed to map file \"%s\"!\n", path);
+        return false;
+    }
+    madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    m.addr = static_cast<uint8_t const *>(addr);
+    m.size = static_cast<size_t>(st.st_size);
+#endif //_WIN32
+    return true;
+}
+
+static void unmap_file(struct mapping & m)
+{
+    if(m.addr == nullptr)
+    {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m.addr);
+    CloseHandle(m.map);
+    CloseHandle(m.file);
+#else //_WIN32
+    munmap(const_cast<uint8_t *>(m.addr), m.size);
+#endif //_WIN32
+    m.addr = nullptr;
+    m.size = 0;
+}
+
+/** Check the header of given mapped file and set up given state object to
+ *  point to the state data in the mapping.
+ */
+static bool get_state(
+    char const * const path,
+    struct mapping const & m,
+    uint64_t const fingerprint,
+    mt_llm_state & out)
+{
+    uint32_t version = 0, header_size = 0;
+    uint64_t file_fingerprint = 0, data_size = 0;
+    int32_t tok_cnt = 0, last_tok_type = 0;
+
+    if(m.size < MT_LLM_SNAPSHOT_FILE_MIN_HEADER_SIZE
+        || memcmp(
+            m.addr + MT_LLM_SNAPSHOT_FILE_OFFSET_MAGIC,
+            s_magic,
+            sizeof s_magic) != 0)
+    {
+        MT_LOG_ERR("File \"%s\" is not a snapshot file!\n", path);
+        return false;
+    }
+
+    memcpy(
+        &version, m.addr + MT_LLM_SNAPSHOT_FILE_OFFSET_VERSION, sizeof version);
+    if(version != MT_LLM_SNAPSHOT_FILE_VERSION && version != 2)
+    {
+        MT_LOG_ERR(
+            "Version %u of file \"%s\" is not supported!\n",
+            static_cast<unsigned int>(version),
+            path);
+        return false;
+    }
+
+    memcpy(
+        &header_size,
+        m.addr + MT_LLM_SNAPSHOT_FILE_OFFSET_HEADER_SIZE,
+        sizeof header_size);
+    memcpy(
+        &file_fingerprint,
+        m.addr + MT_LLM_SNAPSHOT_FILE_OFFSET_FINGERPRINT,
+        sizeof file_fingerprint);
+    memcpy(
+        &tok_cnt, m.addr + MT_LLM_SNAPSHOT_FILE_OFFSET_TOK_CNT, sizeof tok_cnt);
+    memcpy(
+        &last_tok_type,
+        m.addr + MT_LLM_SNAPSHOT_FILE_OFFSET_LAST_TOK_TYPE,
+        sizeof last_tok_type);
+    memcpy(
+        &data_size,
+        m.addr + MT_LLM_SNAPSHOT_FILE_OFFSET_DATA_SIZE,
+        sizeof data_size);
+
+    if(header_size < MT_LLM_SNAPSHOT_FILE_MIN_HEADER_SIZE
+        || data_size == 0
+        || static_cast<uint64_t>(m.size) != header_size + data_size)
+    {
+        MT_LOG_ERR("File \"%s\" is corrupt!\n", path);
+        return false;
+    }
+    if(file_fingerprint != fingerprint)
+    {
+        MT_LOG_ERR("File \"%s\" was saved with another model!\n", path);
+        return false;
+    }
+
+    out.last_tok_type = static_cast<int>(last_tok_type);
+    out.tok_cnt = static_cast<int>(tok_cnt);
+    out.state = const_cast<uint8_t *>(m.addr + header_size); // (read, only)
+    out.size = static_cast<size_t>(data_size);
+    return true;
+}
+
+/** Copy the current state to a new buffer.
+ */
+static bool create_state(mt_llm_state & out, uint64_t & fingerprint)
+{
+    size_t capacity = 0;
+
+    out.state = nullptr;
+    out.size = 0;
+
+    if(!mt_llm_get_model_fingerprint(fingerprint)
+        || !mt_llm_state_fill(out, capacity)) // (logs on error)
+    {
+        free(out.state);
+        out.state = nullptr;
+        return false;
+    }
+    return true;
+}
+
+static bool save(char const * const path)
+{
+    mt_llm_state state;
+    uint64_t fingerprint = 0;
+
+    {
+        std::unique_lock<std::mutex> lock(s_mutex);
+
+        // A pending job may write to the same (temporary) file:
+        //
+        wait_for_jobs(lock);
+    }
+
+    if(!create_state(state, fingerprint))
+    {
+        return false;
+    }
+
+    bool const ret_val = encode(state, mt_llm_snapshot_get_codec())
+        && write_file(path, fingerprint, state);
+
+    free(state.state);
+    return ret_val;
+}
+
+static bool save_async(char const * const path)
+{
+    struct job j;
+
+    if(!create_state(j.state, j.fingerprint))
+    {
+        return false;
+    }
+    j.path = path;
+    j.codec = mt_llm_snapshot_get_codec();
+
+    std::lock_guard<std::mutex> const lock(s_mutex);
+
+    if(!s_is_running)
+    {
+        s_is_stopping = false;
+        s_worker = std::thread(worker);
+        s_is_running = true;
+    }
+    s_jobs.push_back(std::move(j));
+    s_cond.notify_all();
+    return true;
+}
+
+static bool wait()
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    wait_for_jobs(lock);
+
+    bool const ret_val = !s_has_failed;
+
+    s_has_failed = false;
+    return ret_val;
+}
+
+static bool load(char const * const path)
+{
+    struct mapping m;
+    mt_llm_state state;
+    uint64_t fingerprint = 0;
+
+    {
+        std::unique_lock<std::mutex> lock(s_mutex);
+
+        wait_for_jobs(lock);
+    }
+
+    if(!mt_llm_get_model_fingerprint(fingerprint))
+    {
+        return false;
+    }
+    if(!map_file(path, m))
+    {
+        return false;
+    }
+
+    bool const ret_val = get_state(path, m, fingerprint, state)
+        && mt_llm_state_restore(&state); // (logs on error)
+
+    unmap_file(m);
+    return ret_val;
+}
+
+void mt_llm_snapshot_file_stop()
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    if(!s_is_running)
+    {
+        return;
+    }
+    wait_for_jobs(lock);
+    s_is_stopping = true;
+    s_cond.notify_all();
+    lock.unlock();
+
+    s_worker.join();
+
+    lock.lock();
+    s_is_running = false;
+    s_is_stopping = false;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_file_save(
+    char const * const path)
+{
+    if(path == nullptr)
+    {
+        MT_LOG_ERR("NULL given!\n");
+        return false;
+    }
+
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = save(path);
+
+    mt_llm_record_end(t_rec, "snapshot_file_save", ret_val, path);
+    return ret_val;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_file_save_async(
+    char const * const path)
+{
+    if(path == nullptr)
+    {
+        MT_LOG_ERR("NULL given!\n");
+        return false;
+    }
+
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = save_async(path);
+
+    mt_llm_record_end(t_rec, "snapshot_file_save_async", ret_val, path);
+    return ret_val;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_file_wait()
+{
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = wait();
+
+    mt_llm_record_end(t_rec, "snapshot_file_wait", ret_val, nullptr);
+    return ret_val;
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_file_load(
+    char const * const path)
+{
+    if(path == nullptr)
+    {
+        MT_LOG_ERR("NULL given!\n");
+        return false;
+    }
+
+    int64_t const t_rec = mt_llm_record_begin();
+    bool const ret_val = load(path);
+
+    mt_llm_record_end(t_rec, "snapshot_file_load", ret_val, path);
+    return ret_val;
+}
@@ -0,0 +1,99 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// This is meant to be a pure-C interface to save snapshots of the LLM state to
+// files and to restore them from files.
+
+#ifndef MT_LLM_SNAPSHOT_FILE
+#define MT_LLM_SNAPSHOT_FILE
+
+#include "mt_llm_lib.h"
+
+#ifdef __cplusplus
+    #include <cstdbool>
+#else //__cplusplus
+    #include <stdbool.h>
+#endif //__cplusplus
+
+// File format (all values in host byte order):
+//
+// - 8 bytes: Magic "MTLLMSNP".
+// - 4 bytes: Version (see below).
+// - 4 bytes: Header size (offset of the state data, see below).
+// - 8 bytes: Model fingerprint (see mt_llm_model_get_fingerprint()).
+// - 4 bytes: Token count (see mt_llm_state).
+// - 4 bytes: Type of the last token (see mt_llm_state).
+// - 8 bytes: Size of the state data.
+// - Zero-padding up to the header size.
+// - State data (as given by llama.cpp for the sequence used, optionally
+//   encoded, see mt_llm_snapshot_set_codec()).
+//
+// Version history:
+//
+// 1: State data of the whole context.
+// 2: State data of the sequence used, only.
+// 3: State data may be encoded (version 2 files can still be loaded).
+//
+#define MT_LLM_SNAPSHOT_FILE_VERSION 3
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+/** Save the current LLM state to a file at given path (which gets replaced).
+ *
+ * - Encodes the state with the codec set via mt_llm_snapshot_set_codec().
+ * - Writes to a temporary file first, which gets renamed when complete.
+ * - Waits for pending background writes to complete, first.
+ * - Returns false, if not initialized or on error.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_file_save(
+    char const * const path);
+
+/** Like mt_llm_snapshot_file_save(), but just copies the LLM state to RAM and
+ *  lets a background thread encode it (if a codec is set) and write the file.
+ *
+ * - Returns false, if not initialized or the state could not be copied.
+ * - Use mt_llm_snapshot_file_wait() to wait for the file(-s) being written.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_file_save_async(
+    char const * const path);
+
+/** Wait for all files to be written by the background thread.
+ *
+ * - Returns false, if at least one file could not be written since the last
+ *   call.
+ * - mt_llm_deinit() also waits (but does not reset the error).
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_file_wait();
+
+/** Restore the LLM state from the file at given path.
+ *
+ * - The file gets memory-mapped and llama.cpp reads the state directly from
+ *   the mapping (without copying it to the heap, first), if it is not
+ *   encoded (otherwise it gets decoded from the mapping).
+ * - Returns false, if not initialized, if the file is invalid, was created
+ *   with another version or another model or on error (then the state of the
+ *   context is unknown).
+ * - Waits for pending background writes to complete, first.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_snapshot_file_load(
+    char const * const path);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+// The following functions are used internally and are not pure-C:
+//
+#ifdef __cplusplus/*MT_EXPORT_LLM*/
+
+/** Wait for all files to be written and stop the background thread.
+ *
+ * - Does no harm, if not started.
+ */
+void mt_llm_snapshot_file_stop();
+
+#endif //__cplusplus/*MT_EXPORT_LLM*/
+
+#endif //MT_LLM_SNAPSHOT_FILE
@@ -0,0 +1,1133 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <queue>
+#include <atomic>
+#include <chrono>
+
+#include "ggml.h"
+#include "llama.h"
+
+#include "mt_llm_state_codec.h"
+#include "mt_llm_state.h"
+#include "mt_llm_log.h"
+
+static char const s_magic[8] = { 'M', 'T', 'L', 'L', 'M', 'E', 'N', 'C' };
+
+#define MT_LLM_STATE_CODEC_HEADER_SIZE 24
+
+// Record types (see mt_llm_state_codec.h, could be an enum):
+//
+#define MT_LLM_STATE_CODEC_REC_STORED 0
+#define MT_LLM_STATE_CODEC_REC_HUFFMAN 1
+#define MT_LLM_STATE_CODEC_REC_Q8_0 2
+//
+#define MT_LLM_STATE_CODEC_REC_HEADER_SIZE 9
+
+// Maximum length of a Huffman code in bits (the decoding table has
+// 2^length entries):
+//
+#define MT_LLM_STATE_CODEC_MAX_CODE_LEN 12
+
+// Count of f16 values sharing one scale in a q8_0 block (like in ggml) and size
+// of such a block:
+//
+#define MT_LLM_STATE_CODEC_Q8_0_BLOCK 32
+#define MT_LLM_STATE_CODEC_Q8_0_BLOCK_SIZE (2 + MT_LLM_STATE_CODEC_Q8_0_BLOCK)
+
+// Version of llama.cpp's sequence state data, whose layout parse() knows (the
+// layout is private to llama.cpp, so any other version is not parsed):
+//
+#define MT_LLM_STATE_CODEC_LLAMA_SEQ_VERSION 2
+
+/** A part of raw state data, optionally holding f16 K or V values.
+ */
+struct segment
+{
+    size_t offset;
+    size_t size;
+    bool is_f16;
+};
+
+/** Writes to the buffer of a state object, growing it as necessary.
+ */
+struct writer
+{
+    mt_llm_state & out;
+    size_t & capacity;
+    size_t size;
+};
+
+/** Reads from a buffer, never beyond its end.
+ */
+struct reader
+{
+    uint8_t const * data;
+    size_t size;
+    size_t pos;
+};
+
+static std::atomic<uint64_t> s_encodings(0);
+static std::atomic<uint64_t> s_decodings(0);
+static std::atomic<uint64_t> s_fallbacks(0);
+static std::atomic<uint64_t> s_raw_bytes(0);
+static std::atomic<uint64_t> s_encoded_bytes(0);
+static std::atomic<uint64_t> s_encode_us(0);
+static std::atomic<uint64_t> s_decode_us(0);
+
+static uint64_t get_us(std::chrono::steady_clock::time_point const t0)
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t0).count());
+}
+
+// *****************************************************************************
+// *** WRITING AND READING                                                   ***
+// *****************************************************************************
+
+/** Make sure that given count of bytes can be appended.
+ */
+static bool reserve(struct writer & w, size_t const n)
+{
+    size_t const needed = w.size + n;
+
+    if(needed <= w.capacity)
+    {
+        return true;
+    }
+
+    size_t const capacity = needed < w.capacity + w.capacity / 2
+        ? w.capacity + w.capacity / 2 : needed;
+    uint8_t * const buf = static_cast<uint8_t*>(
+        realloc(w.out.state, capacity));
+
+    if(buf == nullptr)
+    {
+        MT_LOG_ERR("Failed to allocate %zu bytes!\n", capacity);
+        return false;
+    }
+    w.out.state = buf;
+    w.capacity = capacity;
+    return true;
+}
+
+static bool put(struct writer & w, void const * const src, size_t const n)
+{
+    if(!reserve(w, n))
+    {
+        return false;
+    }
+    memcpy(w.out.state + w.size, src, n);
+    w.size += n;
+    return true;
+}
+
+static bool put_rec_header(
+    struct writer & w, uint8_t const type, uint64_t const n)
+{
+    return put(w, &type, sizeof type) && put(w, &n, sizeof n);
+}
+
+static bool get(struct reader & r, void * const dest, size_t const n)
+{
+    if(r.size - r.pos < n)
+    {
+        return false;
+    }
+    memcpy(dest, r.data + r.pos, n);
+    r.pos += n;
+    return true;
+}
+
+static bool skip(struct reader & r, uint64_t const n)
+{
+    if(static_cast<uint64_t>(r.size - r.pos) < n)
+    {
+        return false;
+    }
+    r.pos += static_cast<size_t>(n);
+    return true;
+}
+
+// *****************************************************************************
+// *** HUFFMAN CODING                                                        ***
+// *****************************************************************************
+
+/** Calculate the code lengths of a Huffman code for given symbol frequencies.
+ *
+ * - Flattens the frequencies, until no code is longer than the maximum.
+ * - A single symbol gets a code length of 1.
+ */
+static void get_code_lens(uint64_t freqs[256], uint8_t lens[256])
+{
+    typedef std::pair<uint64_t, int> entry; // Weight and node index.
+
+    while(true)
+    {
+        std::priority_queue<entry, std::vector<entry>, std::greater<entry>> q;
+        std::vector<int> parents; // Of the nodes, leaves first.
+        int max_len = 0;
+
+        memset(lens, 0, 256);
+        for(int i = 0; i < 256; ++i)
+        {
+            if(freqs[i] != 0)
+            {
+                q.push({ freqs[i], static_cast<int>(parents.size()) });
+                parents.push_back(i); // (temporarily holds the symbol)
+            }
+        }
+        if(parents.size() < 2)
+        {
+            if(parents.size() == 1)
+            {
+                lens[parents[0]] = 1;
+            }
+            return;
+        }
+
+        std::vector<int> const syms = parents;
+
+        while(1 < q.size())
+        {
+            entry const a = q.top();
+            q.pop();
+            entry const b = q.top();
+            q.pop();
+
+            int const node = static_cast<int>(parents.size());
+
+            parents[a.second] = node;
+            parents[b.second] = node;
+            parents.push_back(-1); // (root, if not overwritten)
+            q.push({ a.first + b.first, node });
+        }
+
+        // Parents are created after their children, so the depths can be
+        // calculated from the root down:
+        //
+        std::vector<int> depths(parents.size(), 0);
+
+        for(int i = static_cast<int>(parents.size()) - 2; i >= 0; --i)
+        {
+            depths[i] = depths[parents[i]] + 1;
+        }
+        for(size_t i = 0; i < syms.size(); ++i)
+        {
+            lens[syms[i]] = static_cast<uint8_t>(depths[i]);
+            if(max_len < depths[i])
+            {
+                max_len = depths[i];
+            }
+        }
+        if(max_len <= MT_LLM_STATE_CODEC_MAX_CODE_LEN)
+        {
+            return;
+        }
+        for(int i = 0; i < 256; ++i)
+        {
+            if(freqs[i] != 0)
+            {
+                freqs[i] = (freqs[i] >> 1) | 1;
+            }
+        }
+    }
+}
+
+/** Calculate the canonical codes for given code lengths.
+ *
+ * - Returns false, if the code lengths do not form a valid prefix code.
+ */
+static bool get_codes(uint8_t const lens[256], uint16_t codes[256])
+{
+    uint32_t counts[MT_LLM_STATE_CODEC_MAX_CODE_LEN + 1] = { 0 };
+    uint32_t next[MT_LLM_STATE_CODEC_MAX_CODE_LEN + 1] = { 0 };
+    uint32_t code = 0;
+    uint32_t space = 0;
+
+    for(int i = 0; i < 256; ++i)
+    {
+        if(MT_LLM_STATE_CODEC_MAX_CODE_LEN < lens[i])
+        {
+            return false;
+        }
+        ++counts[lens[i]];
+        if(lens[i] != 0)
+        {
+            space += 1u << (MT_LLM_STATE_CODEC_MAX_CODE_LEN - lens[i]);
+        }
+    }
+    if((1u << MT_LLM_STATE_CODEC_MAX_CODE_LEN) < space)
+    {
+        return false;
+    }
+    counts[0] = 0;
+    for(int len = 1; len <= MT_LLM_STATE_CODEC_MAX_CODE_LEN; ++len)
+    {
+        code = (code + counts[len - 1]) << 1;
+        next[len] = code;
+    }
+    for(int i = 0; i < 256; ++i)
+    {
+        codes[i] = lens[i] == 0 ? 0 : static_cast<uint16_t>(next[lens[i]]++);
+    }
+    return true;
+}
+
+/** Append given count of bytes (read with given stride) as record, either
+ *  Huffman-coded or just stored (if that is not larger).
+ */
+static bool put_lossless(
+    struct writer & w,
+    uint8_t const * const src,
+    size_t const stride,
+    size_t const n)
+{
+    uint64_t freqs[256] = { 0 };
+    uint8_t lens[256];
+    uint16_t codes[256];
+    uint64_t bits = 0;
+
+    for(size_t i = 0; i < n; ++i)
+    {
+        ++freqs[src[i * stride]];
+    }
+    {
+        uint64_t f[256];
+
+        memcpy(f, freqs, sizeof f);
+        get_code_lens(f, lens);
+    }
+    for(int i = 0; i < 256; ++i)
+    {
+        bits += freqs[i] * lens[i];
+    }
+
+    uint64_t const bytes = (bits + 7) / 8;
+
+    if(static_cast<uint64_t>(n) <= sizeof lens + sizeof bytes + bytes
+        || !get_codes(lens, codes))
+    {
+        if(!put_rec_header(w, MT_LLM_STATE_CODEC_REC_STORED, n)
+            || !reserve(w, n))
+        {
+            return false;
+        }
+        for(size_t i = 0; i < n; ++i)
+        {
+            w.out.state[w.size + i] = src[i * stride];
+        }
+        w.size += n;
+        return true;
+    }
+
+    if(!put_rec_header(w, MT_LLM_STATE_CODEC_REC_HUFFMAN, n)
+        || !put(w, lens, sizeof lens)
+        || !put(w, &bytes, sizeof bytes)
+        || !reserve(w, static_cast<size_t>(bytes)))
+    {
+        return false;
+    }
+
+    uint8_t * dest = w.out.state + w.size;
+    uint64_t acc = 0;
+    int acc_bits = 0;
+
+    for(size_t i = 0; i < n; ++i)
+    {
+        uint8_t const sym = src[i * stride];
+
+        acc = (acc << lens[sym]) | codes[sym];
+        acc_bits += lens[sym];
+        while(8 <= acc_bits)
+        {
+            acc_bits -= 8;
+            *dest++ = static_cast<uint8_t>(acc >> acc_bits);
+        }
+    }
+    if(0 < acc_bits)
+    {
+        *dest++ = static_cast<uint8_t>(acc << (8 - acc_bits));
+    }
+    assert(dest == w.out.state + w.size + bytes);
+    w.size += static_cast<size_t>(bytes);
+    return true;
+}
+
+/** Decode a Huffman-coded record's data into given count of bytes (written
+ *  with given stride).
+ */
+static bool get_huffman(
+    struct reader & r,
+    uint8_t * const dest,
+    size_t const stride,
+    size_t const n)
+{
+    static int const table_size = 1 << MT_LLM_STATE_CODEC_MAX_CODE_LEN;
+    uint8_t lens[256];
+    uint16_t codes[256];
+    uint64_t bytes = 0;
+
+    if(!get(r, lens, sizeof lens)
+        || !get(r, &bytes, sizeof bytes)
+        || static_cast<uint64_t>(r.size - r.pos) < bytes
+        || !get_codes(lens, codes))
+    {
+        return false;
+    }
+
+    // Each entry holds the symbol (low byte) and the code length (high byte,
+    // 0 = invalid code):
+    //
+    std::vector<uint16_t> table(table_size, 0);
+
+    for(int i = 0; i < 256; ++i)
+    {
+        if(lens[i] == 0)
+        {
+            continue;
+        }
+
+        int const shift = MT_LLM_STATE_CODEC_MAX_CODE_LEN - lens[i];
+        int const first = codes[i] << shift;
+
+        for(int j = 0; j < 1 << shift; ++j)
+        {
+            table[first + j] = static_cast<uint16_t>((lens[i] << 8) | i);
+        }
+    }
+
+    uint8_t const * src = r.data + r.pos;
+    uint8_t const * const src_end = src + bytes;
+    uint64_t acc = 0; // Next bits, MSB first.
+    int acc_bits = 0;
+
+    for(size_t i = 0; i < n; ++i)
+    {
+        while(acc_bits <= 56 && src < src_end)
+        {
+            acc |= static_cast<uint64_t>(*src++) << (56 - acc_bits);
+            acc_bits += 8;
+        }
+
+        uint16_t const entry = table[
+            acc >> (64 - MT_LLM_STATE_CODEC_MAX_CODE_LEN)];
+        int const len = entry >> 8;
+
+        if(len == 0 || acc_bits < len)
+        {
+            return false;
+        }
+        dest[i * stride] = static_cast<uint8_t>(entry);
+        acc <<= len;
+        acc_bits -= len;
+    }
+    r.pos += static_cast<size_t>(bytes);
+    return true;
+}
+
+// *****************************************************************************
+// *** Q8_0 QUANTIZATION                                                     ***
+// *****************************************************************************
+
+static float get_f16(uint8_t const * const src)
+{
+    ggml_fp16_t v;
+
+    memcpy(&v, src, sizeof v);
+    return ggml_fp16_to_fp32(v);
+}
+
+/** Append given f16 values as q8_0 record.
+ *
+ * - Returns false without having appended anything, if a value is not finite
+ *   (or on error).
+ */
+static bool put_q8_0(
+    struct writer & w, uint8_t const * const src, size_t const size)
+{
+    assert(size % 2 == 0);
+
+    size_t const count = size / 2;
+    size_t const blocks = (count + MT_LLM_STATE_CODEC_Q8_0_BLOCK - 1)
+        / MT_LLM_STATE_CODEC_Q8_0_BLOCK;
+    size_t const rec_beg = w.size;
+
+    if(!put_rec_header(w, MT_LLM_STATE_CODEC_REC_Q8_0, size)
+        || !reserve(w, blocks * MT_LLM_STATE_CODEC_Q8_0_BLOCK_SIZE))
+    {
+        return false;
+    }
+
+    uint8_t * dest = w.out.state + w.size;
+
+    for(size_t b = 0; b < blocks; ++b)
+    {
+        size_t const beg = b * MT_LLM_STATE_CODEC_Q8_0_BLOCK;
+        size_t const end = beg + MT_LLM_STATE_CODEC_Q8_0_BLOCK < count
+            ? beg + MT_LLM_STATE_CODEC_Q8_0_BLOCK : count;
+        float vals[MT_LLM_STATE_CODEC_Q8_0_BLOCK] = { 0.0f };
+        float amax = 0.0f;
+
+        for(size_t i = beg; i < end; ++i)
+        {
+            vals[i - beg] = get_f16(src + 2 * i);
+            if(!std::isfinite(vals[i - beg]))
+            {
+                w.size = rec_beg;
+                return false;
+            }
+            if(amax < std::fabs(vals[i - beg]))
+            {
+                amax = std::fabs(vals[i - beg]);
+            }
+        }
+
+        float const d = amax / 127.0f;
+        float const id = d == 0.0f ? 0.0f : 1.0f / d;
+        ggml_fp16_t const d_f16 = ggml_fp32_to_fp16(d);
+
+        memcpy(dest, &d_f16, sizeof d_f16);
+        for(int i = 0; i < MT_LLM_STATE_CODEC_Q8_0_BLOCK; ++i)
+        {
+            dest[2 + i] = static_cast<uint8_t>(
+                static_cast<int8_t>(std::lround(vals[i] * id)));
+        }
+        dest += MT_LLM_STATE_CODEC_Q8_0_BLOCK_SIZE;
+    }
+    w.size += blocks * MT_LLM_STATE_CODEC_Q8_0_BLOCK_SIZE;
+    return true;
+}
+
+static bool get_q8_0(struct reader & r, uint8_t * const dest, size_t const size)
+{
+    if(size % 2 != 0)
+    {
+        return false;
+    }
+
+    size_t const count = size / 2;
+    size_t const blocks = (count + MT_LLM_STATE_CODEC_Q8_0_BLOCK - 1)
+        / MT_LLM_STATE_CODEC_Q8_0_BLOCK;
+
+    if((r.size - r.pos) / MT_LLM_STATE_CODEC_Q8_0_BLOCK_SIZE < blocks)
+    {
+        return false;
+    }
+
+    uint8_t const * src = r.data + r.pos;
+
+    for(size_t b = 0; b < blocks; ++b)
+    {
+        size_t const beg = b * MT_LLM_STATE_CODEC_Q8_0_BLOCK;
+        size_t const end = beg + MT_LLM_STATE_CODEC_Q8_0_BLOCK < count
+            ? beg + MT_LLM_STATE_CODEC_Q8_0_BLOCK : count;
+        float const d = get_f16(src);
+
+        for(size_t i = beg; i < end; ++i)
+        {
+            ggml_fp16_t const v = ggml_fp32_to_fp16(
+                d * static_cast<float>(static_cast<int8_t>(src[2 + i - beg])));
+
+            memcpy(dest + 2 * i, &v, sizeof v);
+        }
+        src += MT_LLM_STATE_CODEC_Q8_0_BLOCK_SIZE;
+    }
+    r.pos += blocks * MT_LLM_STATE_CODEC_Q8_0_BLOCK_SIZE;
+    return true;
+}
+
+// *****************************************************************************
+// *** LAYOUT OF LLAMA.CPP'S SEQUENCE STATE DATA                             ***
+// *****************************************************************************
+
+/** Add the segment of not-yet added data before the current read position and
+ *  the data of given size following it (if possible).
+ */
+static bool add_data(
+    struct reader & r,
+    std::vector<struct segment> & segs,
+    uint64_t const size,
+    bool const is_f16)
+{
+    size_t const prev_end = segs.empty()
+        ? 0 : segs.back().offset + segs.back().size;
+
+    if(prev_end < r.pos)
+    {
+        segs.push_back({ prev_end, r.pos - prev_end, false });
+    }
+
+    size_t const offset = r.pos;
+
+    if(!skip(r, size))
+    {
+        return false;
+    }
+    if(size != 0)
+    {
+        segs.push_back(
+            { offset, static_cast<size_t>(size), is_f16 && size % 2 == 0 });
+    }
+    return true;
+}
+
+/** Parse the KV cache data of one stream (or of a cache without streams).
+ *
+ * - Layout as written by llama_kv_cache::state_write(): The cell count, the
+ *   positions of the cells (and their sequence IDs), then the K rows of all
+ *   layers and the V rows (or the transposed V values) of all layers.
+ */
+static bool parse_stream(struct reader & r, std::vector<struct segment> & segs)
+{
+    static int32_t const type_f16 = static_cast<int32_t>(GGML_TYPE_F16);
+    uint32_t cell_count = 0, v_trans = 0, layer_count = 0;
+
+    if(!get(r, &cell_count, sizeof cell_count))
+    {
+        return false;
+    }
+    if(cell_count == 0)
+    {
+        return true;
+    }
+
+    for(uint32_t i = 0; i < cell_count; ++i)
+    {
+        int32_t pos = 0;
+        uint32_t seq_id_count = 0;
+
+        if(!get(r, &pos, sizeof pos)
+            || pos < 0
+            || !get(r, &seq_id_count, sizeof seq_id_count)
+            || 1024 < seq_id_count
+            || !skip(r, 4 * static_cast<uint64_t>(seq_id_count)))
+        {
+            return false;
+        }
+    }
+
+    if(!get(r, &v_trans, sizeof v_trans)
+        || !get(r, &layer_count, sizeof layer_count)
+        || 1 < v_trans
+        || layer_count == 0
+        || 4096 < layer_count)
+    {
+        return false;
+    }
+
+    for(int kv = 0; kv < 2; ++kv)
+    {
+        for(uint32_t l = 0; l < layer_count; ++l)
+        {
+            int32_t type = 0;
+
+            if(!get(r, &type, sizeof type)
+                || type < 0
+                || static_cast<int32_t>(GGML_TYPE_COUNT) <= type)
+            {
+                return false;
+            }
+
+            size_t const type_size =
+                ggml_type_size(static_cast<enum ggml_type>(type));
+
+            if(kv == 0 || v_trans == 0)
+            {
+                uint64_t row_size = 0;
+
+                if(!get(r, &row_size, sizeof row_size)
+                    || row_size == 0
+                    || row_size % type_size != 0
+                    || static_cast<uint64_t>(r.size) / cell_count < row_size
+                    || !add_data(
+                        r, segs, row_size * cell_count, type == type_f16))
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            uint32_t el_size = 0, el_count = 0;
+
+            if(!get(r, &el_size, sizeof el_size)
+                || el_size != type_size
+                || !get(r, &el_count, sizeof el_count))
+            {
+                return false;
+            }
+
+            uint64_t const row_size = static_cast<uint64_t>(el_size) * el_count;
+
+            if(static_cast<uint64_t>(r.size) / cell_count < row_size
+                || !add_data(
+                    r,
+                    segs,
+                    row_size * cell_count,
+                    type == type_f16 && el_size == 2))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/** Split given raw state data into segments with and without f16 values.
+ *
+ * - The data can hold multiple caches (e.g. with sliding window attention).
+ * - Newer versions of llama.cpp write the count of streams before each cache,
+ *   older ones do not, so both are tried.
+ * - Returns false, if the layout is not recognized (also, if llama.cpp's
+ *   version of the sequence state data is not the one known, as a changed
+ *   layout may be parsed without error, but wrongly).
+ */
+static bool parse(
+    uint8_t const * const data,
+    size_t const size,
+    std::vector<struct segment> & segs)
+{
+    if(LLAMA_STATE_SEQ_VERSION != MT_LLM_STATE_CODEC_LLAMA_SEQ_VERSION)
+    {
+        return false;
+    }
+    for(int with_streams = 1; with_streams >= 0; --with_streams)
+    {
+        struct reader r = { data, size, 0 };
+        bool is_ok = true;
+
+        segs.clear();
+        while(is_ok && r.pos < r.size)
+        {
+            uint32_t stream_count = 1;
+
+            if(with_streams == 1
+                && (!get(r, &stream_count, sizeof stream_count)
+                    || stream_count == 0
+                    || 64 < stream_count))
+            {
+                is_ok = false;
+                break;
+            }
+            for(uint32_t i = 0; is_ok && i < stream_count; ++i)
+            {
+                is_ok = parse_stream(r, segs);
+            }
+        }
+        if(!is_ok)
+        {
+            continue;
+        }
+        add_data(r, segs, 0, false); // (adds the rest, if any)
+        for(auto const & seg : segs)
+        {
+            if(seg.is_f16)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// *****************************************************************************
+// *** ENCODING AND DECODING                                                 ***
+// *****************************************************************************
+
+static bool put_header(
+    struct writer & w, int const codec, size_t const raw_size)
+{
+    uint32_t const codec_u32 = static_cast<uint32_t>(codec);
+    uint32_t const reserved = 0;
+    uint64_t const raw_size_u64 = static_cast<uint64_t>(raw_size);
+
+    w.size = 0;
+    return put(w, s_magic, sizeof s_magic)
+        && put(w, &codec_u32, sizeof codec_u32)
+        && put(w, &reserved, sizeof reserved)
+        && put(w, &raw_size_u64, sizeof raw_size_u64);
+}
+
+static bool encode_lossless(
+    uint8_t const * const raw, size_t const raw_size, struct writer & w)
+{
+    return put_header(w, MT_LLM_STATE_CODEC_LOSSLESS, raw_size)
+        && put_lossless(w, raw, 2, (raw_size + 1) / 2)
+        && put_lossless(w, raw + 1, 2, raw_size / 2);
+}
+
+static bool encode_q8_0(
+    uint8_t const * const raw,
+    size_t const raw_size,
+    std::vector<struct segment> const & segs,
+    struct writer & w)
+{
+    if(!put_header(w, MT_LLM_STATE_CODEC_Q8_0, raw_size))
+    {
+        return false;
+    }
+    for(auto const & seg : segs)
+    {
+        if(seg.is_f16 && put_q8_0(w, raw + seg.offset, seg.size))
+        {
+            continue;
+        }
+        if(!put_lossless(w, raw + seg.offset, 1, seg.size))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int mt_llm_state_codec_get(uint8_t const * const data, size_t const size)
+{
+    uint32_t codec = MT_LLM_STATE_CODEC_RAW;
+
+    if(data == nullptr
+        || size < MT_LLM_STATE_CODEC_HEADER_SIZE
+        || memcmp(data, s_magic, sizeof s_magic) != 0)
+    {
+        return MT_LLM_STATE_CODEC_RAW;
+    }
+    memcpy(&codec, data + sizeof s_magic, sizeof codec);
+    return static_cast<int>(codec);
+}
+
+bool mt_llm_state_codec_encode(
+    uint8_t const * const raw,
+    size_t const raw_size,
+    int const codec,
+    struct mt_llm_state & out,
+    size_t & capacity)
+{
+    auto const t0 = std::chrono::steady_clock::now();
+    struct writer w = { out, capacity, 0 };
+    bool is_ok = false;
+
+    assert(raw != nullptr && 0 < raw_size);
+
+    switch(codec)
+    {
+        case MT_LLM_STATE_CODEC_LOSSLESS:
+        {
+            is_ok = encode_lossless(raw, raw_size, w);
+            break;
+        }
+        case MT_LLM_STATE_CODEC_Q8_0:
+        {
+            std::vector<struct segment> segs;
+
+            if(parse(raw, raw_size, segs))
+            {
+                is_ok = encode_q8_0(raw, raw_size, segs, w);
+                break;
+            }
+            MT_LOG(
+                "State layout not recognized, encoding lossless, instead.\n");
+            s_fallbacks.fetch_add(1, std::memory_order_relaxed);
+            is_ok = encode_lossless(raw, raw_size, w);
+            break;
+        }
+
+        default:
+        {
+            MT_LOG_ERR("Invalid codec %d given!\n", codec);
+            return false;
+        }
+    }
+    if(!is_ok)
+    {
+        return false; // (reserve() logged)
+    }
+    out.size = w.size;
+
+    uint64_t const us = get_us(t0);
+
+    s_encodings.fetch_add(1, std::memory_order_relaxed);
+    s_raw_bytes.fetch_add(raw_size, std::memory_order_relaxed);
+    s_encoded_bytes.fetch_add(w.size, std::memory_order_relaxed);
+    s_encode_us.fetch_add(us, std::memory_order_relaxed);
+    MT_LOG(
+        "Encoded %zu state bytes to %zu bytes in %llu us.\n",
+        raw_size,
+        w.size,
+        static_cast<unsigned long long>(us));
+    return true;
+}
+
+/** Decode the next record into given count of bytes (written with given
+ *  stride, which must be 1 for q8_0 records).
+ */
+static bool get_record(
+    struct reader & r,
+    uint8_t * const dest,
+    size_t const stride,
+    uint64_t const max_n,
+    uint64_t & n)
+{
+    uint8_t type = 0;
+
+    if(!get(r, &type, sizeof type) || !get(r, &n, sizeof n) || max_n < n)
+    {
+        return false;
+    }
+    switch(type)
+    {
+        case MT_LLM_STATE_CODEC_REC_STORED:
+        {
+            if(static_cast<uint64_t>(r.size - r.pos) < n)
+            {
+                return false;
+            }
+            for(size_t i = 0; i < n; ++i)
+            {
+                dest[i * stride] = r.data[r.pos + i];
+            }
+            r.pos += static_cast<size_t>(n);
+            return true;
+        }
+        case MT_LLM_STATE_CODEC_REC_HUFFMAN:
+        {
+            return get_huffman(r, dest, stride, static_cast<size_t>(n));
+        }
+        case MT_LLM_STATE_CODEC_REC_Q8_0:
+        {
+            return stride == 1 && get_q8_0(r, dest, static_cast<size_t>(n));
+        }
+
+        default:
+        {
+            return false;
+        }
+    }
+}
+
+bool mt_llm_state_codec_decode(
+    uint8_t const * const data,
+    size_t const size,
+    struct mt_llm_state & out,
+    size_t & capacity)
+{
+    auto const t0 = std::chrono::steady_clock::now();
+    int const codec = mt_llm_state_codec_get(data, size);
+    struct reader r = { data, size, sizeof s_magic + 8 };
+    uint64_t raw_size = 0, n = 0;
+    bool is_ok = false;
+
+    if((codec != MT_LLM_STATE_CODEC_LOSSLESS
+            && codec != MT_LLM_STATE_CODEC_Q8_0)
+        || !get(r, &raw_size, sizeof raw_size)
+        || raw_size == 0)
+    {
+        MT_LOG_ERR("Not an encoded state!\n");
+        return false;
+    }
+    if(capacity < raw_size)
+    {
+        uint8_t * const buf = static_cast<uint8_t*>(
+            realloc(out.state, static_cast<size_t>(raw_size)));
+
+        if(buf == nullptr)
+        {
+            MT_LOG_ERR(
+                "Failed to allocate %llu bytes!\n",
+                static_cast<unsigned long long>(raw_size));
+            return false;
+        }
+        out.state = buf;
+        capacity = static_cast<size_t>(raw_size);
+    }
+
+    if(codec == MT_LLM_STATE_CODEC_LOSSLESS)
+    {
+        is_ok = get_record(r, out.state, 2, (raw_size + 1) / 2, n)
+            && n == (raw_size + 1) / 2
+            && get_record(r, out.state + 1, 2, raw_size / 2, n)
+            && n == raw_size / 2;
+    }
+    else
+    {
+        uint64_t pos = 0;
+
+        is_ok = true;
+        while(is_ok && r.pos < r.size)
+        {
+            is_ok = get_record(r, out.state + pos, 1, raw_size - pos, n);
+            pos += n;
+        }
+        is_ok = is_ok && pos == raw_size;
+    }
+    if(!is_ok || r.pos != r.size)
+    {
+        MT_LOG_ERR("Encoded state is corrupt!\n");
+        return false;
+    }
+    out.size = static_cast<size_t>(raw_size);
+
+    uint64_t const us = get_us(t0);
+
+    s_decodings.fetch_add(1, std::memory_order_relaxed);
+    s_decode_us.fetch_add(us, std::memory_order_relaxed);
+    MT_LOG(
+        "Decoded %zu state bytes from %zu bytes in %llu us.\n",
+        out.size,
+        size,
+        static_cast<unsigned long long>(us));
+    return true;
+}
+
+/** Create a new state object with a copy of the token count and type of given
+ *  one (and without a buffer).
+ */
+static struct mt_llm_state * create_state(struct mt_llm_state const & src)
+{
+    struct mt_llm_state * const ret_val = static_cast<mt_llm_state*>(
+        malloc(sizeof *ret_val));
+
+    if(ret_val == nullptr)
+    {
+        MT_LOG_ERR("Failed to allocate state object!\n");
+        return nullptr;
+    }
+    ret_val->last_tok_type = src.last_tok_type;
+    ret_val->tok_cnt = src.tok_cnt;
+    ret_val->state = nullptr;
+    ret_val->size = 0;
+    return ret_val;
+}
+
+static struct mt_llm_state * copy_state(struct mt_llm_state const & src)
+{
+    struct mt_llm_state * const ret_val = create_state(src);
+
+    if(ret_val == nullptr)
+    {
+        return nullptr;
+    }
+    ret_val->state = static_cast<uint8_t*>(malloc(src.size));
+    if(ret_val->state == nullptr)
+    {
+        MT_LOG_ERR("Failed to allocate %zu bytes!\n", src.size);
+        free(ret_val);
+        return nullptr;
+    }
+    memcpy(ret_val->state, src.state, src.size);
+    ret_val->size = src.size;
+    return ret_val;
+}
+
+MT_EXPORT_LLM_API struct mt_llm_state * __stdcall mt_llm_state_encode(
+    struct mt_llm_state const * const state, int const codec)
+{
+    if(state == nullptr || state->state == nullptr || state->size == 0)
+    {
+        MT_LOG_ERR("Invalid state given!\n");
+        return nullptr;
+    }
+    if(mt_llm_state_codec_get(state->state, state->size)
+        != MT_LLM_STATE_CODEC_RAW)
+    {
+        MT_LOG_ERR("State is already encoded!\n");
+        return nullptr;
+    }
+    if(codec == MT_LLM_STATE_CODEC_RAW)
+    {
+        return copy_state(*state);
+    }
+
+    struct mt_llm_state * const ret_val = create_state(*state);
+    size_t capacity = 0;
+
+    if(ret_val == nullptr)
+    {
+        return nullptr;
+    }
+    if(!mt_llm_state_codec_encode(
+        state->state, state->size, codec, *ret_val, capacity))
+    {
+        free(ret_val->state);
+        free(ret_val);
+        return nullptr;
+    }
+    return ret_val; // Caller takes ownership!
+}
+
+MT_EXPORT_LLM_API struct mt_llm_state * __stdcall mt_llm_state_decode(
+    struct mt_llm_state const * const state)
+{
+    if(state == nullptr || state->state == nullptr || state->size == 0)
+    {
+        MT_LOG_ERR("Invalid state given!\n");
+        return nullptr;
+    }
+    if(mt_llm_state_codec_get(state->state, state->size)
+        == MT_LLM_STATE_CODEC_RAW)
+    {
+        return copy_state(*state);
+    }
+
+    struct mt_llm_state * const ret_val = create_state(*state);
+    size_t capacity = 0;
+
+    if(ret_val == nullptr)
+    {
+        return nullptr;
+    }
+    if(!mt_llm_state_codec_decode(
+        state->state, state->size, *ret_val, capacity))
+    {
+        free(ret_val->state);
+        free(ret_val);
+        return nullptr;
+    }
+    return ret_val; // Caller takes ownership!
+}
+
+MT_EXPORT_LLM_API int __stdcall mt_llm_state_get_codec(
+    struct mt_llm_state const * const state)
+{
+    if(state == nullptr)
+    {
+        return -1;
+    }
+    return mt_llm_state_codec_get(state->state, state->size);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_state_codec_get_stats(
+    struct mt_llm_state_codec_stats * const out)
+{
+    if(out == nullptr)
+    {
+        return;
+    }
+    out->encodings = s_encodings.load(std::memory_order_relaxed);
+    out->decodings = s_decodings.load(std::memory_order_relaxed);
+    out->fallbacks = s_fallbacks.load(std::memory_order_relaxed);
+    out->raw_bytes = s_raw_bytes.load(std::memory_order_relaxed);
+    out->encoded_bytes = s_encoded_bytes.load(std::memory_order_relaxed);
+    out->ratio = out->encoded_bytes == 0
+        ? 0.0
+        : static_cast<double>(out->raw_bytes)
+            / static_cast<double>(out->encoded_bytes);
+    out->encode_us = s_encode_us.load(std::memory_order_relaxed);
+    out->decode_us = s_decode_us.load(std::memory_order_relaxed);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_state_codec_reset_stats()
+{
+    s_encodings.store(0, std::memory_order_relaxed);
+    s_decodings.store(0, std::memory_order_relaxed);
+    s_fallbacks.store(0, std::memory_order_relaxed);
+    s_raw_bytes.store(0, std::memory_order_relaxed);
+    s_encoded_bytes.store(0, std::memory_order_relaxed);
+    s_encode_us.store(0, std::memory_order_relaxed);
+    s_decode_us.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,152 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// This is meant to be a pure-C interface to encode (compress) LLM states and
+// to decode them, again.
+
+#ifndef MT_LLM_STATE_CODEC
+#define MT_LLM_STATE_CODEC
+
+#include "mt_llm_lib.h"
+
+#ifdef __cplusplus
+    #include <cstdbool>
+    #include <cstddef>
+    #include <cstdint>
+#else //__cplusplus
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdint.h>
+#endif //__cplusplus
+
+#include "mt_llm_state.h"
+
+// Codecs (could be an enum):
+//
+// - RAW: The state data as given by llama.cpp (not encoded).
+// - LOSSLESS: Huffman-coded byte planes of the state data (the high bytes of
+//   the f16 values compress well, the low bytes are just stored, if they do
+//   not).
+// - Q8_0: The f16 K and V values get quantized to 8 bits with one f16 scale
+//   per 32 values (like llama.cpp's q8_0 type), all other data gets encoded
+//   lossless. Falls back to LOSSLESS, if the layout of the state data is not
+//   recognized, e.g. after a llama.cpp update (see mt_llm_state_codec_stats).
+//
+#define MT_LLM_STATE_CODEC_RAW 0
+#define MT_LLM_STATE_CODEC_LOSSLESS 1
+#define MT_LLM_STATE_CODEC_Q8_0 2
+
+// Encoded state data (all values in host byte order):
+//
+// - 8 bytes: Magic "MTLLMENC".
+// - 4 bytes: Codec used.
+// - 4 bytes: Reserved (zero).
+// - 8 bytes: Size of the raw state data.
+// - Records, each consisting of:
+//   - 1 byte: Record type (stored, Huffman-coded or q8_0).
+//   - 8 bytes: Count of raw bytes represented by the record.
+//   - The record's data.
+//
+// LOSSLESS holds two records for the even and the odd bytes of the raw data,
+// Q8_0 holds the records for the consecutive parts of the raw data.
+
+/** Statistics of all encodings and decodings since the library got loaded or
+ *  since the last call of mt_llm_state_codec_reset_stats().
+ */
+struct mt_llm_state_codec_stats
+{
+    uint64_t encodings; // Count of states encoded.
+    uint64_t decodings; // Count of states decoded.
+    uint64_t fallbacks; // Q8_0 encodings that fell back to LOSSLESS.
+
+    uint64_t raw_bytes; // Sum of the raw sizes of the states encoded.
+    uint64_t encoded_bytes; // Sum of the encoded sizes of the states encoded.
+    double ratio; // raw_bytes / encoded_bytes (0, if nothing was encoded).
+
+    uint64_t encode_us; // Sum of the durations of the encodings.
+    uint64_t decode_us; // Sum of the durations of the decodings.
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+/** Encode given (raw) state with given codec.
+ *
+ * - Caller takes ownership of return value (free the buffer and the object
+ *   like the ones returned by mt_llm_state_create()).
+ * - mt_llm_state_restore() accepts encoded states, too (and decodes them).
+ * - Just copies the state, if MT_LLM_STATE_CODEC_RAW given.
+ * - Returns nullptr, if given state is already encoded, on invalid codec or
+ *   on error.
+ */
+MT_EXPORT_LLM_API struct mt_llm_state * __stdcall mt_llm_state_encode(
+    struct mt_llm_state const * const state, int const codec);
+
+/** Decode given encoded state.
+ *
+ * - Caller takes ownership of return value (see mt_llm_state_encode()).
+ * - Just copies the state, if it is not encoded.
+ * - Returns nullptr, if given state is corrupt or on error.
+ */
+MT_EXPORT_LLM_API struct mt_llm_state * __stdcall mt_llm_state_decode(
+    struct mt_llm_state const * const state);
+
+/** Returns the codec given state is encoded with.
+ *
+ * - Returns -1, if nullptr given.
+ */
+MT_EXPORT_LLM_API int __stdcall mt_llm_state_get_codec(
+    struct mt_llm_state const * const state);
+
+/**
+ * - Can be called from any thread.
+ * - Does nothing, if nullptr given.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_state_codec_get_stats(
+    struct mt_llm_state_codec_stats * const out);
+
+/**
+ * - Can be called from any thread.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_state_codec_reset_stats();
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+// The following functions are used internally and are not pure-C:
+//
+#ifdef __cplusplus/*MT_EXPORT_LLM*/
+
+/** Returns the codec given state data is encoded with (RAW, if it does not
+ *  start with the magic of encoded state data).
+ */
+int mt_llm_state_codec_get(uint8_t const * const data, size_t const size);
+
+/** Encode given raw state data with given codec into the buffer of given state
+ *  object, which has given capacity (in bytes).
+ *
+ * - Reallocates the buffer (and updates the capacity), only if it is too small.
+ * - Keeps the buffer (and its capacity), on error.
+ * - Does not modify the token count and type of the state object.
+ * - Can be called from any thread.
+ */
+bool mt_llm_state_codec_encode(
+    uint8_t const * const raw,
+    size_t const raw_size,
+    int const codec,
+    struct mt_llm_state & out,
+    size_t & capacity);
+
+/** Like mt_llm_state_codec_encode(), but decodes given encoded state data.
+ */
+bool mt_llm_state_codec_decode(
+    uint8_t const * const data,
+    size_t const size,
+    struct mt_llm_state & out,
+    size_t & capacity);
+
+#endif //__cplusplus/*MT_EXPORT_LLM*/
+
+#endif //MT_LLM_STATE_CODEC
@@ -0,0 +1,236 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+#include "llama.h"
+#include "ggml-backend.h"
+#include "llama-io.h"
+#include "llama-memory.h"
+
+#include "mt_llm_state_io.h"
+#include "mt_llm_ctx.h"
+#include "mt_llm_log.h"
+
+// Kept for reuse by reader (see mt_llm_state_io_read()):
+//
+static std::vector<uint8_t> s_read_buf;
+
+/** Collects the data written by llama.cpp and gives it to the write function,
+ *  in parts.
+ *
+ * - Throws, if the write function returns false (which makes llama.cpp stop
+ *   writing).
+ */
+struct writer : llama_io_write_i
+{
+    writer(
+        bool(*write)(void *, uint8_t const *, size_t),
+        void * const user,
+        llama_context * const yield_ctx)
+        : m_write(write)
+        , m_user(user)
+        , m_yield_ctx(yield_ctx)
+        , m_buf(MT_LLM_STATE_IO_BUF_SIZE)
+    {
+        // Nothing else to do.
+    }
+
+    void write(void const * src, size_t size) override
+    {
+        uint8_t const * p = static_cast<uint8_t const *>(src);
+
+        while(0 < size)
+        {
+            size_t const n = get_free(size);
+
+            memcpy(m_buf.data() + m_used, p, n);
+            p += n;
+            size -= n;
+            add(n);
+        }
+    }
+
+    void write_tensor(
+        ggml_tensor const * tensor, size_t offset, size_t size) override
+    {
+        while(0 < size)
+        {
+            size_t const n = get_free(size);
+
+            if(m_yield_ctx != nullptr && mt_llm_ctx_yield())
+            {
+                // The other thread may have left work queued:
+                //
+                llama_synchronize(m_yield_ctx);
+            }
+            ggml_backend_tensor_get(tensor, m_buf.data() + m_used, offset, n);
+            offset += n;
+            size -= n;
+            add(n);
+        }
+    }
+
+    size_t n_bytes() override
+    {
+        return m_written;
+    }
+
+    void flush()
+    {
+        if(m_used == 0)
+        {
+            return;
+        }
+        if(!m_write(m_user, m_buf.data(), m_used))
+        {
+            throw std::runtime_error("Write function failed");
+        }
+        m_used = 0;
+    }
+
+private:
+    size_t get_free(size_t const wanted) const
+    {
+        size_t const n = m_buf.size() - m_used;
+
+        return wanted < n ? wanted : n;
+    }
+
+    void add(size_t const n)
+    {
+        m_used += n;
+        m_written += n;
+        if(m_used == m_buf.size())
+        {
+            flush();
+        }
+    }
+
+    bool(*m_write)(void *, uint8_t const *, size_t);
+    void * m_user;
+    llama_context * m_yield_ctx; // nullptr = Do not yield.
+    std::vector<uint8_t> m_buf;
+    size_t m_used = 0; // Bytes in the buffer.
+    size_t m_written = 0; // All bytes given by llama.cpp.
+};
+
+/** Gives the data read by the read function to llama.cpp.
+ *
+ * - Throws, if the read function returns false (which makes llama.cpp stop
+ *   reading).
+ */
+struct reader : llama_io_read_i
+{
+    reader(bool(*read)(void *, uint8_t *, size_t), void * const user)
+        : m_read(read), m_user(user)
+    {
+        // Nothing else to do.
+    }
+
+    uint8_t const * read(size_t size) override
+    {
+        if(s_read_buf.size() < size)
+        {
+            s_read_buf.resize(size);
+        }
+        read_to(s_read_buf.data(), size);
+        return s_read_buf.data();
+    }
+
+    void read_to(void * dst, size_t size) override
+    {
+        if(!m_read(m_user, static_cast<uint8_t *>(dst), size))
+        {
+            throw std::runtime_error("Read function failed");
+        }
+        m_read_count += size;
+    }
+
+    size_t n_bytes() override
+    {
+        return m_read_count;
+    }
+
+private:
+    bool(*m_read)(void *, uint8_t *, size_t);
+    void * m_user;
+    size_t m_read_count = 0;
+};
+
+bool mt_llm_state_io_write(
+    llama_context * const ctx,
+    llama_seq_id const seq,
+    bool(*write)(void *, uint8_t const *, size_t),
+    void * const user,
+    bool const yield,
+    size_t & size)
+{
+    llama_memory_t const mem = llama_get_memory(ctx);
+    struct writer w(write, user, yield ? ctx : nullptr);
+
+    size = 0;
+    if(mem == nullptr)
+    {
+        MT_LOG_ERR("Context has no memory!\n");
+        return false;
+    }
+
+    llama_synchronize(ctx); // (like llama_state_seq_get_data() does)
+    try
+    {
+        mem->state_write(w, seq);
+        w.flush();
+    }
+    catch(std::exception const & e)
+    {
+        MT_LOG_ERR("Failed to write state: %s!\n", e.what());
+        return false;
+    }
+    size = w.n_bytes();
+    return true;
+}
+
+bool mt_llm_state_io_read(
+    llama_context * const ctx,
+    llama_seq_id const seq,
+    bool(*read)(void *, uint8_t *, size_t),
+    void * const user,
+    size_t & size)
+{
+    llama_memory_t const mem = llama_get_memory(ctx);
+    struct reader r(read, user);
+
+    size = 0;
+    if(mem == nullptr)
+    {
+        MT_LOG_ERR("Context has no memory!\n");
+        return false;
+    }
+
+    llama_synchronize(ctx); // (like llama_state_seq_set_data() does)
+    try
+    {
+        mem->state_read(r, seq);
+    }
+    catch(std::exception const & e)
+    {
+        MT_LOG_ERR("Failed to read state: %s!\n", e.what());
+
+        // llama.cpp does not clean up, if reading fails this way:
+        //
+        llama_memory_seq_rm(mem, seq, -1, -1);
+        return false;
+    }
+    size = r.n_bytes();
+    return true;
+}
+
+void mt_llm_state_io_free()
+{
+    std::vector<uint8_t>().swap(s_read_buf);
+}
@@ -0,0 +1,62 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// Streamed (de-)serialization of the KV cache entries of a sequence, without
+// holding the whole state data in RAM.
+
+#ifndef MT_LLM_STATE_IO
+#define MT_LLM_STATE_IO
+
+#include <cstddef>
+#include <cstdint>
+
+#include "llama.h"
+
+// Size of the buffer that collects the data before it gets given to the write
+// function:
+//
+#define MT_LLM_STATE_IO_BUF_SIZE (1024 * 1024)
+
+/** Write the state data of given sequence (the same bytes, that
+ *  llama_state_seq_get_data() would give) to given function, in parts.
+ *
+ * - Tensor data gets copied from the backend directly into a buffer of
+ *   MT_LLM_STATE_IO_BUF_SIZE bytes, which gets given to the function each
+ *   time it is full (and at the end).
+ * - Stops and returns false, if the function returns false or on error.
+ * - If yielding, the lock of the context (which the caller must hold) is given
+ *   to waiting threads before each part of tensor data copied (see
+ *   mt_llm_ctx_yield()), so the given sequence must not be modified by others.
+ * - Sets given size to the count of bytes written.
+ */
+bool mt_llm_state_io_write(
+    llama_context * const ctx,
+    llama_seq_id const seq,
+    bool(*write)(void *, uint8_t const *, size_t),
+    void * const user,
+    bool const yield,
+    size_t & size);
+
+/** Read the state data of given sequence (as written by
+ *  mt_llm_state_io_write()) from given function, replacing the sequence's KV
+ *  cache entries.
+ *
+ * - The function must read exactly the count of bytes requested.
+ * - Only the data of a single tensor read by llama.cpp gets buffered (e.g.
+ *   the K values of one layer), which is done in a buffer kept for reuse.
+ * - Stops and returns false, if the function returns false or on error (then
+ *   the sequence gets emptied).
+ * - Sets given size to the count of bytes read.
+ */
+bool mt_llm_state_io_read(
+    llama_context * const ctx,
+    llama_seq_id const seq,
+    bool(*read)(void *, uint8_t *, size_t),
+    void * const user,
+    size_t & size);
+
+/** Free the buffer kept for reuse by mt_llm_state_io_read().
+ */
+void mt_llm_state_io_free();
+
+#endif //MT_LLM_STATE_IO
@@ -0,0 +1,378 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+#include <cstdint>
+#include <cassert>
+#include <atomic>
+
+#include "mt_llm_stats.h"
+#include "mt_llm_perf.h"
+
+// HDR-style histogram with log-linear buckets: Values below 2 * sub-bucket
+// count are stored exactly, above that each power of two is split into
+// sub-bucket count buckets of equal width.
+//
+#define MT_LLM_STATS_SUB_BITS 4
+#define MT_LLM_STATS_SUB_COUNT (1 << MT_LLM_STATS_SUB_BITS)
+#define MT_LLM_STATS_MAX_MSB 39 // => Up to ~6 days in microseconds.
+#define MT_LLM_STATS_BUCKET_COUNT \
+    ((MT_LLM_STATS_MAX_MSB - MT_LLM_STATS_SUB_BITS + 2) \
+        * MT_LLM_STATS_SUB_COUNT)
+
+struct hist
+{
+    std::atomic<uint64_t> buckets[MT_LLM_STATS_BUCKET_COUNT];
+    std::atomic<uint64_t> max;
+};
+
+// Zero-initialized, as static:
+//
+static struct hist s_hists[MT_LLM_STATS_LAT_COUNT];
+static std::atomic<uint64_t> s_counters[MT_LLM_STATS_CNT_COUNT];
+static std::atomic<uint64_t> s_gauges[MT_LLM_STATS_GAUGE_COUNT];
+static std::atomic<double> s_tokens_per_second(0.0);
+
+static std::atomic<bool> s_is_hw_enabled(false);
+static int s_hw_phase = -1; // Phase currently counted (used by one thread).
+static std::atomic<uint64_t> s_hw_tokens[MT_LLM_STATS_PHASE_COUNT];
+static std::atomic<uint64_t>
+    s_hw_vals[MT_LLM_STATS_PHASE_COUNT][MT_LLM_PERF_EVT_COUNT];
+
+static int get_msb(uint64_t const val)
+{
+    assert(val != 0);
+
+    int ret_val = 0;
+    uint64_t v = val;
+
+    while(v >>= 1)
+    {
+        ++ret_val;
+    }
+    return ret_val;
+}
+
+static int get_bucket_index(uint64_t const val)
+{
+    uint64_t v = val;
+
+    if(v < 2 * MT_LLM_STATS_SUB_COUNT)
+    {
+        return static_cast<int>(v); // Exact.
+    }
+
+    int msb = get_msb(v);
+
+    if(MT_LLM_STATS_MAX_MSB < msb) // Clamp to the last bucket.
+    {
+        msb = MT_LLM_STATS_MAX_MSB;
+        v = (static_cast<uint64_t>(1) << (msb + 1)) - 1;
+    }
+
+    int const shift = msb - MT_LLM_STATS_SUB_BITS;
+
+    // v >> shift is in [sub. count, 2 * sub. count - 1]:
+    //
+    return shift * MT_LLM_STATS_SUB_COUNT + static_cast<int>(v >> shift);
+}
+
+/** Returns the highest value that gets stored in bucket with given index.
+ */
+static uint64_t get_bucket_upper(int const index)
+{
+    assert(0 <= index && index < MT_LLM_STATS_BUCKET_COUNT);
+
+    if(index < 2 * MT_LLM_STATS_SUB_COUNT)
+    {
+        return static_cast<uint64_t>(index); // Exact.
+    }
+
+    int const shift = index / MT_LLM_STATS_SUB_COUNT - 1;
+    uint64_t const mantissa = static_cast<uint64_t>(
+        index % MT_LLM_STATS_SUB_COUNT + MT_LLM_STATS_SUB_COUNT);
+
+    return (mantissa << shift) + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+static void get_latency(struct hist const & h, struct mt_llm_latency & out)
+{
+    uint64_t counts[MT_LLM_STATS_BUCKET_COUNT];
+    uint64_t total = 0;
+
+    // Take a copy first, as the histogram may be updated concurrently:
+    //
+    for(int i = 0; i < MT_LLM_STATS_BUCKET_COUNT; ++i)
+    {
+        counts[i] = h.buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    out.count = total;
+    out.max = h.max.load(std::memory_order_relaxed);
+    out.p50 = 0;
+    out.p95 = 0;
+    out.p99 = 0;
+
+    if(total == 0)
+    {
+        return;
+    }
+
+    // Ranks are rounded up, e.g. p50 of 3 values is the 2nd value:
+    //
+    uint64_t const rank_50 = (total * 50 + 99) / 100,
+        rank_95 = (total * 95 + 99) / 100,
+        rank_99 = (total * 99 + 99) / 100;
+    uint64_t sum = 0;
+    bool got_50 = false,
+        got_95 = false;
+
+    for(int i = 0; i < MT_LLM_STATS_BUCKET_COUNT; ++i)
+    {
+        if(counts[i] == 0)
+        {
+            continue;
+        }
+        sum += counts[i];
+
+        uint64_t const upper = get_bucket_upper(i);
+
+        if(!got_50 && rank_50 <= sum)
+        {
+            out.p50 = upper;
+            got_50 = true;
+        }
+        if(!got_95 && rank_95 <= sum)
+        {
+            out.p95 = upper;
+            got_95 = true;
+        }
+        if(rank_99 <= sum)
+        {
+            out.p99 = upper;
+            break;
+        }
+    }
+
+    // The bucket's upper bound may be larger than the actual maximum:
+    //
+    if(out.max < out.p50)
+    {
+        out.p50 = out.max;
+    }
+    if(out.max < out.p95)
+    {
+        out.p95 = out.max;
+    }
+    if(out.max < out.p99)
+    {
+        out.p99 = out.max;
+    }
+}
+
+void mt_llm_stats_add(int const cnt_type, uint64_t const val)
+{
+    assert(0 <= cnt_type && cnt_type < MT_LLM_STATS_CNT_COUNT);
+
+    s_counters[cnt_type].fetch_add(val, std::memory_order_relaxed);
+}
+
+void mt_llm_stats_set(int const gauge_type, uint64_t const val)
+{
+    assert(0 <= gauge_type && gauge_type < MT_LLM_STATS_GAUGE_COUNT);
+
+    s_gauges[gauge_type].store(val, std::memory_order_relaxed);
+}
+
+void mt_llm_stats_set_tokens_per_second(double const val)
+{
+    s_tokens_per_second.store(val, std::memory_order_relaxed);
+}
+
+void mt_llm_stats_record_latency(int const lat_type, uint64_t const us)
+{
+    assert(0 <= lat_type && lat_type < MT_LLM_STATS_LAT_COUNT);
+
+    struct hist & h = s_hists[lat_type];
+
+    h.buckets[get_bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t cur_max = h.max.load(std::memory_order_relaxed);
+
+    while(cur_max < us
+        && !h.max.compare_exchange_weak(
+            cur_max, us, std::memory_order_relaxed))
+    {
+        // (cur_max got updated by compare_exchange_weak())
+    }
+}
+
+static void get_hw_phase(int const phase, struct mt_llm_hw_phase & out)
+{
+    out.tokens = s_hw_tokens[phase].load(std::memory_order_relaxed);
+    out.cycles = s_hw_vals[phase][MT_LLM_PERF_EVT_CYCLES].load(
+        std::memory_order_relaxed);
+    out.instructions = s_hw_vals[phase][MT_LLM_PERF_EVT_INSTRUCTIONS].load(
+        std::memory_order_relaxed);
+    out.llc_misses = s_hw_vals[phase][MT_LLM_PERF_EVT_LLC_MISSES].load(
+        std::memory_order_relaxed);
+    out.stalled_cycles = s_hw_vals[phase][MT_LLM_PERF_EVT_STALLED_CYCLES].load(
+        std::memory_order_relaxed);
+
+    out.ipc = out.cycles == 0
+        ? 0.0
+        : static_cast<double>(out.instructions)
+            / static_cast<double>(out.cycles);
+    out.llc_miss_bytes_per_token = out.tokens == 0
+        ? 0.0
+        : 64.0 * static_cast<double>(out.llc_misses)
+            / static_cast<double>(out.tokens);
+}
+
+void mt_llm_stats_begin_phase(int const phase)
+{
+    assert(0 <= phase && phase < MT_LLM_STATS_PHASE_COUNT);
+
+    if(!s_is_hw_enabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    assert(s_hw_phase == -1);
+    s_hw_phase = phase;
+    mt_llm_perf_begin(); // (return value ignored, see mt_llm_perf_end())
+}
+
+void mt_llm_stats_end_phase(int const phase, int const tokens)
+{
+    assert(0 <= phase && phase < MT_LLM_STATS_PHASE_COUNT);
+
+    if(s_hw_phase != phase)
+    {
+        return; // Not counting (e.g. was disabled, when phase began).
+    }
+    s_hw_phase = -1;
+
+    uint64_t vals[MT_LLM_PERF_EVT_COUNT];
+    bool is_valid[MT_LLM_PERF_EVT_COUNT];
+
+    mt_llm_perf_end(vals, is_valid);
+
+    for(int i = 0; i < MT_LLM_PERF_EVT_COUNT; ++i)
+    {
+        if(is_valid[i])
+        {
+            s_hw_vals[phase][i].fetch_add(vals[i], std::memory_order_relaxed);
+        }
+    }
+    if(0 < tokens)
+    {
+        s_hw_tokens[phase].fetch_add(
+            static_cast<uint64_t>(tokens), std::memory_order_relaxed);
+    }
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_stats_get_counters(
+    struct mt_llm_counters * const out)
+{
+    if(out == nullptr)
+    {
+        return;
+    }
+
+    out->queries = s_counters[MT_LLM_STATS_CNT_QUERIES].load(
+        std::memory_order_relaxed);
+    out->prefill_tokens = s_counters[MT_LLM_STATS_CNT_PREFILL_TOKENS].load(
+        std::memory_order_relaxed);
+    out->generated_tokens = s_counters[MT_LLM_STATS_CNT_GENERATED_TOKENS].load(
+        std::memory_order_relaxed);
+    out->errors_not_initialized =
+        s_counters[MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED].load(
+            std::memory_order_relaxed);
+    out->errors_decode = s_counters[MT_LLM_STATS_CNT_ERR_DECODE].load(
+        std::memory_order_relaxed);
+    out->errors_ctx_full = s_counters[MT_LLM_STATS_CNT_ERR_CTX_FULL].load(
+        std::memory_order_relaxed);
+    out->errors_state = s_counters[MT_LLM_STATS_CNT_ERR_STATE].load(
+        std::memory_order_relaxed);
+
+    out->tokens_per_second = s_tokens_per_second.load(
+        std::memory_order_relaxed);
+    out->kv_used_tokens = s_gauges[MT_LLM_STATS_GAUGE_KV_USED_TOKENS].load(
+        std::memory_order_relaxed);
+    out->kv_size_tokens = s_gauges[MT_LLM_STATS_GAUGE_KV_SIZE_TOKENS].load(
+        std::memory_order_relaxed);
+    out->snapshot_count = s_gauges[MT_LLM_STATS_GAUGE_SNAPSHOT_COUNT].load(
+        std::memory_order_relaxed);
+    out->snapshot_bytes = s_gauges[MT_LLM_STATS_GAUGE_SNAPSHOT_BYTES].load(
+        std::memory_order_relaxed);
+
+    out->evicted_tokens = s_counters[MT_LLM_STATS_CNT_EVICTED_TOKENS].load(
+        std::memory_order_relaxed);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_stats_get_latency(
+    struct mt_llm_latency_stats * const out)
+{
+    if(out == nullptr)
+    {
+        return;
+    }
+
+    get_latency(s_hists[MT_LLM_STATS_LAT_INTER_TOKEN], out->inter_token);
+    get_latency(
+        s_hists[MT_LLM_STATS_LAT_PREFILL_PER_100], out->prefill_per_100);
+    get_latency(s_hists[MT_LLM_STATS_LAT_CALLBACK], out->callback);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_stats_reset_latency()
+{
+    for(int i = 0; i < MT_LLM_STATS_LAT_COUNT; ++i)
+    {
+        struct hist & h = s_hists[i];
+
+        for(int j = 0; j < MT_LLM_STATS_BUCKET_COUNT; ++j)
+        {
+            h.buckets[j].store(0, std::memory_order_relaxed);
+        }
+        h.max.store(0, std::memory_order_relaxed);
+    }
+}
+
+MT_EXPORT_LLM_API bool __stdcall mt_llm_stats_set_hw_counters(
+    bool const enable)
+{
+    if(enable && !mt_llm_perf_is_available())
+    {
+        s_is_hw_enabled.store(false, std::memory_order_relaxed);
+        return false;
+    }
+    s_is_hw_enabled.store(enable, std::memory_order_relaxed);
+    return true;
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_stats_get_hw(
+    struct mt_llm_hw_stats * const out)
+{
+    if(out == nullptr)
+    {
+        return;
+    }
+
+    out->is_enabled = s_is_hw_enabled.load(std::memory_order_relaxed);
+    get_hw_phase(MT_LLM_STATS_PHASE_PREFILL, out->prefill);
+    get_hw_phase(MT_LLM_STATS_PHASE_GENERATION, out->generation);
+}
+
+MT_EXPORT_LLM_API void __stdcall mt_llm_stats_reset_hw()
+{
+    for(int i = 0; i < MT_LLM_STATS_PHASE_COUNT; ++i)
+    {
+        s_hw_tokens[i].store(0, std::memory_order_relaxed);
+
+        for(int j = 0; j < MT_LLM_PERF_EVT_COUNT; ++j)
+        {
+            s_hw_vals[i][j].store(0, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,215 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// This is meant to be a pure-C interface to retrieve statistics.
+
+#ifndef MT_LLM_STATS
+#define MT_LLM_STATS
+
+#include "mt_llm_lib.h"
+
+#ifdef __cplusplus
+    #include <cstdbool>
+    #include <cstdint>
+#else //__cplusplus
+    #include <stdbool.h>
+    #include <stdint.h>
+#endif //__cplusplus
+
+/** Latency distribution (all values in microseconds, except count).
+ *
+ * - Percentile values are the upper bounds of the histogram buckets they fall
+ *   into (relative error is below 7%).
+ */
+struct mt_llm_latency
+{
+    uint64_t count; // Count of values recorded.
+    uint64_t p50;
+    uint64_t p95;
+    uint64_t p99;
+    uint64_t max;
+};
+
+struct mt_llm_latency_stats
+{
+    // Time between two sampled tokens being given to the callback (includes
+    // the duration of the callback call for the former token).
+    struct mt_llm_latency inter_token;
+
+    // Prefill (prompt decoding) latency normalized to 100 tokens.
+    struct mt_llm_latency prefill_per_100;
+
+    // Duration of each callback call.
+    struct mt_llm_latency callback;
+};
+
+/** Counters (since process start) and gauges (current values).
+ */
+struct mt_llm_counters
+{
+    uint64_t queries;
+    uint64_t prefill_tokens; // Prompt (and delimiter) tokens decoded.
+    uint64_t generated_tokens; // Tokens sampled.
+
+    uint64_t errors_not_initialized; // API function called while not init.
+    uint64_t errors_decode; // Failed to decode tokens.
+    uint64_t errors_ctx_full; // Context length reached during inference.
+    uint64_t errors_state; // Failed to create or restore a state.
+
+    double tokens_per_second; // Of the last inference.
+    uint64_t kv_used_tokens; // Tokens currently held by the context.
+    uint64_t kv_size_tokens; // Context size in tokens.
+    uint64_t snapshot_count;
+    uint64_t snapshot_bytes;
+
+    uint64_t evicted_tokens; // Removed to reclaim context (e.g. thinking).
+};
+
+/** Hardware performance counter values summed up for an inference phase.
+ *
+ * - A value is zero, if the CPU or kernel does not support counting it.
+ */
+struct mt_llm_hw_phase
+{
+    uint64_t tokens; // Tokens decoded in this phase.
+
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t llc_misses; // Last-level cache misses.
+    uint64_t stalled_cycles; // Cycles stalled in the back-end (e.g. memory).
+
+    double ipc; // Instructions per cycle.
+    double llc_miss_bytes_per_token; // Assumes 64 bytes per cache line.
+};
+
+struct mt_llm_hw_stats
+{
+    bool is_enabled; // See mt_llm_stats_set_hw_counters().
+
+    struct mt_llm_hw_phase prefill; // Decoding of the prompt(-s).
+    struct mt_llm_hw_phase generation; // Sampling and decoding of answers.
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+/**
+ * - Can be called from any thread, also while a query is running.
+ * - Does nothing, if nullptr given.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_stats_get_counters(
+    struct mt_llm_counters * const out);
+
+/**
+ * - Can be called from any thread, also while a query is running.
+ * - Does nothing, if nullptr given.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_stats_get_latency(
+    struct mt_llm_latency_stats * const out);
+
+/**
+ * - Can be called from any thread, also while a query is running.
+ * - Also done by mt_llm_reinit().
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_stats_reset_latency();
+
+/** Enable or disable counting hardware events (via perf_event_open(), Linux
+ *  only) during the prefill and generation phases of each query.
+ *
+ * - Disabled by default, as opening the counters costs some time per phase.
+ * - Returns false (and stays disabled), if enabling is wanted, but hardware
+ *   performance counters are not available (e.g. because of the system's
+ *   perf_event_paranoid setting or not running on Linux).
+ * - Must not be called while a query is running.
+ */
+MT_EXPORT_LLM_API bool __stdcall mt_llm_stats_set_hw_counters(
+    bool const enable);
+
+/**
+ * - Can be called from any thread, also while a query is running.
+ * - Does nothing, if nullptr given.
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_stats_get_hw(
+    struct mt_llm_hw_stats * const out);
+
+/**
+ * - Can be called from any thread, also while a query is running.
+ * - Also done by mt_llm_reinit().
+ */
+MT_EXPORT_LLM_API void __stdcall mt_llm_stats_reset_hw();
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+// The following functions are used internally and are not pure-C:
+//
+#ifdef __cplusplus/*MT_EXPORT_LLM*/
+
+// Could be an enum:
+//
+#define MT_LLM_STATS_LAT_INTER_TOKEN 0
+#define MT_LLM_STATS_LAT_PREFILL_PER_100 1
+#define MT_LLM_STATS_LAT_CALLBACK 2
+//
+#define MT_LLM_STATS_LAT_COUNT 3
+
+#define MT_LLM_STATS_CNT_QUERIES 0
+#define MT_LLM_STATS_CNT_PREFILL_TOKENS 1
+#define MT_LLM_STATS_CNT_GENERATED_TOKENS 2
+#define MT_LLM_STATS_CNT_ERR_NOT_INITIALIZED 3
+#define MT_LLM_STATS_CNT_ERR_DECODE 4
+#define MT_LLM_STATS_CNT_ERR_CTX_FULL 5
+#define MT_LLM_STATS_CNT_ERR_STATE 6
+#define MT_LLM_STATS_CNT_EVICTED_TOKENS 7
+//
+#define MT_LLM_STATS_CNT_COUNT 8
+
+#define MT_LLM_STATS_GAUGE_KV_USED_TOKENS 0
+#define MT_LLM_STATS_GAUGE_KV_SIZE_TOKENS 1
+#define MT_LLM_STATS_GAUGE_SNAPSHOT_COUNT 2
+#define MT_LLM_STATS_GAUGE_SNAPSHOT_BYTES 3
+//
+#define MT_LLM_STATS_GAUGE_COUNT 4
+
+/** Add given value to the counter of given type.
+ *
+ * - Lock-free (relaxed atomics).
+ */
+void mt_llm_stats_add(int const cnt_type, uint64_t const val);
+
+/** Set the gauge of given type to given value.
+ *
+ * - Lock-free (relaxed atomics).
+ */
+void mt_llm_stats_set(int const gauge_type, uint64_t const val);
+
+/** Set the tokens per second of the last inference.
+ */
+void mt_llm_stats_set_tokens_per_second(double const val);
+
+#define MT_LLM_STATS_PHASE_PREFILL 0
+#define MT_LLM_STATS_PHASE_GENERATION 1
+//
+#define MT_LLM_STATS_PHASE_COUNT 2
+
+/** Start counting hardware events for given phase, if enabled (see
+ *  mt_llm_stats_set_hw_counters()).
+ */
+void mt_llm_stats_begin_phase(int const phase);
+
+/** Stop counting hardware events for given phase, if enabled, and add the
+ *  counts and given count of tokens decoded to the phase's sums.
+ */
+void mt_llm_stats_end_phase(int const phase, int const tokens);
+
+/** Add a value in microseconds to the histogram of given latency type.
+ *
+ * - Lock-free, meant to be called from the generation loop.
+ */
+void mt_llm_stats_record_latency(int const lat_type, uint64_t const us);
+
+#endif //__cplusplus/*MT_EXPORT_LLM*/
+
+#endif //MT_LLM_STATS
@@ -0,0 +1,704 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// Benchmark of mt_llm via its public (pure-C) interface.
+//
+// Measures (for each thread count given):
+//
+// - Prefill throughput for different prompt lengths.
+// - Time to first token (TTFT) with and without a system prompt.
+// - Generation speed (tokens per second).
+// - State creation and restoration (throughput and size), also via the
+//   snapshot interface.
+// - Reset cost.
+//
+// Sampling uses a fixed seed, results are written as JSON.
+
+#ifndef _WIN32
+    #define _POSIX_C_SOURCE 199309L // For clock_gettime().
+#endif //_WIN32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else //_WIN32
+    #include <time.h>
+#endif //_WIN32
+
+#include "mt_llm.h"
+#include "mt_llm_p.h"
+#include "mt_llm_tok_type.h"
+#include "mt_llm_snapshot.h"
+#include "mt_llm_state.h"
+#include "mt_llm_log.h"
+
+#define MT_BENCH_SEED 42
+#define MT_BENCH_MAX_VALS 16 // Max. count of thread counts and prompt lengths.
+#define MT_BENCH_MAX_REPS 64
+
+// Used as prompt for TTFT measurements:
+static char const * const s_short_prompt = "Please tell me your name!";
+
+// Used as system prompt for TTFT measurement with system prompt:
+static char const * const s_sys_prompt =
+    "You are a helpful AI assistant. Answer briefly and precisely.";
+
+// Words used to create prompts of a wanted token count (deterministically):
+static char const * const s_words[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "a", "lazy", "dog",
+    "while", "seven", "wizards", "quietly", "count", "golden", "stars",
+    "under", "an", "old", "bridge", "near", "river", "and", "mountain"
+};
+
+struct bench_args
+{
+    char const * model_file_path;
+    char const * out_path; // NULL = stdout.
+    int n_gpu_layers;
+    int thread_counts[MT_BENCH_MAX_VALS];
+    int thread_count_count;
+    int prompt_lens[MT_BENCH_MAX_VALS];
+    int prompt_len_count;
+    int n_gen;
+    int reps;
+    uint32_t n_ctx; // 0 = Calculated from prompt lengths and n_gen.
+};
+
+/** Measurement state, filled by bench_callback().
+ */
+struct bench_run
+{
+    double t_start; // Set before calling mt_llm_query().
+    double t_first; // Time, when first sampled token was received (or -1.0).
+    double t_last; // Time, when last sampled token was received.
+    int n_prompt; // Count of prompt, system prompt and delimiter tokens.
+    int n_sampled;
+    int n_sampled_max; // Callback requests stop, when reached.
+};
+
+static struct bench_run s_run;
+
+/**
+ * - Returns milliseconds from some fixed point in time (monotonic).
+ */
+static double get_ms(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, cnt;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return 1000.0 * (double)cnt.QuadPart / (double)freq.QuadPart;
+#else //_WIN32
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return 1000.0 * (double)t.tv_sec + (double)t.tv_nsec / 1000000.0;
+#endif //_WIN32
+}
+
+static int cmp_double(void const * a, void const * b)
+{
+    double const x = *(double const *)a, y = *(double const *)b;
+
+    return x < y ? -1 : (y < x ? 1 : 0);
+}
+
+/**
+ * - Sorts given array.
+ */
+static double get_median(double * const vals, int const count)
+{
+    if(count <= 0)
+    {
+        return 0.0;
+    }
+    qsort(vals, (size_t)count, sizeof *vals, cmp_double);
+    if(count % 2 == 1)
+    {
+        return vals[count / 2];
+    }
+    return (vals[count / 2 - 1] + vals[count / 2]) / 2.0;
+}
+
+static bool bench_callback(
+    int tok, char const * piece, int type, float const * dig_probs)
+{
+    (void)tok;
+    (void)piece;
+    (void)dig_probs;
+
+    switch(type)
+    {
+        case MT_TOK_TYPE_PROMPT:
+        case MT_TOK_TYPE_DELIM:
+        case MT_TOK_TYPE_SYS_PROMPT:
+            ++s_run.n_prompt;
+            return false;
+
+        case MT_TOK_TYPE_SAMPLED_NON_EOG_NON_CONTROL:
+        case MT_TOK_TYPE_SAMPLED_EOG:
+        case MT_TOK_TYPE_SAMPLED_CONTROL_NON_EOG:
+        case MT_TOK_TYPE_SAMPLED_THINK:
+        {
+            double const t = get_ms();
+
+            if(s_run.t_first < 0.0)
+            {
+                s_run.t_first = t;
+            }
+            s_run.t_last = t;
+            ++s_run.n_sampled;
+            return s_run.n_sampled_max <= s_run.n_sampled; // Stop, if reached.
+        }
+
+        default: // (e.g. IRQ tokens)
+            return false;
+    }
+}
+
+/** Run a query and fill s_run.
+ *
+ * - Stops after n_sampled_max tokens were sampled (or on EOG).
+ */
+static bool run_query(char const * const prompt, int const n_sampled_max)
+{
+    s_run.t_first = -1.0;
+    s_run.t_last = -1.0;
+    s_run.n_prompt = 0;
+    s_run.n_sampled = 0;
+    s_run.n_sampled_max = n_sampled_max;
+
+    s_run.t_start = get_ms();
+    if(!mt_llm_query(prompt))
+    {
+        fprintf(stderr, "Query failed!\n");
+        return false;
+    }
+    if(s_run.t_first < 0.0)
+    {
+        fprintf(stderr, "No token was sampled!\n");
+        return false;
+    }
+    return true;
+}
+
+/** Create a prompt with (at least) given count of tokens.
+ *
+ * - Must be initialized.
+ * - Caller takes ownership of return value.
+ */
+static char * create_prompt(int const tok_cnt)
+{
+    size_t const cap = (size_t)tok_cnt * 16 + 1;
+    char * const ret_val = malloc(cap);
+    size_t len = 0;
+    uint32_t r = MT_BENCH_SEED;
+
+    if(ret_val == NULL)
+    {
+        return NULL;
+    }
+    ret_val[0] = '\0';
+
+    // (a prompt may consist of fewer tokens than words, so check each time)
+    //
+    while(mt_llm_get_token_count(ret_val, false) < tok_cnt)
+    {
+        char const * word = NULL;
+        size_t word_len = 0;
+
+        r = r * 1664525u + 1013904223u; // (LCG, deterministic)
+        word = s_words[(r >> 16) % (sizeof s_words / sizeof *s_words)];
+        word_len = strlen(word);
+
+        if(cap <= len + 1 + word_len)
+        {
+            break; // (should not happen)
+        }
+        if(len != 0)
+        {
+            ret_val[len++] = ' ';
+        }
+        memcpy(ret_val + len, word, word_len + 1);
+        len += word_len;
+    }
+    return ret_val;
+}
+
+static bool init(
+    struct bench_args const * const a,
+    int const threads,
+    bool const with_sys_prompt,
+    double * const out_load_ms)
+{
+    struct mt_llm_p p;
+    double t = 0.0;
+
+    memset(&p, 0, sizeof p);
+
+    p.n_gpu_layers = a->n_gpu_layers;
+
+    p.seed = MT_BENCH_SEED;
+    p.n_ctx = a->n_ctx;
+    p.threads = (uint32_t)threads;
+
+    p.top_k = 40;
+    p.top_p = 0.95f;
+    p.min_p = 0.05f;
+    p.temp = 0.8f;
+
+    strncpy(
+        p.model_file_path,
+        a->model_file_path,
+        MT_LLM_P_LEN_MODEL_FILE_PATH - 1);
+    if(with_sys_prompt)
+    {
+        strncpy(p.sys_prompt, s_sys_prompt, MT_LLM_P_LEN_SYS_PROMPT - 1);
+    }
+    p.try_prompts_by_model = 1;
+    p.callback = bench_callback;
+
+    t = get_ms();
+    if(!mt_llm_reinit(&p))
+    {
+        fprintf(stderr, "Failed to initialize with model!\n");
+        return false;
+    }
+    if(out_load_ms != NULL)
+    {
+        *out_load_ms = get_ms() - t;
+    }
+    return true;
+}
+
+static void free_state(struct mt_llm_state * const state)
+{
+    if(state != NULL)
+    {
+        free(state->state);
+        free(state);
+    }
+}
+
+/** Run all measurements for given thread count and write them as JSON object.
+ */
+static bool bench_threads(
+    struct bench_args const * const a, int const threads, FILE * const out)
+{
+    double vals[MT_BENCH_MAX_REPS];
+    double vals2[MT_BENCH_MAX_REPS];
+    double load_ms = 0.0;
+    size_t state_size = 0;
+    struct mt_llm_memory_info mem;
+
+    fprintf(stderr, "Benchmarking with %d thread(-s)..\n", threads);
+
+    if(!init(a, threads, false, &load_ms))
+    {
+        return false;
+    }
+
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"threads\": %d,\n", threads);
+    fprintf(out, "      \"load_ms\": %.3f,\n", load_ms);
+
+    // Prefill throughput for each prompt length:
+
+    fprintf(out, "      \"prefill\": [\n");
+    for(int i = 0; i < a->prompt_len_count; ++i)
+    {
+        char * const prompt = create_prompt(a->prompt_lens[i]);
+        int n_prompt = 0;
+
+        if(prompt == NULL)
+        {
+            return false;
+        }
+        for(int rep = 0; rep < a->reps; ++rep)
+        {
+            mt_llm_reset();
+            if(!run_query(prompt, 1))
+            {
+                free(prompt);
+                return false;
+            }
+            n_prompt = s_run.n_prompt;
+            vals[rep] = s_run.t_first - s_run.t_start;
+        }
+        free(prompt);
+
+        {
+            double const ms = get_median(vals, a->reps);
+
+            fprintf(
+                out,
+                "        { \"tokens\": %d, \"ms\": %.3f,"
+                    " \"tokens_per_second\": %.3f }%s\n",
+                n_prompt,
+                ms,
+                ms <= 0.0 ? 0.0 : 1000.0 * (double)n_prompt / ms,
+                i + 1 < a->prompt_len_count ? "," : "");
+        }
+    }
+    fprintf(out, "      ],\n");
+
+    // TTFT without system prompt and generation speed:
+
+    for(int rep = 0; rep < a->reps; ++rep)
+    {
+        mt_llm_reset();
+        if(!run_query(s_short_prompt, a->n_gen))
+        {
+            return false;
+        }
+        vals[rep] = s_run.t_first - s_run.t_start;
+        vals2[rep] = s_run.n_sampled <= 1 || s_run.t_last <= s_run.t_first
+            ? 0.0
+            : 1000.0 * (double)(s_run.n_sampled - 1)
+                / (s_run.t_last - s_run.t_first);
+    }
+    fprintf(
+        out,
+        "      \"ttft_without_sys_prompt_ms\": %.3f,\n",
+        get_median(vals, a->reps));
+    fprintf(
+        out,
+        "      \"generation\": { \"tokens\": %d,"
+            " \"tokens_per_second\": %.3f },\n",
+        s_run.n_sampled,
+        get_median(vals2, a->reps));
+
+    // State creation and restoration (of the state after the last query):
+
+    for(int rep = 0; rep < a->reps; ++rep)
+    {
+        double t = get_ms();
+        struct mt_llm_state * const state = mt_llm_state_create();
+
+        vals[rep] = get_ms() - t;
+        if(state == NULL)
+        {
+            return false;
+        }
+        state_size = state->size;
+
+        t = get_ms();
+        if(!mt_llm_state_restore(state))
+        {
+            free_state(state);
+            return false;
+        }
+        vals2[rep] = get_ms() - t;
+        free_state(state);
+    }
+    {
+        double const create_ms = get_median(vals, a->reps),
+            restore_ms = get_median(vals2, a->reps),
+            mib = (double)state_size / (1024.0 * 1024.0);
+
+        fprintf(out, "      \"state\": {\n");
+        fprintf(out, "        \"bytes\": %zu,\n", state_size);
+        fprintf(out, "        \"create_ms\": %.3f,\n", create_ms);
+        fprintf(
+            out,
+            "        \"create_mib_per_second\": %.3f,\n",
+            create_ms <= 0.0 ? 0.0 : 1000.0 * mib / create_ms);
+        fprintf(out, "        \"restore_ms\": %.3f,\n", restore_ms);
+        fprintf(
+            out,
+            "        \"restore_mib_per_second\": %.3f\n",
+            restore_ms <= 0.0 ? 0.0 : 1000.0 * mib / restore_ms);
+        fprintf(out, "      },\n");
+    }
+
+    // Snapshot update and restoration:
+
+    for(int rep = 0; rep < a->reps; ++rep)
+    {
+        double t = get_ms();
+
+        if(!mt_llm_snapshot_update())
+        {
+            return false;
+        }
+        vals[rep] = get_ms() - t;
+
+        t = get_ms();
+        if(!mt_llm_snapshot_restore())
+        {
+            return false;
+        }
+        vals2[rep] = get_ms() - t;
+    }
+    mt_llm_snapshot_clear();
+    fprintf(
+        out,
+        "      \"snapshot\": { \"update_ms\": %.3f, \"restore_ms\": %.3f },\n",
+        get_median(vals, a->reps),
+        get_median(vals2, a->reps));
+
+    // Reset cost (after a query):
+
+    for(int rep = 0; rep < a->reps; ++rep)
+    {
+        double t = 0.0;
+
+        if(!run_query(s_short_prompt, a->n_gen))
+        {
+            return false;
+        }
+        t = get_ms();
+        mt_llm_reset();
+        vals[rep] = get_ms() - t;
+    }
+    fprintf(out, "      \"reset_ms\": %.3f,\n", get_median(vals, a->reps));
+
+    if(!mt_llm_get_memory_info(&mem))
+    {
+        return false;
+    }
+    fprintf(
+        out,
+        "      \"memory\": { \"model_bytes\": %llu,"
+            " \"kv_allocated_bytes\": %llu,"
+            " \"process_peak_bytes\": %llu },\n",
+        (unsigned long long)mem.model_bytes,
+        (unsigned long long)mem.kv_allocated_bytes,
+        (unsigned long long)mem.process_peak_bytes);
+
+    // TTFT with system prompt (needs re-initialization):
+
+    if(!init(a, threads, true, NULL))
+    {
+        return false;
+    }
+    for(int rep = 0; rep < a->reps; ++rep)
+    {
+        mt_llm_reset();
+        if(!run_query(s_short_prompt, 1))
+        {
+            return false;
+        }
+        vals[rep] = s_run.t_first - s_run.t_start;
+    }
+    fprintf(
+        out,
+        "      \"ttft_with_sys_prompt_ms\": %.3f,\n",
+        get_median(vals, a->reps));
+    fprintf(
+        out,
+        "      \"prompt_tokens_with_sys_prompt\": %d\n",
+        s_run.n_prompt);
+
+    fprintf(out, "    }");
+
+    mt_llm_deinit();
+    return true;
+}
+
+/**
+ * - Returns count of values parsed or -1 on error.
+ */
+static int parse_int_list(char const * str, int * const out, int const max)
+{
+    int ret_val = 0;
+
+    while(*str != '\0')
+    {
+        char * end = NULL;
+        long const val = strtol(str, &end, 10);
+
+        if(end == str || val <= 0 || max <= ret_val)
+        {
+            return -1;
+        }
+        out[ret_val++] = (int)val;
+
+        str = end;
+        if(*str == ',')
+        {
+            ++str;
+        }
+    }
+    return ret_val;
+}
+
+static void print_usage(char const * const name)
+{
+    fprintf(
+        stderr,
+        "Usage: %s -m <model.gguf> [options]\n"
+            "\n"
+            "  -o <path>   Write JSON to file (default: stdout).\n"
+            "  -t <list>   Thread counts, e.g. 1,2,4,8 (default: 4).\n"
+            "  -p <list>   Prompt lengths in tokens (default: 32,128,512).\n"
+            "  -n <count>  Tokens to generate (default: 64).\n"
+            "  -r <count>  Repetitions per measurement (default: 3).\n"
+            "  -c <count>  Context length (default: calculated).\n"
+            "  -g <count>  Layers to offload to GPU (default: 0).\n",
+        name);
+}
+
+static bool parse_args(
+    int const argc, char * const argv[], struct bench_args * const a)
+{
+    memset(a, 0, sizeof *a);
+
+    a->thread_counts[0] = 4;
+    a->thread_count_count = 1;
+    a->prompt_lens[0] = 32;
+    a->prompt_lens[1] = 128;
+    a->prompt_lens[2] = 512;
+    a->prompt_len_count = 3;
+    a->n_gen = 64;
+    a->reps = 3;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        char const * const opt = argv[i];
+        char const * const val = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if(opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0' || val == NULL)
+        {
+            return false;
+        }
+        ++i;
+
+        switch(opt[1])
+        {
+            case 'm':
+                a->model_file_path = val;
+                break;
+            case 'o':
+                a->out_path = val;
+                break;
+            case 't':
+                a->thread_count_count = parse_int_list(
+                    val, a->thread_counts, MT_BENCH_MAX_VALS);
+                break;
+            case 'p':
+                a->prompt_len_count = parse_int_list(
+                    val, a->prompt_lens, MT_BENCH_MAX_VALS);
+                break;
+            case 'n':
+                a->n_gen = atoi(val);
+                break;
+            case 'r':
+                a->reps = atoi(val);
+                break;
+            case 'c':
+                a->n_ctx = (uint32_t)atoi(val);
+                break;
+            case 'g':
+                a->n_gpu_layers = atoi(val);
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    if(a->model_file_path == NULL
+        || a->thread_count_count <= 0
+        || a->prompt_len_count <= 0
+        || a->n_gen <= 0
+        || a->reps <= 0
+        || MT_BENCH_MAX_REPS < a->reps)
+    {
+        return false;
+    }
+
+    if(a->n_ctx == 0)
+    {
+        int max_len = 0;
+
+        for(int i = 0; i < a->prompt_len_count; ++i)
+        {
+            if(max_len < a->prompt_lens[i])
+            {
+                max_len = a->prompt_lens[i];
+            }
+        }
+
+        // Enough for the longest prompt (plus some tokens, as the prompt
+        // created may be a bit longer) or the generation (plus delimiters):
+        //
+        a->n_ctx = (uint32_t)(
+            (max_len < a->n_gen ? a->n_gen : max_len) * 2 + 256);
+    }
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    struct bench_args a;
+    FILE * out = stdout;
+
+    if(!parse_args(argc, argv, &a))
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    mt_llm_log_set_level(MT_LOG_LEVEL_ERR); // (keeps stdout clean for JSON)
+
+    if(a.out_path != NULL)
+    {
+        out = fopen(a.out_path, "w");
+        if(out == NULL)
+        {
+            fprintf(stderr, "Failed to open \"%s\"!\n", a.out_path);
+            return 1;
+        }
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"model\": \"");
+    for(char const * c = a.model_file_path; *c != '\0'; ++c)
+    {
+        if(*c == '"' || *c == '\\')
+        {
+            fputc('\\', out);
+        }
+        fputc(*c, out);
+    }
+    fprintf(out, "\",\n");
+    fprintf(out, "  \"seed\": %d,\n", MT_BENCH_SEED);
+    fprintf(out, "  \"n_ctx\": %u,\n", (unsigned int)a.n_ctx);
+    fprintf(out, "  \"n_gen\": %d,\n", a.n_gen);
+    fprintf(out, "  \"repetitions\": %d,\n", a.reps);
+    fprintf(out, "  \"results\": [\n");
+
+    for(int i = 0; i < a.thread_count_count; ++i)
+    {
+        if(!bench_threads(&a, a.thread_counts[i], out))
+        {
+            fprintf(
+                stderr,
+                "Benchmark failed for %d thread(-s)!\n",
+                a.thread_counts[i]);
+            mt_llm_deinit();
+            if(out != stdout)
+            {
+                fclose(out);
+            }
+            return 1;
+        }
+        fprintf(out, "%s\n", i + 1 < a.thread_count_count ? "," : "");
+    }
+
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+
+    if(out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
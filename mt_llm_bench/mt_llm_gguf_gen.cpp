@@ -0,0 +1,470 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// Creates a tiny GGUF model file with random weights (LLaMA architecture and
+// SentencePiece-like vocabulary), to benchmark mt_llm's own overhead without
+// the need for a real model.
+//
+// The model's name matches a supported prompt template (see mt_llm_model.cpp),
+// the template's delimiters are part of the vocabulary as control tokens.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "ggml.h"
+#include "gguf.h"
+
+#include "mt_llm_p.h"
+#include "mt_llm_model.h"
+
+#define MT_GEN_MAX_VOCAB (256 * 1024)
+
+// SentencePiece token types (see llama.cpp's llama_token_type):
+#define MT_GEN_TOK_NORMAL 1
+#define MT_GEN_TOK_UNKNOWN 2
+#define MT_GEN_TOK_CONTROL 3
+#define MT_GEN_TOK_BYTE 6
+
+struct gen_args
+{
+    char const * out_path;
+    char const * tmpl; // Template's model name or index.
+    int n_vocab;
+    int n_embd;
+    int n_layer;
+    int n_head;
+    int n_head_kv;
+    int n_ff;
+    int n_ctx;
+    uint32_t seed;
+};
+
+struct vocab
+{
+    std::vector<std::string> texts;
+    std::vector<float> scores;
+    std::vector<int32_t> types;
+    std::set<std::string> known;
+};
+
+static uint64_t s_rnd = 0;
+
+static float get_rnd(float const range)
+{
+    // xorshift64*:
+    s_rnd ^= s_rnd >> 12;
+    s_rnd ^= s_rnd << 25;
+    s_rnd ^= s_rnd >> 27;
+
+    uint64_t const r = s_rnd * 2685821657736338717ull;
+
+    return range * (2.0f * static_cast<float>(r >> 40) / 16777216.0f - 1.0f);
+}
+
+static bool add_token(
+    struct vocab & v, std::string const & text, int32_t const type)
+{
+    if(!v.known.insert(text).second)
+    {
+        return false; // Exists already.
+    }
+    v.texts.push_back(text);
+    v.scores.push_back(-static_cast<float>(v.texts.size()));
+    v.types.push_back(type);
+    return true;
+}
+
+/** Add the "<...>" and "[...]" parts of given delimiter as control tokens.
+ */
+static void add_control_tokens(struct vocab & v, char const * const delim)
+{
+    char const * c = delim;
+
+    while(*c != '\0')
+    {
+        char const close = *c == '<' ? '>' : (*c == '[' ? ']' : '\0');
+
+        if(close == '\0')
+        {
+            ++c;
+            continue;
+        }
+
+        char const * end = c + 1;
+
+        while(*end != '\0' && *end != close && *end != ' ' && *end != '\n')
+        {
+            ++end;
+        }
+        if(*end == close && end - c < 32)
+        {
+            add_token(v, std::string(c, end + 1), MT_GEN_TOK_CONTROL);
+            c = end + 1;
+            continue;
+        }
+        ++c;
+    }
+}
+
+/** Create the vocabulary with given count of tokens.
+ */
+static bool fill_vocab(
+    struct vocab & v, int const n_vocab, struct mt_llm_p const & p)
+{
+    static char const * const space = "\xE2\x96\x81"; // "▁" (U+2581).
+
+    add_token(v, "<unk>", MT_GEN_TOK_UNKNOWN);
+    add_token(v, "<s>", MT_GEN_TOK_CONTROL);
+    add_token(v, "</s>", MT_GEN_TOK_CONTROL);
+
+    for(int i = 0; i < 256; ++i)
+    {
+        char buf[8];
+
+        snprintf(buf, sizeof buf, "<0x%02X>", i);
+        add_token(v, buf, MT_GEN_TOK_BYTE);
+    }
+
+    add_control_tokens(v, p.sys_prompt_beg_delim);
+    add_control_tokens(v, p.sys_prompt_mid_delim);
+    add_control_tokens(v, p.sys_prompt_end_delim);
+    add_control_tokens(v, p.prompt_beg_delim);
+    add_control_tokens(v, p.prompt_end_delim);
+    add_control_tokens(v, p.think_beg_delim);
+    add_control_tokens(v, p.think_end_delim);
+
+    add_token(v, space, MT_GEN_TOK_NORMAL);
+
+    // Printable ASCII characters (incl. the digits), alone and with a leading
+    // space:
+    //
+    for(char c = '!'; c <= '~'; ++c)
+    {
+        add_token(v, std::string(1, c), MT_GEN_TOK_NORMAL);
+        add_token(v, std::string(space) + c, MT_GEN_TOK_NORMAL);
+    }
+
+    // Fill up with "words" of lowercase letters ("aa", "ab", ..):
+    //
+    for(uint32_t i = 26; static_cast<int>(v.texts.size()) < n_vocab; ++i)
+    {
+        std::string word;
+
+        for(uint32_t j = i; 0 < j; j /= 26)
+        {
+            word.insert(word.begin(), static_cast<char>('a' + j % 26));
+        }
+        add_token(v, word, MT_GEN_TOK_NORMAL);
+        if(static_cast<int>(v.texts.size()) < n_vocab)
+        {
+            add_token(v, std::string(space) + word, MT_GEN_TOK_NORMAL);
+        }
+    }
+
+    if(n_vocab < static_cast<int>(v.texts.size()))
+    {
+        fprintf(
+            stderr,
+            "Vocabulary size must be at least %d for this template!\n",
+            static_cast<int>(v.texts.size()));
+        return false;
+    }
+    return true;
+}
+
+static struct ggml_tensor * add_tensor(
+    struct ggml_context * const ctx,
+    struct gguf_context * const gguf,
+    char const * const name,
+    int64_t const ne0,
+    int64_t const ne1, // 0 = 1-dimensional.
+    float const range) // 0.0f = Fill with 1.0f.
+{
+    struct ggml_tensor * const t = ne1 == 0
+        ? ggml_new_tensor_1d(ctx, GGML_TYPE_F32, ne0)
+        : ggml_new_tensor_2d(ctx, GGML_TYPE_F32, ne0, ne1);
+    float * const data = static_cast<float*>(t->data);
+    int64_t const n = ggml_nelements(t);
+
+    ggml_set_name(t, name);
+    for(int64_t i = 0; i < n; ++i)
+    {
+        data[i] = range == 0.0f ? 1.0f : get_rnd(range);
+    }
+    gguf_add_tensor(gguf, t);
+    return t;
+}
+
+static void print_usage(char const * const name)
+{
+    fprintf(
+        stderr,
+        "Usage: %s -o <out.gguf> [options]\n"
+            "\n"
+            "  -t <name|index>  Prompt template (default: 0, -l to list).\n"
+            "  -l               List prompt templates.\n"
+            "  -v <count>       Vocabulary size (default: 32000, max.: %d).\n"
+            "  -e <count>       Embedding length (default: 64).\n"
+            "  -L <count>       Layers (default: 2).\n"
+            "  -H <count>       Attention heads (default: 4).\n"
+            "  -K <count>       Attention KV heads (default: 4).\n"
+            "  -f <count>       Feed-forward length (default: 128).\n"
+            "  -c <count>       Context length (default: 4096).\n"
+            "  -s <seed>        Seed of random weights (default: 42).\n",
+        name,
+        MT_GEN_MAX_VOCAB);
+}
+
+static void print_templates()
+{
+    for(int i = 0; true; ++i)
+    {
+        char const * const name = mt_llm_model_get_template(i, nullptr);
+
+        if(name == nullptr)
+        {
+            return;
+        }
+        printf("%d: \"%s\"\n", i, name);
+    }
+}
+
+/**
+ * - Returns the template's index or -1, if not found.
+ */
+static int get_template_index(char const * const tmpl)
+{
+    char * end = nullptr;
+    long const index = strtol(tmpl, &end, 10);
+
+    if(*end == '\0' && 0 <= index)
+    {
+        return mt_llm_model_get_template(static_cast<int>(index), nullptr)
+                == nullptr
+            ? -1 : static_cast<int>(index);
+    }
+    for(int i = 0; true; ++i)
+    {
+        char const * const name = mt_llm_model_get_template(i, nullptr);
+
+        if(name == nullptr)
+        {
+            return -1;
+        }
+        if(strcmp(name, tmpl) == 0)
+        {
+            return i;
+        }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    struct gen_args a;
+    struct mt_llm_p p;
+    struct vocab v;
+
+    a.out_path = nullptr;
+    a.tmpl = "0";
+    a.n_vocab = 32000;
+    a.n_embd = 64;
+    a.n_layer = 2;
+    a.n_head = 4;
+    a.n_head_kv = 4;
+    a.n_ff = 128;
+    a.n_ctx = 4096;
+    a.seed = 42;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "-l") == 0)
+        {
+            print_templates();
+            return 0;
+        }
+        if(argv[i][0] != '-' || argv[i][1] == '\0' || i + 1 == argc)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        char const * const val = argv[++i];
+
+        switch(argv[i - 1][1])
+        {
+            case 'o': a.out_path = val; break;
+            case 't': a.tmpl = val; break;
+            case 'v': a.n_vocab = atoi(val); break;
+            case 'e': a.n_embd = atoi(val); break;
+            case 'L': a.n_layer = atoi(val); break;
+            case 'H': a.n_head = atoi(val); break;
+            case 'K': a.n_head_kv = atoi(val); break;
+            case 'f': a.n_ff = atoi(val); break;
+            case 'c': a.n_ctx = atoi(val); break;
+            case 's': a.seed = static_cast<uint32_t>(atoi(val)); break;
+
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if(a.out_path == nullptr
+        || a.n_vocab <= 0 || MT_GEN_MAX_VOCAB < a.n_vocab
+        || a.n_embd <= 0 || a.n_layer <= 0 || a.n_ff <= 0 || a.n_ctx <= 0
+        || a.n_head <= 0 || a.n_embd % a.n_head != 0
+        || a.n_head_kv <= 0 || a.n_head % a.n_head_kv != 0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    int const tmpl_index = get_template_index(a.tmpl);
+
+    if(tmpl_index == -1)
+    {
+        fprintf(stderr, "Template \"%s\" not found (see -l)!\n", a.tmpl);
+        return 1;
+    }
+
+    memset(&p, 0, sizeof p);
+
+    char const * const model_name = mt_llm_model_get_template(tmpl_index, &p);
+
+    if(!fill_vocab(v, a.n_vocab, p))
+    {
+        return 1;
+    }
+
+    s_rnd = 0x9E3779B97F4A7C15ull ^ a.seed;
+
+    int const n_embd_head = a.n_embd / a.n_head;
+    int const n_embd_kv = n_embd_head * a.n_head_kv;
+
+    // Meta data:
+
+    struct gguf_context * const gguf = gguf_init_empty();
+
+    gguf_set_val_str(gguf, "general.architecture", "llama");
+    gguf_set_val_str(gguf, "general.name", model_name);
+
+    gguf_set_val_u32(gguf, "llama.vocab_size", a.n_vocab);
+    gguf_set_val_u32(gguf, "llama.context_length", a.n_ctx);
+    gguf_set_val_u32(gguf, "llama.embedding_length", a.n_embd);
+    gguf_set_val_u32(gguf, "llama.block_count", a.n_layer);
+    gguf_set_val_u32(gguf, "llama.feed_forward_length", a.n_ff);
+    gguf_set_val_u32(gguf, "llama.attention.head_count", a.n_head);
+    gguf_set_val_u32(gguf, "llama.attention.head_count_kv", a.n_head_kv);
+    gguf_set_val_u32(gguf, "llama.rope.dimension_count", n_embd_head);
+    gguf_set_val_f32(gguf, "llama.attention.layer_norm_rms_epsilon", 1e-5f);
+
+    {
+        std::vector<char const *> texts;
+
+        for(std::string const & text : v.texts)
+        {
+            texts.push_back(text.c_str());
+        }
+        gguf_set_val_str(gguf, "tokenizer.ggml.model", "llama");
+        gguf_set_arr_str(
+            gguf, "tokenizer.ggml.tokens", texts.data(), texts.size());
+    }
+    gguf_set_arr_data(
+        gguf,
+        "tokenizer.ggml.scores",
+        GGUF_TYPE_FLOAT32,
+        v.scores.data(),
+        v.scores.size());
+    gguf_set_arr_data(
+        gguf,
+        "tokenizer.ggml.token_type",
+        GGUF_TYPE_INT32,
+        v.types.data(),
+        v.types.size());
+    gguf_set_val_u32(gguf, "tokenizer.ggml.unknown_token_id", 0);
+    gguf_set_val_u32(gguf, "tokenizer.ggml.bos_token_id", 1);
+    gguf_set_val_u32(gguf, "tokenizer.ggml.eos_token_id", 2);
+    gguf_set_val_bool(gguf, "tokenizer.ggml.add_bos_token", true);
+    gguf_set_val_bool(gguf, "tokenizer.ggml.add_eos_token", false);
+
+    // Tensors (the output tensor is omitted, so the token embeddings are used
+    // instead):
+
+    size_t const n_floats =
+        static_cast<size_t>(a.n_vocab) * a.n_embd
+            + a.n_embd
+            + static_cast<size_t>(a.n_layer) * (
+                2 * a.n_embd
+                    + 2 * static_cast<size_t>(a.n_embd) * a.n_embd
+                    + 2 * static_cast<size_t>(a.n_embd) * n_embd_kv
+                    + 3 * static_cast<size_t>(a.n_embd) * a.n_ff);
+    size_t const n_tensors = 2 + 9 * static_cast<size_t>(a.n_layer);
+
+    struct ggml_init_params params;
+
+    params.mem_size = n_floats * sizeof(float)
+        + n_tensors * (ggml_tensor_overhead() + 64); // (64 for alignment)
+    params.mem_buffer = nullptr;
+    params.no_alloc = false;
+
+    struct ggml_context * const ctx = ggml_init(params);
+
+    if(ctx == nullptr)
+    {
+        fprintf(stderr, "Failed to allocate %zu bytes!\n", params.mem_size);
+        gguf_free(gguf);
+        return 1;
+    }
+
+    float const range = 1.0f / sqrtf(static_cast<float>(a.n_embd));
+
+    add_tensor(ctx, gguf, "token_embd.weight", a.n_embd, a.n_vocab, range);
+    add_tensor(ctx, gguf, "output_norm.weight", a.n_embd, 0, 0.0f);
+
+    for(int l = 0; l < a.n_layer; ++l)
+    {
+        char name[64];
+
+        snprintf(name, sizeof name, "blk.%d.attn_norm.weight", l);
+        add_tensor(ctx, gguf, name, a.n_embd, 0, 0.0f);
+        snprintf(name, sizeof name, "blk.%d.attn_q.weight", l);
+        add_tensor(ctx, gguf, name, a.n_embd, a.n_embd, range);
+        snprintf(name, sizeof name, "blk.%d.attn_k.weight", l);
+        add_tensor(ctx, gguf, name, a.n_embd, n_embd_kv, range);
+        snprintf(name, sizeof name, "blk.%d.attn_v.weight", l);
+        add_tensor(ctx, gguf, name, a.n_embd, n_embd_kv, range);
+        snprintf(name, sizeof name, "blk.%d.attn_output.weight", l);
+        add_tensor(ctx, gguf, name, a.n_embd, a.n_embd, range);
+        snprintf(name, sizeof name, "blk.%d.ffn_norm.weight", l);
+        add_tensor(ctx, gguf, name, a.n_embd, 0, 0.0f);
+        snprintf(name, sizeof name, "blk.%d.ffn_gate.weight", l);
+        add_tensor(ctx, gguf, name, a.n_embd, a.n_ff, range);
+        snprintf(name, sizeof name, "blk.%d.ffn_up.weight", l);
+        add_tensor(ctx, gguf, name, a.n_embd, a.n_ff, range);
+        snprintf(name, sizeof name, "blk.%d.ffn_down.weight", l);
+        add_tensor(ctx, gguf, name, a.n_ff, a.n_embd, range);
+    }
+
+    bool const ok = gguf_write_to_file(gguf, a.out_path, false);
+
+    ggml_free(ctx);
+    gguf_free(gguf);
+
+    if(!ok)
+    {
+        fprintf(stderr, "Failed to write \"%s\"!\n", a.out_path);
+        return 1;
+    }
+    fprintf(
+        stderr,
+        "Wrote \"%s\" (\"%s\", %d tokens).\n",
+        a.out_path,
+        model_name,
+        a.n_vocab);
+    return 0;
+}
@@ -0,0 +1,453 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// Microbenchmarks of mt_llm's own per-token hot paths (not of llama.cpp),
+// meant to be used with a tiny model created by mt_llm_gguf_gen.
+//
+// Results are written as JSON (nanoseconds per operation).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "llama.h"
+#include "common.h"
+
+#include "mt_llm.h"
+#include "mt_llm_p.h"
+#include "mt_llm_log.h"
+#include "mt_llm_tok_type.h"
+#include "mt_llm_model.h"
+#include "mt_llm_ctx.h"
+#include "mt_llm_prob.h"
+#include "mt_llm_rev.h"
+
+#define MT_MICRO_SEED 42
+
+struct micro_args
+{
+    char const * model_file_path;
+    char const * out_path; // nullptr = stdout.
+    int iters; // Base count of iterations (scaled down for slow operations).
+    int n_gen; // Tokens to generate for the per-token overhead measurement.
+    int threads;
+};
+
+struct micro_result
+{
+    std::string name;
+    int iters;
+    double ns_per_op;
+    double items_per_op; // E.g. tokens processed per operation (0 = n/a).
+};
+
+static std::vector<struct micro_result> s_results;
+
+// Prevents the compiler from optimizing away the measured operations:
+static volatile float s_sink = 0.0f;
+
+// Filled by callback() during the per-token overhead measurement:
+static int s_n_sampled = 0;
+static int s_n_sampled_max = 0;
+static std::chrono::steady_clock::time_point s_t_first;
+static std::chrono::steady_clock::time_point s_t_last;
+
+static double get_ns(std::chrono::steady_clock::time_point const & t0)
+{
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - t0).count();
+}
+
+/** Run given function given count of times and add the result.
+ */
+template<typename F> static void run(
+    char const * const name, int const iters, double const items, F f)
+{
+    f(); // Warm-up.
+
+    auto const t0 = std::chrono::steady_clock::now();
+
+    for(int i = 0; i < iters; ++i)
+    {
+        f();
+    }
+
+    double const ns = get_ns(t0);
+
+    s_results.push_back(
+        { name, iters, ns / static_cast<double>(iters), items });
+    fprintf(
+        stderr,
+        "%-36s %12.1f ns/op\n",
+        name,
+        ns / static_cast<double>(iters));
+}
+
+static void on_llama_log(ggml_log_level level, char const * text, void * user)
+{
+    (void)level;
+    (void)text;
+    (void)user;
+}
+
+static bool callback(int tok, char const * piece, int type, float const * dp)
+{
+    (void)tok;
+    (void)piece;
+    (void)dp;
+
+    if(type != MT_TOK_TYPE_SAMPLED_NON_EOG_NON_CONTROL
+        && type != MT_TOK_TYPE_SAMPLED_CONTROL_NON_EOG
+        && type != MT_TOK_TYPE_SAMPLED_THINK
+        && type != MT_TOK_TYPE_SAMPLED_EOG)
+    {
+        return false;
+    }
+
+    auto const t = std::chrono::steady_clock::now();
+
+    if(s_n_sampled == 0)
+    {
+        s_t_first = t;
+    }
+    s_t_last = t;
+    ++s_n_sampled;
+    return s_n_sampled_max <= s_n_sampled;
+}
+
+static void fill_p(struct micro_args const & a, struct mt_llm_p & p)
+{
+    memset(&p, 0, sizeof p);
+
+    p.seed = MT_MICRO_SEED;
+    p.n_ctx = static_cast<uint32_t>(a.n_gen + 256);
+    p.threads = static_cast<uint32_t>(a.threads);
+    p.top_k = 40;
+    p.top_p = 0.95f;
+    p.min_p = 0.05f;
+    p.temp = 0.8f;
+    strncpy(
+        p.model_file_path, a.model_file_path, MT_LLM_P_LEN_MODEL_FILE_PATH - 1);
+    p.try_prompts_by_model = 1;
+    p.callback = callback;
+}
+
+/** Sampler as created by mt_llm.cpp (for the same parameters).
+ */
+static llama_sampler * create_sampler(struct mt_llm_p const & p)
+{
+    llama_sampler * const ret_val = llama_sampler_chain_init(
+        llama_sampler_chain_default_params());
+
+    llama_sampler_chain_add(ret_val, llama_sampler_init_top_k(p.top_k));
+    llama_sampler_chain_add(ret_val, llama_sampler_init_top_p(p.top_p, 0));
+    llama_sampler_chain_add(ret_val, llama_sampler_init_min_p(p.min_p, 0));
+    llama_sampler_chain_add(ret_val, llama_sampler_init_temp(p.temp));
+    llama_sampler_chain_add(ret_val, llama_sampler_init_dist(p.seed));
+    return ret_val;
+}
+
+/** Benchmark the internal functions directly.
+ *
+ * - Returns the time per token of a plain llama.cpp sample-and-decode loop in
+ *   nanoseconds or a negative value on error.
+ */
+static double bench_internals(struct micro_args const & a)
+{
+    struct mt_llm_p p;
+
+    fill_p(a, p);
+
+    llama_log_set(on_llama_log, nullptr);
+    llama_backend_init();
+
+    llama_model * const model = mt_llm_model_create(p);
+
+    if(model == nullptr)
+    {
+        fprintf(stderr, "Failed to load model!\n");
+        return -1.0;
+    }
+    mt_llm_model_try_set_prompts(*model, p);
+
+    llama_context * const ctx = mt_llm_ctx_create(p, *model);
+
+    if(ctx == nullptr)
+    {
+        fprintf(stderr, "Failed to create context!\n");
+        llama_model_free(model);
+        return -1.0;
+    }
+
+    llama_sampler * const sampler = create_sampler(p);
+    int const n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+    std::vector<std::vector<int>> digit_toks;
+    std::vector<std::string> pieces;
+    std::vector<float> logits(static_cast<size_t>(n_vocab));
+    float max = 0.0f;
+
+    // Decode BOS to have logits:
+    //
+    if(mt_llm_ctx_decode(*ctx, *sampler, 0, "", nullptr) < 0)
+    {
+        fprintf(stderr, "Failed to decode!\n");
+        llama_sampler_free(sampler);
+        llama_free(ctx);
+        llama_model_free(model);
+        return -1.0;
+    }
+
+    run("prob_get_last_logits", a.iters, n_vocab, [&]() {
+        logits = mt_llm_prob_get_last_logits(*ctx, max);
+    });
+
+    run("prob_get_probabilities", a.iters, n_vocab, [&]() {
+        s_sink = mt_llm_prob_get_probabilities(logits, max)[0];
+    });
+
+    run("model_get_digit_tokens", a.iters / 100 + 1, n_vocab, [&]() {
+        digit_toks = mt_llm_model_get_digit_tokens(*model);
+    });
+
+    {
+        std::vector<float> const probs = mt_llm_prob_get_probabilities(
+            logits, max);
+
+        run("prob_get_token_group_probabilities", a.iters * 10, 10, [&]() {
+            s_sink = mt_llm_prob_get_token_group_probabilities(
+                digit_toks, probs)[0];
+        });
+    }
+
+    // Piece rendering for (up to) 4096 tokens per operation:
+
+    int const n_pieces = n_vocab < 4096 ? n_vocab : 4096;
+
+    pieces.resize(static_cast<size_t>(n_pieces));
+    run("ctx_get_piece_from", a.iters / 100 + 1, n_pieces, [&]() {
+        for(int i = 0; i < n_pieces; ++i)
+        {
+            pieces[i] = mt_llm_ctx_get_piece_from(*ctx, n_vocab - 1 - i);
+        }
+    });
+
+    run("ctx_tokenize", a.iters, 0, [&]() {
+        s_sink = static_cast<float>(mt_llm_ctx_tokenize(
+            *ctx, "Please tell me your name!", false).size());
+    });
+
+    // Reverse prompt ring buffer, fed with the rendered pieces:
+    {
+        struct mt_llm_rev rev;
+
+        if(!mt_llm_rev_init(rev, "Master:"))
+        {
+            mt_llm_rev_free(rev);
+            return -1.0;
+        }
+        run("rev_add_and_is_found", a.iters / 100 + 1, n_pieces, [&]() {
+            for(int i = 0; i < n_pieces; ++i)
+            {
+                mt_llm_rev_add(rev, pieces[i].c_str());
+                s_sink = mt_llm_rev_is_found(rev) ? 1.0f : 0.0f;
+            }
+        });
+        mt_llm_rev_free(rev);
+    }
+
+    // Plain llama.cpp generation loop (as baseline for the per-token overhead):
+
+    double ret_val = -1.0;
+    {
+        llama_batch batch = llama_batch_init(1, 0, 1);
+        int n_cur = 1; // (BOS is decoded)
+        auto const t0 = std::chrono::steady_clock::now();
+
+        for(int i = 0; i < a.n_gen; ++i)
+        {
+            llama_token const tok = llama_sampler_sample(sampler, ctx, -1);
+
+            common_batch_clear(batch);
+            common_batch_add(batch, tok, n_cur++, { 0 }, true);
+            if(llama_decode(ctx, batch) != 0)
+            {
+                break;
+            }
+            llama_sampler_accept(sampler, tok);
+        }
+        ret_val = get_ns(t0) / static_cast<double>(a.n_gen);
+        llama_batch_free(batch);
+
+        s_results.push_back({ "llama_sample_and_decode", a.n_gen, ret_val, 1 });
+        fprintf(
+            stderr, "%-36s %12.1f ns/op\n", "llama_sample_and_decode", ret_val);
+    }
+
+    llama_sampler_free(sampler);
+    llama_free(ctx);
+    llama_model_free(model);
+    llama_backend_free();
+    return ret_val;
+}
+
+/** Measure the time per sampled token via the public interface.
+ *
+ * - Returns nanoseconds per token or a negative value on error.
+ */
+static double bench_public(struct micro_args const & a)
+{
+    struct mt_llm_p p;
+
+    fill_p(a, p);
+
+    if(!mt_llm_reinit(&p))
+    {
+        fprintf(stderr, "Failed to initialize!\n");
+        return -1.0;
+    }
+
+    s_n_sampled = 0;
+    s_n_sampled_max = a.n_gen + 1; // (first token is sampled after prefill)
+    if(!mt_llm_query("Hi"))
+    {
+        fprintf(stderr, "Query failed!\n");
+        mt_llm_deinit();
+        return -1.0;
+    }
+    mt_llm_deinit();
+
+    if(s_n_sampled < 2)
+    {
+        fprintf(stderr, "Too few tokens were sampled!\n");
+        return -1.0;
+    }
+
+    double const ret_val =
+        std::chrono::duration<double, std::nano>(s_t_last - s_t_first).count()
+            / static_cast<double>(s_n_sampled - 1);
+
+    s_results.push_back(
+        { "mt_llm_query_per_token", s_n_sampled - 1, ret_val, 1 });
+    fprintf(
+        stderr, "%-36s %12.1f ns/op\n", "mt_llm_query_per_token", ret_val);
+    return ret_val;
+}
+
+static void print_usage(char const * const name)
+{
+    fprintf(
+        stderr,
+        "Usage: %s -m <model.gguf> [options]\n"
+            "\n"
+            "  -o <path>   Write JSON to file (default: stdout).\n"
+            "  -i <count>  Base count of iterations (default: 1000).\n"
+            "  -n <count>  Tokens to generate (default: 256).\n"
+            "  -t <count>  Threads (default: 1).\n",
+        name);
+}
+
+int main(int argc, char * argv[])
+{
+    struct micro_args a;
+
+    a.model_file_path = nullptr;
+    a.out_path = nullptr;
+    a.iters = 1000;
+    a.n_gen = 256;
+    a.threads = 1;
+
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        char const * const val = argv[i + 1];
+
+        if(strcmp(argv[i], "-m") == 0)
+        {
+            a.model_file_path = val;
+        }
+        else if(strcmp(argv[i], "-o") == 0)
+        {
+            a.out_path = val;
+        }
+        else if(strcmp(argv[i], "-i") == 0)
+        {
+            a.iters = atoi(val);
+        }
+        else if(strcmp(argv[i], "-n") == 0)
+        {
+            a.n_gen = atoi(val);
+        }
+        else if(strcmp(argv[i], "-t") == 0)
+        {
+            a.threads = atoi(val);
+        }
+    }
+    if(a.model_file_path == nullptr
+        || a.iters <= 0 || a.n_gen <= 0 || a.threads <= 0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    mt_llm_log_set_level(MT_LOG_LEVEL_ERR);
+
+    double const ns_llama = bench_internals(a);
+
+    if(ns_llama < 0.0)
+    {
+        return 1;
+    }
+
+    double const ns_mt_llm = bench_public(a);
+
+    if(ns_mt_llm < 0.0)
+    {
+        return 1;
+    }
+
+    s_results.push_back(
+        { "mt_llm_overhead_per_token", 1, ns_mt_llm - ns_llama, 1 });
+    fprintf(
+        stderr,
+        "%-36s %12.1f ns/op\n",
+        "mt_llm_overhead_per_token",
+        ns_mt_llm - ns_llama);
+
+    FILE * const out = a.out_path == nullptr ? stdout : fopen(a.out_path, "w");
+
+    if(out == nullptr)
+    {
+        fprintf(stderr, "Failed to open \"%s\"!\n", a.out_path);
+        return 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"seed\": %d,\n", MT_MICRO_SEED);
+    fprintf(out, "  \"threads\": %d,\n", a.threads);
+    fprintf(out, "  \"results\": [\n");
+    for(size_t i = 0; i < s_results.size(); ++i)
+    {
+        struct micro_result const & r = s_results[i];
+
+        fprintf(
+            out,
+            "    { \"name\": \"%s\", \"iterations\": %d,"
+                " \"ns_per_op\": %.1f, \"items_per_op\": %.0f }%s\n",
+            r.name.c_str(),
+            r.iters,
+            r.ns_per_op,
+            r.items_per_op,
+            i + 1 < s_results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+
+    if(out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,744 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// Compares (e.g. differently quantized) GGUF model files regarding quality and
+// speed, fully offline:
+//
+// - Perplexity over a local text file (batched log-likelihood, tokenized by
+//   mt_llm).
+// - Digit classification accuracy over a local labelled set (via the public
+//   interface, so mt_llm's prompt templates and digit probabilities are used).
+// - Prefill and generation speed (via the public interface).
+//
+// Writes a table to stdout that marks the Pareto-optimal models and optionally
+// the results as JSON.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+
+#include "llama.h"
+#include "common.h"
+
+#include "mt_llm.h"
+#include "mt_llm_p.h"
+#include "mt_llm_log.h"
+#include "mt_llm_tok_type.h"
+#include "mt_llm_stats.h"
+#include "mt_llm_model.h"
+#include "mt_llm_ctx.h"
+
+#define MT_QUANT_SEED 42
+
+// Could be an enum:
+//
+#define MT_QUANT_MODE_NONE 0
+#define MT_QUANT_MODE_CLASSIFY 1
+#define MT_QUANT_MODE_GENERATE 2
+
+struct quant_args
+{
+    std::vector<char const *> model_file_paths;
+    char const * text_path; // nullptr = No perplexity.
+    char const * labels_path; // nullptr = No classification accuracy.
+    char const * sys_prompt; // nullptr = None.
+    char const * out_path; // nullptr = No JSON.
+    int n_chunk; // Tokens per perplexity chunk.
+    int max_chunks; // 0 = All.
+    int n_prompt; // Prompt length for the speed measurement (in words).
+    int n_gen; // Tokens to generate for the speed measurement.
+    int threads;
+    int n_gpu_layers;
+};
+
+struct quant_item
+{
+    int label; // 0 to 9.
+    std::string prompt;
+};
+
+struct quant_result
+{
+    std::string model_file_path;
+    uint64_t file_bytes;
+
+    double perplexity; // Negative = Not measured.
+    int ppl_tokens; // Count of tokens scored.
+
+    double accuracy; // Negative = Not measured.
+    int acc_items;
+
+    double prefill_tps; // Tokens per second.
+    double gen_tps; // Tokens per second.
+
+    bool is_pareto;
+};
+
+// Used by callback():
+//
+static int s_mode = MT_QUANT_MODE_NONE;
+static int s_predicted = -1; // Digit with highest probability.
+static int s_n_sampled = 0;
+static int s_n_sampled_max = 0;
+static std::chrono::steady_clock::time_point s_t_first;
+static std::chrono::steady_clock::time_point s_t_last;
+
+static void on_llama_log(ggml_log_level level, char const * text, void * user)
+{
+    (void)level;
+    (void)text;
+    (void)user;
+}
+
+static bool callback(int tok, char const * piece, int type, float const * dp)
+{
+    (void)tok;
+    (void)piece;
+
+    if(type != MT_TOK_TYPE_SAMPLED_NON_EOG_NON_CONTROL
+        && type != MT_TOK_TYPE_SAMPLED_CONTROL_NON_EOG
+        && type != MT_TOK_TYPE_SAMPLED_THINK
+        && type != MT_TOK_TYPE_SAMPLED_EOG)
+    {
+        return false;
+    }
+
+    if(s_mode == MT_QUANT_MODE_CLASSIFY)
+    {
+        if(dp == nullptr) // <=> No non-whitespace token sampled, yet.
+        {
+            return false;
+        }
+        s_predicted = 0;
+        for(int i = 1; i < 10; ++i)
+        {
+            if(dp[s_predicted] < dp[i])
+            {
+                s_predicted = i;
+            }
+        }
+        return true; // (the digit probabilities are all that is needed)
+    }
+
+    auto const t = std::chrono::steady_clock::now();
+
+    if(s_n_sampled == 0)
+    {
+        s_t_first = t;
+    }
+    s_t_last = t;
+    ++s_n_sampled;
+    return s_n_sampled_max <= s_n_sampled;
+}
+
+static bool read_file(char const * const path, std::string & out)
+{
+    std::ifstream f(path, std::ios::binary);
+
+    if(!f)
+    {
+        fprintf(stderr, "Failed to open \"%s\"!\n", path);
+        return false;
+    }
+
+    std::stringstream ss;
+
+    ss << f.rdbuf();
+    out = ss.str();
+    return true;
+}
+
+/** Read the labelled set.
+ *
+ * - One item per line: The label (a digit from 0 to 9), a tab character and
+ *   the prompt.
+ * - Empty lines and lines starting with '#' are ignored.
+ */
+static bool read_items(
+    char const * const path, std::vector<struct quant_item> & out)
+{
+    std::ifstream f(path);
+    std::string line;
+    int line_nr = 0;
+
+    if(!f)
+    {
+        fprintf(stderr, "Failed to open \"%s\"!\n", path);
+        return false;
+    }
+    while(std::getline(f, line))
+    {
+        ++line_nr;
+        if(!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if(line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        if(line.size() < 3 || line[0] < '0' || '9' < line[0] || line[1] != '\t')
+        {
+            fprintf(stderr, "Invalid item in line %d!\n", line_nr);
+            return false;
+        }
+        out.push_back({ line[0] - '0', line.substr(2) });
+    }
+    if(out.empty())
+    {
+        fprintf(stderr, "No items found in \"%s\"!\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void fill_p(
+    struct quant_args const & a,
+    char const * const model_file_path,
+    struct mt_llm_p & p)
+{
+    memset(&p, 0, sizeof p);
+
+    p.seed = MT_QUANT_SEED;
+    p.n_ctx = static_cast<uint32_t>(2 * a.n_prompt + a.n_gen + 1024);
+    p.threads = static_cast<uint32_t>(a.threads);
+    p.n_gpu_layers = a.n_gpu_layers;
+    p.top_k = 40;
+    p.top_p = 0.95f;
+    p.min_p = 0.05f;
+    p.temp = 0.8f;
+    strncpy(
+        p.model_file_path, model_file_path, MT_LLM_P_LEN_MODEL_FILE_PATH - 1);
+    if(a.sys_prompt != nullptr)
+    {
+        strncpy(p.sys_prompt, a.sys_prompt, MT_LLM_P_LEN_SYS_PROMPT - 1);
+    }
+    p.try_prompts_by_model = 1;
+    p.callback = callback;
+}
+
+/** Calculate the perplexity of given text for given model.
+ *
+ * - Like llama.cpp's perplexity tool, the text is split into independent
+ *   chunks and only the second half of each chunk is scored (to give each
+ *   scored token enough context).
+ * - Decodes each chunk as one batch (mt_llm's own context uses a batch size of
+ *   one, but the results do not depend on the batch size).
+ * - Returns false on error.
+ */
+static bool calc_perplexity(
+    struct quant_args const & a,
+    std::string const & text,
+    struct quant_result & r)
+{
+    struct mt_llm_p p;
+
+    fill_p(a, r.model_file_path.c_str(), p);
+
+    llama_model * const model = mt_llm_model_create(p);
+
+    if(model == nullptr)
+    {
+        fprintf(stderr, "Failed to load model!\n");
+        return false;
+    }
+
+    llama_context_params ctx_p = llama_context_default_params();
+
+    ctx_p.n_ctx = static_cast<uint32_t>(a.n_chunk);
+    ctx_p.n_batch = ctx_p.n_ctx;
+    ctx_p.n_ubatch = ctx_p.n_ctx;
+    ctx_p.n_seq_max = 1;
+    ctx_p.n_threads = a.threads;
+    ctx_p.n_threads_batch = a.threads;
+
+    llama_context * const ctx = llama_init_from_model(model, ctx_p);
+
+    if(ctx == nullptr)
+    {
+        fprintf(stderr, "Failed to create context!\n");
+        llama_model_free(model);
+        return false;
+    }
+
+    llama_vocab const * const vocab = llama_model_get_vocab(model);
+    int const n_vocab = llama_vocab_n_tokens(vocab);
+    bool const add_bos = llama_vocab_get_add_bos(vocab);
+    std::vector<int> const toks = mt_llm_ctx_tokenize(*ctx, text.c_str(), true);
+    int n_chunks = static_cast<int>(toks.size()) / a.n_chunk;
+    int const first = a.n_chunk / 2; // Index of first token scored.
+    llama_batch batch = llama_batch_init(a.n_chunk, 0, 1);
+    double nll = 0.0; // Negative log-likelihood sum.
+    bool ret_val = true;
+
+    if(0 < a.max_chunks && a.max_chunks < n_chunks)
+    {
+        n_chunks = a.max_chunks;
+    }
+    if(n_chunks == 0)
+    {
+        fprintf(
+            stderr,
+            "Text is too short (%d tokens, %d needed)!\n",
+            static_cast<int>(toks.size()),
+            a.n_chunk);
+        ret_val = false;
+    }
+
+    r.ppl_tokens = 0;
+    for(int c = 0; ret_val && c < n_chunks; ++c)
+    {
+        int const start = c * a.n_chunk;
+
+        llama_memory_clear(llama_get_memory(ctx), true);
+
+        common_batch_clear(batch);
+        for(int i = 0; i < a.n_chunk; ++i)
+        {
+            llama_token const tok = i == 0 && add_bos
+                ? llama_vocab_bos(vocab) : toks[start + i];
+
+            common_batch_add(batch, tok, i, { 0 }, first - 1 <= i);
+        }
+        if(llama_decode(ctx, batch) != 0)
+        {
+            fprintf(stderr, "Decoding failed!\n");
+            ret_val = false;
+            break;
+        }
+
+        for(int i = first - 1; i < a.n_chunk - 1; ++i)
+        {
+            float const * const logits = llama_get_logits_ith(ctx, i);
+            float max = logits[0];
+            double sum = 0.0;
+
+            for(int j = 1; j < n_vocab; ++j)
+            {
+                if(max < logits[j])
+                {
+                    max = logits[j];
+                }
+            }
+            for(int j = 0; j < n_vocab; ++j)
+            {
+                sum += exp(static_cast<double>(logits[j] - max));
+            }
+            nll += log(sum) + static_cast<double>(max)
+                - static_cast<double>(logits[toks[start + i + 1]]);
+            ++r.ppl_tokens;
+        }
+        fprintf(
+            stderr,
+            "  Chunk %d/%d: Perplexity = %.4f\n",
+            c + 1,
+            n_chunks,
+            exp(nll / static_cast<double>(r.ppl_tokens)));
+    }
+    if(ret_val)
+    {
+        r.perplexity = exp(nll / static_cast<double>(r.ppl_tokens));
+    }
+
+    llama_batch_free(batch);
+    llama_free(ctx);
+    llama_model_free(model);
+    return ret_val;
+}
+
+/** Classify given items via mt_llm_query() and the digit probabilities given
+ *  to the callback.
+ *
+ * - mt_llm must be initialized.
+ */
+static bool calc_accuracy(
+    std::vector<struct quant_item> const & items, struct quant_result & r)
+{
+    int correct = 0;
+
+    s_mode = MT_QUANT_MODE_CLASSIFY;
+    for(size_t i = 0; i < items.size(); ++i)
+    {
+        mt_llm_reset();
+
+        s_predicted = -1;
+        if(!mt_llm_query(items[i].prompt.c_str()))
+        {
+            fprintf(stderr, "Query failed!\n");
+            return false;
+        }
+        if(s_predicted == items[i].label)
+        {
+            ++correct;
+        }
+    }
+    r.acc_items = static_cast<int>(items.size());
+    r.accuracy = static_cast<double>(correct) / static_cast<double>(r.acc_items);
+    return true;
+}
+
+/** Measure prefill and generation speed via mt_llm_query().
+ *
+ * - mt_llm must be initialized.
+ * - The prompt is created deterministically from given text (or a fixed word,
+ *   if no text given).
+ */
+static bool calc_speed(
+    struct quant_args const & a,
+    std::string const & text,
+    struct quant_result & r)
+{
+    std::istringstream words(text);
+    std::string word, prompt;
+    struct mt_llm_counters cnt_before, cnt_after;
+
+    for(int i = 0; i < a.n_prompt; ++i)
+    {
+        if(!(words >> word))
+        {
+            word = "hello";
+        }
+        prompt += i == 0 ? word : " " + word;
+    }
+    prompt += "\nPlease continue this text.";
+
+    mt_llm_reset();
+    mt_llm_stats_get_counters(&cnt_before);
+
+    s_mode = MT_QUANT_MODE_GENERATE;
+    s_n_sampled = 0;
+    s_n_sampled_max = a.n_gen;
+
+    auto const t0 = std::chrono::steady_clock::now();
+
+    if(!mt_llm_query(prompt.c_str()))
+    {
+        fprintf(stderr, "Query failed!\n");
+        return false;
+    }
+    mt_llm_stats_get_counters(&cnt_after);
+    if(s_n_sampled < 2)
+    {
+        fprintf(stderr, "Too few tokens were sampled!\n");
+        return false;
+    }
+
+    // The first token is sampled right after the prefill (sampling time is
+    // negligible compared to decoding the prompt):
+    //
+    r.prefill_tps = static_cast<double>(
+            cnt_after.prefill_tokens - cnt_before.prefill_tokens)
+        / std::chrono::duration<double>(s_t_first - t0).count();
+    r.gen_tps = static_cast<double>(s_n_sampled - 1)
+        / std::chrono::duration<double>(s_t_last - s_t_first).count();
+    return true;
+}
+
+/** Returns true, if result x is at least as good as y regarding each measured
+ *  metric and better regarding at least one.
+ */
+static bool is_dominating(
+    struct quant_result const & x, struct quant_result const & y)
+{
+    int better = 0, worse = 0;
+
+    auto const cmp = [&](double const vx, double const vy, bool const higher) {
+        if(vx == vy)
+        {
+            return;
+        }
+        if((vx > vy) == higher)
+        {
+            ++better;
+        }
+        else
+        {
+            ++worse;
+        }
+    };
+
+    if(0.0 <= x.perplexity && 0.0 <= y.perplexity)
+    {
+        cmp(x.perplexity, y.perplexity, false);
+    }
+    if(0.0 <= x.accuracy && 0.0 <= y.accuracy)
+    {
+        cmp(x.accuracy, y.accuracy, true);
+    }
+    cmp(x.prefill_tps, y.prefill_tps, true);
+    cmp(x.gen_tps, y.gen_tps, true);
+    cmp(
+        static_cast<double>(x.file_bytes),
+        static_cast<double>(y.file_bytes),
+        false);
+    return worse == 0 && 0 < better;
+}
+
+static void print_table(std::vector<struct quant_result> const & results)
+{
+    printf(
+        "| Model | Size (MiB) | Perplexity | Accuracy | Prefill (t/s)"
+            " | Generation (t/s) | Pareto |\n");
+    printf("|---|---:|---:|---:|---:|---:|:---:|\n");
+    for(auto const & r : results)
+    {
+        printf(
+            "| %s | %.1f | ",
+            std::filesystem::path(r.model_file_path).filename().c_str(),
+            static_cast<double>(r.file_bytes) / (1024.0 * 1024.0));
+        if(0.0 <= r.perplexity)
+        {
+            printf("%.4f | ", r.perplexity);
+        }
+        else
+        {
+            printf("- | ");
+        }
+        if(0.0 <= r.accuracy)
+        {
+            printf("%.2f%% | ", 100.0 * r.accuracy);
+        }
+        else
+        {
+            printf("- | ");
+        }
+        printf(
+            "%.1f | %.1f | %s |\n",
+            r.prefill_tps,
+            r.gen_tps,
+            r.is_pareto ? "yes" : "");
+    }
+}
+
+static bool write_json(
+    struct quant_args const & a,
+    std::vector<struct quant_result> const & results)
+{
+    FILE * const out = fopen(a.out_path, "w");
+
+    if(out == nullptr)
+    {
+        fprintf(stderr, "Failed to open \"%s\"!\n", a.out_path);
+        return false;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"seed\": %d,\n", MT_QUANT_SEED);
+    fprintf(out, "  \"threads\": %d,\n", a.threads);
+    fprintf(out, "  \"chunk_tokens\": %d,\n", a.n_chunk);
+    fprintf(out, "  \"prompt_words\": %d,\n", a.n_prompt);
+    fprintf(out, "  \"gen_tokens\": %d,\n", a.n_gen);
+    fprintf(out, "  \"models\": [\n");
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        struct quant_result const & r = results[i];
+
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"path\": \"");
+        for(char const c : r.model_file_path)
+        {
+            fprintf(out, c == '"' || c == '\\' ? "\\%c" : "%c", c);
+        }
+        fprintf(out, "\",\n");
+        fprintf(
+            out,
+            "      \"file_bytes\": %llu,\n",
+            static_cast<unsigned long long>(r.file_bytes));
+        if(0.0 <= r.perplexity)
+        {
+            fprintf(out, "      \"perplexity\": %.6f,\n", r.perplexity);
+            fprintf(out, "      \"perplexity_tokens\": %d,\n", r.ppl_tokens);
+        }
+        if(0.0 <= r.accuracy)
+        {
+            fprintf(out, "      \"accuracy\": %.6f,\n", r.accuracy);
+            fprintf(out, "      \"accuracy_items\": %d,\n", r.acc_items);
+        }
+        fprintf(out, "      \"prefill_tps\": %.3f,\n", r.prefill_tps);
+        fprintf(out, "      \"gen_tps\": %.3f,\n", r.gen_tps);
+        fprintf(
+            out, "      \"pareto\": %s\n", r.is_pareto ? "true" : "false");
+        fprintf(out, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+    fclose(out);
+    return true;
+}
+
+static void print_usage(char const * const name)
+{
+    fprintf(
+        stderr,
+        "Usage: %s [options] <model.gguf> [<model.gguf> ...]\n"
+            "\n"
+            "  -x <path>   Text file for perplexity.\n"
+            "  -l <path>   Labelled set for digit classification accuracy\n"
+            "              (lines of \"<digit>\\t<prompt>\").\n"
+            "  -s <text>   System prompt for classification and speed.\n"
+            "  -o <path>   Also write JSON to file.\n"
+            "  -c <count>  Tokens per perplexity chunk (default: 512).\n"
+            "  -k <count>  Max. count of perplexity chunks (default: all).\n"
+            "  -p <count>  Prompt length for speed in words (default: 256).\n"
+            "  -n <count>  Tokens to generate for speed (default: 128).\n"
+            "  -t <count>  Threads (default: 4).\n"
+            "  -g <count>  Layers to offload to GPU (default: 0).\n",
+        name);
+}
+
+int main(int argc, char * argv[])
+{
+    struct quant_args a;
+    std::string text;
+    std::vector<struct quant_item> items;
+    std::vector<struct quant_result> results;
+
+    a.text_path = nullptr;
+    a.labels_path = nullptr;
+    a.sys_prompt = nullptr;
+    a.out_path = nullptr;
+    a.n_chunk = 512;
+    a.max_chunks = 0;
+    a.n_prompt = 256;
+    a.n_gen = 128;
+    a.threads = 4;
+    a.n_gpu_layers = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(argv[i][0] != '-')
+        {
+            a.model_file_paths.push_back(argv[i]);
+            continue;
+        }
+        if(i + 1 == argc)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        char const * const val = argv[++i];
+
+        switch(argv[i - 1][1])
+        {
+            case 'x': a.text_path = val; break;
+            case 'l': a.labels_path = val; break;
+            case 's': a.sys_prompt = val; break;
+            case 'o': a.out_path = val; break;
+            case 'c': a.n_chunk = atoi(val); break;
+            case 'k': a.max_chunks = atoi(val); break;
+            case 'p': a.n_prompt = atoi(val); break;
+            case 'n': a.n_gen = atoi(val); break;
+            case 't': a.threads = atoi(val); break;
+            case 'g': a.n_gpu_layers = atoi(val); break;
+
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if(a.model_file_paths.empty()
+        || a.n_chunk < 4 || a.max_chunks < 0 || a.n_prompt <= 0
+        || a.n_gen < 2 || a.threads <= 0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if(a.text_path != nullptr && !read_file(a.text_path, text))
+    {
+        return 1;
+    }
+    if(a.labels_path != nullptr && !read_items(a.labels_path, items))
+    {
+        return 1;
+    }
+
+    mt_llm_log_set_level(MT_LOG_LEVEL_ERR);
+
+    for(char const * const path : a.model_file_paths)
+    {
+        struct quant_result r;
+        std::error_code ec;
+
+        r.model_file_path = path;
+        r.file_bytes = static_cast<uint64_t>(
+            std::filesystem::file_size(path, ec));
+        if(ec)
+        {
+            fprintf(stderr, "Failed to get size of \"%s\"!\n", path);
+            return 1;
+        }
+        r.perplexity = -1.0;
+        r.ppl_tokens = 0;
+        r.accuracy = -1.0;
+        r.acc_items = 0;
+        r.prefill_tps = 0.0;
+        r.gen_tps = 0.0;
+        r.is_pareto = false;
+
+        fprintf(stderr, "%s:\n", path);
+
+        if(!text.empty())
+        {
+            llama_log_set(on_llama_log, nullptr);
+            llama_backend_init();
+            bool const ok = calc_perplexity(a, text, r);
+            llama_backend_free();
+            if(!ok)
+            {
+                return 1;
+            }
+        }
+
+        struct mt_llm_p p;
+
+        fill_p(a, path, p);
+        if(!mt_llm_reinit(&p))
+        {
+            fprintf(stderr, "Failed to initialize!\n");
+            return 1;
+        }
+        if((!items.empty() && !calc_accuracy(items, r))
+            || !calc_speed(a, text, r))
+        {
+            mt_llm_deinit();
+            return 1;
+        }
+        mt_llm_deinit();
+
+        fprintf(
+            stderr,
+            "  Prefill: %.1f t/s, generation: %.1f t/s\n",
+            r.prefill_tps,
+            r.gen_tps);
+        results.push_back(r);
+    }
+
+    for(auto & r : results)
+    {
+        r.is_pareto = true;
+        for(auto const & other : results)
+        {
+            if(is_dominating(other, r))
+            {
+                r.is_pareto = false;
+                break;
+            }
+        }
+    }
+
+    print_table(results);
+    if(a.out_path != nullptr && !write_json(a, results))
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,1121 @@
+
+// Marcel Timm, RhinoDevel, 2026oct18
+
+// Replays calls recorded via mt_llm_record_start() (see mt_llm_record.h) with
+// any model or library build and reports the latency distributions as JSON.
+
+#ifndef _WIN32
+    #define _POSIX_C_SOURCE 199309L // For clock_gettime() and nanosleep().
+#endif //_WIN32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else //_WIN32
+    #include <time.h>
+#endif //_WIN32
+
+#include "mt_llm.h"
+#include "mt_llm_p.h"
+#include "mt_llm_tok_type.h"
+#include "mt_llm_snapshot.h"
+#include "mt_llm_snapshot_file.h"
+#include "mt_llm_prefix_cache.h"
+#include "mt_llm_state.h"
+#include "mt_llm_record.h"
+#include "mt_llm_log.h"
+
+#define MT_REPLAY_MAX_ARGS 32
+
+// Could be an enum (new IDs get appended, existing ones never change):
+//
+#define MT_REPLAY_LAT_REINIT 0
+#define MT_REPLAY_LAT_DEINIT 1
+#define MT_REPLAY_LAT_QUERY 2
+#define MT_REPLAY_LAT_RESET 3
+#define MT_REPLAY_LAT_STATE_CREATE 4
+#define MT_REPLAY_LAT_STATE_RESTORE 5
+#define MT_REPLAY_LAT_SNAPSHOT_CLEAR 6
+#define MT_REPLAY_LAT_SNAPSHOT_UPDATE 7
+#define MT_REPLAY_LAT_SNAPSHOT_RESTORE 8
+#define MT_REPLAY_LAT_TTFT 9
+#define MT_REPLAY_LAT_INTER_TOKEN 10
+#define MT_REPLAY_LAT_SNAPSHOT_SLOT_UPDATE 11
+#define MT_REPLAY_LAT_SNAPSHOT_SLOT_RESTORE 12
+#define MT_REPLAY_LAT_SNAPSHOT_SLOT_REMOVE 13
+#define MT_REPLAY_LAT_SNAPSHOT_SET_BUDGET 14
+#define MT_REPLAY_LAT_SNAPSHOT_FILE_SAVE 15
+#define MT_REPLAY_LAT_SNAPSHOT_FILE_SAVE_ASYNC 16
+#define MT_REPLAY_LAT_SNAPSHOT_FILE_WAIT 17
+#define MT_REPLAY_LAT_SNAPSHOT_FILE_LOAD 18
+#define MT_REPLAY_LAT_SNAPSHOT_SET_MAX_DELTA_DEPTH 19
+#define MT_REPLAY_LAT_SNAPSHOT_SET_CODEC 20
+#define MT_REPLAY_LAT_STATE_WRITE_TO 21
+#define MT_REPLAY_LAT_STATE_WRITE_STREAM 22
+#define MT_REPLAY_LAT_STATE_READ_FROM 23
+#define MT_REPLAY_LAT_STATE_READ_STREAM 24
+#define MT_REPLAY_LAT_SNAPSHOT_UPDATE_ASYNC 25
+#define MT_REPLAY_LAT_SNAPSHOT_SLOT_UPDATE_ASYNC 26
+#define MT_REPLAY_LAT_SNAPSHOT_ASYNC_WAIT 27
+#define MT_REPLAY_LAT_PREFIX_CACHE_SET_MAX_TOKENS 28
+#define MT_REPLAY_LAT_PREFIX_CACHE_SET_BUDGET 29
+#define MT_REPLAY_LAT_PREFIX_CACHE_SET_DIR 30
+#define MT_REPLAY_LAT_PREFIX_CACHE_SET_DISK_BUDGET 31
+#define MT_REPLAY_LAT_PREFIX_CACHE_CLEAR 32
+#define MT_REPLAY_LAT_FORK 33
+#define MT_REPLAY_LAT_FORK_SWITCH 34
+#define MT_REPLAY_LAT_FORK_DISCARD 35
+#define MT_REPLAY_LAT_ROLLBACK 36
+#define MT_REPLAY_LAT_SET_EVICT_THINKING 37
+#define MT_REPLAY_LAT_BARGE_IN 38
+#define MT_REPLAY_LAT_PROMPT_BEGIN 39
+#define MT_REPLAY_LAT_PROMPT_APPEND 40
+#define MT_REPLAY_LAT_PROMPT_REPLACE 41
+#define MT_REPLAY_LAT_PROMPT_COMMIT 42
+#define MT_REPLAY_LAT_PROMPT_SPECULATE 43
+#define MT_REPLAY_LAT_SET_BACKGROUND_THREADS 44
+#define MT_REPLAY_LAT_SET_PRECOMPUTE 45
+#define MT_REPLAY_LAT_SET_STANDBY 46
+//
+#define MT_REPLAY_LAT_COUNT 47
+
+// Names of the calls as recorded (and of the additional latencies):
+static char const * const s_lat_names[MT_REPLAY_LAT_COUNT] = {
+    "reinit",
+    "deinit",
+    "query",
+    "reset",
+    "state_create",
+    "state_restore",
+    "snapshot_clear",
+    "snapshot_update",
+    "snapshot_restore",
+    "ttft",
+    "inter_token",
+    "snapshot_slot_update",
+    "snapshot_slot_restore",
+    "snapshot_slot_remove",
+    "snapshot_set_budget",
+    "snapshot_file_save",
+    "snapshot_file_save_async",
+    "snapshot_file_wait",
+    "snapshot_file_load",
+    "snapshot_set_max_delta_depth",
+    "snapshot_set_codec",
+    "state_write_to",
+    "state_write_stream",
+    "state_read_from",
+    "state_read_stream",
+    "snapshot_update_async",
+    "snapshot_slot_update_async",
+    "snapshot_async_wait",
+    "prefix_cache_set_max_tokens",
+    "prefix_cache_set_budget",
+    "prefix_cache_set_dir",
+    "prefix_cache_set_disk_budget",
+    "prefix_cache_clear",
+    "fork",
+    "fork_switch",
+    "fork_discard",
+    "rollback",
+    "set_evict_thinking",
+    "barge_in",
+    "prompt_begin",
+    "prompt_append",
+    "prompt_replace",
+    "prompt_commit",
+    "prompt_speculate",
+    "set_background_threads",
+    "set_precompute",
+    "set_standby"
+};
+
+/** Growing array of values (in milliseconds).
+ */
+struct vals
+{
+    double * arr;
+    int count;
+    int cap;
+};
+
+/** A state created during replay with the ID it was recorded with.
+ */
+struct replay_state
+{
+    char id[32];
+    struct mt_llm_state * state;
+};
+
+struct replay_args
+{
+    char const * record_path;
+    char const * out_path; // NULL = stdout.
+    char const * model_file_path; // NULL = As recorded.
+    int threads; // -1 = As recorded.
+    int n_gpu_layers; // -1 = As recorded.
+    bool is_paced; // Wait between calls as recorded.
+};
+
+static struct vals s_lat[MT_REPLAY_LAT_COUNT]; // Measured.
+static struct vals s_rec_lat[MT_REPLAY_LAT_COUNT]; // As recorded.
+
+static struct replay_state * s_states = NULL;
+static int s_state_count = 0;
+
+// Used by callback() during a query:
+static double s_t_query = 0.0;
+static double s_t_last_tok = -1.0;
+static int s_sampled_cnt = 0;
+static int s_irq_at = 0; // 0 = No interrupt.
+static uint64_t s_async_handle = 0; // Of the last async. snapshot update.
+
+static double get_ms(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, cnt;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return 1000.0 * (double)cnt.QuadPart / (double)freq.QuadPart;
+#else //_WIN32
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return 1000.0 * (double)t.tv_sec + (double)t.tv_nsec / 1000000.0;
+#endif //_WIN32
+}
+
+static void sleep_ms(double const ms)
+{
+    if(ms <= 0.0)
+    {
+        return;
+    }
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else //_WIN32
+    {
+        struct timespec t;
+
+        t.tv_sec = (time_t)(ms / 1000.0);
+        t.tv_nsec = (long)((ms - 1000.0 * (double)t.tv_sec) * 1000000.0);
+        nanosleep(&t, NULL);
+    }
+#endif //_WIN32
+}
+
+static void add_val(struct vals * const v, double const val)
+{
+    if(v->count == v->cap)
+    {
+        int const cap = v->cap == 0 ? 64 : 2 * v->cap;
+        double * const arr = realloc(v->arr, (size_t)cap * sizeof *arr);
+
+        if(arr == NULL)
+        {
+            return; // (value gets lost)
+        }
+        v->arr = arr;
+        v->cap = cap;
+    }
+    v->arr[v->count++] = val;
+}
+
+static int cmp_double(void const * a, void const * b)
+{
+    double const x = *(double const *)a, y = *(double const *)b;
+
+    return x < y ? -1 : (y < x ? 1 : 0);
+}
+
+/**
+ * - Expects given values to be sorted.
+ */
+static double get_percentile(struct vals const * const v, double const p)
+{
+    int i = 0;
+
+    if(v->count == 0)
+    {
+        return 0.0;
+    }
+    i = (int)ceil(p * (double)v->count) - 1; // (nearest rank)
+    return v->arr[i < 0 ? 0 : i];
+}
+
+static bool callback(
+    int tok, char const * piece, int type, float const * dig_probs)
+{
+    double t = 0.0;
+
+    (void)tok;
+    (void)piece;
+    (void)dig_probs;
+
+    if(type != MT_TOK_TYPE_SAMPLED_NON_EOG_NON_CONTROL
+        && type != MT_TOK_TYPE_SAMPLED_EOG
+        && type != MT_TOK_TYPE_SAMPLED_CONTROL_NON_EOG
+        && type != MT_TOK_TYPE_SAMPLED_THINK)
+    {
+        return false;
+    }
+
+    t = get_ms();
+    if(s_t_last_tok < 0.0)
+    {
+        add_val(&s_lat[MT_REPLAY_LAT_TTFT], t - s_t_query);
+    }
+    else
+    {
+        add_val(&s_lat[MT_REPLAY_LAT_INTER_TOKEN], t - s_t_last_tok);
+    }
+    s_t_last_tok = t;
+
+    ++s_sampled_cnt;
+    return s_sampled_cnt == s_irq_at; // Interrupt, as recorded.
+}
+
+/** Read a line of any length.
+ *
+ * - Returns NULL at end of file.
+ * - Caller takes ownership of return value.
+ */
+static char * read_line(FILE * const f)
+{
+    size_t cap = 256, len = 0;
+    char * buf = malloc(cap);
+    int c = EOF;
+
+    if(buf == NULL)
+    {
+        return NULL;
+    }
+    while((c = fgetc(f)) != EOF && c != '\n')
+    {
+        if(len + 1 == cap)
+        {
+            char * const new_buf = realloc(buf, 2 * cap);
+
+            if(new_buf == NULL)
+            {
+                free(buf);
+                return NULL;
+            }
+            buf = new_buf;
+            cap *= 2;
+        }
+        buf[len++] = (char)c;
+    }
+    if(c == EOF && len == 0)
+    {
+        free(buf);
+        return NULL;
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+/** Unescape given string in-place (see mt_llm_record.h).
+ */
+static void unescape(char * const str)
+{
+    char * w = str;
+
+    for(char const * r = str; *r != '\0'; ++r)
+    {
+        if(*r != '\\' || r[1] == '\0')
+        {
+            *w++ = *r;
+            continue;
+        }
+        ++r;
+        switch(*r)
+        {
+            case 's': *w++ = ' '; break;
+            case 'n': *w++ = '\n'; break;
+            case 'r': *w++ = '\r'; break;
+            case 't': *w++ = '\t'; break;
+
+            default: // (e.g. '\\')
+                *w++ = *r;
+                break;
+        }
+    }
+    *w = '\0';
+}
+
+/**
+ * - Returns count of arguments (split at spaces).
+ */
+static int split(char * const line, char ** const out_args, int const max)
+{
+    int ret_val = 0;
+    char * c = line;
+
+    while(*c != '\0' && ret_val < max)
+    {
+        out_args[ret_val++] = c;
+        while(*c != '\0' && *c != ' ')
+        {
+            ++c;
+        }
+        if(*c == ' ')
+        {
+            *c++ = '\0';
+        }
+    }
+    return ret_val;
+}
+
+static void copy_str(char * const dest, char const * const src, int const len)
+{
+    strncpy(dest, src, (size_t)len - 1);
+    dest[len - 1] = '\0';
+}
+
+/** Fill given parameters from the recorded arguments of mt_llm_reinit().
+ */
+static void fill_p(
+    char ** const args,
+    int const arg_count,
+    struct replay_args const * const a,
+    struct mt_llm_p * const p)
+{
+    memset(p, 0, sizeof *p);
+
+    for(int i = 0; i < arg_count; ++i)
+    {
+        char * const key = args[i];
+        char * const val = strchr(key, '=');
+
+        if(val == NULL)
+        {
+            continue;
+        }
+        *val = '\0';
+        unescape(val + 1);
+
+        char const * const v = val + 1;
+
+        if(strcmp(key, "n_gpu_layers") == 0)
+            p->n_gpu_layers = atoi(v);
+        else if(strcmp(key, "seed") == 0)
+            p->seed = (uint32_t)strtoul(v, NULL, 10);
+        else if(strcmp(key, "n_ctx") == 0)
+            p->n_ctx = (uint32_t)strtoul(v, NULL, 10);
+        else if(strcmp(key, "threads") == 0)
+            p->threads = (uint32_t)strtoul(v, NULL, 10);
+        else if(strcmp(key, "top_k") == 0)
+            p->top_k = atoi(v);
+        else if(strcmp(key, "top_p") == 0)
+            p->top_p = (float)atof(v);
+        else if(strcmp(key, "min_p") == 0)
+            p->min_p = (float)atof(v);
+        else if(strcmp(key, "temp") == 0)
+            p->temp = (float)atof(v);
+        else if(strcmp(key, "grammar") == 0)
+            copy_str(p->grammar, v, MT_LLM_P_LEN_GRAMMAR);
+        else if(strcmp(key, "model_file_path") == 0)
+            copy_str(p->model_file_path, v, MT_LLM_P_LEN_MODEL_FILE_PATH);
+        else if(strcmp(key, "sys_prompt") == 0)
+            copy_str(p->sys_prompt, v, MT_LLM_P_LEN_SYS_PROMPT);
+        else if(strcmp(key, "prompt_beg_delim") == 0)
+            copy_str(p->prompt_beg_delim, v, MT_LLM_P_LEN_PROMPT_BEG_DELIM);
+        else if(strcmp(key, "prompt_end_delim") == 0)
+            copy_str(p->prompt_end_delim, v, MT_LLM_P_LEN_PROMPT_END_DELIM);
+        else if(strcmp(key, "sys_prompt_beg_delim") == 0)
+            copy_str(
+                p->sys_prompt_beg_delim, v, MT_LLM_P_LEN_SYS_PROMPT_BEG_DELIM);
+        else if(strcmp(key, "sys_prompt_mid_delim") == 0)
+            copy_str(
+                p->sys_prompt_mid_delim, v, MT_LLM_P_LEN_SYS_PROMPT_MID_DELIM);
+        else if(strcmp(key, "sys_prompt_end_delim") == 0)
+            copy_str(
+                p->sys_prompt_end_delim, v, MT_LLM_P_LEN_SYS_PROMPT_END_DELIM);
+        else if(strcmp(key, "rev_prompt") == 0)
+            copy_str(p->rev_prompt, v, MT_LLM_P_LEN_REV_PROMPT);
+        else if(strcmp(key, "think_beg_delim") == 0)
+            copy_str(p->think_beg_delim, v, MT_LLM_P_LEN_THINK_BEG_DELIM);
+        else if(strcmp(key, "think_end_delim") == 0)
+            copy_str(p->think_end_delim, v, MT_LLM_P_LEN_THINK_END_DELIM);
+        else if(strcmp(key, "try_prompts_by_model") == 0)
+            p->try_prompts_by_model = (uint8_t)atoi(v);
+    }
+
+    if(a->model_file_path != NULL)
+    {
+        copy_str(
+            p->model_file_path,
+            a->model_file_path,
+            MT_LLM_P_LEN_MODEL_FILE_PATH);
+    }
+    if(0 <= a->threads)
+    {
+        p->threads = (uint32_t)a->threads;
+    }
+    if(0 <= a->n_gpu_layers)
+    {
+        p->n_gpu_layers = a->n_gpu_layers;
+    }
+    p->callback = callback;
+}
+
+/**
+ * - Returns NULL, if not found.
+ */
+static struct replay_state * get_state(char const * const id)
+{
+    for(int i = 0; i < s_state_count; ++i)
+    {
+        if(strcmp(s_states[i].id, id) == 0)
+        {
+            return s_states + i;
+        }
+    }
+    return NULL;
+}
+
+static void free_state(struct mt_llm_state * const state)
+{
+    if(state != NULL)
+    {
+        free(state->state);
+        free(state);
+    }
+}
+
+/** Store given state with given ID (replacing a former one with same ID).
+ */
+static void set_state(char const * const id, struct mt_llm_state * const state)
+{
+    struct replay_state * entry = get_state(id);
+
+    if(entry == NULL)
+    {
+        struct replay_state * const arr = realloc(
+            s_states, (size_t)(s_state_count + 1) * sizeof *arr);
+
+        if(arr == NULL)
+        {
+            free_state(state);
+            return;
+        }
+        s_states = arr;
+        entry = s_states + s_state_count++;
+        copy_str(entry->id, id, (int)sizeof entry->id);
+        entry->state = NULL;
+    }
+    free_state(entry->state);
+    entry->state = state;
+}
+
+/** Stream function for mt_llm_state_write_stream(), which appends to the
+ *  buffer of the state object given as user pointer.
+ */
+static bool write_stream(
+    void * const user, uint8_t const * const data, size_t const size)
+{
+    struct mt_llm_state * const state = user;
+    uint8_t * const buf = realloc(state->state, state->size + size);
+
+    if(buf == NULL)
+    {
+        return false;
+    }
+    memcpy(buf + state->size, data, size);
+    state->state = buf;
+    state->size += size;
+    return true;
+}
+
+/** Stream function for mt_llm_state_read_stream(), which reads from the
+ *  buffer of the state object given as user pointer (and uses its token count
+ *  as read position).
+ */
+static bool read_stream(
+    void * const user, uint8_t * const dest, size_t const size)
+{
+    struct mt_llm_state * const state = user;
+    size_t const pos = (size_t)state->tok_cnt;
+
+    if(state->size - pos < size)
+    {
+        return false;
+    }
+    memcpy(dest, state->state + pos, size);
+    state->tok_cnt = (int)(pos + size);
+    return true;
+}
+
+/** Replay a single recorded call.
+ *
+ * - Returns the index of the latency type or -1, if the call is unknown or
+ *   could not be replayed.
+ */
+static int replay_call(
+    char const * const call,
+    char ** const args,
+    int const arg_count,
+    struct replay_args const * const a)
+{
+    if(strcmp(call, "reinit") == 0)
+    {
+        struct mt_llm_p p;
+
+        fill_p(args, arg_count, a, &p);
+        if(!mt_llm_reinit(&p))
+        {
+            fprintf(stderr, "Reinit. failed!\n");
+        }
+        return MT_REPLAY_LAT_REINIT;
+    }
+    if(strcmp(call, "deinit") == 0)
+    {
+        mt_llm_deinit();
+        return MT_REPLAY_LAT_DEINIT;
+    }
+    if(strcmp(call, "query") == 0)
+    {
+        if(arg_count < 1)
+        {
+            return -1;
+        }
+
+        char * const prompt = arg_count < 2 ? "" : args[1];
+
+        unescape(prompt);
+
+        s_irq_at = atoi(args[0]);
+        s_sampled_cnt = 0;
+        s_t_last_tok = -1.0;
+        s_t_query = get_ms();
+        if(!mt_llm_query(prompt))
+        {
+            fprintf(stderr, "Query failed!\n");
+        }
+        return MT_REPLAY_LAT_QUERY;
+    }
+    if(strcmp(call, "prompt_begin") == 0)
+    {
+        mt_llm_prompt_begin();
+        return MT_REPLAY_LAT_PROMPT_BEGIN;
+    }
+    if(strcmp(call, "prompt_append") == 0
+        || strcmp(call, "prompt_replace") == 0)
+    {
+        char * const text = arg_count < 1 ? "" : args[0];
+
+        unescape(text);
+        if(strcmp(call, "prompt_replace") == 0)
+        {
+            mt_llm_prompt_replace(text);
+            return MT_REPLAY_LAT_PROMPT_REPLACE;
+        }
+        mt_llm_prompt_append(text);
+        return MT_REPLAY_LAT_PROMPT_APPEND;
+    }
+    if(strcmp(call, "prompt_speculate") == 0)
+    {
+        mt_llm_prompt_speculate(arg_count < 1 ? 0 : atoi(args[0]));
+        return MT_REPLAY_LAT_PROMPT_SPECULATE;
+    }
+    if(strcmp(call, "prompt_commit") == 0)
+    {
+        s_irq_at = arg_count < 1 ? 0 : atoi(args[0]);
+        s_sampled_cnt = 0;
+        s_t_last_tok = -1.0;
+        s_t_query = get_ms();
+        if(!mt_llm_prompt_commit())
+        {
+            fprintf(stderr, "Prompt commit failed!\n");
+        }
+        return MT_REPLAY_LAT_PROMPT_COMMIT;
+    }
+    if(strcmp(call, "reset") == 0)
+    {
+        mt_llm_reset();
+        return MT_REPLAY_LAT_RESET;
+    }
+    if(strcmp(call, "set_evict_thinking") == 0)
+    {
+        mt_llm_set_evict_thinking(0 < arg_count && atoi(args[0]) != 0);
+        return MT_REPLAY_LAT_SET_EVICT_THINKING;
+    }
+    if(strcmp(call, "set_precompute") == 0)
+    {
+        mt_llm_set_precompute(0 < arg_count && atoi(args[0]) != 0);
+        return MT_REPLAY_LAT_SET_PRECOMPUTE;
+    }
+    if(strcmp(call, "set_standby") == 0)
+    {
+        mt_llm_set_standby(0 < arg_count && atoi(args[0]) != 0);
+        return MT_REPLAY_LAT_SET_STANDBY;
+    }
+    if(strcmp(call, "set_background_threads") == 0)
+    {
+        mt_llm_set_background_threads(arg_count < 1 ? 1 : atoi(args[0]));
+        return MT_REPLAY_LAT_SET_BACKGROUND_THREADS;
+    }
+    if(strcmp(call, "rollback") == 0)
+    {
+        mt_llm_rollback(arg_count < 1 ? 0 : atoi(args[0]));
+        return MT_REPLAY_LAT_ROLLBACK;
+    }
+    if(strcmp(call, "barge_in") == 0)
+    {
+        mt_llm_barge_in(
+            arg_count < 1 ? 0 : (size_t)strtoull(args[0], NULL, 10));
+        return MT_REPLAY_LAT_BARGE_IN;
+    }
+    if(strcmp(call, "fork") == 0)
+    {
+        // Forks get the lowest free index, so the indices recorded are the
+        // ones of the replay (if no forks existed when recording started):
+        //
+        mt_llm_fork();
+        return MT_REPLAY_LAT_FORK;
+    }
+    if(strcmp(call, "fork_switch") == 0)
+    {
+        mt_llm_fork_switch(arg_count < 1 ? -1 : atoi(args[0]));
+        return MT_REPLAY_LAT_FORK_SWITCH;
+    }
+    if(strcmp(call, "fork_discard") == 0)
+    {
+        mt_llm_fork_discard(arg_count < 1 ? -1 : atoi(args[0]));
+        return MT_REPLAY_LAT_FORK_DISCARD;
+    }
+    if(strcmp(call, "state_create") == 0)
+    {
+        struct mt_llm_state * const state = mt_llm_state_create();
+
+        if(state != NULL && 0 < arg_count)
+        {
+            set_state(args[0], state);
+        }
+        else
+        {
+            free_state(state);
+        }
+        return MT_REPLAY_LAT_STATE_CREATE;
+    }
+    if(strcmp(call, "state_restore") == 0)
+    {
+        struct replay_state const * const entry =
+            arg_count < 1 ? NULL : get_state(args[0]);
+
+        if(entry == NULL || entry->state == NULL)
+        {
+            fprintf(stderr, "State to restore is unknown!\n");
+            return -1;
+        }
+        mt_llm_state_restore(entry->state);
+        return MT_REPLAY_LAT_STATE_RESTORE;
+    }
+    if(strcmp(call, "state_write_to") == 0
+        || strcmp(call, "state_write_stream") == 0)
+    {
+        bool const is_stream = strcmp(call, "state_write_stream") == 0;
+        struct mt_llm_state * const state = malloc(sizeof *state);
+
+        if(state == NULL)
+        {
+            return -1;
+        }
+        state->last_tok_type = 0;
+        state->tok_cnt = 0;
+        state->size = is_stream ? 0 : mt_llm_state_get_size();
+        state->state = is_stream ? NULL : malloc(state->size);
+
+        if(is_stream)
+        {
+            mt_llm_state_write_stream(write_stream, state);
+        }
+        else
+        {
+            state->size = mt_llm_state_write_to(state->state, state->size);
+        }
+        if(0 < arg_count && 0 < state->size)
+        {
+            set_state(args[0], state);
+        }
+        else
+        {
+            free_state(state);
+        }
+        return is_stream
+            ? MT_REPLAY_LAT_STATE_WRITE_STREAM : MT_REPLAY_LAT_STATE_WRITE_TO;
+    }
+    if(strcmp(call, "state_read_from") == 0
+        || strcmp(call, "state_read_stream") == 0)
+    {
+        struct replay_state * const entry =
+            arg_count < 1 ? NULL : get_state(args[0]);
+
+        if(entry == NULL || entry->state == NULL)
+        {
+            fprintf(stderr, "State to read is unknown!\n");
+            return -1;
+        }
+        if(strcmp(call, "state_read_stream") == 0)
+        {
+            entry->state->tok_cnt = 0; // Read position.
+            mt_llm_state_read_stream(read_stream, entry->state);
+            return MT_REPLAY_LAT_STATE_READ_STREAM;
+        }
+        mt_llm_state_read_from(entry->state->state, entry->state->size);
+        return MT_REPLAY_LAT_STATE_READ_FROM;
+    }
+    if(strcmp(call, "snapshot_clear") == 0)
+    {
+        mt_llm_snapshot_clear();
+        return MT_REPLAY_LAT_SNAPSHOT_CLEAR;
+    }
+    if(strcmp(call, "snapshot_update") == 0)
+    {
+        mt_llm_snapshot_update();
+        return MT_REPLAY_LAT_SNAPSHOT_UPDATE;
+    }
+    if(strcmp(call, "snapshot_restore") == 0)
+    {
+        mt_llm_snapshot_restore();
+        return MT_REPLAY_LAT_SNAPSHOT_RESTORE;
+    }
+    if(strcmp(call, "snapshot_slot_update") == 0)
+    {
+        if(0 < arg_count)
+        {
+            unescape(args[0]);
+        }
+        mt_llm_snapshot_slot_update(arg_count < 1 ? "" : args[0]);
+        return MT_REPLAY_LAT_SNAPSHOT_SLOT_UPDATE;
+    }
+    if(strcmp(call, "snapshot_slot_restore") == 0)
+    {
+        if(0 < arg_count)
+        {
+            unescape(args[0]);
+        }
+        mt_llm_snapshot_slot_restore(arg_count < 1 ? "" : args[0]);
+        return MT_REPLAY_LAT_SNAPSHOT_SLOT_RESTORE;
+    }
+    if(strcmp(call, "snapshot_slot_remove") == 0)
+    {
+        if(0 < arg_count)
+        {
+            unescape(args[0]);
+        }
+        mt_llm_snapshot_slot_remove(arg_count < 1 ? "" : args[0]);
+        return MT_REPLAY_LAT_SNAPSHOT_SLOT_REMOVE;
+    }
+    if(strcmp(call, "snapshot_set_budget") == 0)
+    {
+        mt_llm_snapshot_set_budget(
+            arg_count < 1 ? 0 : (uint64_t)strtoull(args[0], NULL, 10));
+        return MT_REPLAY_LAT_SNAPSHOT_SET_BUDGET;
+    }
+    if(strcmp(call, "snapshot_set_max_delta_depth") == 0)
+    {
+        mt_llm_snapshot_set_max_delta_depth(arg_count < 1 ? 0 : atoi(args[0]));
+        return MT_REPLAY_LAT_SNAPSHOT_SET_MAX_DELTA_DEPTH;
+    }
+    if(strcmp(call, "snapshot_set_codec") == 0)
+    {
+        mt_llm_snapshot_set_codec(arg_count < 1 ? 0 : atoi(args[0]));
+        return MT_REPLAY_LAT_SNAPSHOT_SET_CODEC;
+    }
+    if(strcmp(call, "snapshot_update_async") == 0)
+    {
+        s_async_handle = mt_llm_snapshot_update_async();
+        return MT_REPLAY_LAT_SNAPSHOT_UPDATE_ASYNC;
+    }
+    if(strcmp(call, "snapshot_slot_update_async") == 0)
+    {
+        if(0 < arg_count)
+        {
+            unescape(args[0]);
+        }
+        s_async_handle = mt_llm_snapshot_slot_update_async(
+            arg_count < 1 ? "" : args[0]);
+        return MT_REPLAY_LAT_SNAPSHOT_SLOT_UPDATE_ASYNC;
+    }
+    if(strcmp(call, "snapshot_async_wait") == 0)
+    {
+        // The handles recorded are not the ones of the replay (recording may
+        // have started later), so just wait for the last update:
+        //
+        mt_llm_snapshot_async_wait(s_async_handle);
+        return MT_REPLAY_LAT_SNAPSHOT_ASYNC_WAIT;
+    }
+    if(strcmp(call, "snapshot_file_wait") == 0)
+    {
+        mt_llm_snapshot_file_wait();
+        return MT_REPLAY_LAT_SNAPSHOT_FILE_WAIT;
+    }
+    if(strncmp(call, "snapshot_file_", 14) == 0)
+    {
+        if(arg_count < 1)
+        {
+            return -1;
+        }
+        unescape(args[0]);
+        if(strcmp(call, "snapshot_file_save") == 0)
+        {
+            mt_llm_snapshot_file_save(args[0]);
+            return MT_REPLAY_LAT_SNAPSHOT_FILE_SAVE;
+        }
+        if(strcmp(call, "snapshot_file_save_async") == 0)
+        {
+            mt_llm_snapshot_file_save_async(args[0]);
+            return MT_REPLAY_LAT_SNAPSHOT_FILE_SAVE_ASYNC;
+        }
+        if(strcmp(call, "snapshot_file_load") == 0)
+        {
+            mt_llm_snapshot_file_load(args[0]);
+            return MT_REPLAY_LAT_SNAPSHOT_FILE_LOAD;
+        }
+    }
+    if(strcmp(call, "prefix_cache_set_max_tokens") == 0)
+    {
+        mt_llm_prefix_cache_set_max_tokens(arg_count < 1 ? 0 : atoi(args[0]));
+        return MT_REPLAY_LAT_PREFIX_CACHE_SET_MAX_TOKENS;
+    }
+    if(strcmp(call, "prefix_cache_set_budget") == 0)
+    {
+        mt_llm_prefix_cache_set_budget(
+            arg_count < 1 ? 0 : (uint64_t)strtoull(args[0], NULL, 10));
+        return MT_REPLAY_LAT_PREFIX_CACHE_SET_BUDGET;
+    }
+    if(strcmp(call, "prefix_cache_set_dir") == 0)
+    {
+        if(0 < arg_count)
+        {
+            unescape(args[0]);
+        }
+        mt_llm_prefix_cache_set_dir(arg_count < 1 ? NULL : args[0]);
+        return MT_REPLAY_LAT_PREFIX_CACHE_SET_DIR;
+    }
+    if(strcmp(call, "prefix_cache_set_disk_budget") == 0)
+    {
+        mt_llm_prefix_cache_set_disk_budget(
+            arg_count < 1 ? 0 : (uint64_t)strtoull(args[0], NULL, 10));
+        return MT_REPLAY_LAT_PREFIX_CACHE_SET_DISK_BUDGET;
+    }
+    if(strcmp(call, "prefix_cache_clear") == 0)
+    {
+        mt_llm_prefix_cache_clear();
+        return MT_REPLAY_LAT_PREFIX_CACHE_CLEAR;
+    }
+    fprintf(stderr, "Unknown call \"%s\"!\n", call);
+    return -1;
+}
+
+/**
+ * - Returns count of calls replayed or -1 on error.
+ */
+static int replay(FILE * const f, struct replay_args const * const a)
+{
+    int ret_val = 0;
+    char * line = read_line(f);
+    double const t_replay_start = get_ms();
+
+    if(line == NULL
+        || strncmp(line, "mt_llm_record ", 14) != 0
+        || atoi(line + 14) != MT_LLM_RECORD_VERSION)
+    {
+        fprintf(stderr, "Not a (supported) record file!\n");
+        free(line);
+        return -1;
+    }
+    free(line);
+
+    while((line = read_line(f)) != NULL)
+    {
+        char * args[MT_REPLAY_MAX_ARGS];
+        int const arg_count = split(line, args, MT_REPLAY_MAX_ARGS);
+
+        if(arg_count < 4)
+        {
+            free(line);
+            continue; // (e.g. an empty line)
+        }
+
+        double const rec_t_start = (double)atoll(args[0]) / 1000.0,
+            rec_dur = (double)atoll(args[1]) / 1000.0;
+
+        if(a->is_paced)
+        {
+            sleep_ms(rec_t_start - (get_ms() - t_replay_start));
+        }
+
+        double const t = get_ms();
+        int const lat_type = replay_call(
+            args[3], args + 4, arg_count - 4, a);
+        double const dur = get_ms() - t;
+
+        if(0 <= lat_type)
+        {
+            add_val(&s_lat[lat_type], dur);
+            add_val(&s_rec_lat[lat_type], rec_dur);
+            ++ret_val;
+        }
+        free(line);
+    }
+    return ret_val;
+}
+
+static void write_json(
+    FILE * const out,
+    struct replay_args const * const a,
+    int const call_count,
+    double const wall_ms)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"calls\": %d,\n", call_count);
+    fprintf(out, "  \"wall_ms\": %.3f,\n", wall_ms);
+    fprintf(out, "  \"paced\": %s,\n", a->is_paced ? "true" : "false");
+    fprintf(out, "  \"latency_ms\": {\n");
+    for(int i = 0; i < MT_REPLAY_LAT_COUNT; ++i)
+    {
+        struct vals * const v = s_lat + i;
+        struct vals * const r = s_rec_lat + i;
+
+        qsort(v->arr, (size_t)v->count, sizeof *v->arr, cmp_double);
+        qsort(r->arr, (size_t)r->count, sizeof *r->arr, cmp_double);
+
+        fprintf(
+            out,
+            "    \"%s\": { \"count\": %d, \"p50\": %.3f, \"p95\": %.3f,"
+                " \"p99\": %.3f, \"max\": %.3f",
+            s_lat_names[i],
+            v->count,
+            get_percentile(v, 0.50),
+            get_percentile(v, 0.95),
+            get_percentile(v, 0.99),
+            get_percentile(v, 1.0));
+        if(0 < r->count)
+        {
+            fprintf(
+                out,
+                ", \"recorded_p50\": %.3f, \"recorded_p95\": %.3f",
+                get_percentile(r, 0.50),
+                get_percentile(r, 0.95));
+        }
+        fprintf(out, " }%s\n", i + 1 < MT_REPLAY_LAT_COUNT ? "," : "");
+    }
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+}
+
+static void print_usage(char const * const name)
+{
+    fprintf(
+        stderr,
+        "Usage: %s -r <record.txt> [options]\n"
+            "\n"
+            "  -o <path>   Write JSON to file (default: stdout).\n"
+            "  -m <path>   Model file to use (default: as recorded).\n"
+            "  -t <count>  Threads to use (default: as recorded).\n"
+            "  -g <count>  Layers to offload to GPU (default: as recorded).\n"
+            "  -p          Wait between calls as recorded.\n",
+        name);
+}
+
+int main(int argc, char * argv[])
+{
+    struct replay_args a;
+    FILE * f = NULL;
+    FILE * out = stdout;
+    int call_count = 0;
+    double t = 0.0;
+
+    a.record_path = NULL;
+    a.out_path = NULL;
+    a.model_file_path = NULL;
+    a.threads = -1;
+    a.n_gpu_layers = -1;
+    a.is_paced = false;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "-p") == 0)
+        {
+            a.is_paced = true;
+            continue;
+        }
+        if(i + 1 == argc)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if(strcmp(argv[i], "-r") == 0)
+            a.record_path = argv[++i];
+        else if(strcmp(argv[i], "-o") == 0)
+            a.out_path = argv[++i];
+        else if(strcmp(argv[i], "-m") == 0)
+            a.model_file_path = argv[++i];
+        else if(strcmp(argv[i], "-t") == 0)
+            a.threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-g") == 0)
+            a.n_gpu_layers = atoi(argv[++i]);
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if(a.record_path == NULL)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    f = fopen(a.record_path, "r");
+    if(f == NULL)
+    {
+        fprintf(stderr, "Failed to open \"%s\"!\n", a.record_path);
+        return 1;
+    }
+
+    mt_llm_log_set_level(MT_LOG_LEVEL_ERR); // (keeps stdout clean for JSON)
+
+    t = get_ms();
+    call_count = replay(f, &a);
+    t = get_ms() - t;
+    fclose(f);
+
+    mt_llm_deinit(); // (in case the record does not end with it)
+    for(int i = 0; i < s_state_count; ++i)
+    {
+        free_state(s_states[i].state);
+    }
+    free(s_states);
+
+    if(call_count < 0)
+    {
+        return 1;
+    }
+
+    if(a.out_path != NULL)
+    {
+        out = fopen(a.out_path, "w");
+        if(out == NULL)
+        {
+            fprintf(stderr, "Failed to open \"%s\"!\n", a.out_path);
+            return 1;
+        }
+    }
+    write_json(out, &a, call_count, t);
+    if(out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}